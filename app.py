@@ -5,10 +5,13 @@ Streamlit GUI wrapper around the cbir CLI.
 Lets users select database folders and query images.
 Runs retrieval and renders results with previews.
 Supports classic features and DNN embedding mode.
+Reuses a running `cbir serve --socket` process when CBIR_SOCKET is set.
 """
 from __future__ import annotations
 
+import os
 import shlex
+import socket
 import subprocess
 import tempfile
 from pathlib import Path
@@ -23,6 +26,8 @@ IMAGE_EXTENSIONS = {".jpg", ".jpeg", ".png", ".bmp"}
 FOLDER_PLACEHOLDER = "Select a folder..."
 QUERY_PLACEHOLDER = "Click an image below or type a path..."
 GALLERY_MAX_HEIGHT_PX = 420
+# Unix socket of a `./cbir serve --socket` process started from the project root.
+CBIR_SOCKET = os.environ.get("CBIR_SOCKET", "")
 
 
 # Resolve user-entered paths relative to the project root.
@@ -68,6 +73,10 @@ def parse_cbir_output(stdout_text: str) -> list[dict[str, float | str]]:
         stripped = line.strip()
         if not stripped:
             continue
+        # "# progress"/"# final" headers start a new block; keep only the latest.
+        if stripped.startswith("#"):
+            rows = []
+            continue
 
         parts = stripped.rsplit(maxsplit=1)
         if len(parts) != 2:
@@ -82,6 +91,71 @@ def parse_cbir_output(stdout_text: str) -> list[dict[str, float | str]]:
     return rows
 
 
+# Check whether CLI output ends with a budget-cut "# final ... partial" block.
+def is_partial_output(stdout_text: str) -> bool:
+    """Return True if the last "# final" header marks a partial answer."""
+    final_lines = [line for line in stdout_text.splitlines() if line.startswith("# final")]
+    return bool(final_lines) and final_lines[-1].rstrip().endswith("partial")
+
+
+# Send one query to the cbir server and return (returncode, stdout, stderr, partial).
+def query_cbir_server(socket_path: str, args: list[str]) -> tuple[int, str, str, bool]:
+    """Send one query line to a cbir server and return CLI-style output.
+
+    The partial flag is set when the server answered "OK <n> partial".
+    """
+    with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as conn:
+        conn.connect(socket_path)
+        stream = conn.makefile("rw", encoding="utf-8")
+        stream.write(shlex.join(args) + "\n")
+        stream.flush()
+        header = stream.readline().strip()
+        if not header.startswith("OK "):
+            return 1, "", header.removeprefix("ERROR ") or "(no response from server)", False
+        fields = header.split()
+        lines = [stream.readline() for _ in range(int(fields[1]))]
+    return 0, "".join(lines), "", fields[-1] == "partial"
+
+
+# Run a query through the warm server when configured, else a fresh process.
+def run_cbir(cmd: list[str], on_snapshot=None) -> tuple[int, str, str, bool]:
+    """Run a cbir query and return (returncode, stdout, stderr, partial).
+
+    partial is True when a time budget cut the scan short. With on_snapshot, each "# progress" block is passed to it as it arrives.
+    """
+    if CBIR_SOCKET and Path(CBIR_SOCKET).exists():
+        try:
+            return query_cbir_server(CBIR_SOCKET, cmd[1:])
+        except OSError:
+            pass
+    if on_snapshot is None:
+        completed = subprocess.run(
+            cmd, cwd=PROJECT_ROOT, capture_output=True, text=True, check=False
+        )
+        return (
+            completed.returncode,
+            completed.stdout,
+            completed.stderr,
+            is_partial_output(completed.stdout),
+        )
+
+    with subprocess.Popen(
+        cmd, cwd=PROJECT_ROOT, stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True
+    ) as process:
+        lines = []
+        block = []
+        for line in process.stdout:
+            lines.append(line)
+            if line.startswith("#"):
+                if block and block[0].startswith("# progress"):
+                    on_snapshot(block[0][2:].strip(), parse_cbir_output("".join(block)))
+                block = []
+            block.append(line)
+        stderr_text = process.stderr.read()
+    stdout_text = "".join(lines)
+    return process.returncode, stdout_text, stderr_text, is_partial_output(stdout_text)
+
+
 @st.cache_data(show_spinner=False)
 # Find folders under data/ or olympus/ that contain images.
 def list_database_dirs() -> list[Path]:
@@ -183,6 +257,9 @@ with left_col:
     distance_metric = st.selectbox("Distance metric", distance_options)
     top_n = st.number_input("Top N results", min_value=1, max_value=50, value=5, step=1)
     show_least = st.checkbox("Show least-similar matches (--least)", value=False)
+    time_budget_ms = st.number_input(
+        "Time budget in ms (0 = scan everything)", min_value=0, value=0, step=100
+    )
 
     embeddings_csv_text = st.text_input(
         "Embeddings CSV (used for dnn)", value="features/embeddings.csv"
@@ -293,28 +370,45 @@ if submitted:
         cmd.append(embeddings_csv_text)
     if show_least:
         cmd.append("--least")
+    if time_budget_ms > 0:
+        # Snapshots every quarter of the budget keep the table moving.
+        cmd += ["--time-budget-ms", str(int(time_budget_ms)),
+                "--progress-ms", str(max(int(time_budget_ms) // 4, 1))]
 
     st.code(shlex.join(cmd), language="bash")
 
+    snapshot_placeholder = st.empty()
+
+    def show_snapshot(header: str, rows: list[dict[str, float | str]]) -> None:
+        with snapshot_placeholder.container():
+            st.caption(f"Scanning... {header}")
+            st.dataframe(rows, use_container_width=True, hide_index=True)
+
     try:
         # Run cbir and capture output for rendering in the GUI.
-        completed = subprocess.run(
-            cmd, cwd=PROJECT_ROOT, capture_output=True, text=True, check=False
+        returncode, stdout_text, stderr_text, partial = run_cbir(
+            cmd, show_snapshot if time_budget_ms > 0 else None
         )
+        snapshot_placeholder.empty()
 
-        if completed.returncode != 0:
+        if returncode != 0:
             st.error("CBIR execution failed.")
-            stderr_text = completed.stderr.strip() or "(no stderr output)"
+            stderr_text = stderr_text.strip() or "(no stderr output)"
             st.code(stderr_text, language="text")
             st.stop()
 
-        results = parse_cbir_output(completed.stdout)
+        results = parse_cbir_output(stdout_text)
         if not results:
             st.warning("No results returned.")
-            raw_output = completed.stdout.strip() or "(empty output)"
+            raw_output = stdout_text.strip() or "(empty output)"
             st.code(raw_output, language="text")
             st.stop()
 
+        if partial:
+            # The CLI reports how far the scan got; the server only flags the cut.
+            final_lines = [line for line in stdout_text.splitlines() if line.startswith("# final")]
+            scanned = f" ({final_lines[-1][8:].split()[0]} scanned)" if final_lines else ""
+            st.warning(f"Time budget reached; best results so far{scanned}.")
         st.success(f"Retrieved {len(results)} results.")
         st.dataframe(results, use_container_width=True, hide_index=True)
 
@@ -0,0 +1,138 @@
+/*
+Authors - Joseph Defendre, Sourav Das
+
+Benchmark for the feature/embedding CSV reader.
+Compares the original getline/stringstream/stof parser with the memory-mapped,
+chunked from_chars reader at one thread and at every hardware thread.
+Reports MB/s and rows/s on a synthetic embeddings CSV, or on a given CSV.
+Exits non-zero if the readers disagree on any filename or value.
+*/
+#include "../include/image_io.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+constexpr int kRepetitions = 3;
+constexpr size_t kSyntheticRows = 20000;
+constexpr size_t kSyntheticDimension = 512;
+
+using FeatureRows = std::vector<std::pair<std::string, std::vector<float>>>;
+
+/**
+ * Reference reader: the line-by-line parser the mapped reader replaced.
+ *
+ * @param path CSV path.
+ * @return Filename/value pairs in file order.
+ */
+FeatureRows referenceReadCsv(const std::string &path) {
+    std::ifstream input(path);
+    FeatureRows rows;
+    std::string line;
+    while (std::getline(input, line)) {
+        if (line.empty()) {
+            continue;
+        }
+        std::stringstream lineStream(line);
+        std::string filename;
+        std::getline(lineStream, filename, ',');
+        std::vector<float> values;
+        std::string cell;
+        while (std::getline(lineStream, cell, ',')) {
+            values.push_back(cell.empty() ? 0.0f : std::stof(cell));
+        }
+        rows.emplace_back(std::move(filename), std::move(values));
+    }
+    return rows;
+}
+
+/**
+ * Write an embeddings-like CSV of random values.
+ *
+ * @param path Destination path.
+ */
+void writeSyntheticCsv(const std::string &path) {
+    std::mt19937 rng(11);
+    std::normal_distribution<float> value(0.0f, 1.0f);
+    FeatureRows rows(kSyntheticRows);
+    for (size_t row = 0; row < rows.size(); ++row) {
+        rows[row].first = "pic." + std::to_string(row) + ".jpg";
+        rows[row].second.resize(kSyntheticDimension);
+        for (auto &entry : rows[row].second) {
+            entry = value(rng);
+        }
+    }
+    writeFeaturesCsv(path, rows);
+}
+
+/**
+ * Best-of-N wall time of a reader.
+ *
+ * @param read Reader under test.
+ * @return Seconds of the fastest run.
+ */
+double bestSeconds(const std::function<size_t()> &read) {
+    double best = 0.0;
+    for (int rep = 0; rep < kRepetitions; ++rep) {
+        auto start = std::chrono::steady_clock::now();
+        volatile size_t sink = read();
+        (void)sink;
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = rep == 0 ? seconds : std::min(best, seconds);
+    }
+    return best;
+}
+} // namespace
+
+/**
+ * Time the reference and mapped CSV readers and check they agree.
+ *
+ * @param argc Argument count.
+ * @param argv Optional CSV path (a synthetic CSV is written otherwise).
+ * @return 0 if both readers return the same rows, 1 otherwise.
+ */
+int main(int argc, char *argv[]) {
+    std::string path;
+    bool synthetic = argc < 2;
+    if (synthetic) {
+        path = (std::filesystem::temp_directory_path() / "cbir_bench_csv.csv").string();
+        writeSyntheticCsv(path);
+    } else {
+        path = argv[1];
+    }
+    double megabytes = static_cast<double>(std::filesystem::file_size(path)) / 1e6;
+    int threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+
+    FeatureRows reference = referenceReadCsv(path);
+    bool match = readFeaturesCsv(path, threads) == reference;
+    size_t rows = reference.size();
+
+    std::printf("%-18s %8s %10s %12s %8s\n", "reader", "threads", "MB/s", "rows/s", "speedup");
+    double before = bestSeconds([&]() { return referenceReadCsv(path).size(); });
+    std::printf("%-18s %8d %10.1f %12.0f %7.2fx\n", "getline_stof", 1, megabytes / before, rows / before, 1.0);
+    std::vector<int> threadCounts = {1};
+    if (threads > 1) {
+        threadCounts.push_back(threads);
+    }
+    for (int threadCount : threadCounts) {
+        double after = bestSeconds([&]() { return readFeatureMatrixCsv(path, threadCount).filenames.size(); });
+        std::printf("%-18s %8d %10.1f %12.0f %7.2fx\n", "mapped_from_chars", threadCount, megabytes / after,
+                    rows / after, before / after);
+    }
+    std::printf("rows: %zu, values %s\n", rows, match ? "match" : "MISMATCH");
+
+    if (synthetic) {
+        std::filesystem::remove(path);
+    }
+    return match ? 0 : 1;
+}
@@ -0,0 +1,293 @@
+/*
+Authors - Joseph Defendre, Sourav Das
+
+Benchmark for the SIMD distance kernels.
+Checks every available SIMD level against a scalar reference.
+Times one-query-vs-many-rows scans and reports GB/s per metric.
+Times the four-query dot kernel used by batch queries.
+Includes the fused weighted multi-region intersection used by custom_sunset.
+Exits non-zero if any kernel disagrees beyond tolerance.
+*/
+#include "../include/distance_kernels.h"
+#include "../include/distance_metrics.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace {
+// Relative tolerance for reordered float accumulation.
+constexpr double kTolerance = 1e-4;
+// Bytes of candidate rows streamed per timed scan (larger than LLC).
+constexpr size_t kScanBytes = size_t(64) << 20;
+constexpr int kRepetitions = 5;
+
+/**
+ * Reference kernels: the original single-accumulator loops, in double.
+ */
+double referenceSsd(const float *a, const float *b, size_t n) {
+    double sum = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        double diff = static_cast<double>(a[i]) - b[i];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+double referenceIntersection(const float *a, const float *b, size_t n) {
+    double sum = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        sum += std::min(a[i], b[i]);
+    }
+    return sum;
+}
+
+double referenceDot(const float *a, const float *b, size_t n) {
+    double sum = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        sum += static_cast<double>(a[i]) * b[i];
+    }
+    return sum;
+}
+
+/**
+ * Largest relative error of a kernel against its reference over many rows.
+ *
+ * @param kernel Kernel under test.
+ * @param reference Double-precision reference.
+ * @param query Query vector.
+ * @param rows Row-major candidate matrix.
+ * @param rowCount Number of rows.
+ * @param dimension Floats per row.
+ * @return Maximum relative error.
+ */
+double maxRelativeError(
+    float (*kernel)(const float *, const float *, size_t),
+    double (*reference)(const float *, const float *, size_t),
+    const float *query,
+    const float *rows,
+    size_t rowCount,
+    size_t dimension) {
+    double worst = 0.0;
+    for (size_t row = 0; row < rowCount; ++row) {
+        // Every tail length is covered because dimensions are not multiples of 64.
+        size_t length = dimension - (row % 17);
+        double expected = reference(query, rows + row * dimension, length);
+        double actual = kernel(query, rows + row * dimension, length);
+        double scale = std::max(std::abs(expected), 1e-6);
+        worst = std::max(worst, std::abs(actual - expected) / scale);
+    }
+    return worst;
+}
+
+/**
+ * Best-of-N throughput for scanning every row with a kernel.
+ *
+ * @param kernel Kernel under test.
+ * @param query Query vector.
+ * @param rows Row-major candidate matrix.
+ * @param rowCount Number of rows.
+ * @param dimension Floats per row.
+ * @return Candidate bytes processed per second, in GB/s.
+ */
+double scanGigabytesPerSecond(
+    float (*kernel)(const float *, const float *, size_t),
+    const float *query,
+    const float *rows,
+    size_t rowCount,
+    size_t dimension) {
+    std::vector<float> out(rowCount);
+    double best = 0.0;
+    for (int rep = 0; rep < kRepetitions; ++rep) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t row = 0; row < rowCount; ++row) {
+            out[row] = kernel(query, rows + row * dimension, dimension);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double bytes = static_cast<double>(rowCount * dimension * sizeof(float));
+        best = std::max(best, bytes / seconds / 1e9);
+    }
+    // Keep the results observable so the loop is not optimized away.
+    volatile float sink = out[rowCount / 2];
+    (void)sink;
+    return best;
+}
+/**
+ * Largest relative error of a four-query dot kernel against the reference.
+ *
+ * @param kernel dot4 kernel under test.
+ * @param queries Four query vectors of dimension floats.
+ * @param rows Row-major candidate matrix.
+ * @param rowCount Number of rows.
+ * @param dimension Floats per row.
+ * @return Maximum relative error over all four outputs.
+ */
+double dot4RelativeError(
+    void (*kernel)(const float *const *, const float *, size_t, float *),
+    const float *const *queries,
+    const float *rows,
+    size_t rowCount,
+    size_t dimension) {
+    double worst = 0.0;
+    for (size_t row = 0; row < rowCount; ++row) {
+        size_t length = dimension - (row % 17);
+        float actual[4];
+        kernel(queries, rows + row * dimension, length, actual);
+        for (size_t q = 0; q < 4; ++q) {
+            double expected = referenceDot(queries[q], rows + row * dimension, length);
+            double scale = std::max(std::abs(expected), 1e-6);
+            worst = std::max(worst, std::abs(actual[q] - expected) / scale);
+        }
+    }
+    return worst;
+}
+
+/**
+ * Best-of-N throughput of a four-query dot kernel over every row.
+ *
+ * @param kernel dot4 kernel under test.
+ * @param queries Four query vectors.
+ * @param rows Row-major candidate matrix.
+ * @param rowCount Number of rows.
+ * @param dimension Floats per row.
+ * @return Query-row bytes scored per second (4x the rows streamed), in GB/s.
+ */
+double dot4GigabytesPerSecond(
+    void (*kernel)(const float *const *, const float *, size_t, float *),
+    const float *const *queries,
+    const float *rows,
+    size_t rowCount,
+    size_t dimension) {
+    std::vector<float> out(rowCount * 4);
+    double best = 0.0;
+    for (int rep = 0; rep < kRepetitions; ++rep) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t row = 0; row < rowCount; ++row) {
+            kernel(queries, rows + row * dimension, dimension, out.data() + row * 4);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double bytes = static_cast<double>(4 * rowCount * dimension * sizeof(float));
+        best = std::max(best, bytes / seconds / 1e9);
+    }
+    volatile float sink = out[rowCount * 2];
+    (void)sink;
+    return best;
+}
+} // namespace
+
+/**
+ * Run agreement checks and throughput measurements for every SIMD level.
+ *
+ * @return 0 if all kernels agree with the reference, 1 otherwise.
+ */
+int main() {
+    const size_t dimensions[] = {16, 147, 256, 512, 1536};
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    bool allAgree = true;
+
+    std::printf("active level: %s\n", simdLevelName(activeDistanceKernels().level));
+    std::printf("%-13s %-7s %6s %10s %12s\n", "metric", "level", "dim", "GB/s", "max_rel_err");
+    for (size_t dimension : dimensions) {
+        size_t rowCount = kScanBytes / (dimension * sizeof(float));
+        std::vector<float> rows(rowCount * dimension);
+        std::vector<float> query(dimension);
+        for (auto &value : rows) {
+            value = uniform(rng);
+        }
+        for (auto &value : query) {
+            value = uniform(rng);
+        }
+
+        for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::Sse, SimdLevel::Avx2, SimdLevel::Avx512}) {
+            const DistanceKernels *kernels = distanceKernelsFor(level);
+            if (kernels == nullptr) {
+                continue;
+            }
+            struct {
+                const char *name;
+                float (*kernel)(const float *, const float *, size_t);
+                double (*reference)(const float *, const float *, size_t);
+            } metrics[] = {
+                {"ssd", kernels->ssd, referenceSsd},
+                {"intersection", kernels->intersection, referenceIntersection},
+                {"dot", kernels->dot, referenceDot},
+            };
+            for (const auto &metric : metrics) {
+                double error = maxRelativeError(metric.kernel, metric.reference, query.data(),
+                                                rows.data(), std::min<size_t>(rowCount, 4096), dimension);
+                double throughput = scanGigabytesPerSecond(metric.kernel, query.data(), rows.data(),
+                                                           rowCount, dimension);
+                bool agrees = error <= kTolerance;
+                allAgree = allAgree && agrees;
+                std::printf("%-13s %-7s %6zu %10.2f %12.2e%s\n", metric.name, simdLevelName(level),
+                            dimension, throughput, error, agrees ? "" : "  MISMATCH");
+            }
+
+            // Four queries per row load, as in batch queries; GB/s counts each query's pass.
+            std::vector<float> batchQueries(4 * dimension);
+            for (auto &value : batchQueries) {
+                value = uniform(rng);
+            }
+            const float *queries[4] = {batchQueries.data(), batchQueries.data() + dimension,
+                                       batchQueries.data() + 2 * dimension, batchQueries.data() + 3 * dimension};
+            double error = dot4RelativeError(kernels->dot4, queries, rows.data(),
+                                             std::min<size_t>(rowCount, 4096), dimension);
+            double throughput = dot4GigabytesPerSecond(kernels->dot4, queries, rows.data(), rowCount, dimension);
+            bool agrees = error <= kTolerance;
+            allAgree = allAgree && agrees;
+            std::printf("%-13s %-7s %6zu %10.2f %12.2e%s\n", "dot4", simdLevelName(level), dimension, throughput,
+                        error, agrees ? "" : "  MISMATCH");
+        }
+
+        // Public batch API on the active level, including cosine.
+        std::vector<float> batch(rowCount);
+        std::vector<float> single(dimension);
+        double worstCosine = 0.0;
+        cosineDistanceBatch(query.data(), rows.data(), rowCount, dimension, batch.data());
+        for (size_t row = 0; row < std::min<size_t>(rowCount, 4096); ++row) {
+            const float *candidate = rows.data() + row * dimension;
+            double dot = referenceDot(query.data(), candidate, dimension);
+            double norms = std::sqrt(referenceDot(query.data(), query.data(), dimension)) *
+                           std::sqrt(referenceDot(candidate, candidate, dimension));
+            worstCosine = std::max(worstCosine, std::abs(batch[row] - (1.0 - dot / norms)));
+        }
+        bool cosineAgrees = worstCosine <= kTolerance;
+        allAgree = allAgree && cosineAgrees;
+        std::printf("%-13s %-7s %6zu %10s %12.2e%s\n", "cosine_batch",
+                    simdLevelName(activeDistanceKernels().level), dimension, "-", worstCosine,
+                    cosineAgrees ? "" : "  MISMATCH");
+    }
+
+    // Fused 3-region weighted intersection (custom_sunset layout: 3 x 512 bins).
+    {
+        const size_t bins = 512;
+        const size_t regions = 3;
+        const size_t dimension = bins * regions;
+        const std::vector<float> weights = {0.2f, 0.3f, 0.5f};
+        size_t rowCount = kScanBytes / (dimension * sizeof(float));
+        std::vector<float> rows(rowCount * dimension);
+        for (auto &value : rows) {
+            value = uniform(rng) / bins;
+        }
+        FloatView query(rows.data(), dimension);
+        std::vector<float> out(rowCount);
+        double best = 0.0;
+        for (int rep = 0; rep < kRepetitions; ++rep) {
+            auto start = std::chrono::steady_clock::now();
+            for (size_t row = 0; row < rowCount; ++row) {
+                out[row] = histogramIntersectionDistanceMulti(
+                    query, FloatView(rows.data() + row * dimension, dimension), bins, regions, weights);
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            best = std::max(best, static_cast<double>(rowCount * dimension * sizeof(float)) / seconds / 1e9);
+        }
+        std::printf("%-13s %-7s %6zu %10.2f %12s\n", "multi_region",
+                    simdLevelName(activeDistanceKernels().level), dimension, best, "-");
+    }
+
+    return allAgree ? 0 : 1;
+}
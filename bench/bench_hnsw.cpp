@@ -0,0 +1,102 @@
+/*
+Authors - Joseph Defendre, Sourav Das
+
+Benchmark for the HNSW embedding index.
+Builds graphs for several M values over a packed embedding store or synthetic clusters.
+Reports recall@N against an exhaustive scan and query latency for a sweep of ef.
+Checks that a saved index answers identically after loading.
+Exits non-zero if recall at the widest beam falls below the floor.
+*/
+#include "../include/distance_metrics.h"
+#include "../include/hnsw_index.h"
+#include "../include/parallel.h"
+#include "../include/top_k.h"
+#include "recall_common.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+// Recall@N required at the widest beam for M = 16.
+constexpr double kRecallFloor = 0.95;
+} // namespace
+
+/**
+ * Sweep M and ef for both metrics and report recall@N and latency.
+ *
+ * @param argc Argument count.
+ * @param argv Optional packed embedding store path.
+ * @return 0 if recall and the save/load round trip pass, 1 otherwise.
+ */
+int main(int argc, char **argv) {
+    std::mt19937 rng(7);
+    Dataset dataset = argc > 1 ? storeDataset(argv[1]) : syntheticDataset(rng);
+    if (dataset.rowCount == 0) {
+        std::fprintf(stderr, "No vectors to index\n");
+        return 1;
+    }
+    int threads = resolveThreadCount(0);
+    const size_t mValues[] = {8, 16, 32};
+    const size_t efValues[] = {10, 20, 40, 80, 160, 320};
+    bool passed = true;
+
+    std::printf("rows=%zu dim=%zu queries=%zu N=%zu threads=%d\n", dataset.rowCount, dataset.dimension,
+                dataset.queries.size() / dataset.dimension, kTopN, threads);
+    std::printf("%-7s %4s %9s %5s %10s %10s %10s\n", "metric", "M", "build_s", "ef", "recall@N", "us/query",
+                "speedup");
+    for (const std::string metric : {"cosine", "ssd"}) {
+        double exhaustiveMicros = 0.0;
+        auto truth = exhaustiveTopN(dataset, metric, exhaustiveMicros);
+        std::printf("%-7s %4s %9s %5s %10.4f %10.1f %10.1f\n", metric.c_str(), "-", "-", "all", 1.0,
+                    exhaustiveMicros, 1.0);
+        for (size_t m : mValues) {
+            HnswParams params;
+            params.m = m;
+            auto start = std::chrono::steady_clock::now();
+            HnswIndex index = HnswIndex::build(metric, dataset.rows.data(), dataset.rowCount, dataset.dimension,
+                                               dataset.names, params, threads);
+            double buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            double recall = 0.0;
+            for (size_t ef : efValues) {
+                double micros = 0.0;
+                recall = measureRecall(index, dataset, truth, ef, micros);
+                std::printf("%-7s %4zu %9.2f %5zu %10.4f %10.1f %10.1f\n", metric.c_str(), m, buildSeconds, ef,
+                            recall, micros, exhaustiveMicros / micros);
+            }
+            if (m == 16 && recall < kRecallFloor) {
+                std::printf("  RECALL BELOW %.2f\n", kRecallFloor);
+                passed = false;
+            }
+
+            if (m == 16) {
+                // Loading must reproduce the in-memory graph exactly.
+                std::string path = (std::filesystem::temp_directory_path() / "cbir_bench.hnsw").string();
+                index.save(path);
+                HnswIndex loaded(path);
+                std::filesystem::remove(path);
+                for (size_t q = 0; q < truth.size(); ++q) {
+                    FloatView query(dataset.queries.data() + q * dataset.dimension, dataset.dimension);
+                    auto before = index.search(query, kTopN, 64);
+                    auto after = loaded.search(query, kTopN, 64);
+                    bool same = before.size() == after.size() &&
+                                std::equal(before.begin(), before.end(), after.begin(),
+                                           [](const ScoredCandidate &a, const ScoredCandidate &b) {
+                                               return a.index == b.index && a.distance == b.distance;
+                                           });
+                    if (!same) {
+                        std::printf("  LOADED INDEX DIFFERS (query %zu)\n", q);
+                        passed = false;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,81 @@
+/*
+Authors - Joseph Defendre, Sourav Das
+
+Benchmark for the product-quantized embedding index.
+Encodes a packed embedding store or synthetic clusters at 8x and 16x compression.
+Reports recall@N against an exhaustive scan with and without exact re-ranking.
+Reports resident bytes per vector and query latency for each setting.
+Exits non-zero if re-ranked recall at 8x falls below the floor.
+*/
+#include "../include/distance_metrics.h"
+#include "../include/parallel.h"
+#include "../include/pq_index.h"
+#include "../include/top_k.h"
+#include "recall_common.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+// Recall@N required at 8x compression with the widest re-rank.
+constexpr double kRecallFloor = 0.9;
+} // namespace
+
+/**
+ * Sweep compression and re-rank depth for both metrics.
+ *
+ * @param argc Argument count.
+ * @param argv Optional packed embedding store path.
+ * @return 0 if re-ranked recall at 8x meets the floor, 1 otherwise.
+ */
+int main(int argc, char **argv) {
+    std::mt19937 rng(7);
+    Dataset dataset = argc > 1 ? storeDataset(argv[1]) : syntheticDataset(rng);
+    if (dataset.rowCount == 0 || dataset.dimension < 4) {
+        std::fprintf(stderr, "Need vectors of at least 4 dimensions\n");
+        return 1;
+    }
+    int threads = resolveThreadCount(0);
+    const size_t compressions[] = {8, 16};
+    const size_t rerankDepths[] = {0, 20, 50, 100};
+    bool passed = true;
+    std::string path = (std::filesystem::temp_directory_path() / "cbir_bench.pq").string();
+
+    std::printf("rows=%zu dim=%zu queries=%zu N=%zu\n", dataset.rowCount, dataset.dimension,
+                dataset.queries.size() / dataset.dimension, kTopN);
+    std::printf("%-7s %6s %8s %9s %7s %10s %10s\n", "metric", "ratio", "bytes", "train_s", "rerank", "recall@N",
+                "us/query");
+    for (const std::string metric : {"cosine", "ssd"}) {
+        double exhaustiveMicros = 0.0;
+        auto truth = exhaustiveTopN(dataset, metric, exhaustiveMicros);
+        std::printf("%-7s %6s %8zu %9s %7s %10.4f %10.1f\n", metric.c_str(), "1x",
+                    dataset.dimension * sizeof(float), "-", "-", 1.0, exhaustiveMicros);
+        for (size_t ratio : compressions) {
+            // float32 is 4 bytes per dimension, so ratio R needs 4 * D / R code bytes.
+            PqParams params;
+            params.subspaces = std::max<size_t>(dataset.dimension * sizeof(float) / ratio, 1);
+            auto start = std::chrono::steady_clock::now();
+            writePqIndex(path, metric, dataset.rows.data(), dataset.rowCount, dataset.dimension, dataset.names,
+                         params, threads);
+            double trainSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            PqIndex index(path);
+            for (size_t rerank : rerankDepths) {
+                double micros = 0.0;
+                double recall = measureRecall(index, dataset, truth, rerank, micros);
+                std::printf("%-7s %5zux %8zu %9.2f %7zu %10.4f %10.1f\n", metric.c_str(), ratio,
+                            index.subspaces(), trainSeconds, rerank, recall, micros);
+                if (ratio == 8 && rerank == rerankDepths[3] && recall < kRecallFloor) {
+                    std::printf("  RECALL BELOW %.2f\n", kRecallFloor);
+                    passed = false;
+                }
+            }
+        }
+    }
+    std::filesystem::remove(path);
+    return passed ? 0 : 1;
+}
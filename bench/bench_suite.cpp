@@ -0,0 +1,354 @@
+/*
+Authors - Joseph Defendre, Sourav Das
+
+Micro-benchmark suite for the feature extractors and distance metrics.
+Runs every extractor over synthetic images of several sizes and every
+metric over several vector dimensions, with warmup and repeated samples.
+Reports ns/op, pixels/s and GB/s as a table and optionally as JSON,
+so results can be diffed between releases.
+*/
+#include "../include/distance_kernels.h"
+#include "../include/distance_metrics.h"
+#include "../include/feature_extraction.h"
+#include "synthetic_image.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+// Untimed samples run before measuring (page faults, caches, frequency ramp).
+constexpr int kWarmupSamples = 2;
+constexpr int kDefaultSamples = 7;
+// Each sample repeats the operation until it takes at least this long.
+constexpr double kMinSampleSeconds = 0.02;
+// Rows cycled through by the metric benchmarks (fits in L2 for small dimensions).
+constexpr size_t kMetricRows = 256;
+
+// Results are folded in here so benchmarked calls are not optimized away.
+volatile float gSink = 0.0f;
+
+/**
+ * One benchmarked operation and what a single call processes.
+ */
+struct BenchCase {
+    std::string group;
+    std::string name;
+    // Image size ("640x480") or vector dimension ("d=512").
+    std::string shape;
+    // Pixels per call (0 for metrics).
+    double pixels = 0.0;
+    // Input bytes read per call.
+    double bytes = 0.0;
+    // Runs the operation `iterations` times.
+    std::function<void(size_t iterations)> run;
+};
+
+/**
+ * Timing summary of one case.
+ */
+struct BenchResult {
+    const BenchCase *benchCase = nullptr;
+    size_t iterations = 0;
+    int samples = 0;
+    double nsPerOpMin = 0.0;
+    double nsPerOpMedian = 0.0;
+    double nsPerOpMax = 0.0;
+};
+
+/**
+ * Seconds taken by one sample of `iterations` calls.
+ *
+ * @param benchCase Case to run.
+ * @param iterations Calls per sample.
+ * @return Elapsed wall time.
+ */
+double timeSample(const BenchCase &benchCase, size_t iterations) {
+    auto start = std::chrono::steady_clock::now();
+    benchCase.run(iterations);
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Calibrate, warm up and time a case.
+ *
+ * The iteration count doubles until one sample lasts kMinSampleSeconds, so
+ * fast metrics and slow full-resolution extractions get comparable precision.
+ *
+ * @param benchCase Case to run.
+ * @param samples Timed samples to take.
+ * @return Min/median/max ns per call over the samples.
+ */
+BenchResult measure(const BenchCase &benchCase, int samples) {
+    size_t iterations = 1;
+    while (timeSample(benchCase, iterations) < kMinSampleSeconds && iterations < (size_t(1) << 30)) {
+        iterations *= 2;
+    }
+    for (int i = 0; i < kWarmupSamples; ++i) {
+        timeSample(benchCase, iterations);
+    }
+    std::vector<double> nsPerOp(static_cast<size_t>(samples));
+    for (auto &value : nsPerOp) {
+        value = timeSample(benchCase, iterations) * 1e9 / static_cast<double>(iterations);
+    }
+    std::sort(nsPerOp.begin(), nsPerOp.end());
+
+    BenchResult result;
+    result.benchCase = &benchCase;
+    result.iterations = iterations;
+    result.samples = samples;
+    result.nsPerOpMin = nsPerOp.front();
+    result.nsPerOpMedian = nsPerOp[nsPerOp.size() / 2];
+    result.nsPerOpMax = nsPerOp.back();
+    return result;
+}
+
+/**
+ * Add one case per extractor for an image.
+ *
+ * @param cases Output list.
+ * @param image Shared input image (kept alive by the captures).
+ */
+void addExtractorCases(std::vector<BenchCase> &cases, const std::shared_ptr<cv::Mat> &image) {
+    using Extractor = std::function<std::vector<float>(const cv::Mat &)>;
+    struct Entry {
+        const char *name;
+        Extractor extract;
+        // Pixels read per call (0 = the whole image).
+        double pixels = 0.0;
+    };
+    const Entry extractors[] = {
+        {"center_patch_7", [](const cv::Mat &m) { return extractCenterPatchFeature(m, 7); }, 7.0 * 7.0},
+        {"rgb_histogram_8", [](const cv::Mat &m) { return extractRgbHistogram(m, 8); }},
+        {"rg_histogram_16", [](const cv::Mat &m) { return extractRgChromaticityHistogram(m, 16); }},
+        {"multi_region_8x2", [](const cv::Mat &m) { return extractMultiRegionRgbHistogram(m, 8, 2); }},
+        {"sobel_histogram_16", [](const cv::Mat &m) { return extractSobelMagnitudeHistogram(m, 16); }},
+        {"custom_sunset_8x3", [](const cv::Mat &m) { return extractCustomSunsetHistogram(m, 8, 3); }},
+        {"fused_all", [](const cv::Mat &m) {
+             DescriptorRequest request;
+             request.rgbBins = 8;
+             request.rgBins = 16;
+             request.regionCounts = {2, 3};
+             request.sobelBins = 16;
+             return extractDescriptors(m, request).rgb;
+         }},
+    };
+    std::string shape = std::to_string(image->cols) + "x" + std::to_string(image->rows);
+    double imagePixels = static_cast<double>(image->rows) * image->cols;
+    for (const auto &extractor : extractors) {
+        Extractor extract = extractor.extract;
+        double pixels = extractor.pixels > 0.0 ? extractor.pixels : imagePixels;
+        cases.push_back({"extract", extractor.name, shape, pixels, pixels * 3.0, [image, extract](size_t iterations) {
+                             for (size_t i = 0; i < iterations; ++i) {
+                                 gSink = gSink + extract(*image)[0];
+                             }
+                         }});
+    }
+}
+
+/**
+ * Add one case per distance metric for a vector dimension.
+ *
+ * Pairwise metrics compare a query with a rotating database row (bytes count
+ * both vectors); batch metrics score kMetricRows rows per call (bytes count
+ * the rows, and ns/op is per row).
+ *
+ * @param cases Output list.
+ * @param dimension Floats per vector.
+ * @param rng Random source.
+ */
+void addMetricCases(std::vector<BenchCase> &cases, size_t dimension, std::mt19937 &rng) {
+    // Histogram-like data: non-negative and summing to one per row.
+    auto rows = std::make_shared<std::vector<float>>(kMetricRows * dimension);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    for (size_t row = 0; row < kMetricRows; ++row) {
+        float sum = 0.0f;
+        for (size_t i = 0; i < dimension; ++i) {
+            sum += (*rows)[row * dimension + i] = uniform(rng);
+        }
+        for (size_t i = 0; i < dimension; ++i) {
+            (*rows)[row * dimension + i] /= sum;
+        }
+    }
+    auto out = std::make_shared<std::vector<float>>(kMetricRows);
+    std::string shape = "d=" + std::to_string(dimension);
+    double pairBytes = 2.0 * dimension * sizeof(float);
+    double rowBytes = static_cast<double>(dimension * sizeof(float));
+
+    using Pairwise = float (*)(FloatView, FloatView);
+    const std::pair<const char *, Pairwise> pairwise[] = {
+        {"ssd", ssdDistance},
+        {"histogram_intersection", histogramIntersectionDistance},
+        {"cosine", cosineDistance},
+    };
+    for (const auto &metric : pairwise) {
+        Pairwise distance = metric.second;
+        cases.push_back({"metric", metric.first, shape, 0.0, pairBytes, [rows, dimension, distance](size_t iterations) {
+                             FloatView query(rows->data(), dimension);
+                             float sum = 0.0f;
+                             for (size_t i = 0; i < iterations; ++i) {
+                                 size_t row = i % kMetricRows;
+                                 sum += distance(query, FloatView(rows->data() + row * dimension, dimension));
+                             }
+                             gSink = gSink + sum;
+                         }});
+    }
+
+    // Three equal regions, as custom_sunset stores them.
+    if (dimension % 3 == 0) {
+        cases.push_back({"metric", "intersection_multi_3", shape, 0.0, pairBytes, [rows, dimension](size_t iterations) {
+                             const std::vector<float> weights = {0.2f, 0.3f, 0.5f};
+                             FloatView query(rows->data(), dimension);
+                             float sum = 0.0f;
+                             for (size_t i = 0; i < iterations; ++i) {
+                                 size_t row = i % kMetricRows;
+                                 sum += histogramIntersectionDistanceMulti(
+                                     query, FloatView(rows->data() + row * dimension, dimension), dimension / 3, 3,
+                                     weights);
+                             }
+                             gSink = gSink + sum;
+                         }});
+    }
+
+    using Batch = void (*)(const float *, const float *, size_t, size_t, float *);
+    const std::pair<const char *, Batch> batches[] = {
+        {"ssd_batch", ssdDistanceBatch},
+        {"histogram_intersection_batch", histogramIntersectionDistanceBatch},
+        {"cosine_batch", cosineDistanceBatch},
+    };
+    for (const auto &metric : batches) {
+        Batch distance = metric.second;
+        cases.push_back({"metric", metric.first, shape, 0.0, rowBytes, [rows, out, dimension, distance](size_t iterations) {
+                             // One op is one row, so whole blocks are scored until iterations rows are done.
+                             for (size_t done = 0; done < iterations; done += kMetricRows) {
+                                 size_t count = std::min(kMetricRows, iterations - done);
+                                 distance(rows->data(), rows->data(), count, dimension, out->data());
+                             }
+                             gSink = gSink + (*out)[0];
+                         }});
+    }
+}
+
+/**
+ * Escape a string for a JSON literal (names here are plain ASCII).
+ *
+ * @param text Raw text.
+ * @return Quoted JSON string.
+ */
+std::string jsonString(const std::string &text) {
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+        }
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+/**
+ * Write every result as one JSON document.
+ *
+ * @param path Output path.
+ * @param results Measured cases.
+ * @return False if the file cannot be written.
+ */
+bool writeJson(const std::string &path, const std::vector<BenchResult> &results) {
+    FILE *file = std::fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        return false;
+    }
+    std::fprintf(file, "{\n  \"schema\": 1,\n  \"simd_level\": %s,\n  \"warmup_samples\": %d,\n  \"results\": [\n",
+                 jsonString(simdLevelName(activeDistanceKernels().level)).c_str(), kWarmupSamples);
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult &result = results[i];
+        const BenchCase &benchCase = *result.benchCase;
+        double opsPerSecond = 1e9 / result.nsPerOpMedian;
+        std::fprintf(file,
+                     "    {\"group\": %s, \"name\": %s, \"shape\": %s, \"iterations\": %zu, \"samples\": %d, "
+                     "\"ns_per_op_min\": %.3f, \"ns_per_op_median\": %.3f, \"ns_per_op_max\": %.3f, "
+                     "\"pixels_per_sec\": %.6g, \"gb_per_sec\": %.6g}%s\n",
+                     jsonString(benchCase.group).c_str(), jsonString(benchCase.name).c_str(),
+                     jsonString(benchCase.shape).c_str(), result.iterations, result.samples, result.nsPerOpMin,
+                     result.nsPerOpMedian, result.nsPerOpMax, benchCase.pixels * opsPerSecond,
+                     benchCase.bytes * opsPerSecond / 1e9, i + 1 < results.size() ? "," : "");
+    }
+    std::fprintf(file, "  ]\n}\n");
+    return std::fclose(file) == 0;
+}
+
+void printUsage() {
+    std::fprintf(stderr, "Usage: cbir_bench_suite [--json <path>] [--samples <S>] [--filter <substring>]\n");
+}
+} // namespace
+
+/**
+ * Build the case list, time every case and print/write the results.
+ *
+ * @return 0 on success, 1 on bad arguments or an unwritable JSON path.
+ */
+int main(int argc, char **argv) {
+    std::string jsonPath;
+    std::string filter;
+    int samples = kDefaultSamples;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--json" && i + 1 < argc) {
+            jsonPath = argv[++i];
+        } else if (arg == "--samples" && i + 1 < argc) {
+            samples = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--filter" && i + 1 < argc) {
+            filter = argv[++i];
+        } else {
+            printUsage();
+            return 1;
+        }
+    }
+
+    std::mt19937 rng(42);
+    std::vector<BenchCase> cases;
+    for (const cv::Size &size : {cv::Size(320, 240), cv::Size(1280, 720), cv::Size(4000, 3000)}) {
+        addExtractorCases(cases, std::make_shared<cv::Mat>(syntheticImage(size.height, size.width, rng)));
+    }
+    // Feature dimensions the CLI produces (rg 16^2, rgb 8^3, sunset 3 x 8^3) plus an embedding size.
+    for (size_t dimension : {16, 256, 512, 1536, 2048}) {
+        addMetricCases(cases, dimension, rng);
+    }
+
+    std::printf("simd level: %s\n", simdLevelName(activeDistanceKernels().level));
+    std::printf("%-8s %-28s %-10s %12s %12s %12s %9s\n", "group", "name", "shape", "ns/op", "min_ns/op",
+                "Mpixels/s", "GB/s");
+    std::vector<BenchResult> results;
+    for (const BenchCase &benchCase : cases) {
+        std::string label = benchCase.group + "/" + benchCase.name + "/" + benchCase.shape;
+        if (!filter.empty() && label.find(filter) == std::string::npos) {
+            continue;
+        }
+        BenchResult result = measure(benchCase, samples);
+        double opsPerSecond = 1e9 / result.nsPerOpMedian;
+        char pixelRate[32] = "-";
+        if (benchCase.pixels > 0.0) {
+            std::snprintf(pixelRate, sizeof(pixelRate), "%.1f", benchCase.pixels * opsPerSecond / 1e6);
+        }
+        std::printf("%-8s %-28s %-10s %12.1f %12.1f %12s %9.2f\n", benchCase.group.c_str(), benchCase.name.c_str(),
+                    benchCase.shape.c_str(), result.nsPerOpMedian, result.nsPerOpMin, pixelRate,
+                    benchCase.bytes * opsPerSecond / 1e9);
+        std::fflush(stdout);
+        results.push_back(result);
+    }
+
+    if (!jsonPath.empty()) {
+        if (!writeJson(jsonPath, results)) {
+            std::fprintf(stderr, "Failed to write %s\n", jsonPath.c_str());
+            return 1;
+        }
+        std::printf("wrote %s\n", jsonPath.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,165 @@
+/*
+Authors - Joseph Defendre, Sourav Das
+
+Shared dataset and ground-truth helpers for the approximate-index benchmarks.
+Builds synthetic Gaussian clusters or loads a packed embedding store with held-out queries.
+Computes exhaustive top-N answers with the batch kernels and recall@N of an index against them.
+*/
+#ifndef RECALL_COMMON_H
+#define RECALL_COMMON_H
+
+#include "../include/distance_metrics.h"
+#include "../include/feature_store.h"
+#include "../include/top_k.h"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+inline constexpr size_t kSyntheticRows = 50000;
+inline constexpr size_t kSyntheticDimension = 128;
+inline constexpr size_t kSyntheticClusters = 200;
+inline constexpr size_t kQueryCount = 200;
+inline constexpr size_t kTopN = 10;
+
+/**
+ * Vectors under test plus held-out queries.
+ */
+struct Dataset {
+    std::vector<float> rows;
+    std::vector<std::string> names;
+    std::vector<float> queries;
+    size_t rowCount = 0;
+    size_t dimension = 0;
+};
+
+/**
+ * Gaussian clusters, roughly the shape of image embeddings.
+ *
+ * @param rng Random source.
+ * @return Dataset with kQueryCount queries drawn from the same clusters.
+ */
+inline Dataset syntheticDataset(std::mt19937 &rng) {
+    Dataset dataset;
+    dataset.rowCount = kSyntheticRows;
+    dataset.dimension = kSyntheticDimension;
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+    std::uniform_int_distribution<size_t> pickCluster(0, kSyntheticClusters - 1);
+    std::vector<float> centers(kSyntheticClusters * kSyntheticDimension);
+    for (auto &value : centers) {
+        value = normal(rng);
+    }
+    auto sample = [&](std::vector<float> &out) {
+        const float *center = centers.data() + pickCluster(rng) * kSyntheticDimension;
+        for (size_t d = 0; d < kSyntheticDimension; ++d) {
+            out.push_back(center[d] + 0.35f * normal(rng));
+        }
+    };
+    for (size_t row = 0; row < kSyntheticRows; ++row) {
+        sample(dataset.rows);
+        dataset.names.push_back("img" + std::to_string(row) + ".jpg");
+    }
+    for (size_t q = 0; q < kQueryCount; ++q) {
+        sample(dataset.queries);
+    }
+    return dataset;
+}
+
+/**
+ * Rows of a packed embedding store; queries are evenly spaced rows.
+ *
+ * @param path Store path (from `cbir pack`).
+ * @return Dataset backed by copies of the store rows.
+ */
+inline Dataset storeDataset(const std::string &path) {
+    FeatureStore store(path);
+    Dataset dataset;
+    dataset.rowCount = store.rowCount();
+    dataset.dimension = store.dimension();
+    dataset.rows.assign(store.data(), store.data() + store.rowCount() * store.dimension());
+    for (size_t row = 0; row < store.rowCount(); ++row) {
+        dataset.names.emplace_back(store.filename(row));
+    }
+    for (size_t q = 0; q < kQueryCount && dataset.rowCount > 0; ++q) {
+        const float *row = store.row(q * dataset.rowCount / kQueryCount);
+        dataset.queries.insert(dataset.queries.end(), row, row + dataset.dimension);
+    }
+    return dataset;
+}
+
+/**
+ * Exhaustive top-N for every query with the batch kernels.
+ *
+ * @param dataset Rows and queries.
+ * @param metric "cosine" or "ssd".
+ * @param microsecondsPerQuery Receives the mean scan latency.
+ * @return Ground-truth row indices per query.
+ */
+inline std::vector<std::vector<size_t>> exhaustiveTopN(
+    const Dataset &dataset,
+    const std::string &metric,
+    double &microsecondsPerQuery) {
+    size_t queryCount = dataset.queries.size() / dataset.dimension;
+    std::vector<std::vector<size_t>> truth(queryCount);
+    std::vector<float> distances(dataset.rowCount);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t q = 0; q < queryCount; ++q) {
+        const float *query = dataset.queries.data() + q * dataset.dimension;
+        if (metric == "cosine") {
+            cosineDistanceBatch(query, dataset.rows.data(), dataset.rowCount, dataset.dimension, distances.data());
+        } else {
+            ssdDistanceBatch(query, dataset.rows.data(), dataset.rowCount, dataset.dimension, distances.data());
+        }
+        TopKCollector collector(kTopN, false);
+        for (size_t row = 0; row < dataset.rowCount; ++row) {
+            collector.offer(distances[row], row);
+        }
+        for (const auto &candidate : collector.sorted()) {
+            truth[q].push_back(candidate.index);
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    microsecondsPerQuery = seconds * 1e6 / std::max<size_t>(queryCount, 1);
+    return truth;
+}
+
+/**
+ * Mean recall@N of an approximate index, and its mean latency.
+ *
+ * @param index Index under test; any type with search(query, N, param).
+ * @param dataset Queries.
+ * @param truth Exhaustive answers.
+ * @param searchParam Index-specific effort (HNSW beam width, PQ re-rank depth).
+ * @param microsecondsPerQuery Receives the mean search latency.
+ * @return Fraction of true neighbours found.
+ */
+template <typename Index>
+double measureRecall(
+    const Index &index,
+    const Dataset &dataset,
+    const std::vector<std::vector<size_t>> &truth,
+    size_t searchParam,
+    double &microsecondsPerQuery) {
+    std::vector<std::vector<ScoredCandidate>> answers(truth.size());
+    auto start = std::chrono::steady_clock::now();
+    for (size_t q = 0; q < truth.size(); ++q) {
+        FloatView query(dataset.queries.data() + q * dataset.dimension, dataset.dimension);
+        answers[q] = index.search(query, kTopN, searchParam);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    microsecondsPerQuery = seconds * 1e6 / std::max<size_t>(truth.size(), 1);
+    size_t found = 0;
+    size_t expected = 0;
+    for (size_t q = 0; q < truth.size(); ++q) {
+        for (size_t row : truth[q]) {
+            found += std::any_of(answers[q].begin(), answers[q].end(),
+                                 [row](const ScoredCandidate &c) { return c.index == row; });
+        }
+        expected += truth[q].size();
+    }
+    return expected == 0 ? 1.0 : static_cast<double>(found) / expected;
+}
+
+#endif
@@ -0,0 +1,39 @@
+/*
+Authors - Joseph Defendre, Sourav Das
+
+Synthetic input images shared by the extractor benchmarks.
+Smooth gradients plus noise, so neighbouring pixels often share bins as in real photos.
+*/
+#ifndef SYNTHETIC_IMAGE_H
+#define SYNTHETIC_IMAGE_H
+
+#include <opencv2/opencv.hpp>
+
+#include <algorithm>
+#include <random>
+
+/**
+ * Synthetic photo-like image: smooth gradients plus noise, so neighbouring
+ * pixels often share bins as in real images.
+ *
+ * @param rows Image height.
+ * @param cols Image width.
+ * @param rng Random source.
+ * @return BGR image (CV_8UC3).
+ */
+inline cv::Mat syntheticImage(int rows, int cols, std::mt19937 &rng) {
+    cv::Mat image(rows, cols, CV_8UC3);
+    std::uniform_int_distribution<int> noise(-12, 12);
+    for (int row = 0; row < rows; ++row) {
+        auto *rowPtr = image.ptr<cv::Vec3b>(row);
+        for (int col = 0; col < cols; ++col) {
+            int base[3] = {col * 255 / cols, row * 255 / rows, (row + col) * 255 / (rows + cols)};
+            for (int channel = 0; channel < 3; ++channel) {
+                rowPtr[col][channel] = static_cast<uchar>(std::clamp(base[channel] + noise(rng), 0, 255));
+            }
+        }
+    }
+    return image;
+}
+
+#endif
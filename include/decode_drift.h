@@ -0,0 +1,59 @@
+/*
+Authors - Joseph Defendre, Sourav Das
+
+
+Declarations for the reduced-resolution decode drift report.
+Ranks sample queries at full resolution and at each reduced decode scale.
+Reports top-N overlap, rank displacement and decode+extract cost per scale.
+Used by the `cbir drift` subcommand to choose a --decode-scale.
+*/
+#ifndef DECODE_DRIFT_H
+#define DECODE_DRIFT_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * Settings for one drift measurement.
+ */
+struct DriftOptions {
+    std::string databaseDir;
+    std::string featureType;
+    size_t topN = 10;
+    // Reduced scales to compare against full resolution.
+    std::vector<int> scales = {2, 4, 8};
+    // Number of database images used as queries (evenly spaced).
+    size_t samples = 20;
+    int threadCount = 1;
+};
+
+/**
+ * Drift of one decode scale relative to full resolution.
+ */
+struct DriftRow {
+    int scale = 1;
+    // Mean fraction of the full-resolution top-N also found in the reduced top-N.
+    double overlap = 1.0;
+    // Mean |rank change| of full-resolution top-N items (missing items count as rank N).
+    double rankDisplacement = 0.0;
+    // Mean decode + extraction time per image.
+    double millisecondsPerImage = 0.0;
+};
+
+/**
+ * Measure how much reduced-resolution decoding changes the rankings.
+ *
+ * Every database image is decoded and described at full resolution and at
+ * each requested scale. Each sample query then ranks the other images with
+ * query and database at the same scale, and its top-N is compared with the
+ * full-resolution top-N.
+ *
+ * @param options Database, feature type, N, scales, samples and threads.
+ * @return One row per scale, starting with the full-resolution reference.
+ * @throws std::runtime_error on unknown feature type, invalid scale or
+ *         unreadable images.
+ */
+std::vector<DriftRow> measureDecodeDrift(const DriftOptions &options);
+
+#endif
@@ -0,0 +1,65 @@
+/*
+Authors - Joseph Defendre, Sourav Das
+
+
+Declarations for the low-level distance kernels.
+Provides scalar, SSE, AVX2 and AVX-512 variants of the inner loops.
+Selects the best variant supported by the CPU at runtime.
+Used by distance_metrics.cpp; exposed for benchmarking.
+*/
+#ifndef DISTANCE_KERNELS_H
+#define DISTANCE_KERNELS_H
+
+#include <cstddef>
+
+/**
+ * Instruction set levels with a kernel implementation.
+ */
+enum class SimdLevel {
+    Scalar,
+    Sse,
+    Avx2,
+    Avx512
+};
+
+/**
+ * Raw pointer kernels for one instruction set level.
+ * All kernels read n floats from each input and accumulate in float.
+ */
+struct DistanceKernels {
+    SimdLevel level;
+    float (*ssd)(const float *a, const float *b, size_t n);
+    float (*intersection)(const float *a, const float *b, size_t n);
+    float (*dot)(const float *a, const float *b, size_t n);
+    // Dot products of queries[0..3] with one row, written to out[0..3]; the
+    // row is loaded once for all four (register-blocked many-to-many scans).
+    void (*dot4)(const float *const *queries, const float *row, size_t n, float *out);
+};
+
+/**
+ * Kernels for the best level supported by this CPU.
+ *
+ * Detected once via CPUID. The CBIR_SIMD environment variable
+ * (scalar, sse, avx2, avx512) can cap the level for comparisons.
+ *
+ * @return Active kernel table.
+ */
+const DistanceKernels &activeDistanceKernels();
+
+/**
+ * Kernels for a specific level, if this build and CPU support it.
+ *
+ * @param level Requested instruction set level.
+ * @return Kernel table, or nullptr if unavailable.
+ */
+const DistanceKernels *distanceKernelsFor(SimdLevel level);
+
+/**
+ * Lower-case name of a level ("scalar", "sse", "avx2", "avx512").
+ *
+ * @param level Instruction set level.
+ * @return Static name string.
+ */
+const char *simdLevelName(SimdLevel level);
+
+#endif
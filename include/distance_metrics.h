@@ -5,13 +5,42 @@ Authors - Joseph Defendre, Sourav Das
 Declarations for distance metric functions used in CBIR.
 Includes SSD, histogram intersection, and weighted multi-histogram support.
 Provides cosine distance for embedding-based comparisons.
-All functions operate on float vectors and validate sizes.
+All functions take non-owning float views and validate sizes.
+Batch variants score one query against a contiguous block of rows.
+Bounded variants abandon a candidate once it cannot beat the current k-th best.
 */
 #ifndef DISTANCE_METRICS_H
 #define DISTANCE_METRICS_H
 
+#include <cstddef>
+#include <limits>
 #include <vector>
 
+// Floats accumulated between early-abandon checks.
+constexpr size_t kAbandonChunk = 64;
+
+/**
+ * Non-owning view of contiguous floats (pointer + length).
+ *
+ * Converts implicitly from std::vector<float>, so vectors, feature store rows
+ * and sub-ranges of larger vectors can all be scored without copying.
+ */
+struct FloatView {
+    const float *data = nullptr;
+    size_t size = 0;
+
+    FloatView() = default;
+    FloatView(const float *values, size_t count) : data(values), size(count) {}
+    FloatView(const std::vector<float> &values) : data(values.data()), size(values.size()) {}
+
+    /**
+     * @param offset First element of the sub-range.
+     * @param count Number of elements.
+     * @return View of [offset, offset + count) (caller guarantees bounds).
+     */
+    FloatView subview(size_t offset, size_t count) const { return FloatView(data + offset, count); }
+};
+
 /**
  * Compute sum of squared differences between two equal-length vectors.
  *
@@ -20,7 +49,7 @@ All functions operate on float vectors and validate sizes.
  * @return Sum of squared differences.
  * @throws std::runtime_error if the input sizes do not match.
  */
-float ssdDistance(const std::vector<float> &a, const std::vector<float> &b);
+float ssdDistance(FloatView a, FloatView b);
 
 /**
  * Compute histogram intersection similarity (higher is more similar).
@@ -31,8 +60,8 @@ float ssdDistance(const std::vector<float> &a, const std::vector<float> &b);
  * @throws std::runtime_error if the input sizes do not match.
  */
 float histogramIntersectionSimilarity(
-    const std::vector<float> &a,
-    const std::vector<float> &b);
+    FloatView a,
+    FloatView b);
 
 /**
  * Convert histogram intersection similarity to a distance in [0, 1].
@@ -43,12 +72,14 @@ float histogramIntersectionSimilarity(
  * @throws std::runtime_error if the input sizes do not match.
  */
 float histogramIntersectionDistance(
-    const std::vector<float> &a,
-    const std::vector<float> &b);
+    FloatView a,
+    FloatView b);
 
 /**
  * Compute weighted intersection distance over concatenated per-region histograms.
  *
+ * Walks both inputs once, region by region, without allocating.
+ *
  * @param a Concatenated histograms for image A.
  * @param b Concatenated histograms for image B.
  * @param binsPerHistogram Number of bins in each region histogram.
@@ -58,11 +89,97 @@ float histogramIntersectionDistance(
  * @throws std::runtime_error if sizes or weights do not match expectations.
  */
 float histogramIntersectionDistanceMulti(
-    const std::vector<float> &a,
-    const std::vector<float> &b,
+    FloatView a,
+    FloatView b,
     size_t binsPerHistogram,
     size_t histogramCount,
-    const std::vector<float> &weights);
+    FloatView weights);
+
+/**
+ * Weighted multi-histogram distance that gives up once it must exceed bound.
+ *
+ * Regions are scored in order; the distance so far can only grow, so the scan
+ * stops at the first region that pushes it past bound.
+ *
+ * @param a Concatenated histograms for image A.
+ * @param b Concatenated histograms for image B.
+ * @param binsPerHistogram Number of bins in each region histogram.
+ * @param histogramCount Number of regions concatenated in the vectors.
+ * @param weights Per-region weights (size must equal histogramCount).
+ * @param bound Distance the candidate must not exceed to be useful.
+ * @return The exact distance when it is at most bound, otherwise a value
+ *         greater than bound.
+ * @throws std::runtime_error if sizes or weights do not match expectations.
+ */
+float histogramIntersectionDistanceMultiBounded(
+    FloatView a,
+    FloatView b,
+    size_t binsPerHistogram,
+    size_t histogramCount,
+    FloatView weights,
+    float bound);
+
+/**
+ * SSD that stops accumulating once the partial sum passes bound.
+ *
+ * Partial sums are checked every kAbandonChunk floats. A candidate that
+ * survives is rescored with the full kernel, so its distance is bit-identical
+ * to ssdDistance.
+ *
+ * @param a First feature vector.
+ * @param b Second feature vector.
+ * @param bound Distance the candidate must not exceed to be useful.
+ * @return ssdDistance(a, b) when it is at most bound, otherwise a value
+ *         greater than bound.
+ * @throws std::runtime_error if the input sizes do not match.
+ */
+float ssdDistanceBounded(FloatView a, FloatView b, float bound);
+
+/**
+ * Histogram mass remaining at each early-abandon chunk boundary.
+ *
+ * Entry c is the sum of histogram[c * kAbandonChunk, end); the last entry is 0.
+ * Computed once per query for histogramIntersectionDistanceBounded.
+ *
+ * @param histogram Query histogram.
+ * @return ceil(size / kAbandonChunk) + 1 tail sums.
+ */
+std::vector<float> histogramTailMass(FloatView histogram);
+
+/**
+ * Histogram intersection distance that gives up once it must exceed bound.
+ *
+ * The bins still to come can add at most a's remaining mass to the
+ * similarity, which gives a lower bound on the distance after every chunk.
+ * Survivors are rescored with the full kernel, so their distance is
+ * bit-identical to histogramIntersectionDistance.
+ *
+ * @param a Query histogram.
+ * @param b Candidate histogram.
+ * @param aTailMass histogramTailMass(a).
+ * @param bound Distance the candidate must not exceed to be useful.
+ * @return histogramIntersectionDistance(a, b) when it is at most bound,
+ *         otherwise a value greater than bound.
+ * @throws std::runtime_error if the input sizes do not match.
+ */
+float histogramIntersectionDistanceBounded(
+    FloatView a,
+    FloatView b,
+    FloatView aTailMass,
+    float bound);
+
+/**
+ * Bound that a lower bound must exceed before a candidate is dropped.
+ *
+ * Chunked and coarse sums round differently from the full kernels, so the
+ * bound is widened slightly; a candidate tied with the k-th best is never dropped.
+ *
+ * @param bound Current k-th best distance.
+ * @return Widened bound.
+ */
+inline float abandonThreshold(float bound) {
+    return bound + (bound < 0.0f ? -bound : bound) * 1e-5f + 1e-6f;
+}
 
 /**
  * Compute cosine distance (1 - cosine similarity) between two vectors.
@@ -72,6 +189,55 @@ float histogramIntersectionDistanceMulti(
  * @return Cosine distance in [0, 2], or 1.0 if either vector has zero norm.
  * @throws std::runtime_error if the input sizes do not match.
  */
-float cosineDistance(const std::vector<float> &a, const std::vector<float> &b);
+float cosineDistance(FloatView a, FloatView b);
+
+/**
+ * Compute SSD between one query and each row of a row-major matrix.
+ *
+ * @param query Query vector of length dimension.
+ * @param rows First element of rowCount contiguous rows.
+ * @param rowCount Number of rows to score.
+ * @param dimension Floats per row.
+ * @param distances Output array of length rowCount.
+ */
+void ssdDistanceBatch(
+    const float *query,
+    const float *rows,
+    size_t rowCount,
+    size_t dimension,
+    float *distances);
+
+/**
+ * Compute histogram intersection distance between one query and each row.
+ *
+ * @param query Query histogram of length dimension.
+ * @param rows First element of rowCount contiguous rows.
+ * @param rowCount Number of rows to score.
+ * @param dimension Floats per row.
+ * @param distances Output array of length rowCount (1 - similarity).
+ */
+void histogramIntersectionDistanceBatch(
+    const float *query,
+    const float *rows,
+    size_t rowCount,
+    size_t dimension,
+    float *distances);
+
+/**
+ * Compute cosine distance between one query and each row.
+ * The query norm is computed once for the whole block.
+ *
+ * @param query Query vector of length dimension.
+ * @param rows First element of rowCount contiguous rows.
+ * @param rowCount Number of rows to score.
+ * @param dimension Floats per row.
+ * @param distances Output array of length rowCount (1.0 for zero-norm rows).
+ */
+void cosineDistanceBatch(
+    const float *query,
+    const float *rows,
+    size_t rowCount,
+    size_t dimension,
+    float *distances);
 
 #endif
@@ -5,6 +5,7 @@ Authors - Joseph Defendre, Sourav Das
 Declarations for feature extraction routines.
 Covers baseline patch, RGB/RG histograms, and Sobel texture features.
 Supports multi-region and custom sunset descriptors.
+A fused extractor produces several descriptors from one pixel walk.
 Used by the CLI and GUI to build feature vectors.
 */
 #ifndef FEATURE_EXTRACTION_H
@@ -13,6 +14,44 @@ Used by the CLI and GUI to build feature vectors.
 #include <opencv2/opencv.hpp>
 #include <vector>
 
+/**
+ * Descriptors to compute in one pass over the pixels (0 / empty = skip).
+ */
+struct DescriptorRequest {
+    int rgbBins = 0;
+    int rgBins = 0;
+    // Horizontal region splits, each producing concatenated RGB histograms.
+    std::vector<int> regionCounts;
+    int regionBins = 8;
+    int sobelBins = 0;
+};
+
+/**
+ * Normalized descriptors produced by extractDescriptors.
+ * regions[i] corresponds to request.regionCounts[i].
+ */
+struct DescriptorSet {
+    std::vector<float> rgb;
+    std::vector<float> rgChromaticity;
+    std::vector<std::vector<float>> regions;
+    std::vector<float> sobel;
+};
+
+/**
+ * Compute every requested descriptor from a single walk over the pixels.
+ *
+ * Each pixel is read once: its RGB bin is counted into the horizontal band
+ * it falls in (bands are the union of all region boundaries, so whole-image
+ * and per-region histograms are sums of band counts), its r-g chromaticity
+ * bin is counted, and its gray value is written for the Sobel pass. Results
+ * match the single-descriptor extractors below.
+ *
+ * @param image Input BGR image (CV_8UC3).
+ * @param request Descriptors and bin settings to compute.
+ * @return Requested descriptors (unrequested members are empty).
+ */
+DescriptorSet extractDescriptors(const cv::Mat &image, const DescriptorRequest &request);
+
 /**
  * Extract a flattened center patch in BGR order (uint8 -> float).
  *
@@ -0,0 +1,115 @@
+/*
+Authors - Joseph Defendre, Sourav Das
+
+
+Declarations for the offline feature index.
+Precomputes classic features for a database directory once.
+Persists them as a binary feature store (or CSV) so queries skip decoding.
+Rebuilds incrementally from per-file size and mtime recorded in the store.
+Folds byte-identical images into one row so each is extracted once.
+Used by the `cbir index` subcommand and the `--index` query option.
+*/
+#ifndef FEATURE_INDEX_H
+#define FEATURE_INDEX_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * Check whether an index path selects the CSV format.
+ *
+ * @param path Index path.
+ * @return True if the path ends in ".csv".
+ */
+bool isCsvIndexPath(const std::string &path);
+
+/**
+ * Default index location for a database directory and feature type.
+ *
+ * @param databaseDir Directory holding the database images.
+ * @param featureType Classic feature type name.
+ * @return Path of the form <databaseDir>/<featureType>.features.bin.
+ */
+std::string defaultIndexPath(const std::string &databaseDir, const std::string &featureType);
+
+/**
+ * Settings shared by every index build.
+ */
+struct IndexBuildOptions {
+    // Worker threads used for decoding and extraction.
+    int threadCount = 1;
+    // Requested downscale factor (capped per type by decodeScaleFor).
+    int decodeScale = 1;
+    // Reuse rows of an existing store whose source file and settings are unchanged.
+    bool incremental = true;
+    // Hash file contents and extract byte-identical images once (off with --no-dedup).
+    bool deduplicate = true;
+};
+
+/**
+ * Outcome of building one index.
+ */
+struct IndexBuildStats {
+    // Rows in the written index (images currently in the directory).
+    size_t images = 0;
+    // Images decoded and extracted in this build.
+    size_t extracted = 0;
+    // Images whose features were copied from the previous store.
+    size_t reused = 0;
+    // Images sharing the features of a byte-identical image listed before them.
+    size_t duplicates = 0;
+    // Previously indexed images that no longer exist.
+    size_t removed = 0;
+};
+
+/**
+ * Extract features for every image in the directory and persist them.
+ *
+ * Paths ending in ".csv" are written as a features CSV; anything else is
+ * written as a binary feature store. Stores record the decode scale and each
+ * source file's size and mtime. When options.incremental is set and the
+ * existing store was built with the same settings, only images that are new
+ * or whose size/mtime changed are decoded; rows of deleted images are dropped.
+ * CSV indexes record neither and are always rebuilt in full.
+ *
+ * With options.deduplicate, every image not reused is hashed, and images whose
+ * bytes match an image listed before them share its features instead of being
+ * decoded. Stores keep one row per distinct image, named after its first
+ * copy, with the other copies recorded as that row's duplicates; CSV indexes
+ * still write a row per image.
+ *
+ * @param databaseDir Directory holding the database images.
+ * @param featureType Classic feature type name.
+ * @param outputPath Destination index path.
+ * @param options Threads, decode scale and incremental mode.
+ * @return Row counts of the written index.
+ * @throws std::runtime_error if the feature type is unknown, an image cannot be
+ *         loaded, or the output cannot be written.
+ */
+IndexBuildStats buildFeatureIndex(
+    const std::string &databaseDir,
+    const std::string &featureType,
+    const std::string &outputPath,
+    const IndexBuildOptions &options = {});
+
+/**
+ * Index several feature types with one decode and one fused pixel walk per image.
+ * Types that need different decode scales share one decode per distinct scale,
+ * and an image is decoded only if some type cannot reuse its stored row.
+ *
+ * @param databaseDir Directory holding the database images.
+ * @param featureTypes Classic feature type names.
+ * @param outputPaths Destination index path for each feature type.
+ * @param options Threads, decode scale and incremental mode.
+ * @return Row counts for each index, in feature type order.
+ * @throws std::runtime_error if a feature type is unknown, the path count does
+ *         not match, an image cannot be loaded, or an output cannot be written.
+ */
+std::vector<IndexBuildStats> buildFeatureIndexes(
+    const std::string &databaseDir,
+    const std::vector<std::string> &featureTypes,
+    const std::vector<std::string> &outputPaths,
+    const IndexBuildOptions &options = {});
+
+#endif
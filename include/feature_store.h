@@ -0,0 +1,219 @@
+/*
+Authors - Joseph Defendre, Sourav Das
+
+
+Declarations for the binary feature store.
+Stores fixed-stride float32 rows plus a filename string table.
+Opened with mmap so rows are read in place and shared across processes.
+Replaces CSV parsing for indexes and packed embeddings.
+Optionally records source file stamps for incremental rebuilds.
+Optionally carries a small coarse descriptor per row for cascade pruning.
+Optionally folds byte-identical source files into one row with a duplicate list.
+*/
+#ifndef FEATURE_STORE_H
+#define FEATURE_STORE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/**
+ * Descriptor settings recorded in the store header.
+ * Queries compare these against the current feature type to reject stale stores.
+ */
+struct FeatureStoreInfo {
+    std::string featureType;
+    int binsPerChannel = 0;
+    int regionCount = 0;
+    // Images were decoded at 1/decodeScale resolution (1 = full size).
+    int decodeScale = 1;
+};
+
+/**
+ * Modification stamp of a source file, used to detect changed inputs.
+ * modified counts filesystem clock ticks so it can be stored on disk.
+ */
+struct FileStamp {
+    int64_t modified = 0;
+    uint64_t size = 0;
+
+    bool operator==(const FileStamp &other) const {
+        return modified == other.modified && size == other.size;
+    }
+    bool operator!=(const FileStamp &other) const { return !(*this == other); }
+};
+
+/**
+ * A byte-identical copy of a row's source image, stored with that row.
+ */
+struct DuplicateFile {
+    std::string filename;
+    FileStamp stamp;
+};
+
+/**
+ * Read the modification stamp of a file or directory.
+ *
+ * Missing paths get an empty stamp; the loader then reports the real error.
+ *
+ * @param path File or directory path.
+ * @return Stamp (mtime, and size for regular files).
+ */
+FileStamp fileStampOf(const std::string &path);
+
+/**
+ * Read-only, memory-mapped view of a binary feature store.
+ *
+ * Rows form one contiguous row-major float32 matrix; filenames are
+ * string views into the mapping. The object owns the mapping and is move-only.
+ */
+class FeatureStore {
+public:
+    /**
+     * Map a store file and validate its header.
+     *
+     * @param path Store file path.
+     * @throws std::runtime_error if the file cannot be mapped or is malformed.
+     */
+    explicit FeatureStore(const std::string &path);
+    ~FeatureStore();
+
+    FeatureStore(FeatureStore &&other) noexcept;
+    FeatureStore &operator=(FeatureStore &&other) noexcept;
+    FeatureStore(const FeatureStore &) = delete;
+    FeatureStore &operator=(const FeatureStore &) = delete;
+
+    /** @return Descriptor settings recorded when the store was written. */
+    const FeatureStoreInfo &info() const { return info_; }
+
+    /** @return Number of stored rows. */
+    size_t rowCount() const { return rowCount_; }
+
+    /** @return Number of floats per row. */
+    size_t dimension() const { return dimension_; }
+
+    /** @return Pointer to the first element of the feature matrix. */
+    const float *data() const { return matrix_; }
+
+    /**
+     * @param index Row index in [0, rowCount()).
+     * @return Pointer to the row's dimension() floats.
+     */
+    const float *row(size_t index) const { return matrix_ + index * dimension_; }
+
+    /**
+     * @param index Row index in [0, rowCount()).
+     * @return Filename stored for the row.
+     */
+    std::string_view filename(size_t index) const;
+
+    /** @return True if the store records a source file stamp per row. */
+    bool hasStamps() const { return stamps_ != nullptr; }
+
+    /**
+     * @param index Row index in [0, rowCount()); requires hasStamps().
+     * @return Stamp of the source file when the row was extracted.
+     */
+    FileStamp stamp(size_t index) const;
+
+    /** @return True if the store carries a coarse descriptor per row. */
+    bool hasCoarse() const { return coarse_ != nullptr; }
+
+    /** @return Floats per coarse descriptor (0 without a coarse section). */
+    size_t coarseDimension() const { return coarseDimension_; }
+
+    /** @return First element of the row-major coarse matrix; requires hasCoarse(). */
+    const float *coarseData() const { return coarse_; }
+
+    /** @return True if the store records a content hash per row (built with deduplication). */
+    bool hasContentHashes() const { return hashes_ != nullptr; }
+
+    /**
+     * @param index Row index in [0, rowCount()); requires hasContentHashes().
+     * @return Hash of the source file's bytes.
+     */
+    uint64_t contentHash(size_t index) const;
+
+    /** @return True if the store records byte-identical copies folded into its rows. */
+    bool hasDuplicates() const { return firstDuplicate_ != nullptr; }
+
+    /**
+     * Duplicates of a row's source file occupy [first, second) of the store's
+     * duplicate list, in filename order. Stores without duplicates return an
+     * empty range for every row.
+     *
+     * @param index Row index in [0, rowCount()).
+     * @return Range of duplicate numbers.
+     */
+    std::pair<size_t, size_t> duplicateRange(size_t index) const;
+
+    /**
+     * @param duplicate Duplicate number from duplicateRange().
+     * @return Filename of the copy.
+     */
+    std::string_view duplicateName(size_t duplicate) const;
+
+    /**
+     * @param duplicate Duplicate number from duplicateRange().
+     * @return Stamp of the copy when the store was written.
+     */
+    FileStamp duplicateStamp(size_t duplicate) const;
+
+private:
+    void release();
+
+    void *mapping_ = nullptr;
+    size_t mappingSize_ = 0;
+    FeatureStoreInfo info_;
+    size_t rowCount_ = 0;
+    size_t dimension_ = 0;
+    const float *matrix_ = nullptr;
+    const uint64_t *nameOffsets_ = nullptr;
+    const char *names_ = nullptr;
+    const char *stamps_ = nullptr;
+    const float *coarse_ = nullptr;
+    size_t coarseDimension_ = 0;
+    const char *hashes_ = nullptr;
+    const uint64_t *firstDuplicate_ = nullptr;
+    const char *duplicateStamps_ = nullptr;
+    const uint64_t *duplicateNameOffsets_ = nullptr;
+    const char *duplicateNames_ = nullptr;
+};
+
+/**
+ * Check whether a file starts with the feature store magic.
+ *
+ * @param path File path.
+ * @return True if the file looks like a binary feature store.
+ */
+bool isFeatureStoreFile(const std::string &path);
+
+/**
+ * Write (filename, feature vector) rows as a binary feature store.
+ *
+ * The store is written next to outputPath and renamed over it, so processes
+ * that still map the previous store keep reading consistent data.
+ *
+ * @param outputPath Destination store path.
+ * @param info Descriptor settings to record in the header.
+ * @param features Filename/feature pairs; all vectors must share one size.
+ * @param stamps Source file stamp per row, or empty to record none.
+ * @param coarse Coarse descriptor per row (see coarseFeature), or empty.
+ * @param contentHashes Source file content hash per row, or empty to record none.
+ * @param duplicates Byte-identical copies folded into each row, or empty.
+ * @throws std::runtime_error if rows differ in size, the stamp, coarse, hash
+ *         or duplicate count does not match, or the file cannot be written.
+ */
+void writeFeatureStore(
+    const std::string &outputPath,
+    const FeatureStoreInfo &info,
+    const std::vector<std::pair<std::string, std::vector<float>>> &features,
+    const std::vector<FileStamp> &stamps = {},
+    const std::vector<std::vector<float>> &coarse = {},
+    const std::vector<uint64_t> &contentHashes = {},
+    const std::vector<std::vector<DuplicateFile>> &duplicates = {});
+
+#endif
@@ -0,0 +1,219 @@
+/*
+Authors - Joseph Defendre, Sourav Das
+
+
+Declarations for the feature type registry used by the CLI.
+Maps feature type names to their extractor and distance function.
+Keeps live scans and stored feature indexes on the same definitions.
+Classic descriptors only; DNN embeddings are read from CSV instead.
+Coarse descriptors and bounded distances let scans prune hopeless candidates.
+*/
+#ifndef FEATURE_TYPES_H
+#define FEATURE_TYPES_H
+
+#include "distance_metrics.h"
+#include "feature_store.h"
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+/**
+ * Names of the classic (pixel-derived) feature types.
+ *
+ * @return baseline, histogram_rg, histogram_rgb, multi_histogram,
+ *         texture_color and custom_sunset.
+ */
+const std::vector<std::string> &classicFeatureTypes();
+
+/**
+ * Check whether the name is a classic (pixel-derived) feature type.
+ *
+ * @param featureType Feature type name from the command line.
+ * @return True for baseline, histogram_rg, histogram_rgb, multi_histogram,
+ *         texture_color and custom_sunset.
+ */
+bool isClassicFeatureType(const std::string &featureType);
+
+/**
+ * Descriptor settings for a feature type, as recorded in feature stores.
+ *
+ * @param featureType Classic feature type name or "dnn".
+ * @return Feature type name with its bins-per-channel and region count
+ *         (zero where a setting does not apply).
+ * @throws std::runtime_error if the feature type is unknown.
+ */
+FeatureStoreInfo featureTypeInfo(const std::string &featureType);
+
+/**
+ * Decode scale to use for a feature type under a requested budget.
+ *
+ * Normalized histograms barely change when the image is downscaled, so they
+ * take the requested scale. The baseline center patch samples raw pixels at a
+ * fixed size and is always decoded at full resolution.
+ *
+ * @param featureType Classic feature type name.
+ * @param requested Requested downscale factor (1 = full resolution).
+ * @return Downscale factor to decode with.
+ */
+int decodeScaleFor(const std::string &featureType, int requested);
+
+/**
+ * Extract the feature vector for a classic feature type.
+ *
+ * texture_color is stored as the RGB histogram followed by the Sobel
+ * magnitude histogram in one vector.
+ *
+ * @param featureType Classic feature type name.
+ * @param image Input BGR image (CV_8UC3).
+ * @return Feature vector for the image.
+ * @throws std::runtime_error if the feature type is unknown.
+ */
+std::vector<float> computeFeature(const std::string &featureType, const cv::Mat &image);
+
+/**
+ * Extract several classic feature types from one pass over the pixels.
+ *
+ * The RGB, chromaticity, per-region and Sobel descriptors the types need are
+ * gathered into one fused extraction, so indexing every type costs about one
+ * decode and one pixel walk. Each vector equals computeFeature for its type.
+ *
+ * @param featureTypes Classic feature type names.
+ * @param image Input BGR image (CV_8UC3).
+ * @return One feature vector per requested type, in order.
+ * @throws std::runtime_error if a feature type is unknown.
+ */
+std::vector<std::vector<float>> computeFeatures(
+    const std::vector<std::string> &featureTypes,
+    const cv::Mat &image);
+
+/**
+ * Compare two feature vectors produced by computeFeature.
+ * Views may point into feature store rows; nothing is copied.
+ *
+ * @param featureType Classic feature type name.
+ * @param target Feature vector of the query image.
+ * @param candidate Feature vector of the database image.
+ * @return Distance (smaller is more similar).
+ * @throws std::runtime_error if the feature type is unknown or sizes mismatch.
+ */
+float featureDistance(
+    const std::string &featureType,
+    FloatView target,
+    FloatView candidate);
+
+/**
+ * Check that every histogram part of a feature is normalized or empty.
+ *
+ * Intersection distance (1 - overlap) obeys the triangle inequality between
+ * such histograms: an empty part (a flat image's Sobel histogram) is at
+ * distance 1 from everything, itself included. Partial masses break it.
+ *
+ * @param featureType Classic histogram feature type name.
+ * @param feature Feature vector from computeFeature.
+ * @return True if each part sums to 1 or is all zero.
+ */
+bool hasMetricHistograms(const std::string &featureType, FloatView feature);
+
+/**
+ * Score a target feature against a block of stored rows.
+ *
+ * @param featureType Classic feature type name.
+ * @param target Feature vector of the query image.
+ * @param rows First element of rowCount contiguous rows of target.size floats.
+ * @param rowCount Number of rows to score.
+ * @param distances Output array of length rowCount.
+ * @throws std::runtime_error if the feature type is unknown.
+ */
+void featureDistanceBatch(
+    const std::string &featureType,
+    FloatView target,
+    const float *rows,
+    size_t rowCount,
+    float *distances);
+
+/**
+ * Size of the coarse descriptor kept alongside a full feature vector.
+ *
+ * The coarse descriptor pools the full histogram into a few wide bins
+ * (2x2 rg chromaticity, 2x2x2 RGB, 4 Sobel bins) or sums baseline patch rows,
+ * so that its distance is a lower bound on the full distance.
+ *
+ * @param featureType Classic feature type name.
+ * @return Floats per coarse descriptor, or 0 if the type has none.
+ */
+size_t coarseFeatureSize(const std::string &featureType);
+
+/**
+ * Pool a full feature vector into its coarse descriptor.
+ *
+ * @param featureType Classic feature type name.
+ * @param feature Full feature vector from computeFeature.
+ * @return Coarse descriptor of coarseFeatureSize(featureType) floats.
+ * @throws std::runtime_error if the type has no coarse descriptor or the
+ *         feature has the wrong size.
+ */
+std::vector<float> coarseFeature(const std::string &featureType, FloatView feature);
+
+/**
+ * Coarse descriptors for every row written to a feature store.
+ *
+ * @param featureType Feature type of the rows.
+ * @param features Filename/feature pairs.
+ * @return One coarse descriptor per row, or empty if the type has none.
+ * @throws std::runtime_error if a row has the wrong size.
+ */
+std::vector<std::vector<float>> coarseFeatureRows(
+    const std::string &featureType,
+    const std::vector<std::pair<std::string, std::vector<float>>> &features);
+
+/**
+ * Distance between coarse descriptors; never exceeds featureDistance of the
+ * full vectors they were pooled from.
+ *
+ * @param featureType Classic feature type name.
+ * @param target Coarse descriptor of the query image.
+ * @param candidate Coarse descriptor of the database image.
+ * @return Lower bound on the full distance.
+ */
+float coarseFeatureDistance(
+    const std::string &featureType,
+    FloatView target,
+    FloatView candidate);
+
+/**
+ * Query-side data for featureDistanceBounded, prepared once per query.
+ */
+struct BoundedTarget {
+    FloatView feature;
+    // histogramTailMass of the (color) histogram, where the type uses one.
+    std::vector<float> tailMass;
+};
+
+/**
+ * Prepare a query feature for bounded scoring.
+ *
+ * @param featureType Classic feature type name.
+ * @param target Query feature vector (must outlive the result).
+ * @return Bounded query state.
+ */
+BoundedTarget boundedTarget(const std::string &featureType, FloatView target);
+
+/**
+ * Compare two feature vectors, abandoning once the distance must exceed bound.
+ *
+ * @param featureType Classic feature type name.
+ * @param target Query prepared by boundedTarget.
+ * @param candidate Feature vector of the database image.
+ * @param bound Distance the candidate must not exceed to be useful.
+ * @return featureDistance(target, candidate) when it is at most bound,
+ *         otherwise a value greater than bound.
+ * @throws std::runtime_error if the feature type is unknown or sizes mismatch.
+ */
+float featureDistanceBounded(
+    const std::string &featureType,
+    const BoundedTarget &target,
+    FloatView candidate,
+    float bound);
+
+#endif
@@ -0,0 +1,150 @@
+/*
+Authors - Joseph Defendre, Sourav Das
+
+
+Declarations for the recursive image file walker.
+Walks nested directories on a pool of threads with readdir and d_type.
+Matches image extensions in place, without copying or lowercasing names.
+Streams paths to a consumer as they are found, or lists them sorted.
+Records each directory's stamp so resident listings notice nested changes.
+*/
+#ifndef FILE_WALKER_H
+#define FILE_WALKER_H
+
+#include "feature_store.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/**
+ * Check whether a filename has a supported image extension (case-insensitive).
+ *
+ * @param filename Filename or path.
+ * @return True for .jpg, .jpeg, .png and .bmp.
+ */
+bool hasImageExtension(std::string_view filename);
+
+/**
+ * Visit every image file below a directory, recursing into subdirectories.
+ *
+ * Up to threadCount threads read directories concurrently; onImage calls are
+ * serialized, in no particular order. Symbolic links to files are followed,
+ * links to directories are not (so cycles cannot occur). Subdirectories that
+ * cannot be opened are skipped.
+ *
+ * @param root Directory to walk.
+ * @param threadCount Directory reader threads (1 walks on the calling thread).
+ * @param onImage Receives each image path ("<dir>/<name>"); false stops the walk.
+ * @param onDirectory Optional; receives each directory walked, root included.
+ * @throws std::runtime_error if root is not a readable directory, or the
+ *         first exception thrown by a callback.
+ */
+void walkImageFiles(
+    const std::string &root,
+    int threadCount,
+    const std::function<bool(std::string &&)> &onImage,
+    const std::function<void(const std::string &)> &onDirectory = {});
+
+/**
+ * Image paths below a directory and the directories they came from.
+ */
+struct ImageListing {
+    // Sorted image paths.
+    std::vector<std::string> files;
+    // Every directory walked, root first.
+    std::vector<std::string> directories;
+};
+
+/**
+ * Walk a directory tree and sort the image paths.
+ *
+ * @param root Directory to walk.
+ * @param threadCount Directory reader threads.
+ * @return Sorted listing.
+ * @throws std::runtime_error if root is not a readable directory.
+ */
+ImageListing listImageTree(const std::string &root, int threadCount = 1);
+
+/**
+ * Combine the current stamps of a listing's directories into one stamp.
+ *
+ * A directory's mtime changes when entries are added, removed or renamed in
+ * it, so the combined stamp changes whenever the listing would.
+ *
+ * @param directories Directories recorded by listImageTree.
+ * @return Combined stamp (compare with == only).
+ */
+FileStamp directoryTreeStamp(const std::vector<std::string> &directories);
+
+/**
+ * Image paths handed out to scan workers while a background walk finds them.
+ *
+ * next() numbers paths in the order they were found. The walk runs on its
+ * own threads and never waits for consumers; it stops early on cancel() or
+ * destruction.
+ */
+class ImagePathStream {
+public:
+    /**
+     * Start walking a directory tree.
+     *
+     * @param root Directory to walk.
+     * @param threadCount Directory reader threads.
+     */
+    ImagePathStream(const std::string &root, int threadCount);
+    ~ImagePathStream();
+
+    ImagePathStream(const ImagePathStream &) = delete;
+    ImagePathStream &operator=(const ImagePathStream &) = delete;
+
+    /**
+     * Take the next path, waiting for the walk if none is pending.
+     *
+     * Safe to call from several threads.
+     *
+     * @param index Receives the path's number (0, 1, 2, ... in handout order).
+     * @param path Receives the path.
+     * @return False once the walk has finished and every path was taken, or
+     *         after cancel().
+     */
+    bool next(size_t &index, std::string &path);
+
+    /**
+     * @param index Number returned by next().
+     * @return That path.
+     */
+    std::string path(size_t index) const;
+
+    /** @return Paths found so far. */
+    size_t found() const;
+
+    /** Stop the walk and make next() return false. */
+    void cancel();
+
+    /**
+     * Wait for the walk to end and rethrow its error, if any.
+     *
+     * @throws std::runtime_error if the root could not be read.
+     */
+    void finish();
+
+private:
+    mutable std::mutex mutex_;
+    std::condition_variable available_;
+    std::deque<std::string> paths_;
+    size_t handedOut_ = 0;
+    bool done_ = false;
+    bool cancelled_ = false;
+    std::exception_ptr error_;
+    std::thread walker_;
+};
+
+#endif
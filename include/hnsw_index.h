@@ -0,0 +1,175 @@
+/*
+Authors - Joseph Defendre, Sourav Das
+
+
+Declarations for the HNSW approximate nearest-neighbour index.
+Builds a hierarchical navigable small-world graph over DNN embeddings.
+Supports cosine and SSD, persists to disk and answers top-K with tunable ef.
+Used by the `cbir hnsw` subcommand and dnn queries on large embedding sets.
+*/
+#ifndef HNSW_INDEX_H
+#define HNSW_INDEX_H
+
+#include "distance_kernels.h"
+#include "distance_metrics.h"
+#include "top_k.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Graph construction settings.
+ */
+struct HnswParams {
+    // Links per node on the upper layers; layer 0 keeps up to 2 * m.
+    size_t m = 16;
+    // Candidate list size while inserting (larger = better graph, slower build).
+    size_t efConstruction = 200;
+    // Seed for the layer assignment; links are reproducible only for one-thread builds.
+    uint32_t seed = 42;
+};
+
+/**
+ * In-memory HNSW graph with its vectors and filenames.
+ *
+ * Cosine indexes store unit-length vectors and score 1 - dot, which equals
+ * cosineDistance on the original vectors. search() is const and may run
+ * concurrently from several threads.
+ */
+class HnswIndex {
+public:
+    // Returned by findRow when a filename is not indexed.
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    /**
+     * Load an index written by save().
+     *
+     * @param path Index file path.
+     * @throws std::runtime_error if the file cannot be read or is malformed.
+     */
+    explicit HnswIndex(const std::string &path);
+
+    HnswIndex(HnswIndex &&) noexcept = default;
+    HnswIndex &operator=(HnswIndex &&) noexcept = default;
+    HnswIndex(const HnswIndex &) = delete;
+    HnswIndex &operator=(const HnswIndex &) = delete;
+
+    /**
+     * Build a graph over row-major vectors.
+     *
+     * @param metric "cosine" or "ssd".
+     * @param rows First element of rowCount * dimension floats.
+     * @param rowCount Number of vectors.
+     * @param dimension Floats per vector.
+     * @param filenames Filename per vector (used to resolve results).
+     * @param params Construction settings.
+     * @param threadCount Worker threads inserting nodes concurrently (1 for a reproducible graph).
+     * @return Built index.
+     * @throws std::runtime_error on an unknown metric, bad settings or a name count mismatch.
+     */
+    static HnswIndex build(
+        const std::string &metric,
+        const float *rows,
+        size_t rowCount,
+        size_t dimension,
+        std::vector<std::string> filenames,
+        const HnswParams &params,
+        int threadCount = 1);
+
+    /**
+     * Write the graph, vectors and filenames to disk.
+     *
+     * @param path Destination file path.
+     * @throws std::runtime_error if the file cannot be written.
+     */
+    void save(const std::string &path) const;
+
+    /**
+     * Approximate k nearest neighbours of a query vector.
+     *
+     * @param query Query vector of dimension() floats (not yet normalized).
+     * @param k Number of results.
+     * @param ef Search candidate list size (raised to k if smaller); larger
+     *           values trade latency for recall.
+     * @return Up to k candidates (index = row), nearest first, ties by lower row.
+     * @throws std::runtime_error if the query size does not match.
+     */
+    std::vector<ScoredCandidate> search(FloatView query, size_t k, size_t ef) const;
+
+    /** @return "cosine" or "ssd". */
+    const std::string &metric() const { return metric_; }
+
+    /** @return Construction settings the graph was built with. */
+    const HnswParams &params() const { return params_; }
+
+    /** @return Number of indexed vectors. */
+    size_t size() const { return filenames_.size(); }
+
+    /** @return Floats per vector. */
+    size_t dimension() const { return dimension_; }
+
+    /**
+     * @param index Row index in [0, size()).
+     * @return Stored vector (unit length for cosine indexes).
+     */
+    FloatView row(size_t index) const { return FloatView(data_.data() + index * dimension_, dimension_); }
+
+    /**
+     * @param index Row index in [0, size()).
+     * @return Filename recorded for the row.
+     */
+    const std::string &filename(size_t index) const { return filenames_[index]; }
+
+    /**
+     * @param name Filename to look up.
+     * @return Row holding the filename, or npos.
+     */
+    size_t findRow(const std::string &name) const;
+
+private:
+    HnswIndex() = default;
+
+    float distance(const float *a, const float *b) const;
+    const uint32_t *links(uint32_t node, int level) const;
+    uint32_t *links(uint32_t node, int level);
+    size_t linkCapacity(int level) const { return level == 0 ? 2 * params_.m : params_.m; }
+    uint32_t greedyClosest(const float *query, uint32_t entry, int fromLevel, int toLevel, bool locked) const;
+    std::vector<ScoredCandidate> searchLayer(
+        const float *query, uint32_t entry, size_t ef, int level, bool locked) const;
+    std::vector<uint32_t> selectNeighbours(std::vector<ScoredCandidate> candidates, size_t limit) const;
+    void insert(uint32_t node);
+    void indexFilenames();
+
+    std::string metric_;
+    bool cosine_ = false;
+    HnswParams params_;
+    size_t dimension_ = 0;
+    const DistanceKernels *kernels_ = nullptr;
+    std::vector<float> data_;
+    std::vector<std::string> filenames_;
+    std::unordered_map<std::string, size_t> rowByName_;
+    std::vector<int32_t> levels_;
+    // Layer 0: per node [count, id * 2m]; upper layers: per node, level blocks of [count, id * m].
+    std::vector<uint32_t> layer0_;
+    std::vector<std::vector<uint32_t>> upperLayers_;
+    uint32_t entryPoint_ = 0;
+    int32_t maxLevel_ = -1;
+    // Only used while building: one lock per node plus one for the entry point.
+    std::unique_ptr<std::mutex[]> nodeLocks_;
+    std::unique_ptr<std::mutex> entryLock_;
+};
+
+/**
+ * Check whether a file starts with the HNSW index magic.
+ *
+ * @param path File path.
+ * @return True if the file looks like an HNSW index.
+ */
+bool isHnswIndexFile(const std::string &path);
+
+#endif
@@ -3,65 +3,128 @@ Authors - Joseph Defendre, Sourav Das
 
 
 Declarations for image I/O and CSV helper utilities.
-Lists image files in a directory by common extensions.
+Lists image files under a directory tree by common extensions.
 Loads images with OpenCV and reads/writes feature CSVs.
-Provides an embeddings CSV reader keyed by filename.
+Parses CSVs in parallel from a memory map into one contiguous matrix.
 */
 #ifndef IMAGE_IO_H
 #define IMAGE_IO_H
 
 #include <opencv2/opencv.hpp>
 #include <string>
-#include <unordered_map>
 #include <utility>
 #include <vector>
 
+/**
+ * Row-major float32 matrix with one filename per row.
+ * Used for live image features and for parsed feature/embedding CSVs.
+ */
+struct FeatureMatrix {
+    std::vector<std::string> filenames;
+    std::vector<float> rows;
+    size_t dimension = 0;
+    // L2 norm of each row (filled by readFeatureMatrixCsv, empty otherwise).
+    std::vector<float> norms;
+};
+
 /**
  * Return a sorted list of image file paths under the directory.
  *
+ * Subdirectories are searched too (see walkImageFiles). Sorting makes the
+ * order, and so tie-breaking between equal distances, repeatable.
+ *
  * @param directoryPath Directory to scan for images.
+ * @param threadCount Directory reader threads.
  * @return Sorted vector of image file paths.
+ * @throws std::runtime_error if the directory cannot be read.
  */
-std::vector<std::string> listImageFiles(const std::string &directoryPath);
+std::vector<std::string> listImageFiles(const std::string &directoryPath, int threadCount = 1);
+
+/**
+ * Check a decode scale (1 = full resolution, or 2, 4, 8).
+ *
+ * @param decodeScale Requested downscale factor.
+ * @return True if OpenCV has a reduced decode mode for it.
+ */
+bool isValidDecodeScale(int decodeScale);
 
 /**
  * Load an image from disk and throw on failure.
  *
+ * Scales above 1 use OpenCV's IMREAD_REDUCED_COLOR_* modes, which let the
+ * JPEG decoder skip DCT work instead of shrinking a full-size image.
+ *
  * @param imagePath Path to the image file.
+ * @param decodeScale Downscale factor (1, 2, 4 or 8).
  * @return Loaded BGR image (CV_8UC3).
- * @throws std::runtime_error if the image cannot be loaded.
+ * @throws std::runtime_error if the image cannot be loaded or the scale is invalid.
+ */
+cv::Mat loadImageOrThrow(const std::string &imagePath, int decodeScale = 1);
+
+/**
+ * Read a file's raw bytes (e.g. compressed JPEG data) into memory.
+ *
+ * @param path File path.
+ * @return File contents.
+ * @throws std::runtime_error if the file cannot be read.
  */
-cv::Mat loadImageOrThrow(const std::string &imagePath);
+std::vector<uchar> readFileBytes(const std::string &path);
+
+/**
+ * Decode in-memory image bytes and throw on failure.
+ *
+ * @param bytes Encoded image data.
+ * @param imagePath Source path (for error messages).
+ * @param decodeScale Downscale factor (1, 2, 4 or 8).
+ * @return Decoded BGR image (CV_8UC3).
+ * @throws std::runtime_error if decoding fails or the scale is invalid.
+ */
+cv::Mat decodeImageOrThrow(
+    const std::vector<uchar> &bytes,
+    const std::string &imagePath,
+    int decodeScale = 1);
 
 /**
  * Write (filename, feature vector) pairs to a CSV file.
  *
+ * Values are formatted with std::to_chars (shortest text that reads back to
+ * the same float), in parallel chunks of rows written in order.
+ *
  * @param outputPath Destination CSV path.
  * @param features Vector of filename/feature pairs.
- * @return True on success, false if the file cannot be opened.
+ * @param threadCount Worker threads used for formatting.
+ * @return True on success, false if the file cannot be opened or written.
  */
 bool writeFeaturesCsv(
     const std::string &outputPath,
-    const std::vector<std::pair<std::string, std::vector<float>>> &features);
+    const std::vector<std::pair<std::string, std::vector<float>>> &features,
+    int threadCount = 1);
 
 /**
- * Read (filename, feature vector) pairs from a CSV file.
+ * Parse a features or embeddings CSV (filename, then one value per cell).
+ *
+ * The file is memory-mapped and split into line-aligned chunks. Workers count
+ * the rows of their chunks, then parse them with std::from_chars straight into
+ * their slots of the result. Empty cells read as 0 and blank lines are skipped.
  *
  * @param inputPath Source CSV path.
- * @return Vector of filename/feature pairs.
- * @throws std::runtime_error if the file cannot be opened.
+ * @param threadCount Worker threads used for parsing.
+ * @return Rows in file order, with their L2 norms.
+ * @throws std::runtime_error if the file cannot be read, a cell is not a
+ *         number, or rows have different numbers of values.
  */
-std::vector<std::pair<std::string, std::vector<float>>> readFeaturesCsv(
-    const std::string &inputPath);
+FeatureMatrix readFeatureMatrixCsv(const std::string &inputPath, int threadCount = 1);
 
 /**
- * Read an embeddings CSV into a map keyed by filename.
+ * Read (filename, feature vector) pairs from a CSV file.
  *
  * @param inputPath Source CSV path.
- * @return Map of filename to embedding vector.
- * @throws std::runtime_error if the file cannot be opened.
+ * @param threadCount Worker threads used for parsing.
+ * @return Vector of filename/feature pairs.
+ * @throws std::runtime_error as readFeatureMatrixCsv.
  */
-std::unordered_map<std::string, std::vector<float>> readEmbeddingsCsv(
-    const std::string &inputPath);
+std::vector<std::pair<std::string, std::vector<float>>> readFeaturesCsv(
+    const std::string &inputPath,
+    int threadCount = 1);
 
 #endif
@@ -0,0 +1,63 @@
+/*
+Authors - Joseph Defendre, Sourav Das
+
+
+Declarations for the CLI worker pool helper.
+Runs an index-based loop body across a fixed number of threads.
+Callers write results by index so output order never depends on scheduling.
+Used by database scans and the offline index builder.
+A worker-slot variant lets scans keep lock-free per-thread state.
+*/
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <cstddef>
+#include <functional>
+
+/**
+ * Resolve a requested thread count (values <= 0 mean "all hardware threads").
+ *
+ * @param requested Thread count from the command line.
+ * @return Thread count >= 1.
+ */
+int resolveThreadCount(int requested);
+
+/**
+ * Call body(index) for every index in [0, count) using up to threadCount threads.
+ *
+ * Indices are handed out in small chunks from a shared counter so slow images
+ * do not stall a whole partition. The first exception thrown by any worker is
+ * rethrown on the calling thread after all workers stop.
+ *
+ * @param count Number of loop iterations.
+ * @param threadCount Number of worker threads (1 runs inline).
+ * @param body Loop body; must be safe to call concurrently for distinct indices.
+ */
+void parallelFor(size_t count, int threadCount, const std::function<void(size_t)> &body);
+
+/**
+ * Number of workers parallelFor/parallelForWorkers will use for a loop.
+ *
+ * @param count Number of loop iterations.
+ * @param threadCount Requested worker threads.
+ * @return Worker count in [1, max(count, 1)].
+ */
+size_t parallelWorkerCount(size_t count, int threadCount);
+
+/**
+ * Like parallelFor, but also passes the worker slot running each index.
+ *
+ * Slots are in [0, parallelWorkerCount(count, threadCount)) and each slot is
+ * owned by one thread, so callers can keep per-worker state (e.g. partial
+ * top-K heaps) without locking and merge it after the loop.
+ *
+ * @param count Number of loop iterations.
+ * @param threadCount Number of worker threads (1 runs inline).
+ * @param body Loop body called as body(index, worker).
+ */
+void parallelForWorkers(
+    size_t count,
+    int threadCount,
+    const std::function<void(size_t, size_t)> &body);
+
+#endif
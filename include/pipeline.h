@@ -0,0 +1,120 @@
+/*
+Authors - Joseph Defendre, Sourav Das
+
+
+Declarations for the staged image scan pipeline.
+Separates file reads, JPEG decoding, extraction and scoring into stages.
+Stages are joined by bounded queues so memory stays flat under backpressure.
+Reports per-stage utilization and queue occupancy for tuning.
+*/
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <opencv2/opencv.hpp>
+#include <cstddef>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * Thread counts per stage, queue capacity between stages and decode scale.
+ */
+struct PipelineOptions {
+    int readerThreads = 1;
+    int decoderThreads = 1;
+    int extractorThreads = 1;
+    size_t queueCapacity = 16;
+    // Decoders produce images at 1/decodeScale resolution.
+    int decodeScale = 1;
+};
+
+/**
+ * Work and wait time accumulated by one stage across its threads.
+ */
+struct PipelineStageStats {
+    std::string name;
+    int threads = 0;
+    size_t items = 0;
+    double busySeconds = 0.0;
+    double waitSeconds = 0.0;
+};
+
+/**
+ * Occupancy of the queue feeding a stage.
+ */
+struct PipelineQueueStats {
+    std::string name;
+    size_t capacity = 0;
+    size_t maxDepth = 0;
+    double meanDepth = 0.0;
+    size_t fullWaits = 0;
+    size_t emptyWaits = 0;
+};
+
+/**
+ * Timing and occupancy collected during one pipeline run.
+ */
+struct PipelineStats {
+    double wallSeconds = 0.0;
+    std::vector<PipelineStageStats> stages;
+    std::vector<PipelineQueueStats> queues;
+};
+
+/**
+ * Parse a "readers,decoders,extractors" stage specification.
+ *
+ * @param spec Comma-separated thread counts, e.g. "2,4,8".
+ * @param options Options to update.
+ * @throws std::runtime_error if the spec is malformed or a count is < 1.
+ */
+void parsePipelineSpec(const std::string &spec, PipelineOptions &options);
+
+/**
+ * Read, decode and extract features for every file through staged workers.
+ *
+ * The consumer runs on a single scorer thread and receives each file's
+ * index together with its feature, in completion order. Returning false
+ * stops the scan: queued work is dropped and the stages wind down.
+ *
+ * @param files Image paths to process.
+ * @param options Stage thread counts and queue capacity.
+ * @param extract Feature extractor (called concurrently from extractor threads).
+ * @param consume Scorer callback (called from one thread only); false stops the scan.
+ * @return Per-stage timing and queue occupancy.
+ * @throws std::runtime_error (or the first stage exception) if any stage fails.
+ */
+PipelineStats runImagePipeline(
+    const std::vector<std::string> &files,
+    const PipelineOptions &options,
+    const std::function<std::vector<float>(const cv::Mat &)> &extract,
+    const std::function<bool(size_t, const std::vector<float> &)> &consume);
+
+/**
+ * Same as above, with readers pulling files from a source as they go.
+ *
+ * Lets the scan start while the file list is still being discovered.
+ *
+ * @param nextFile Called concurrently by reader threads; fills the file's
+ *        index and path, or returns false when there are no more files.
+ * @param options Stage thread counts and queue capacity.
+ * @param extract Feature extractor (called concurrently from extractor threads).
+ * @param consume Scorer callback (called from one thread only); false stops the scan.
+ * @return Per-stage timing and queue occupancy.
+ * @throws std::runtime_error (or the first stage exception) if any stage fails.
+ */
+PipelineStats runImagePipeline(
+    const std::function<bool(size_t &, std::string &)> &nextFile,
+    const PipelineOptions &options,
+    const std::function<std::vector<float>(const cv::Mat &)> &extract,
+    const std::function<bool(size_t, const std::vector<float> &)> &consume);
+
+/**
+ * Print a human-readable stage/queue occupancy table.
+ *
+ * @param stats Collected pipeline stats.
+ * @param out Destination stream (stderr in the CLI).
+ */
+void printPipelineStats(const PipelineStats &stats, std::ostream &out);
+
+#endif
@@ -0,0 +1,170 @@
+/*
+Authors - Joseph Defendre, Sourav Das
+
+
+Declarations for the product-quantized embedding index.
+Splits each embedding into subspaces and stores one byte code per subspace.
+Scores queries with asymmetric distance tables and re-ranks from full vectors.
+Used by the `cbir pq` subcommand and dnn queries that must fit in RAM.
+*/
+#ifndef PQ_INDEX_H
+#define PQ_INDEX_H
+
+#include "distance_metrics.h"
+#include "top_k.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Codebook training settings.
+ */
+struct PqParams {
+    // Byte codes per vector (0 = dimension / 4, a 16x reduction from float32).
+    size_t subspaces = 0;
+    // Lloyd iterations per subspace codebook.
+    size_t iterations = 15;
+    // Vectors sampled for training (all of them if there are fewer).
+    size_t trainingSamples = 16384;
+    uint32_t seed = 42;
+    // Also store the full vectors so top candidates can be re-ranked exactly.
+    bool keepVectors = true;
+};
+
+/**
+ * Read-only, memory-mapped product-quantized index.
+ *
+ * Each vector is split into subspaces() contiguous slices and every slice is
+ * replaced by the index of its nearest of 256 trained centroids. A query
+ * builds one 256-entry distance table per subspace, after which scoring a
+ * row is subspaces() table lookups. Cosine indexes quantize unit vectors and
+ * score 1 - dot. The optional full vectors live in the same mapping and are
+ * only paged in for the rows that get re-ranked.
+ */
+class PqIndex {
+public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    /**
+     * Map an index file and validate its header.
+     *
+     * @param path Index file path.
+     * @throws std::runtime_error if the file cannot be mapped or is malformed.
+     */
+    explicit PqIndex(const std::string &path);
+    ~PqIndex();
+
+    PqIndex(PqIndex &&other) noexcept;
+    PqIndex &operator=(PqIndex &&other) noexcept;
+    PqIndex(const PqIndex &) = delete;
+    PqIndex &operator=(const PqIndex &) = delete;
+
+    /** @return "cosine" or "ssd". */
+    const std::string &metric() const { return metric_; }
+
+    /** @return Number of encoded vectors. */
+    size_t rowCount() const { return rowCount_; }
+
+    /** @return Floats per original vector. */
+    size_t dimension() const { return dimension_; }
+
+    /** @return Code bytes per vector. */
+    size_t subspaces() const { return subspaces_; }
+
+    /**
+     * @param name Filename to look up.
+     * @return Row index, or npos if absent.
+     */
+    size_t findRow(std::string_view name) const;
+
+    /** @return True if full vectors are stored for re-ranking. */
+    bool hasVectors() const { return vectors_ != nullptr; }
+
+    /**
+     * @param index Row index in [0, rowCount()).
+     * @return Filename stored for the row.
+     */
+    std::string_view filename(size_t index) const;
+
+    /**
+     * Vector of a row: the stored full vector, or the centroid reconstruction.
+     *
+     * @param index Row index in [0, rowCount()).
+     * @return dimension() floats (unit length for cosine indexes with vectors).
+     */
+    std::vector<float> rowVector(size_t index) const;
+
+    /**
+     * Approximate nearest neighbours by table lookup, optionally re-ranked exactly.
+     *
+     * @param query Query vector of dimension() floats.
+     * @param k Number of results.
+     * @param rerank Candidates kept from the code scan and re-scored on the
+     *               full vectors (raised to k; ignored without stored vectors).
+     * @param allowed Optional per-row mask (non-zero = eligible).
+     * @param threadCount Worker threads for the code scan.
+     * @return Up to k candidates (index = row), nearest first.
+     * @throws std::runtime_error if the query size does not match.
+     */
+    std::vector<ScoredCandidate> search(
+        FloatView query,
+        size_t k,
+        size_t rerank,
+        const std::vector<uint8_t> *allowed = nullptr,
+        int threadCount = 1) const;
+
+private:
+    void release();
+    std::vector<float> prepareQuery(FloatView query) const;
+    size_t subspaceBegin(size_t subspace) const { return subspace * dimension_ / subspaces_; }
+
+    void *mapping_ = nullptr;
+    size_t mappingSize_ = 0;
+    std::string metric_;
+    bool cosine_ = false;
+    size_t rowCount_ = 0;
+    size_t dimension_ = 0;
+    size_t subspaces_ = 0;
+    // Subspace s holds 256 centroids of its slice width, starting at 256 * subspaceBegin(s).
+    const float *centroids_ = nullptr;
+    const uint8_t *codes_ = nullptr;
+    const float *vectors_ = nullptr;
+    const uint64_t *nameOffsets_ = nullptr;
+    const char *names_ = nullptr;
+};
+
+/**
+ * Check whether a file starts with the PQ index magic.
+ *
+ * @param path File path.
+ * @return True if the file looks like a PQ index.
+ */
+bool isPqIndexFile(const std::string &path);
+
+/**
+ * Train subspace codebooks on the rows, encode every row and write the index.
+ *
+ * @param outputPath Destination index path.
+ * @param metric "cosine" or "ssd".
+ * @param rows First element of rowCount * dimension floats.
+ * @param rowCount Number of vectors.
+ * @param dimension Floats per vector.
+ * @param filenames Filename per vector.
+ * @param params Training settings.
+ * @param threadCount Worker threads for training and encoding.
+ * @throws std::runtime_error on an unknown metric, bad settings or write failure.
+ */
+void writePqIndex(
+    const std::string &outputPath,
+    const std::string &metric,
+    const float *rows,
+    size_t rowCount,
+    size_t dimension,
+    const std::vector<std::string> &filenames,
+    const PqParams &params,
+    int threadCount = 1);
+
+#endif
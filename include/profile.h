@@ -0,0 +1,189 @@
+/*
+Authors - Joseph Defendre, Sourav Das
+
+
+Declarations for the per-stage query profiler.
+Times listing, loading, reading, decoding, extraction, scoring and ranking.
+Counts images decoded, bytes read, pixels processed and candidates scored.
+Counts cascade prunes and early-abandoned distances for pruning rates.
+Each thread accumulates into its own slot; slots are summed on report.
+Disabled by default, when a timer costs one relaxed atomic load.
+*/
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+/**
+ * Timed query stages, in report order.
+ */
+enum class ProfileStage : size_t {
+    // listImageFiles.
+    List,
+    // Stores, CSVs and ANN indexes loaded for the query.
+    Load,
+    // Raw file reads (pipeline reader stage).
+    Read,
+    // cv::imread / cv::imdecode.
+    Decode,
+    // Feature extraction.
+    Extract,
+    // Distance computation and top-K offers.
+    Score,
+    // Merging top-K heaps and resolving filenames.
+    Rank,
+    Count
+};
+
+/**
+ * Work counters, in report order.
+ */
+enum class ProfileCounter : size_t {
+    ImagesDecoded,
+    BytesRead,
+    PixelsProcessed,
+    CandidatesScored,
+    // Candidates dropped by the coarse descriptor before a full distance.
+    CandidatesPruned,
+    // Full distances that stopped early once past the k-th best.
+    DistancesAbandoned,
+    // Metric index (VP-tree) nodes entered.
+    IndexNodesVisited,
+    Count
+};
+
+constexpr size_t kProfileStageCount = static_cast<size_t>(ProfileStage::Count);
+constexpr size_t kProfileCounterCount = static_cast<size_t>(ProfileCounter::Count);
+
+/**
+ * Totals for one stage across every thread that ran it.
+ */
+struct ProfileStageReport {
+    double seconds = 0.0;
+    // Longest time any single thread spent in the stage.
+    double maxThreadSeconds = 0.0;
+    uint64_t calls = 0;
+    size_t threads = 0;
+};
+
+/**
+ * Aggregated profile of everything recorded since the last reset.
+ */
+struct ProfileReport {
+    // Caller-measured wall time of the whole query (0 if not set).
+    double wallSeconds = 0.0;
+    std::array<ProfileStageReport, kProfileStageCount> stages;
+    std::array<uint64_t, kProfileCounterCount> counters {};
+    // Threads that recorded anything.
+    size_t threads = 0;
+};
+
+namespace profile_detail {
+extern std::atomic<bool> enabled;
+void record(ProfileStage stage, uint64_t nanoseconds);
+void add(ProfileCounter counter, uint64_t amount);
+} // namespace profile_detail
+
+/**
+ * @return True while profiling is switched on.
+ */
+inline bool profilingEnabled() {
+    return profile_detail::enabled.load(std::memory_order_relaxed);
+}
+
+/**
+ * Switch profiling on or off. Switching on clears previous totals.
+ *
+ * Call between queries only: slots are cleared without synchronizing with
+ * threads that may still be recording.
+ *
+ * @param enabled New state.
+ */
+void setProfilingEnabled(bool enabled);
+
+/**
+ * Add to a work counter on the calling thread (no-op when disabled).
+ *
+ * @param counter Counter to bump.
+ * @param amount Amount to add.
+ */
+inline void profileCount(ProfileCounter counter, uint64_t amount) {
+    if (profilingEnabled()) {
+        profile_detail::add(counter, amount);
+    }
+}
+
+/**
+ * Scoped monotonic-clock timer charging its lifetime to a stage.
+ *
+ * Timers of the same stage must not nest, or the inner time is counted twice.
+ */
+class ProfileTimer {
+public:
+    explicit ProfileTimer(ProfileStage stage) : stage_(stage), active_(profilingEnabled()) {
+        if (active_) {
+            start_ = std::chrono::steady_clock::now();
+        }
+    }
+    ~ProfileTimer() {
+        if (active_) {
+            auto elapsed = std::chrono::steady_clock::now() - start_;
+            profile_detail::record(
+                stage_, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+        }
+    }
+    ProfileTimer(const ProfileTimer &) = delete;
+    ProfileTimer &operator=(const ProfileTimer &) = delete;
+
+private:
+    ProfileStage stage_;
+    bool active_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+/**
+ * Sum every thread's slot into one report.
+ *
+ * Threads that have exited are still counted: their totals were folded in
+ * when they exited, and their slots were handed to later threads.
+ * Call after the profiled work has finished (worker threads joined).
+ *
+ * @return Aggregated stages and counters.
+ */
+ProfileReport collectProfile();
+
+/**
+ * @param stage Stage.
+ * @return Short stage name used in reports ("decode", "score", ...).
+ */
+const char *profileStageName(ProfileStage stage);
+
+/**
+ * @param counter Counter.
+ * @return Short counter name used in reports ("bytes_read", ...).
+ */
+const char *profileCounterName(ProfileCounter counter);
+
+/**
+ * Print a stage table and counter list.
+ *
+ * @param report Collected profile.
+ * @param out Destination stream (stderr in the CLI).
+ */
+void printProfile(const ProfileReport &report, std::ostream &out);
+
+/**
+ * Print the profile as one JSON object on a single line.
+ *
+ * @param report Collected profile.
+ * @param out Destination stream (stderr in the CLI).
+ */
+void printProfileJson(const ProfileReport &report, std::ostream &out);
+
+#endif
@@ -0,0 +1,172 @@
+/*
+Authors - Joseph Defendre, Sourav Das
+
+
+Declarations for CBIR query execution.
+Bundles the CLI query arguments into one options struct.
+Scans live images, stored indexes or embeddings and ranks matches.
+Shared by the one-shot CLI and any long-running front end.
+*/
+#ifndef QUERY_H
+#define QUERY_H
+
+#include "pipeline.h"
+
+class QueryCache;
+
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * Parsed query arguments (mirrors the CLI positional arguments and flags).
+ */
+struct QueryOptions {
+    std::string targetImagePath;
+    std::string databaseDir;
+    std::string featureType;
+    std::string distanceMetric;
+    int topN = 0;
+    bool showLeast = false;
+    std::string embeddingsPath;
+    std::string indexPath;
+    int threadCount = 1;
+    // Staged read/decode/extract/score scan for live images (--pipeline).
+    bool usePipeline = false;
+    PipelineOptions pipeline;
+    bool pipelineStats = false;
+    // Print per-stage timers and counters to stderr (--profile, --profile-json).
+    bool profile = false;
+    bool profileJson = false;
+    // Decode live images at 1/decodeScale resolution (--decode-scale, capped per feature type).
+    int decodeScale = 1;
+    // Search beam width when embeddingsPath names an HNSW index (--ef).
+    size_t hnswEf = 64;
+    // Code-scan candidates re-ranked exactly when embeddingsPath names a PQ index (--rerank, 0 = off).
+    size_t pqRerank = 64;
+    // Report the best-N so far this often during exhaustive scans (--progress-ms, 0 = off).
+    int progressIntervalMs = 0;
+    // Stop exhaustive scans this long after the query starts and keep what was scored (--time-budget-ms, 0 = off).
+    int timeBudgetMs = 0;
+    // Score every candidate in full: no coarse prefilter or early abandoning (--exhaustive).
+    bool exhaustive = false;
+    // Score live images as the directory walk finds them, skipping the sorted listing (--unordered).
+    bool unordered = false;
+    // Report byte-identical images recorded by a deduplicated index with the match
+    // they share a row with, instead of as matches of their own (--collapse-duplicates).
+    bool collapseDuplicates = false;
+};
+
+/**
+ * Ranked result record.
+ */
+struct Match {
+    std::string filename;
+    float distance;
+    // Byte-identical images sharing this match's row (only with collapseDuplicates).
+    std::vector<std::string> duplicates = {};
+};
+
+/**
+ * Outcome of a query, including how much of the database was scored.
+ */
+struct QueryResult {
+    std::vector<Match> matches;
+    // False when the time budget ran out before every candidate was scored.
+    bool complete = true;
+    // Candidates scored and candidates in the scan (0/0 for HNSW and PQ searches).
+    size_t scanned = 0;
+    size_t total = 0;
+};
+
+/**
+ * Best matches so far, reported periodically while a scan runs.
+ */
+struct QueryProgress {
+    std::vector<Match> matches;
+    size_t scanned = 0;
+    size_t total = 0;
+    double elapsedMs = 0.0;
+};
+
+/**
+ * Receives progress snapshots. Calls are serialized but may come from any scan worker.
+ */
+using QueryProgressCallback = std::function<void(const QueryProgress &)>;
+
+/**
+ * Parse CLI-style query arguments (everything after the program name).
+ *
+ * Accepts the positional arguments and flags of the one-shot CLI, so the
+ * server can take the same command lines over its socket.
+ *
+ * @param args Query arguments.
+ * @return Parsed options.
+ * @throws std::invalid_argument on missing arguments, a bad number or an unknown feature type.
+ */
+QueryOptions parseQueryArguments(const std::vector<std::string> &args);
+
+/**
+ * Run a query and return the top-N matches.
+ *
+ * The scan source depends on the options: the embeddings CSV, store or HNSW
+ * index for "dnn", the stored index or VP-tree when indexPath is set, and
+ * decoded images otherwise. HNSW results are approximate; everything else
+ * returns the exhaustive top-N.
+ * Candidate scoring is spread over options.threadCount threads, or over the
+ * staged pipeline when usePipeline is set; ranking is identical either way.
+ * With a cache, listings, stores, CSVs and live image features are loaded
+ * once and reused by later queries until their files change.
+ *
+ * @param options Query options.
+ * @param cache Resident inputs to reuse, or nullptr for a one-shot query.
+ * @return Matches sorted by distance (descending when showLeast is set).
+ * @throws std::runtime_error on missing inputs, unreadable files or size mismatches.
+ */
+std::vector<Match> runQuery(const QueryOptions &options, QueryCache *cache = nullptr);
+
+/**
+ * Run a query with progress snapshots and the optional time budget.
+ *
+ * Exhaustive scans (live images, stored indexes, embedding CSVs and stores)
+ * check options.timeBudgetMs between candidates and stop once it has passed,
+ * returning the best of what was scored with complete = false. When
+ * options.progressIntervalMs is set, onProgress receives the current best-N
+ * that often. HNSW and PQ searches are not interruptible and report neither.
+ * Resident feature extraction in a cache always runs to completion, since its
+ * result is reused by later queries.
+ *
+ * @param options Query options.
+ * @param onProgress Snapshot receiver (may be empty).
+ * @param cache Resident inputs to reuse, or nullptr for a one-shot query.
+ * @return Matches and scan coverage.
+ * @throws std::runtime_error as runQuery.
+ */
+QueryResult runQueryWithProgress(
+    const QueryOptions &options,
+    const QueryProgressCallback &onProgress,
+    QueryCache *cache = nullptr);
+
+/**
+ * Run many targets against one database and return the top-N for each.
+ *
+ * Uses the same sources as runQuery (options.targetImagePath is ignored), but
+ * loads or extracts the database once and scores it in cache-sized tiles
+ * against every target, so the scan is shared by the batch. Classic targets
+ * are image paths; dnn targets are matched by basename, so embedding keys
+ * work too. HNSW and PQ indexes answer the targets one by one from the
+ * shared index. The pipeline options do not apply.
+ *
+ * @param options Query options shared by every target.
+ * @param targets Target image paths (or embedding keys for dnn).
+ * @param cache Resident inputs to reuse, or nullptr for a one-shot batch.
+ * @return Matches per target, in target order.
+ * @throws std::runtime_error on missing inputs, unreadable files, a target
+ *         without an embedding, or size mismatches.
+ */
+std::vector<std::vector<Match>> runBatchQuery(
+    const QueryOptions &options,
+    const std::vector<std::string> &targets,
+    QueryCache *cache = nullptr);
+
+#endif
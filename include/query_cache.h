@@ -0,0 +1,145 @@
+/*
+Authors - Joseph Defendre, Sourav Das
+
+
+Declarations for the resident query data cache.
+Holds directory listings, feature stores, HNSW graphs, VP-trees, CSVs and live image features.
+Reloads an entry when its file timestamp, or any walked directory's, changes.
+Re-extracts only the live images whose own mtime or size changed.
+Lets a long-running server answer repeat queries without reloading inputs.
+*/
+#ifndef QUERY_CACHE_H
+#define QUERY_CACHE_H
+
+#include "feature_store.h"
+#include "file_walker.h"
+#include "hnsw_index.h"
+#include "image_io.h"
+#include "pq_index.h"
+#include "vp_tree.h"
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * Parsed embeddings CSV with a filename -> row lookup.
+ */
+struct EmbeddingTable {
+    FeatureMatrix matrix;
+    // First row for each filename.
+    std::unordered_map<std::string, size_t> rowByName;
+};
+
+/**
+ * Query inputs loaded once and reused across queries.
+ *
+ * Each accessor returns the cached value while the underlying path's stamp is
+ * unchanged and reloads it otherwise. Listings follow the timestamps of every
+ * directory in the tree, which change when files are added or removed at any
+ * depth. Live image features are also stamped per file, so an image rewritten
+ * in place is extracted again.
+ * Not thread-safe: callers serialize queries that share a cache.
+ */
+class QueryCache {
+public:
+    /**
+     * @param databaseDir Database directory.
+     * @param threadCount Directory reader threads used when (re)listing.
+     * @return Sorted image paths (possibly empty).
+     * @throws std::runtime_error if the directory cannot be read.
+     */
+    const std::vector<std::string> &imageFiles(const std::string &databaseDir, int threadCount = 1);
+
+    /**
+     * @param path Binary feature store path.
+     * @return Mapped store.
+     * @throws std::runtime_error if the store cannot be opened.
+     */
+    const FeatureStore &featureStore(const std::string &path);
+
+    /**
+     * @param path HNSW index path.
+     * @return Loaded graph.
+     * @throws std::runtime_error if the index cannot be read.
+     */
+    const HnswIndex &hnswIndex(const std::string &path);
+
+    /**
+     * @param path PQ index path.
+     * @return Mapped index.
+     * @throws std::runtime_error if the index cannot be opened.
+     */
+    const PqIndex &pqIndex(const std::string &path);
+
+    /**
+     * @param path VP-tree path.
+     * @return Loaded tree.
+     * @throws std::runtime_error if the tree cannot be read.
+     */
+    const VpTree &vpTree(const std::string &path);
+
+    /**
+     * @param path Features CSV path.
+     * @param threadCount Worker threads used for parsing.
+     * @return Parsed rows in file order.
+     * @throws std::runtime_error if the CSV cannot be read or parsed.
+     */
+    const FeatureMatrix &featuresCsv(const std::string &path, int threadCount = 1);
+
+    /**
+     * @param path Embeddings CSV path.
+     * @param threadCount Worker threads used for parsing.
+     * @return Parsed embeddings with a filename lookup.
+     * @throws std::runtime_error if the CSV cannot be read or parsed.
+     */
+    const EmbeddingTable &embeddingsCsv(const std::string &path, int threadCount = 1);
+
+    /**
+     * Extract (once) the feature of every image in a database directory.
+     *
+     * Later calls stat every listed image and extract only those that are new
+     * or whose mtime or size changed; the rest reuse their cached rows. The
+     * extraction runs to completion: a query's time budget does not apply to
+     * it, so the first query on a directory takes as long as a full scan.
+     *
+     * @param databaseDir Database directory.
+     * @param featureType Classic feature type.
+     * @param threadCount Worker threads used for extraction.
+     * @param decodeScale Downscale factor used when decoding the images.
+     * @return Feature matrix in listing order.
+     * @throws std::runtime_error on unreadable images or inconsistent sizes.
+     */
+    const FeatureMatrix &imageFeatures(
+        const std::string &databaseDir,
+        const std::string &featureType,
+        int threadCount,
+        int decodeScale = 1);
+
+private:
+    template <typename T>
+    struct Entry {
+        FileStamp stamp;
+        T value;
+    };
+
+    std::unordered_map<std::string, Entry<ImageListing>> listings_;
+    std::unordered_map<std::string, Entry<FeatureStore>> stores_;
+    std::unordered_map<std::string, Entry<HnswIndex>> hnswIndexes_;
+    std::unordered_map<std::string, Entry<PqIndex>> pqIndexes_;
+    std::unordered_map<std::string, Entry<VpTree>> vpTrees_;
+    std::unordered_map<std::string, Entry<FeatureMatrix>> featureCsvs_;
+    std::unordered_map<std::string, Entry<EmbeddingTable>> embeddingCsvs_;
+    /**
+     * Live image features with the stamp of the file each row came from.
+     */
+    struct ImageFeatures {
+        FeatureMatrix matrix;
+        std::vector<FileStamp> stamps;
+    };
+
+    std::unordered_map<std::string, ImageFeatures> imageFeatures_;
+};
+
+#endif
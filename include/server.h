@@ -0,0 +1,90 @@
+/*
+Authors - Joseph Defendre, Sourav Das
+
+
+Declarations for the persistent query server.
+Answers CLI-style query lines over stdin/stdout, a Unix domain socket or TCP.
+Keeps listings, indexes, embeddings and live features resident between queries.
+Runs as a shard worker pinned to one store, or as a scatter-gather coordinator.
+Used by the GUI and batch jobs to avoid per-query process startup.
+*/
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <string>
+#include <vector>
+
+class QueryCache;
+
+/**
+ * Server settings from the `serve` subcommand.
+ */
+struct ServerOptions {
+    // Unix domain socket to listen on; empty serves stdin/stdout.
+    std::string socketPath;
+    // host:port to listen on over TCP instead (--tcp).
+    std::string tcpAddress;
+    // Worker: answer every request from this shard store (--shard).
+    std::string shardPath;
+    // Coordinator: shard worker endpoints in shard order (--shards).
+    std::vector<std::string> shardEndpoints;
+    // Coordinator: drop shards that have not answered after this long (0 = wait).
+    int shardTimeoutMs = 10000;
+};
+
+/**
+ * Split a request line into arguments using shell-style quoting.
+ *
+ * Whitespace separates arguments; single quotes are literal, double quotes
+ * allow backslash escapes, so lines produced by Python's shlex.join parse back
+ * to the original argument list.
+ *
+ * @param line Request line.
+ * @return Arguments.
+ * @throws std::invalid_argument on an unterminated quote.
+ */
+std::vector<std::string> splitRequestLine(const std::string &line);
+
+/**
+ * Answer one request line against a resident cache.
+ *
+ * The line holds the same arguments as a one-shot query (without the program
+ * name). The response is "OK <count>" (with " partial" appended when a time
+ * budget cut the scan short) followed by <count> lines of
+ * "<filename> <distance>", or a single "ERROR <message>" line. Distances are
+ * written in the shortest form that reads back to the same float.
+ *
+ * @param line Request line.
+ * @param cache Resident query cache.
+ * @param shardPath Classic feature store that replaces the request's source
+ *        (a shard worker's own rows), or empty to use the request as given.
+ * @return Response text (empty for a blank line).
+ */
+std::string handleRequestLine(const std::string &line, QueryCache &cache, const std::string &shardPath = "");
+
+/**
+ * Answer one request line by scattering it to shard workers.
+ *
+ * The line is forwarded unchanged; the merged top-N is framed like
+ * handleRequestLine. Shards that fail or time out are reported on stderr and
+ * make the response partial; a shard that rejects the query fails it.
+ *
+ * @param line Request line.
+ * @param options Coordinator settings (shardEndpoints, shardTimeoutMs).
+ * @return Response text (empty for a blank line).
+ */
+std::string handleCoordinatorLine(const std::string &line, const ServerOptions &options);
+
+/**
+ * Serve queries until stdin closes (stdio mode) or forever (socket mode).
+ *
+ * Requests are handled one at a time; each query still uses its own
+ * --threads/--pipeline workers. With shardEndpoints set the server is a
+ * coordinator and holds no data itself.
+ *
+ * @param options Server options.
+ * @throws std::runtime_error if the socket cannot be created or bound.
+ */
+void runServer(const ServerOptions &options);
+
+#endif
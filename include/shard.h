@@ -0,0 +1,117 @@
+/*
+Authors - Joseph Defendre, Sourav Das
+
+
+Declarations for sharded scatter-gather search.
+Splits a classic feature store into contiguous row ranges, one per worker.
+Fans a query line out to shard workers over Unix sockets or TCP.
+Merges each shard's top-N into the ranking a single store would give.
+Used by the `shard` subcommand and by `serve --shards` coordinators.
+*/
+#ifndef SHARD_H
+#define SHARD_H
+
+#include "query.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * How one shard handled a scattered query.
+ */
+enum class ShardStatus {
+    // Full local top-N received.
+    Answered,
+    // The shard's own time budget cut its scan short.
+    Partial,
+    // The shard answered ERROR (bad arguments, unreadable store, ...).
+    Rejected,
+    // No answer: connection refused or reset, malformed reply, or timeout.
+    Failed
+};
+
+/**
+ * Outcome of one shard for one query.
+ */
+struct ShardOutcome {
+    std::string endpoint;
+    ShardStatus status = ShardStatus::Failed;
+    // Error text for Rejected and Failed shards.
+    std::string message;
+    // Matches the shard returned.
+    size_t matchCount = 0;
+};
+
+/**
+ * Merged answer of a scattered query.
+ */
+struct ScatterResult {
+    std::vector<Match> matches;
+    // Every shard answered in full.
+    bool complete = false;
+    // One entry per endpoint, in endpoint order.
+    std::vector<ShardOutcome> shards;
+};
+
+/**
+ * @param storePrefix Output prefix given to splitFeatureStore.
+ * @param shard Shard number.
+ * @return Path of that shard's store ("<prefix>.<shard>.bin").
+ */
+std::string shardStorePath(const std::string &storePrefix, size_t shard);
+
+/**
+ * Split a classic feature store into contiguous, nearly equal row ranges.
+ *
+ * Shard k holds the rows that follow shard k - 1, with their stamps and
+ * coarse descriptors, so merging shard results in shard order breaks ties
+ * exactly as the original store does.
+ *
+ * @param storePath Source feature store.
+ * @param shardCount Number of shards (1 to the row count).
+ * @param outputPrefix Prefix for the shard stores (see shardStorePath).
+ * @return Written shard store paths, in shard order.
+ * @throws std::runtime_error if the store holds embeddings, the shard count
+ *         is out of range, or a shard cannot be written.
+ */
+std::vector<std::string> splitFeatureStore(
+    const std::string &storePath,
+    size_t shardCount,
+    const std::string &outputPrefix);
+
+/**
+ * Split "host:port" into its parts.
+ *
+ * Anything with a '/' or without a numeric port is a Unix socket path.
+ *
+ * @param endpoint Endpoint text.
+ * @param host Receives the host name or address.
+ * @param port Receives the port.
+ * @return True for a TCP endpoint.
+ */
+bool splitTcpEndpoint(const std::string &endpoint, std::string &host, std::string &port);
+
+/**
+ * Send one query line to every shard worker and merge their top-N lists.
+ *
+ * All shards are queried concurrently. A shard that has not answered within
+ * timeoutMs of the start is dropped and marked Failed; the others still count.
+ * Matches are ranked by distance, then by shard order, then by each shard's
+ * own order, which reproduces the tie-breaking of a single contiguous store.
+ *
+ * @param endpoints Worker endpoints (Unix socket paths or host:port), in shard order.
+ * @param requestLine Query arguments as sent to `serve` (no trailing newline).
+ * @param topN Number of merged matches to keep.
+ * @param keepLargest Rank the largest distances first (--least).
+ * @param timeoutMs Per-shard deadline in milliseconds (0 = wait indefinitely).
+ * @return Merged matches and the outcome of each shard.
+ */
+ScatterResult scatterQuery(
+    const std::vector<std::string> &endpoints,
+    const std::string &requestLine,
+    int topN,
+    bool keepLargest,
+    int timeoutMs);
+
+#endif
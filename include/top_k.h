@@ -0,0 +1,85 @@
+/*
+Authors - Joseph Defendre, Sourav Das
+
+
+Declarations for the streaming top-K collector.
+Keeps the best K (distance, candidate index) pairs in a bounded heap.
+Supports nearest-first and least-similar ordering and heap merging.
+Filenames are resolved only for the final K results.
+*/
+#ifndef TOP_K_H
+#define TOP_K_H
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * Score for one candidate, identified by its position in the scan.
+ */
+struct ScoredCandidate {
+    float distance;
+    size_t index;
+};
+
+/**
+ * Bounded heap that retains the K best candidates seen so far.
+ *
+ * Ties on distance are broken by the lower candidate index, so the result is
+ * independent of the order candidates are offered or collectors are merged.
+ */
+class TopKCollector {
+public:
+    /**
+     * @param capacity Number of results to keep (K).
+     * @param keepLargest If true keep the largest distances (--least).
+     */
+    TopKCollector(size_t capacity, bool keepLargest);
+
+    /**
+     * Consider a candidate; O(log K) when it displaces the current worst.
+     *
+     * @param distance Candidate distance.
+     * @param index Candidate index in the scan.
+     */
+    void offer(float distance, size_t index);
+
+    /**
+     * Fold another collector's candidates into this one.
+     *
+     * @param other Collector built with the same capacity and ordering.
+     */
+    void merge(const TopKCollector &other);
+
+    /** @return True once K candidates are held. */
+    bool full() const { return heap_.size() >= capacity_; }
+
+    /** @return Distance of the worst retained candidate (valid when non-empty). */
+    float worstDistance() const { return heap_.front().distance; }
+
+    /** @return Number of retained candidates. */
+    size_t size() const { return heap_.size(); }
+
+    /** @return True if results are kept largest-first. */
+    bool keepLargest() const { return keepLargest_; }
+
+    /** @return Retained candidates, best first. */
+    std::vector<ScoredCandidate> sorted() const;
+
+private:
+    bool better(const ScoredCandidate &a, const ScoredCandidate &b) const;
+
+    size_t capacity_;
+    bool keepLargest_;
+    // Heap ordered so the worst retained candidate is at the front.
+    std::vector<ScoredCandidate> heap_;
+};
+
+/**
+ * Merge per-worker collectors into one.
+ *
+ * @param collectors Partial collectors (at least one).
+ * @return Combined collector.
+ */
+TopKCollector mergeTopK(const std::vector<TopKCollector> &collectors);
+
+#endif
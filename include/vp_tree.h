@@ -0,0 +1,162 @@
+/*
+Authors - Joseph Defendre, Sourav Das
+
+
+Declarations for the vantage-point tree over stored classic features.
+Intersection distance on normalized histograms is half the L1 distance and
+the square root of SSD is the L2 distance, so the triangle inequality prunes.
+Answers the same top-N as the linear scan while visiting a fraction of rows.
+Carries the duplicate lists of deduplicated stores.
+Used by the `cbir vptree` subcommand and queries given a tree as --index.
+*/
+#ifndef VP_TREE_H
+#define VP_TREE_H
+
+#include "distance_metrics.h"
+#include "feature_store.h"
+#include "top_k.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Work done by one tree search.
+ */
+struct VpSearchStats {
+    // Tree nodes entered (internal and leaf).
+    size_t nodesVisited = 0;
+    // Rows whose distance to the query was computed.
+    size_t distancesComputed = 0;
+};
+
+/**
+ * Exact metric index: a vantage-point tree with row buckets at the leaves.
+ *
+ * Each internal node holds a vantage row and the median distance (radius)
+ * from it to the rows below; rows no farther than the radius go inside, the
+ * rest outside. A search skips a side when the triangle inequality shows
+ * nothing there can beat the current N-th best. The tree keeps its own copy
+ * of the rows and filenames, so the file is self-contained. search() is const
+ * and may run concurrently from several threads.
+ */
+class VpTree {
+public:
+    /**
+     * Load a tree written by save().
+     *
+     * @param path Tree file path.
+     * @throws std::runtime_error if the file cannot be read or is malformed.
+     */
+    explicit VpTree(const std::string &path);
+
+    VpTree(VpTree &&) noexcept = default;
+    VpTree &operator=(VpTree &&) noexcept = default;
+    VpTree(const VpTree &) = delete;
+    VpTree &operator=(const VpTree &) = delete;
+
+    /**
+     * Build a tree over the rows of a classic feature store.
+     *
+     * @param store Feature store holding one classic feature type.
+     * @param leafSize Rows per leaf bucket (at least 1).
+     * @param threadCount Worker threads for the distances at each split.
+     * @return Built tree.
+     * @throws std::runtime_error if the store holds no classic type, a
+     *         histogram is not normalized, or there are too many rows.
+     */
+    static VpTree build(const FeatureStore &store, size_t leafSize, int threadCount = 1);
+
+    /**
+     * Write the header, rows, nodes and filename table.
+     *
+     * @param path Destination file path.
+     * @throws std::runtime_error if the file cannot be written.
+     */
+    void save(const std::string &path) const;
+
+    /**
+     * Exact k nearest rows to a query feature.
+     *
+     * @param query Feature vector of the store's type (dimension() floats).
+     * @param k Number of results.
+     * @param stats Optional counters for the search.
+     * @return Up to k candidates (index = row), nearest first, ties by lower
+     *         row: the same list a linear scan of the store returns.
+     * @throws std::runtime_error if the query size does not match.
+     */
+    std::vector<ScoredCandidate> search(FloatView query, size_t k, VpSearchStats *stats = nullptr) const;
+
+    /** @return Descriptor settings copied from the source store. */
+    const FeatureStoreInfo &info() const { return info_; }
+
+    /** @return Number of indexed rows. */
+    size_t size() const { return filenames_.size(); }
+
+    /** @return Number of tree nodes. */
+    size_t nodeCount() const { return nodes_.size(); }
+
+    /** @return Floats per row. */
+    size_t dimension() const { return dimension_; }
+
+    /**
+     * @param index Row index in [0, size()).
+     * @return Stored feature vector.
+     */
+    FloatView row(size_t index) const { return FloatView(data_.data() + index * dimension_, dimension_); }
+
+    /**
+     * @param index Row index in [0, size()).
+     * @return Filename recorded for the row.
+     */
+    const std::string &filename(size_t index) const { return filenames_[index]; }
+
+    /**
+     * @param index Row index in [0, size()).
+     * @return Byte-identical images the source store folded into the row.
+     */
+    std::vector<std::string> duplicates(size_t index) const;
+
+private:
+    // On-disk node; leaves have count > 0 and no vantage row.
+    struct Node {
+        uint32_t vantage;
+        uint32_t inside;
+        uint32_t outside;
+        // Leaf bucket [begin, begin + count) in order_.
+        uint32_t begin;
+        uint32_t count;
+        float radius;
+    };
+
+    VpTree() = default;
+
+    float metricDistance(float featureDistance) const;
+    uint32_t buildNode(std::vector<uint32_t> &rows, size_t begin, size_t end, int threadCount, uint32_t &seed);
+
+    FeatureStoreInfo info_;
+    // True when the feature distance is squared (SSD) and the metric is its root.
+    bool squared_ = false;
+    size_t leafSize_ = 0;
+    size_t dimension_ = 0;
+    std::vector<float> data_;
+    std::vector<std::string> filenames_;
+    // Duplicates of row r are duplicateNames_[firstDuplicate_[r], firstDuplicate_[r + 1]);
+    // both are empty when the source store recorded none.
+    std::vector<uint32_t> firstDuplicate_;
+    std::vector<std::string> duplicateNames_;
+    std::vector<Node> nodes_;
+    std::vector<uint32_t> order_;
+    uint32_t root_ = 0;
+};
+
+/**
+ * Check whether a file starts with the VP-tree magic.
+ *
+ * @param path File path.
+ * @return True if the file looks like a VP-tree index.
+ */
+bool isVpTreeFile(const std::string &path);
+
+#endif
@@ -0,0 +1,170 @@
+/*
+Authors - Joseph Defendre, Sourav Das
+
+Implements the reduced-resolution decode drift report.
+Extracts every database image at full and reduced decode scales.
+Ranks sample queries per scale with bounded top-N heaps.
+Compares the reduced rankings against the full-resolution ones.
+*/
+#include "../include/decode_drift.h"
+
+#include "../include/feature_types.h"
+#include "../include/image_io.h"
+#include "../include/parallel.h"
+#include "../include/top_k.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+/**
+ * Features of every image decoded at one scale.
+ */
+struct ScaledFeatures {
+    std::vector<std::vector<float>> rows;
+    double millisecondsPerImage = 0.0;
+};
+
+/**
+ * Decode and describe every image at one scale, timing each image.
+ *
+ * @param files Image paths.
+ * @param featureType Classic feature type name.
+ * @param scale Decode downscale factor.
+ * @param threadCount Worker threads.
+ * @return Feature rows in file order with the mean per-image cost.
+ */
+ScaledFeatures extractAtScale(
+    const std::vector<std::string> &files,
+    const std::string &featureType,
+    int scale,
+    int threadCount) {
+    ScaledFeatures result;
+    result.rows.resize(files.size());
+    // Per-worker totals so the timing sums CPU time rather than wall time.
+    std::vector<double> workerSeconds(parallelWorkerCount(files.size(), threadCount), 0.0);
+    parallelForWorkers(files.size(), threadCount, [&](size_t i, size_t worker) {
+        auto start = std::chrono::steady_clock::now();
+        cv::Mat image = loadImageOrThrow(files[i], scale);
+        result.rows[i] = computeFeature(featureType, image);
+        workerSeconds[worker] += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    });
+    double total = 0.0;
+    for (double seconds : workerSeconds) {
+        total += seconds;
+    }
+    result.millisecondsPerImage = files.empty() ? 0.0 : total * 1000.0 / files.size();
+    return result;
+}
+
+/**
+ * Top-N database indices for one query row, excluding the query itself.
+ *
+ * @param featureType Classic feature type name.
+ * @param rows Feature rows at one scale.
+ * @param query Index of the query row.
+ * @param topN Number of results.
+ * @return Candidate indices, best first.
+ */
+std::vector<size_t> rankNeighbours(
+    const std::string &featureType,
+    const std::vector<std::vector<float>> &rows,
+    size_t query,
+    size_t topN) {
+    TopKCollector collector(topN, false);
+    for (size_t j = 0; j < rows.size(); ++j) {
+        if (j != query) {
+            collector.offer(featureDistance(featureType, rows[query], rows[j]), j);
+        }
+    }
+    std::vector<size_t> ranked;
+    for (const auto &candidate : collector.sorted()) {
+        ranked.push_back(candidate.index);
+    }
+    return ranked;
+}
+} // namespace
+
+/**
+ * Compare reduced-scale rankings with full-resolution rankings.
+ *
+ * @param options Database, feature type, N, scales, samples and threads.
+ * @return Reference row (scale 1) followed by one row per reduced scale.
+ * @throws std::runtime_error on invalid settings or unreadable images.
+ */
+std::vector<DriftRow> measureDecodeDrift(const DriftOptions &options) {
+    if (!isClassicFeatureType(options.featureType)) {
+        throw std::runtime_error("Drift needs a classic feature type: " + options.featureType);
+    }
+    if (options.topN == 0 || options.samples == 0) {
+        throw std::runtime_error("Drift needs N > 0 and at least one sample");
+    }
+    for (int scale : options.scales) {
+        if (!isValidDecodeScale(scale)) {
+            throw std::runtime_error("Decode scale must be 1, 2, 4 or 8");
+        }
+    }
+
+    auto files = listImageFiles(options.databaseDir, options.threadCount);
+    if (files.size() < 2) {
+        throw std::runtime_error("Drift needs at least two images in " + options.databaseDir);
+    }
+    size_t samples = std::min(options.samples, files.size());
+    std::vector<size_t> queries;
+    for (size_t s = 0; s < samples; ++s) {
+        queries.push_back(s * files.size() / samples);
+    }
+
+    ScaledFeatures reference = extractAtScale(files, options.featureType, 1, options.threadCount);
+    std::vector<std::vector<size_t>> referenceRanks(samples);
+    parallelFor(samples, options.threadCount, [&](size_t s) {
+        referenceRanks[s] = rankNeighbours(options.featureType, reference.rows, queries[s], options.topN);
+    });
+
+    std::vector<DriftRow> report;
+    DriftRow full;
+    full.millisecondsPerImage = reference.millisecondsPerImage;
+    report.push_back(full);
+
+    for (int requested : options.scales) {
+        // Types pinned to full resolution (baseline) have nothing to compare.
+        int scale = decodeScaleFor(options.featureType, requested);
+        if (scale == 1) {
+            continue;
+        }
+        ScaledFeatures reduced = extractAtScale(files, options.featureType, scale, options.threadCount);
+        std::vector<double> overlaps(samples, 0.0);
+        std::vector<double> displacements(samples, 0.0);
+        parallelFor(samples, options.threadCount, [&](size_t s) {
+            auto ranked = rankNeighbours(options.featureType, reduced.rows, queries[s], options.topN);
+            const auto &expected = referenceRanks[s];
+            size_t shared = 0;
+            double displacement = 0.0;
+            for (size_t rank = 0; rank < expected.size(); ++rank) {
+                auto it = std::find(ranked.begin(), ranked.end(), expected[rank]);
+                size_t reducedRank = it == ranked.end() ? options.topN
+                                                        : static_cast<size_t>(it - ranked.begin());
+                shared += it != ranked.end() ? 1 : 0;
+                displacement += std::abs(static_cast<double>(reducedRank) - static_cast<double>(rank));
+            }
+            if (!expected.empty()) {
+                overlaps[s] = static_cast<double>(shared) / expected.size();
+                displacements[s] = displacement / expected.size();
+            }
+        });
+
+        DriftRow row;
+        row.scale = scale;
+        row.overlap = 0.0;
+        for (size_t s = 0; s < samples; ++s) {
+            row.overlap += overlaps[s] / samples;
+            row.rankDisplacement += displacements[s] / samples;
+        }
+        row.millisecondsPerImage = reduced.millisecondsPerImage;
+        report.push_back(row);
+    }
+    return report;
+}
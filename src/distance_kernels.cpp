@@ -0,0 +1,539 @@
+/*
+Authors - Joseph Defendre, Sourav Das
+
+Implements the distance kernels and runtime CPU dispatch.
+Each kernel keeps several independent accumulators to hide FP latency.
+x86-64 variants are compiled with per-function target attributes.
+Other architectures, 32-bit x86 included, use the portable multi-accumulator loops.
+*/
+#include "../include/distance_kernels.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+// 32-bit x86 is excluded: SSE2 is not guaranteed there, and the SSE table below is
+// dispatched without a CPU check.
+#if defined(__x86_64__)
+#define CBIR_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace {
+/**
+ * Portable SSD with four accumulators (auto-vectorizes without -ffast-math).
+ *
+ * @param a First vector.
+ * @param b Second vector.
+ * @param n Element count.
+ * @return Sum of squared differences.
+ */
+float ssdScalar(const float *a, const float *b, size_t n) {
+    float s0 = 0.0f;
+    float s1 = 0.0f;
+    float s2 = 0.0f;
+    float s3 = 0.0f;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        float d0 = a[i] - b[i];
+        float d1 = a[i + 1] - b[i + 1];
+        float d2 = a[i + 2] - b[i + 2];
+        float d3 = a[i + 3] - b[i + 3];
+        s0 += d0 * d0;
+        s1 += d1 * d1;
+        s2 += d2 * d2;
+        s3 += d3 * d3;
+    }
+    for (; i < n; ++i) {
+        float d = a[i] - b[i];
+        s0 += d * d;
+    }
+    return (s0 + s1) + (s2 + s3);
+}
+
+/**
+ * Portable histogram intersection (sum of element-wise minima).
+ *
+ * @param a First vector.
+ * @param b Second vector.
+ * @param n Element count.
+ * @return Intersection similarity.
+ */
+float intersectionScalar(const float *a, const float *b, size_t n) {
+    float s0 = 0.0f;
+    float s1 = 0.0f;
+    float s2 = 0.0f;
+    float s3 = 0.0f;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        s0 += std::min(a[i], b[i]);
+        s1 += std::min(a[i + 1], b[i + 1]);
+        s2 += std::min(a[i + 2], b[i + 2]);
+        s3 += std::min(a[i + 3], b[i + 3]);
+    }
+    for (; i < n; ++i) {
+        s0 += std::min(a[i], b[i]);
+    }
+    return (s0 + s1) + (s2 + s3);
+}
+
+/**
+ * Portable dot product.
+ *
+ * @param a First vector.
+ * @param b Second vector.
+ * @param n Element count.
+ * @return Dot product.
+ */
+float dotScalar(const float *a, const float *b, size_t n) {
+    float s0 = 0.0f;
+    float s1 = 0.0f;
+    float s2 = 0.0f;
+    float s3 = 0.0f;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        s0 += a[i] * b[i];
+        s1 += a[i + 1] * b[i + 1];
+        s2 += a[i + 2] * b[i + 2];
+        s3 += a[i + 3] * b[i + 3];
+    }
+    for (; i < n; ++i) {
+        s0 += a[i] * b[i];
+    }
+    return (s0 + s1) + (s2 + s3);
+}
+
+/**
+ * Portable dot products of four queries with one row (each row element is loaded once).
+ *
+ * @param queries Four query vectors.
+ * @param row Row vector.
+ * @param n Element count.
+ * @param out Four dot products.
+ */
+void dot4Scalar(const float *const *queries, const float *row, size_t n, float *out) {
+    float s0 = 0.0f;
+    float s1 = 0.0f;
+    float s2 = 0.0f;
+    float s3 = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        float value = row[i];
+        s0 += queries[0][i] * value;
+        s1 += queries[1][i] * value;
+        s2 += queries[2][i] * value;
+        s3 += queries[3][i] * value;
+    }
+    out[0] = s0;
+    out[1] = s1;
+    out[2] = s2;
+    out[3] = s3;
+}
+
+#ifdef CBIR_X86_KERNELS
+/**
+ * Horizontal sum of a 4-lane vector.
+ */
+float horizontalSum(__m128 v) {
+    __m128 shuffled = _mm_movehl_ps(v, v);
+    __m128 sums = _mm_add_ps(v, shuffled);
+    shuffled = _mm_shuffle_ps(sums, sums, 0x1);
+    return _mm_cvtss_f32(_mm_add_ss(sums, shuffled));
+}
+
+// SSE2 is part of the x86-64 baseline, so these need no target attribute.
+float ssdSse(const float *a, const float *b, size_t n) {
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    __m128 acc2 = _mm_setzero_ps();
+    __m128 acc3 = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128 d0 = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+        __m128 d1 = _mm_sub_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4));
+        __m128 d2 = _mm_sub_ps(_mm_loadu_ps(a + i + 8), _mm_loadu_ps(b + i + 8));
+        __m128 d3 = _mm_sub_ps(_mm_loadu_ps(a + i + 12), _mm_loadu_ps(b + i + 12));
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(d0, d0));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(d1, d1));
+        acc2 = _mm_add_ps(acc2, _mm_mul_ps(d2, d2));
+        acc3 = _mm_add_ps(acc3, _mm_mul_ps(d3, d3));
+    }
+    for (; i + 4 <= n; i += 4) {
+        __m128 d = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(d, d));
+    }
+    float sum = horizontalSum(_mm_add_ps(_mm_add_ps(acc0, acc1), _mm_add_ps(acc2, acc3)));
+    return sum + ssdScalar(a + i, b + i, n - i);
+}
+
+float intersectionSse(const float *a, const float *b, size_t n) {
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    __m128 acc2 = _mm_setzero_ps();
+    __m128 acc3 = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        acc0 = _mm_add_ps(acc0, _mm_min_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        acc1 = _mm_add_ps(acc1, _mm_min_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+        acc2 = _mm_add_ps(acc2, _mm_min_ps(_mm_loadu_ps(a + i + 8), _mm_loadu_ps(b + i + 8)));
+        acc3 = _mm_add_ps(acc3, _mm_min_ps(_mm_loadu_ps(a + i + 12), _mm_loadu_ps(b + i + 12)));
+    }
+    for (; i + 4 <= n; i += 4) {
+        acc0 = _mm_add_ps(acc0, _mm_min_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+    float sum = horizontalSum(_mm_add_ps(_mm_add_ps(acc0, acc1), _mm_add_ps(acc2, acc3)));
+    return sum + intersectionScalar(a + i, b + i, n - i);
+}
+
+float dotSse(const float *a, const float *b, size_t n) {
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    __m128 acc2 = _mm_setzero_ps();
+    __m128 acc3 = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+        acc2 = _mm_add_ps(acc2, _mm_mul_ps(_mm_loadu_ps(a + i + 8), _mm_loadu_ps(b + i + 8)));
+        acc3 = _mm_add_ps(acc3, _mm_mul_ps(_mm_loadu_ps(a + i + 12), _mm_loadu_ps(b + i + 12)));
+    }
+    for (; i + 4 <= n; i += 4) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+    float sum = horizontalSum(_mm_add_ps(_mm_add_ps(acc0, acc1), _mm_add_ps(acc2, acc3)));
+    return sum + dotScalar(a + i, b + i, n - i);
+}
+
+void dot4Sse(const float *const *queries, const float *row, size_t n, float *out) {
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    __m128 acc2 = _mm_setzero_ps();
+    __m128 acc3 = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 value = _mm_loadu_ps(row + i);
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(queries[0] + i), value));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(queries[1] + i), value));
+        acc2 = _mm_add_ps(acc2, _mm_mul_ps(_mm_loadu_ps(queries[2] + i), value));
+        acc3 = _mm_add_ps(acc3, _mm_mul_ps(_mm_loadu_ps(queries[3] + i), value));
+    }
+    out[0] = horizontalSum(acc0) + dotScalar(queries[0] + i, row + i, n - i);
+    out[1] = horizontalSum(acc1) + dotScalar(queries[1] + i, row + i, n - i);
+    out[2] = horizontalSum(acc2) + dotScalar(queries[2] + i, row + i, n - i);
+    out[3] = horizontalSum(acc3) + dotScalar(queries[3] + i, row + i, n - i);
+}
+
+// AVX2 tails stay inside the VEX-encoded function: calling the legacy-SSE
+// kernels with dirty upper YMM state costs a transition penalty per row.
+__attribute__((target("avx2,fma"))) float horizontalSum256(__m256 v) {
+    return horizontalSum(_mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1)));
+}
+
+__attribute__((target("avx2,fma"))) float ssdAvx2(const float *a, const float *b, size_t n) {
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    __m256 acc2 = _mm256_setzero_ps();
+    __m256 acc3 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8));
+        __m256 d2 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16));
+        __m256 d3 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24));
+        acc0 = _mm256_fmadd_ps(d0, d0, acc0);
+        acc1 = _mm256_fmadd_ps(d1, d1, acc1);
+        acc2 = _mm256_fmadd_ps(d2, d2, acc2);
+        acc3 = _mm256_fmadd_ps(d3, d3, acc3);
+    }
+    for (; i + 8 <= n; i += 8) {
+        __m256 d = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        acc0 = _mm256_fmadd_ps(d, d, acc0);
+    }
+    float sum = horizontalSum256(
+        _mm256_add_ps(_mm256_add_ps(acc0, acc1), _mm256_add_ps(acc2, acc3)));
+    for (; i < n; ++i) {
+        float d = a[i] - b[i];
+        sum += d * d;
+    }
+    return sum;
+}
+
+__attribute__((target("avx2,fma"))) float intersectionAvx2(const float *a, const float *b, size_t n) {
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    __m256 acc2 = _mm256_setzero_ps();
+    __m256 acc3 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        acc0 = _mm256_add_ps(acc0, _mm256_min_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+        acc1 = _mm256_add_ps(acc1, _mm256_min_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8)));
+        acc2 = _mm256_add_ps(acc2, _mm256_min_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16)));
+        acc3 = _mm256_add_ps(acc3, _mm256_min_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24)));
+    }
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm256_add_ps(acc0, _mm256_min_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    }
+    float sum = horizontalSum256(
+        _mm256_add_ps(_mm256_add_ps(acc0, acc1), _mm256_add_ps(acc2, acc3)));
+    for (; i < n; ++i) {
+        sum += std::min(a[i], b[i]);
+    }
+    return sum;
+}
+
+__attribute__((target("avx2,fma"))) float dotAvx2(const float *a, const float *b, size_t n) {
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    __m256 acc2 = _mm256_setzero_ps();
+    __m256 acc3 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+        acc2 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16), acc2);
+        acc3 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24), acc3);
+    }
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+    }
+    float sum = horizontalSum256(
+        _mm256_add_ps(_mm256_add_ps(acc0, acc1), _mm256_add_ps(acc2, acc3)));
+    for (; i < n; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+__attribute__((target("avx2,fma"))) void dot4Avx2(const float *const *queries, const float *row, size_t n,
+                                                  float *out) {
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    __m256 acc2 = _mm256_setzero_ps();
+    __m256 acc3 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 value = _mm256_loadu_ps(row + i);
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(queries[0] + i), value, acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(queries[1] + i), value, acc1);
+        acc2 = _mm256_fmadd_ps(_mm256_loadu_ps(queries[2] + i), value, acc2);
+        acc3 = _mm256_fmadd_ps(_mm256_loadu_ps(queries[3] + i), value, acc3);
+    }
+    float sums[4] = {horizontalSum256(acc0), horizontalSum256(acc1), horizontalSum256(acc2),
+                     horizontalSum256(acc3)};
+    for (; i < n; ++i) {
+        for (size_t q = 0; q < 4; ++q) {
+            sums[q] += queries[q][i] * row[i];
+        }
+    }
+    std::copy(sums, sums + 4, out);
+}
+
+// GCC 12's AVX-512 intrinsic headers trip -Wuninitialized on their own
+// placeholder operands; silence it for this block only.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+// AVX-512 variants finish with a masked load instead of a scalar tail.
+__attribute__((target("avx512f"))) float ssdAvx512(const float *a, const float *b, size_t n) {
+    __m512 acc0 = _mm512_setzero_ps();
+    __m512 acc1 = _mm512_setzero_ps();
+    __m512 acc2 = _mm512_setzero_ps();
+    __m512 acc3 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+        __m512 d1 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16));
+        __m512 d2 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 32), _mm512_loadu_ps(b + i + 32));
+        __m512 d3 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 48), _mm512_loadu_ps(b + i + 48));
+        acc0 = _mm512_fmadd_ps(d0, d0, acc0);
+        acc1 = _mm512_fmadd_ps(d1, d1, acc1);
+        acc2 = _mm512_fmadd_ps(d2, d2, acc2);
+        acc3 = _mm512_fmadd_ps(d3, d3, acc3);
+    }
+    for (; i + 16 <= n; i += 16) {
+        __m512 d = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+        acc0 = _mm512_fmadd_ps(d, d, acc0);
+    }
+    if (i < n) {
+        __mmask16 mask = static_cast<__mmask16>((1u << (n - i)) - 1u);
+        __m512 d = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, a + i), _mm512_maskz_loadu_ps(mask, b + i));
+        acc1 = _mm512_fmadd_ps(d, d, acc1);
+    }
+    return _mm512_reduce_add_ps(_mm512_add_ps(_mm512_add_ps(acc0, acc1), _mm512_add_ps(acc2, acc3)));
+}
+
+__attribute__((target("avx512f"))) float intersectionAvx512(const float *a, const float *b, size_t n) {
+    __m512 acc0 = _mm512_setzero_ps();
+    __m512 acc1 = _mm512_setzero_ps();
+    __m512 acc2 = _mm512_setzero_ps();
+    __m512 acc3 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        acc0 = _mm512_add_ps(acc0, _mm512_min_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i)));
+        acc1 = _mm512_add_ps(acc1, _mm512_min_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16)));
+        acc2 = _mm512_add_ps(acc2, _mm512_min_ps(_mm512_loadu_ps(a + i + 32), _mm512_loadu_ps(b + i + 32)));
+        acc3 = _mm512_add_ps(acc3, _mm512_min_ps(_mm512_loadu_ps(a + i + 48), _mm512_loadu_ps(b + i + 48)));
+    }
+    for (; i + 16 <= n; i += 16) {
+        acc0 = _mm512_add_ps(acc0, _mm512_min_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i)));
+    }
+    if (i < n) {
+        __mmask16 mask = static_cast<__mmask16>((1u << (n - i)) - 1u);
+        acc1 = _mm512_add_ps(acc1, _mm512_min_ps(_mm512_maskz_loadu_ps(mask, a + i),
+                                                  _mm512_maskz_loadu_ps(mask, b + i)));
+    }
+    return _mm512_reduce_add_ps(_mm512_add_ps(_mm512_add_ps(acc0, acc1), _mm512_add_ps(acc2, acc3)));
+}
+
+__attribute__((target("avx512f"))) float dotAvx512(const float *a, const float *b, size_t n) {
+    __m512 acc0 = _mm512_setzero_ps();
+    __m512 acc1 = _mm512_setzero_ps();
+    __m512 acc2 = _mm512_setzero_ps();
+    __m512 acc3 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc0);
+        acc1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16), acc1);
+        acc2 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 32), _mm512_loadu_ps(b + i + 32), acc2);
+        acc3 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 48), _mm512_loadu_ps(b + i + 48), acc3);
+    }
+    for (; i + 16 <= n; i += 16) {
+        acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc0);
+    }
+    if (i < n) {
+        __mmask16 mask = static_cast<__mmask16>((1u << (n - i)) - 1u);
+        acc1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, a + i), _mm512_maskz_loadu_ps(mask, b + i), acc1);
+    }
+    return _mm512_reduce_add_ps(_mm512_add_ps(_mm512_add_ps(acc0, acc1), _mm512_add_ps(acc2, acc3)));
+}
+
+__attribute__((target("avx512f"))) void dot4Avx512(const float *const *queries, const float *row, size_t n,
+                                                   float *out) {
+    __m512 acc0 = _mm512_setzero_ps();
+    __m512 acc1 = _mm512_setzero_ps();
+    __m512 acc2 = _mm512_setzero_ps();
+    __m512 acc3 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512 value = _mm512_loadu_ps(row + i);
+        acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(queries[0] + i), value, acc0);
+        acc1 = _mm512_fmadd_ps(_mm512_loadu_ps(queries[1] + i), value, acc1);
+        acc2 = _mm512_fmadd_ps(_mm512_loadu_ps(queries[2] + i), value, acc2);
+        acc3 = _mm512_fmadd_ps(_mm512_loadu_ps(queries[3] + i), value, acc3);
+    }
+    if (i < n) {
+        __mmask16 mask = static_cast<__mmask16>((1u << (n - i)) - 1u);
+        __m512 value = _mm512_maskz_loadu_ps(mask, row + i);
+        acc0 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, queries[0] + i), value, acc0);
+        acc1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, queries[1] + i), value, acc1);
+        acc2 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, queries[2] + i), value, acc2);
+        acc3 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, queries[3] + i), value, acc3);
+    }
+    out[0] = _mm512_reduce_add_ps(acc0);
+    out[1] = _mm512_reduce_add_ps(acc1);
+    out[2] = _mm512_reduce_add_ps(acc2);
+    out[3] = _mm512_reduce_add_ps(acc3);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
+
+const DistanceKernels kScalarKernels = {SimdLevel::Scalar, ssdScalar, intersectionScalar, dotScalar, dot4Scalar};
+#ifdef CBIR_X86_KERNELS
+const DistanceKernels kSseKernels = {SimdLevel::Sse, ssdSse, intersectionSse, dotSse, dot4Sse};
+const DistanceKernels kAvx2Kernels = {SimdLevel::Avx2, ssdAvx2, intersectionAvx2, dotAvx2, dot4Avx2};
+const DistanceKernels kAvx512Kernels = {SimdLevel::Avx512, ssdAvx512, intersectionAvx512, dotAvx512,
+                                        dot4Avx512};
+#endif
+
+/**
+ * Parse the CBIR_SIMD override, defaulting to the highest level.
+ *
+ * @return Maximum level the user allows.
+ */
+SimdLevel simdLevelCap() {
+    const char *value = std::getenv("CBIR_SIMD");
+    if (value == nullptr) {
+        return SimdLevel::Avx512;
+    }
+    for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::Sse, SimdLevel::Avx2, SimdLevel::Avx512}) {
+        if (std::strcmp(value, simdLevelName(level)) == 0) {
+            return level;
+        }
+    }
+    return SimdLevel::Avx512;
+}
+
+/**
+ * Pick the best supported kernel table, honoring CBIR_SIMD.
+ *
+ * @return Selected kernel table.
+ */
+const DistanceKernels &selectDistanceKernels() {
+    SimdLevel cap = simdLevelCap();
+    for (SimdLevel level : {SimdLevel::Avx512, SimdLevel::Avx2, SimdLevel::Sse}) {
+        const DistanceKernels *kernels = distanceKernelsFor(level);
+        if (kernels != nullptr && level <= cap) {
+            return *kernels;
+        }
+    }
+    return kScalarKernels;
+}
+} // namespace
+
+/**
+ * Return the kernel table chosen for this process (selected once).
+ *
+ * @return Active kernel table.
+ */
+const DistanceKernels &activeDistanceKernels() {
+    static const DistanceKernels &kernels = selectDistanceKernels();
+    return kernels;
+}
+
+/**
+ * Return the kernel table for a level if the build and CPU support it.
+ *
+ * @param level Requested level.
+ * @return Kernel table or nullptr.
+ */
+const DistanceKernels *distanceKernelsFor(SimdLevel level) {
+    switch (level) {
+    case SimdLevel::Scalar:
+        return &kScalarKernels;
+#ifdef CBIR_X86_KERNELS
+    case SimdLevel::Sse:
+        return &kSseKernels;
+    case SimdLevel::Avx2:
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") ? &kAvx2Kernels
+                                                                                : nullptr;
+    case SimdLevel::Avx512:
+        return __builtin_cpu_supports("avx512f") ? &kAvx512Kernels : nullptr;
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+/**
+ * Name a SIMD level for logs and benchmark output.
+ *
+ * @param level Instruction set level.
+ * @return Static lower-case name.
+ */
+const char *simdLevelName(SimdLevel level) {
+    switch (level) {
+    case SimdLevel::Sse:
+        return "sse";
+    case SimdLevel::Avx2:
+        return "avx2";
+    case SimdLevel::Avx512:
+        return "avx512";
+    default:
+        return "scalar";
+    }
+}
@@ -5,9 +5,14 @@ Implements vector distance and similarity metrics.
 Provides SSD and histogram intersection utilities.
 Adds weighted multi-histogram distance support.
 Implements cosine distance with a zero-norm guard.
+Inner loops run on the SIMD kernels selected at startup.
+Bounded variants check a lower bound between chunks and abandon early.
 */
 #include "../include/distance_metrics.h"
 
+#include "../include/distance_kernels.h"
+#include "../include/profile.h"
+
 #include <algorithm>
 #include <cmath>
 #include <numeric>
@@ -21,16 +26,11 @@ Implements cosine distance with a zero-norm guard.
  * @return Sum of squared differences.
  * @throws std::runtime_error if sizes do not match.
  */
-float ssdDistance(const std::vector<float> &a, const std::vector<float> &b) {
-    if (a.size() != b.size()) {
+float ssdDistance(FloatView a, FloatView b) {
+    if (a.size != b.size) {
         throw std::runtime_error("SSD distance size mismatch.");
     }
-    float sum = 0.0f;
-    for (size_t i = 0; i < a.size(); ++i) {
-        float diff = a[i] - b[i];
-        sum += diff * diff;
-    }
-    return sum;
+    return activeDistanceKernels().ssd(a.data, b.data, a.size);
 }
 
 /**
@@ -42,16 +42,12 @@ float ssdDistance(const std::vector<float> &a, const std::vector<float> &b) {
  * @throws std::runtime_error if sizes do not match.
  */
 float histogramIntersectionSimilarity(
-    const std::vector<float> &a,
-    const std::vector<float> &b) {
-    if (a.size() != b.size()) {
+    FloatView a,
+    FloatView b) {
+    if (a.size != b.size) {
         throw std::runtime_error("Histogram intersection size mismatch.");
     }
-    float sum = 0.0f;
-    for (size_t i = 0; i < a.size(); ++i) {
-        sum += std::min(a[i], b[i]);
-    }
-    return sum;
+    return activeDistanceKernels().intersection(a.data, b.data, a.size);
 }
 
 /**
@@ -62,8 +58,8 @@ float histogramIntersectionSimilarity(
  * @return Distance value (1 - similarity).
  */
 float histogramIntersectionDistance(
-    const std::vector<float> &a,
-    const std::vector<float> &b) {
+    FloatView a,
+    FloatView b) {
     float similarity = histogramIntersectionSimilarity(a, b);
     return 1.0f - similarity;
 }
@@ -80,37 +76,156 @@ float histogramIntersectionDistance(
  * @throws std::runtime_error if sizes or weights do not match expectations.
  */
 float histogramIntersectionDistanceMulti(
-    const std::vector<float> &a,
-    const std::vector<float> &b,
+    FloatView a,
+    FloatView b,
+    size_t binsPerHistogram,
+    size_t histogramCount,
+    FloatView weights) {
+    return histogramIntersectionDistanceMultiBounded(
+        a, b, binsPerHistogram, histogramCount, weights, std::numeric_limits<float>::infinity());
+}
+
+/**
+ * Weighted multi-histogram distance, stopping once the weighted sum passes bound.
+ *
+ * @param a Concatenated histograms for image A.
+ * @param b Concatenated histograms for image B.
+ * @param binsPerHistogram Number of bins per region.
+ * @param histogramCount Number of regions.
+ * @param weights Per-region weights (size histogramCount).
+ * @param bound Distance the candidate must not exceed to be useful.
+ * @return Weighted intersection distance, or a value greater than bound.
+ * @throws std::runtime_error if sizes or weights do not match expectations.
+ */
+float histogramIntersectionDistanceMultiBounded(
+    FloatView a,
+    FloatView b,
     size_t binsPerHistogram,
     size_t histogramCount,
-    const std::vector<float> &weights) {
-    if (a.size() != b.size()) {
+    FloatView weights,
+    float bound) {
+    if (a.size != b.size) {
         throw std::runtime_error("Multi-histogram size mismatch.");
     }
-    if (weights.size() != histogramCount) {
+    if (a.size < binsPerHistogram * histogramCount) {
+        throw std::runtime_error("Multi-histogram is smaller than its regions.");
+    }
+    if (weights.size != histogramCount) {
         throw std::runtime_error("Multi-histogram weight size mismatch.");
     }
 
-    float weightSum = std::accumulate(weights.begin(), weights.end(), 0.0f);
+    float weightSum = std::accumulate(weights.data, weights.data + weights.size, 0.0f);
     if (weightSum <= 0.0f) {
         throw std::runtime_error("Multi-histogram weights must sum to > 0.");
     }
 
+    // Score each region in place; the inputs are read exactly once.
+    auto intersection = activeDistanceKernels().intersection;
+    // Region distances are non-negative, so total / weightSum only grows.
+    float limit = abandonThreshold(bound) * weightSum;
     float total = 0.0f;
     for (size_t region = 0; region < histogramCount; ++region) {
         size_t offset = region * binsPerHistogram;
-        // Slice out the histogram block for this region.
-        std::vector<float> histA(a.begin() + offset, a.begin() + offset + binsPerHistogram);
-        std::vector<float> histB(b.begin() + offset, b.begin() + offset + binsPerHistogram);
-        float distance = histogramIntersectionDistance(histA, histB);
-        total += distance * weights[region];
+        float similarity = intersection(a.data + offset, b.data + offset, binsPerHistogram);
+        total += (1.0f - similarity) * weights.data[region];
+        if (total > limit && region + 1 < histogramCount) {
+            profileCount(ProfileCounter::DistancesAbandoned, 1);
+            return total / weightSum;
+        }
     }
 
     // Normalize by total weight to keep distance scale comparable.
     return total / weightSum;
 }
 
+/**
+ * SSD with a partial-sum check every kAbandonChunk floats.
+ *
+ * @param a First feature vector.
+ * @param b Second feature vector.
+ * @param bound Distance the candidate must not exceed to be useful.
+ * @return Exact SSD, or a partial sum greater than bound.
+ * @throws std::runtime_error if sizes do not match.
+ */
+float ssdDistanceBounded(FloatView a, FloatView b, float bound) {
+    if (a.size != b.size) {
+        throw std::runtime_error("SSD distance size mismatch.");
+    }
+    auto ssd = activeDistanceKernels().ssd;
+    if (a.size > kAbandonChunk) {
+        float limit = abandonThreshold(bound);
+        float partial = 0.0f;
+        for (size_t offset = 0; offset < a.size; offset += kAbandonChunk) {
+            partial += ssd(a.data + offset, b.data + offset, std::min(kAbandonChunk, a.size - offset));
+            if (partial > limit) {
+                // A loser found only after the last chunk was not abandoned early.
+                if (offset + kAbandonChunk < a.size) {
+                    profileCount(ProfileCounter::DistancesAbandoned, 1);
+                }
+                return partial;
+            }
+        }
+    }
+    // Rescore survivors in one call so they match the exhaustive ranking exactly.
+    return ssd(a.data, b.data, a.size);
+}
+
+/**
+ * Sum a histogram from each chunk boundary to its end.
+ *
+ * @param histogram Query histogram.
+ * @return Tail sums, one per chunk plus a trailing 0.
+ */
+std::vector<float> histogramTailMass(FloatView histogram) {
+    size_t chunks = (histogram.size + kAbandonChunk - 1) / kAbandonChunk;
+    std::vector<float> tail(chunks + 1, 0.0f);
+    for (size_t chunk = chunks; chunk-- > 0;) {
+        size_t begin = chunk * kAbandonChunk;
+        size_t end = std::min(begin + kAbandonChunk, histogram.size);
+        tail[chunk] = std::accumulate(histogram.data + begin, histogram.data + end, tail[chunk + 1]);
+    }
+    return tail;
+}
+
+/**
+ * Histogram intersection distance with a remaining-mass check every chunk.
+ *
+ * @param a Query histogram.
+ * @param b Candidate histogram.
+ * @param aTailMass Tail sums of a from histogramTailMass.
+ * @param bound Distance the candidate must not exceed to be useful.
+ * @return Exact distance, or a lower bound greater than bound.
+ * @throws std::runtime_error if sizes do not match.
+ */
+float histogramIntersectionDistanceBounded(
+    FloatView a,
+    FloatView b,
+    FloatView aTailMass,
+    float bound) {
+    if (a.size != b.size) {
+        throw std::runtime_error("Histogram intersection size mismatch.");
+    }
+    auto intersection = activeDistanceKernels().intersection;
+    size_t chunks = (a.size + kAbandonChunk - 1) / kAbandonChunk;
+    if (chunks > 1 && aTailMass.size == chunks + 1) {
+        float limit = abandonThreshold(bound);
+        float partial = 0.0f;
+        for (size_t chunk = 0; chunk < chunks; ++chunk) {
+            size_t offset = chunk * kAbandonChunk;
+            partial += intersection(a.data + offset, b.data + offset, std::min(kAbandonChunk, a.size - offset));
+            // Each remaining bin adds at most a's share of it to the similarity.
+            float lowerBound = 1.0f - (partial + aTailMass.data[chunk + 1]);
+            if (lowerBound > limit) {
+                if (chunk + 1 < chunks) {
+                    profileCount(ProfileCounter::DistancesAbandoned, 1);
+                }
+                return lowerBound;
+            }
+        }
+    }
+    return 1.0f - intersection(a.data, b.data, a.size);
+}
+
 /**
  * Compute cosine distance (1 - cosine similarity) with zero-norm protection.
  *
@@ -119,21 +234,88 @@ float histogramIntersectionDistanceMulti(
  * @return Cosine distance (1 - similarity), or 1.0 if either norm is zero.
  * @throws std::runtime_error if sizes do not match.
  */
-float cosineDistance(const std::vector<float> &a, const std::vector<float> &b) {
-    if (a.size() != b.size()) {
+float cosineDistance(FloatView a, FloatView b) {
+    if (a.size != b.size) {
         throw std::runtime_error("Cosine distance size mismatch.");
     }
-    float dot = 0.0f;
-    float normA = 0.0f;
-    float normB = 0.0f;
-    for (size_t i = 0; i < a.size(); ++i) {
-        dot += a[i] * b[i];
-        normA += a[i] * a[i];
-        normB += b[i] * b[i];
-    }
+    const DistanceKernels &kernels = activeDistanceKernels();
+    float dot = kernels.dot(a.data, b.data, a.size);
+    float normA = kernels.dot(a.data, a.data, a.size);
+    float normB = kernels.dot(b.data, b.data, b.size);
     if (normA <= 0.0f || normB <= 0.0f) {
         return 1.0f;
     }
     float cosine = dot / (std::sqrt(normA) * std::sqrt(normB));
     return 1.0f - cosine;
 }
+
+/**
+ * Score one query against a block of rows with the SSD kernel.
+ *
+ * @param query Query vector.
+ * @param rows Contiguous row-major matrix.
+ * @param rowCount Number of rows.
+ * @param dimension Floats per row.
+ * @param distances Output distances.
+ */
+void ssdDistanceBatch(
+    const float *query,
+    const float *rows,
+    size_t rowCount,
+    size_t dimension,
+    float *distances) {
+    auto ssd = activeDistanceKernels().ssd;
+    for (size_t row = 0; row < rowCount; ++row) {
+        distances[row] = ssd(query, rows + row * dimension, dimension);
+    }
+}
+
+/**
+ * Score one query against a block of rows with the intersection kernel.
+ *
+ * @param query Query histogram.
+ * @param rows Contiguous row-major matrix.
+ * @param rowCount Number of rows.
+ * @param dimension Floats per row.
+ * @param distances Output distances (1 - similarity).
+ */
+void histogramIntersectionDistanceBatch(
+    const float *query,
+    const float *rows,
+    size_t rowCount,
+    size_t dimension,
+    float *distances) {
+    auto intersection = activeDistanceKernels().intersection;
+    for (size_t row = 0; row < rowCount; ++row) {
+        distances[row] = 1.0f - intersection(query, rows + row * dimension, dimension);
+    }
+}
+
+/**
+ * Score one query against a block of rows with cosine distance.
+ *
+ * @param query Query vector.
+ * @param rows Contiguous row-major matrix.
+ * @param rowCount Number of rows.
+ * @param dimension Floats per row.
+ * @param distances Output distances (1.0 where either norm is zero).
+ */
+void cosineDistanceBatch(
+    const float *query,
+    const float *rows,
+    size_t rowCount,
+    size_t dimension,
+    float *distances) {
+    auto dot = activeDistanceKernels().dot;
+    float queryNorm = dot(query, query, dimension);
+    float querySqrt = std::sqrt(queryNorm);
+    for (size_t row = 0; row < rowCount; ++row) {
+        const float *candidate = rows + row * dimension;
+        float rowNorm = dot(candidate, candidate, dimension);
+        if (queryNorm <= 0.0f || rowNorm <= 0.0f) {
+            distances[row] = 1.0f;
+            continue;
+        }
+        distances[row] = 1.0f - dot(query, candidate, dimension) / (querySqrt * std::sqrt(rowNorm));
+    }
+}
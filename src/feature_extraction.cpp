@@ -5,12 +5,20 @@ Implements image feature extraction routines.
 Builds histograms and patch features from OpenCV images.
 Provides multi-region and texture+color descriptors.
 Includes helpers for normalization and binning.
+Fuses RGB, rg, per-region and gray/Sobel extraction into one pixel walk.
+Bins pixels through lookup tables into interleaved integer sub-histograms.
+Specializes the walk at compile time for the bin counts the feature types use.
 */
 #include "../include/feature_extraction.h"
 
 #include <algorithm>
+#include <array>
 #include <cmath>
+#include <cstdint>
+#include <map>
+#include <mutex>
 #include <numeric>
+#include <utility>
 
 namespace {
 /**
@@ -68,8 +76,507 @@ int binForValue(float value, int bins) {
     int index = static_cast<int>(value * bins);
     return clampIndex(index, bins - 1);
 }
+
+// OpenCV's fixed-point BGR->gray weights (Q15), as used by cvtColor for 8-bit images.
+constexpr int kGrayShift = 15;
+constexpr int kGrayBlueWeight = 3735;
+constexpr int kGrayGreenWeight = 19235;
+constexpr int kGrayRedWeight = 9798;
+
+// Interleaved copies of each histogram; neighbouring pixels (which often share
+// a bin) update different copies, so increments do not wait on each other.
+constexpr size_t kSubHistograms = 4;
+// Sums of three 8-bit channels span [0, 765].
+constexpr size_t kChannelSumCount = 3 * 255 + 1;
+// Largest bins-per-channel whose chromaticity bins fit the uint8 table.
+constexpr int kMaxTableChromaticityBins = 256;
+// Bin counts of the classic feature types, which get compile-time specialized
+// walks; any other count takes the runtime path.
+constexpr int kFixedRgbBins = 8;
+constexpr int kFixedRgBins = 16;
+constexpr int kFixedSobelBins = 16;
+
+/**
+ * Base-2 logarithm of a power of two.
+ *
+ * @param value Power of two.
+ * @return Exponent.
+ */
+constexpr int log2Of(int value) {
+    return value <= 1 ? 0 : 1 + log2Of(value / 2);
+}
+
+/**
+ * RGB histogram bin of an 8-bit channel value for a power-of-two bin count.
+ *
+ * Equals binForValue(value / 255, Bins): value * Bins / 255 is never within
+ * 1/255 of a bin edge except at 255, which clamps to the last bin either way.
+ *
+ * @param value Channel value.
+ * @return Bin index in [0, Bins - 1].
+ */
+template <int Bins>
+constexpr int shiftBin(int value) {
+    static_assert(Bins > 0 && Bins <= 256 && (Bins & (Bins - 1)) == 0, "Bins must be a power of two");
+    return value >> (8 - log2Of(Bins));
+}
+
+/**
+ * Per-channel RGB bin tables, pre-scaled so a pixel's flattened bin is a sum.
+ * Entries equal binForValue(value / 255, bins), so results are unchanged.
+ */
+struct RgbBinLut {
+    int blue[256];
+    int green[256];
+    int red[256];
+
+    explicit RgbBinLut(int bins) {
+        for (int value = 0; value < 256; ++value) {
+            int bin = binForValue(static_cast<float>(value) / 255.0f, bins);
+            blue[value] = bin;
+            green[value] = bin * bins;
+            red[value] = bin * bins * bins;
+        }
+    }
+
+    int index(const cv::Vec3b &pixel) const {
+        return red[pixel[2]] + green[pixel[1]] + blue[pixel[0]];
+    }
+};
+
+/**
+ * r-g chromaticity histogram bin for one BGR pixel (direct computation).
+ *
+ * @param pixel BGR pixel.
+ * @param bins Number of bins per channel.
+ * @return Bin index in [0, bins^2 - 1].
+ */
+int rgBinIndex(const cv::Vec3b &pixel, int bins) {
+    float r = static_cast<float>(pixel[2]);
+    float g = static_cast<float>(pixel[1]);
+    float b = static_cast<float>(pixel[0]);
+    float sum = r + g + b;
+    // Normalize to chromaticity space; guard against divide-by-zero.
+    float rNorm = sum > 0.0f ? r / sum : 0.0f;
+    float gNorm = sum > 0.0f ? g / sum : 0.0f;
+    return (binForValue(rNorm, bins) * bins) + binForValue(gNorm, bins);
+}
+
+/**
+ * Division-free chromaticity bins: entry [sum * 256 + value] holds the bin of
+ * value / sum, computed exactly as rgBinIndex does. Built once per bin count
+ * and shared by all threads.
+ *
+ * @param bins Number of bins per channel (<= kMaxTableChromaticityBins).
+ * @return Table of kChannelSumCount * 256 bins.
+ */
+const std::vector<uint8_t> &chromaticityBinTable(int bins) {
+    static std::mutex tablesMutex;
+    static std::map<int, std::vector<uint8_t>> tables;
+    std::lock_guard<std::mutex> lock(tablesMutex);
+    auto &table = tables[bins];
+    if (table.empty()) {
+        table.resize(kChannelSumCount * 256, 0);
+        for (size_t sum = 1; sum < kChannelSumCount; ++sum) {
+            for (size_t value = 0; value <= std::min<size_t>(sum, 255); ++value) {
+                float norm = static_cast<float>(value) / static_cast<float>(sum);
+                table[sum * 256 + value] = static_cast<uint8_t>(binForValue(norm, bins));
+            }
+        }
+    }
+    return table;
+}
+
+/**
+ * Fold interleaved sub-histograms into one set of counts.
+ *
+ * @param counts kSubHistograms consecutive histograms of size bins.
+ * @param size Bins per histogram.
+ * @param total Accumulated counts (size bins).
+ */
+void addSubHistograms(const uint32_t *counts, size_t size, std::vector<uint32_t> &total) {
+    for (size_t sub = 0; sub < kSubHistograms; ++sub) {
+        const uint32_t *subPtr = counts + sub * size;
+        for (size_t i = 0; i < size; ++i) {
+            total[i] += subPtr[i];
+        }
+    }
+}
+
+/**
+ * Convert integer bin counts to a normalized float histogram.
+ *
+ * @param counts Bin counts.
+ * @return Normalized histogram.
+ */
+std::vector<float> countsToHistogram(const std::vector<uint32_t> &counts) {
+    return normalizeHistogram(std::vector<float>(counts.begin(), counts.end()));
+}
+
+/**
+ * Row range [start, end) of one horizontal region.
+ *
+ * @param rows Image height.
+ * @param regionCount Number of regions.
+ * @param region Region index.
+ * @return Start and end rows; the last region absorbs the remainder.
+ */
+std::pair<int, int> regionRowRange(int rows, int regionCount, int region) {
+    int rowsPerRegion = rows / regionCount;
+    int startRow = region * rowsPerRegion;
+    int endRow = (region == regionCount - 1) ? rows : (region + 1) * rowsPerRegion;
+    return {startRow, endRow};
+}
+
+/**
+ * Start rows of the bands formed by every requested region boundary.
+ *
+ * @param rows Image height.
+ * @param regionCounts Requested region splits.
+ * @return Sorted unique band start rows, followed by rows as the end sentinel.
+ */
+std::vector<int> bandBoundaries(int rows, const std::vector<int> &regionCounts) {
+    std::vector<int> boundaries = {0, rows};
+    for (int regionCount : regionCounts) {
+        for (int region = 1; region < regionCount; ++region) {
+            boundaries.push_back(regionRowRange(rows, regionCount, region).first);
+        }
+    }
+    std::sort(boundaries.begin(), boundaries.end());
+    boundaries.erase(std::unique(boundaries.begin(), boundaries.end()), boundaries.end());
+    return boundaries;
+}
+
+/**
+ * Sum band histograms whose rows fall in [startRow, endRow).
+ *
+ * @param bandCounts Band histograms, kSubHistograms x bandSize counts each.
+ * @param boundaries Band start rows (with end sentinel).
+ * @param bandSize Bins per band histogram.
+ * @param startRow First row.
+ * @param endRow One past the last row.
+ * @return Summed counts.
+ */
+std::vector<uint32_t> sumBands(
+    const std::vector<uint32_t> &bandCounts,
+    const std::vector<int> &boundaries,
+    size_t bandSize,
+    int startRow,
+    int endRow) {
+    std::vector<uint32_t> counts(bandSize, 0);
+    for (size_t band = 0; band + 1 < boundaries.size(); ++band) {
+        if (boundaries[band] < startRow || boundaries[band] >= endRow) {
+            continue;
+        }
+        addSubHistograms(bandCounts.data() + band * kSubHistograms * bandSize, bandSize, counts);
+    }
+    return counts;
+}
+
+/**
+ * Gray value of one BGR pixel, rounded as cvtColor does for 8-bit images.
+ *
+ * @param pixel BGR pixel.
+ * @return Gray value.
+ */
+uchar grayValue(const cv::Vec3b &pixel) {
+    int weighted = pixel[0] * kGrayBlueWeight + pixel[1] * kGrayGreenWeight + pixel[2] * kGrayRedWeight;
+    return static_cast<uchar>((weighted + (1 << (kGrayShift - 1))) >> kGrayShift);
+}
+
+/**
+ * Pixel walk for any bin counts, binning through lookup tables.
+ *
+ * @param image Input BGR image.
+ * @param request Descriptors and bin settings.
+ * @param boundaries Band start rows (with end sentinel).
+ * @param bandBins RGB bins per channel of the band histograms.
+ * @param countBands Whether band histograms are counted.
+ * @param separateRgb Whether the whole-image RGB histogram has its own bins.
+ * @param gray Receives gray values when non-null (CV_8UC1, image-sized).
+ * @param bandCounts Receives band sub-histograms.
+ * @param rgbCounts Receives whole-image RGB sub-histograms (separateRgb only).
+ * @param rgCounts Receives rg sub-histograms.
+ */
+void countPixelsRuntime(
+    const cv::Mat &image,
+    const DescriptorRequest &request,
+    const std::vector<int> &boundaries,
+    int bandBins,
+    bool countBands,
+    bool separateRgb,
+    cv::Mat *gray,
+    std::vector<uint32_t> &bandCounts,
+    std::vector<uint32_t> &rgbCounts,
+    std::vector<uint32_t> &rgCounts) {
+    bool wantRg = request.rgBins > 0;
+    size_t bandSize = countBands ? static_cast<size_t>(bandBins * bandBins * bandBins) : 0;
+    size_t rgbSize = separateRgb ? static_cast<size_t>(request.rgbBins * request.rgbBins * request.rgbBins) : 0;
+    size_t rgSize = wantRg ? static_cast<size_t>(request.rgBins * request.rgBins) : 0;
+    RgbBinLut bandLut(countBands ? bandBins : 1);
+    RgbBinLut rgbLut(separateRgb ? request.rgbBins : 1);
+    bool rgTable = wantRg && request.rgBins <= kMaxTableChromaticityBins;
+    const uint8_t *rgBins = rgTable ? chromaticityBinTable(request.rgBins).data() : nullptr;
+
+    size_t band = 0;
+    for (int row = 0; row < image.rows; ++row) {
+        while (row >= boundaries[band + 1]) {
+            ++band;
+        }
+        uint32_t *bandPtr = bandCounts.data() + band * kSubHistograms * bandSize;
+        const auto *rowPtr = image.ptr<cv::Vec3b>(row);
+        uchar *grayPtr = gray != nullptr ? gray->ptr<uchar>(row) : nullptr;
+        for (int col = 0; col < image.cols; ++col) {
+            const cv::Vec3b &pixel = rowPtr[col];
+            size_t sub = static_cast<size_t>(col) & (kSubHistograms - 1);
+            if (countBands) {
+                ++bandPtr[sub * bandSize + bandLut.index(pixel)];
+            }
+            if (separateRgb) {
+                ++rgbCounts[sub * rgbSize + rgbLut.index(pixel)];
+            }
+            if (rgTable) {
+                const uint8_t *sumRow = rgBins + (pixel[0] + pixel[1] + pixel[2]) * 256;
+                ++rgCounts[sub * rgSize + sumRow[pixel[2]] * request.rgBins + sumRow[pixel[1]]];
+            } else if (wantRg) {
+                ++rgCounts[sub * rgSize + rgBinIndex(pixel, request.rgBins)];
+            }
+            if (grayPtr != nullptr) {
+                grayPtr[col] = grayValue(pixel);
+            }
+        }
+    }
+}
+
+/**
+ * Pixel walk with the band RGB and rg bin counts fixed at compile time.
+ *
+ * RGB bins are shifts of the channel values and rg table bins are combined
+ * with a shift. Counts go to constexpr-sized std::array sub-histograms and are
+ * copied out in the layout of the runtime walk, so both feed the same
+ * finishing code and give identical descriptors.
+ *
+ * @tparam BandBins RGB bins per channel of the band histograms (0 = not counted).
+ * @tparam RgBins rg chromaticity bins per channel (0 = not counted).
+ * @param image Input BGR image.
+ * @param boundaries Band start rows (with end sentinel).
+ * @param gray Receives gray values when non-null (CV_8UC1, image-sized).
+ * @param bandCounts Receives band sub-histograms (bands x kSubHistograms x BandBins^3).
+ * @param rgCounts Receives rg sub-histograms (kSubHistograms x RgBins^2).
+ */
+template <int BandBins, int RgBins>
+void countPixelsFixed(
+    const cv::Mat &image,
+    const std::vector<int> &boundaries,
+    cv::Mat *gray,
+    std::vector<uint32_t> &bandCounts,
+    std::vector<uint32_t> &rgCounts) {
+    constexpr size_t kBandSize = static_cast<size_t>(BandBins * BandBins * BandBins);
+    constexpr size_t kRgSize = static_cast<size_t>(RgBins * RgBins);
+    constexpr int kBandBits = log2Of(BandBins);
+    constexpr int kRgBits = log2Of(RgBins);
+    static_assert(RgBins == 0 || (RgBins & (RgBins - 1)) == 0, "RgBins must be a power of two");
+
+    std::vector<std::array<uint32_t, kSubHistograms * kBandSize>> bands(boundaries.size() - 1);
+    std::array<uint32_t, kSubHistograms * kRgSize> rg {};
+    const uint8_t *rgTable = RgBins > 0 ? chromaticityBinTable(RgBins).data() : nullptr;
+
+    size_t band = 0;
+    for (int row = 0; row < image.rows; ++row) {
+        while (row >= boundaries[band + 1]) {
+            ++band;
+        }
+        uint32_t *bandPtr = bands[band].data();
+        const auto *rowPtr = image.ptr<cv::Vec3b>(row);
+        uchar *grayPtr = gray != nullptr ? gray->ptr<uchar>(row) : nullptr;
+        for (int col = 0; col < image.cols; ++col) {
+            const cv::Vec3b &pixel = rowPtr[col];
+            size_t sub = static_cast<size_t>(col) & (kSubHistograms - 1);
+            if constexpr (BandBins > 0) {
+                size_t bin = static_cast<size_t>((shiftBin<BandBins>(pixel[2]) << (2 * kBandBits)) |
+                                                 (shiftBin<BandBins>(pixel[1]) << kBandBits) |
+                                                 shiftBin<BandBins>(pixel[0]));
+                ++bandPtr[sub * kBandSize + bin];
+            }
+            if constexpr (RgBins > 0) {
+                const uint8_t *sumRow = rgTable + (pixel[0] + pixel[1] + pixel[2]) * 256;
+                ++rg[sub * kRgSize + ((static_cast<size_t>(sumRow[pixel[2]]) << kRgBits) | sumRow[pixel[1]])];
+            }
+            if (grayPtr != nullptr) {
+                grayPtr[col] = grayValue(pixel);
+            }
+        }
+    }
+
+    for (size_t b = 0; b < bands.size(); ++b) {
+        std::copy(bands[b].begin(), bands[b].end(), bandCounts.begin() + b * kSubHistograms * kBandSize);
+    }
+    std::copy(rg.begin(), rg.end(), rgCounts.begin());
+}
+
+/**
+ * Sobel gradient magnitudes of a gray image and their maximum.
+ *
+ * @param gray Gray image (CV_8UC1).
+ * @param maxMagnitude Receives the largest magnitude.
+ * @return Magnitude image (CV_32F).
+ */
+cv::Mat sobelMagnitude(const cv::Mat &gray, float &maxMagnitude) {
+    cv::Mat gradX;
+    cv::Mat gradY;
+    cv::Sobel(gray, gradX, CV_32F, 1, 0, 3);
+    cv::Sobel(gray, gradY, CV_32F, 0, 1, 3);
+    cv::Mat magnitude;
+    cv::magnitude(gradX, gradY, magnitude);
+
+    double maxValue = 0.0;
+    cv::minMaxLoc(magnitude, nullptr, &maxValue);
+    maxMagnitude = static_cast<float>(maxValue);
+    return magnitude;
+}
+
+/**
+ * Compute a normalized Sobel magnitude histogram from a gray image.
+ *
+ * @param gray Gray image (CV_8UC1).
+ * @param bins Number of magnitude bins.
+ * @return Normalized Sobel magnitude histogram.
+ */
+std::vector<float> sobelHistogramFromGray(const cv::Mat &gray, int bins) {
+    float maxMagnitude = 0.0f;
+    cv::Mat magnitude = sobelMagnitude(gray, maxMagnitude);
+    if (maxMagnitude <= 0.0f) {
+        return std::vector<float>(bins, 0.0f);
+    }
+
+    std::vector<uint32_t> counts(bins, 0);
+    for (int row = 0; row < magnitude.rows; ++row) {
+        const auto *rowPtr = magnitude.ptr<float>(row);
+        for (int col = 0; col < magnitude.cols; ++col) {
+            // Normalize magnitude to [0, 1] before binning.
+            float normalized = rowPtr[col] / maxMagnitude;
+            ++counts[binForValue(normalized, bins)];
+        }
+    }
+    return countsToHistogram(counts);
+}
+
+/**
+ * Sobel magnitude histogram with the bin count fixed at compile time.
+ *
+ * Bins the same way as the runtime version, into a std::array of counts.
+ *
+ * @tparam Bins Number of magnitude bins.
+ * @param gray Gray image (CV_8UC1).
+ * @return Normalized Sobel magnitude histogram.
+ */
+template <int Bins>
+std::vector<float> sobelHistogramFromGray(const cv::Mat &gray) {
+    float maxMagnitude = 0.0f;
+    cv::Mat magnitude = sobelMagnitude(gray, maxMagnitude);
+    if (maxMagnitude <= 0.0f) {
+        return std::vector<float>(Bins, 0.0f);
+    }
+
+    std::array<uint32_t, Bins> counts {};
+    for (int row = 0; row < magnitude.rows; ++row) {
+        const auto *rowPtr = magnitude.ptr<float>(row);
+        for (int col = 0; col < magnitude.cols; ++col) {
+            int bin = static_cast<int>(rowPtr[col] / maxMagnitude * static_cast<float>(Bins));
+            ++counts[static_cast<size_t>(std::min(std::max(bin, 0), Bins - 1))];
+        }
+    }
+    return normalizeHistogram(std::vector<float>(counts.begin(), counts.end()));
+}
 } // namespace
 
+/**
+ * Walk the pixels once and build every requested descriptor.
+ *
+ * @param image Input BGR image.
+ * @param request Descriptors to compute.
+ * @return Normalized descriptors.
+ */
+DescriptorSet extractDescriptors(const cv::Mat &image, const DescriptorRequest &request) {
+    bool wantRegions = !request.regionCounts.empty();
+    bool wantRg = request.rgBins > 0;
+    bool wantGray = request.sobelBins > 0;
+    // Band histograms serve the regions and, when the bins agree, the whole image.
+    int bandBins = wantRegions ? request.regionBins : request.rgbBins;
+    bool countBands = wantRegions || request.rgbBins > 0;
+    bool separateRgb = wantRegions && request.rgbBins > 0 && request.rgbBins != request.regionBins;
+    DescriptorSet descriptors;
+    if (!countBands && !wantRg && !wantGray) {
+        return descriptors;
+    }
+
+    size_t bandSize = countBands ? static_cast<size_t>(bandBins * bandBins * bandBins) : 0;
+    size_t rgbSize = separateRgb ? static_cast<size_t>(request.rgbBins * request.rgbBins * request.rgbBins) : 0;
+    size_t rgSize = wantRg ? static_cast<size_t>(request.rgBins * request.rgBins) : 0;
+    std::vector<int> boundaries = bandBoundaries(image.rows, request.regionCounts);
+    std::vector<uint32_t> bandCounts(kSubHistograms * bandSize * (boundaries.size() - 1), 0);
+    std::vector<uint32_t> rgbCounts(kSubHistograms * rgbSize, 0);
+    std::vector<uint32_t> rgCounts(kSubHistograms * rgSize, 0);
+    cv::Mat gray;
+    if (wantGray) {
+        gray = cv::Mat(image.rows, image.cols, CV_8UC1);
+    }
+
+    // The feature types' own bin counts take a specialized walk; the rest use tables.
+    bool fixedBands = !countBands || bandBins == kFixedRgbBins;
+    bool fixedRg = !wantRg || request.rgBins == kFixedRgBins;
+    if (!separateRgb && fixedBands && fixedRg) {
+        cv::Mat *grayOut = wantGray ? &gray : nullptr;
+        if (countBands && wantRg) {
+            countPixelsFixed<kFixedRgbBins, kFixedRgBins>(image, boundaries, grayOut, bandCounts, rgCounts);
+        } else if (countBands) {
+            countPixelsFixed<kFixedRgbBins, 0>(image, boundaries, grayOut, bandCounts, rgCounts);
+        } else if (wantRg) {
+            countPixelsFixed<0, kFixedRgBins>(image, boundaries, grayOut, bandCounts, rgCounts);
+        } else {
+            countPixelsFixed<0, 0>(image, boundaries, grayOut, bandCounts, rgCounts);
+        }
+    } else {
+        countPixelsRuntime(image, request, boundaries, bandBins, countBands, separateRgb,
+                           wantGray ? &gray : nullptr, bandCounts, rgbCounts, rgCounts);
+    }
+
+    if (separateRgb) {
+        std::vector<uint32_t> counts(rgbSize, 0);
+        addSubHistograms(rgbCounts.data(), rgbSize, counts);
+        descriptors.rgb = countsToHistogram(counts);
+    } else if (request.rgbBins > 0) {
+        descriptors.rgb = countsToHistogram(sumBands(bandCounts, boundaries, bandSize, 0, image.rows));
+    }
+    for (int regionCount : request.regionCounts) {
+        if (regionCount <= 1) {
+            descriptors.regions.push_back(
+                countsToHistogram(sumBands(bandCounts, boundaries, bandSize, 0, image.rows)));
+            continue;
+        }
+        std::vector<float> feature;
+        feature.reserve(bandSize * regionCount);
+        for (int region = 0; region < regionCount; ++region) {
+            auto rows = regionRowRange(image.rows, regionCount, region);
+            auto regionHist = countsToHistogram(
+                sumBands(bandCounts, boundaries, bandSize, rows.first, rows.second));
+            feature.insert(feature.end(), regionHist.begin(), regionHist.end());
+        }
+        descriptors.regions.push_back(std::move(feature));
+    }
+    if (wantRg) {
+        std::vector<uint32_t> counts(rgSize, 0);
+        addSubHistograms(rgCounts.data(), rgSize, counts);
+        descriptors.rgChromaticity = countsToHistogram(counts);
+    }
+    if (wantGray) {
+        descriptors.sobel = request.sobelBins == kFixedSobelBins
+                                ? sobelHistogramFromGray<kFixedSobelBins>(gray)
+                                : sobelHistogramFromGray(gray, request.sobelBins);
+    }
+    return descriptors;
+}
+
 /**
  * Extract a center patch and flatten BGR pixels into a feature vector.
  *
@@ -110,27 +617,9 @@ std::vector<float> extractCenterPatchFeature(const cv::Mat &image, int patchSize
  * @return Normalized RGB histogram.
  */
 std::vector<float> extractRgbHistogram(const cv::Mat &image, int binsPerChannel) {
-    int totalBins = binsPerChannel * binsPerChannel * binsPerChannel;
-    std::vector<float> histogram(totalBins, 0.0f);
-
-    for (int row = 0; row < image.rows; ++row) {
-        const auto *rowPtr = image.ptr<cv::Vec3b>(row);
-        for (int col = 0; col < image.cols; ++col) {
-            const cv::Vec3b &pixel = rowPtr[col];
-            float b = static_cast<float>(pixel[0]) / 255.0f;
-            float g = static_cast<float>(pixel[1]) / 255.0f;
-            float r = static_cast<float>(pixel[2]) / 255.0f;
-            int binB = binForValue(b, binsPerChannel);
-            int binG = binForValue(g, binsPerChannel);
-            int binR = binForValue(r, binsPerChannel);
-            // Flatten 3D bin coordinates into a single index.
-            int index = (binR * binsPerChannel * binsPerChannel) +
-                        (binG * binsPerChannel) + binB;
-            histogram[index] += 1.0f;
-        }
-    }
-
-    return normalizeHistogram(histogram);
+    DescriptorRequest request;
+    request.rgbBins = binsPerChannel;
+    return extractDescriptors(image, request).rgb;
 }
 
 /**
@@ -141,28 +630,9 @@ std::vector<float> extractRgbHistogram(const cv::Mat &image, int binsPerChannel)
  * @return Normalized r-g chromaticity histogram.
  */
 std::vector<float> extractRgChromaticityHistogram(const cv::Mat &image, int binsPerChannel) {
-    int totalBins = binsPerChannel * binsPerChannel;
-    std::vector<float> histogram(totalBins, 0.0f);
-
-    for (int row = 0; row < image.rows; ++row) {
-        const auto *rowPtr = image.ptr<cv::Vec3b>(row);
-        for (int col = 0; col < image.cols; ++col) {
-            const cv::Vec3b &pixel = rowPtr[col];
-            float r = static_cast<float>(pixel[2]);
-            float g = static_cast<float>(pixel[1]);
-            float b = static_cast<float>(pixel[0]);
-            float sum = r + g + b;
-            // Normalize to chromaticity space; guard against divide-by-zero.
-            float rNorm = sum > 0.0f ? r / sum : 0.0f;
-            float gNorm = sum > 0.0f ? g / sum : 0.0f;
-            int binR = binForValue(rNorm, binsPerChannel);
-            int binG = binForValue(gNorm, binsPerChannel);
-            int index = (binR * binsPerChannel) + binG;
-            histogram[index] += 1.0f;
-        }
-    }
-
-    return normalizeHistogram(histogram);
+    DescriptorRequest request;
+    request.rgBins = binsPerChannel;
+    return extractDescriptors(image, request).rgChromaticity;
 }
 
 /**
@@ -177,23 +647,10 @@ std::vector<float> extractMultiRegionRgbHistogram(
     const cv::Mat &image,
     int binsPerChannel,
     int regionCount) {
-    std::vector<float> feature;
-    if (regionCount <= 1) {
-        return extractRgbHistogram(image, binsPerChannel);
-    }
-
-    int rowsPerRegion = image.rows / regionCount;
-    for (int region = 0; region < regionCount; ++region) {
-        int startRow = region * rowsPerRegion;
-        int endRow = (region == regionCount - 1) ? image.rows
-                                                 : (region + 1) * rowsPerRegion;
-        // Compute per-region histogram and append to the feature vector.
-        cv::Mat slice = image.rowRange(startRow, endRow);
-        auto regionHist = extractRgbHistogram(slice, binsPerChannel);
-        feature.insert(feature.end(), regionHist.begin(), regionHist.end());
-    }
-
-    return feature;
+    DescriptorRequest request;
+    request.regionCounts = {regionCount};
+    request.regionBins = binsPerChannel;
+    return std::move(extractDescriptors(image, request).regions.front());
 }
 
 /**
@@ -204,34 +661,9 @@ std::vector<float> extractMultiRegionRgbHistogram(
  * @return Normalized Sobel magnitude histogram.
  */
 std::vector<float> extractSobelMagnitudeHistogram(const cv::Mat &image, int bins) {
-    cv::Mat gray;
-    cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
-    cv::Mat gradX;
-    cv::Mat gradY;
-    cv::Sobel(gray, gradX, CV_32F, 1, 0, 3);
-    cv::Sobel(gray, gradY, CV_32F, 0, 1, 3);
-    cv::Mat magnitude;
-    cv::magnitude(gradX, gradY, magnitude);
-
-    double maxValue = 0.0;
-    cv::minMaxLoc(magnitude, nullptr, &maxValue);
-    float maxMagnitude = static_cast<float>(maxValue);
-    if (maxMagnitude <= 0.0f) {
-        return std::vector<float>(bins, 0.0f);
-    }
-
-    std::vector<float> histogram(bins, 0.0f);
-    for (int row = 0; row < magnitude.rows; ++row) {
-        const auto *rowPtr = magnitude.ptr<float>(row);
-        for (int col = 0; col < magnitude.cols; ++col) {
-            // Normalize magnitude to [0, 1] before binning.
-            float normalized = rowPtr[col] / maxMagnitude;
-            int bin = binForValue(normalized, bins);
-            histogram[bin] += 1.0f;
-        }
-    }
-
-    return normalizeHistogram(histogram);
+    DescriptorRequest request;
+    request.sobelBins = bins;
+    return extractDescriptors(image, request).sobel;
 }
 
 /**
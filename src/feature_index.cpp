@@ -0,0 +1,380 @@
+/*
+Authors - Joseph Defendre, Sourav Das
+
+Implements the offline feature index builder.
+Walks the database directory and extracts features once.
+Builds several feature types from a single decode per image.
+Writes (path, feature) rows as a binary store or features CSV.
+Optionally decodes at reduced resolution and records the scale in stores.
+Reuses stored rows whose source file size and mtime are unchanged.
+Hashes file contents and extracts byte-identical copies only once.
+Queries read the rows back instead of decoding images.
+*/
+#include "../include/feature_index.h"
+
+#include "../include/feature_store.h"
+#include "../include/feature_types.h"
+#include "../include/image_io.h"
+#include "../include/parallel.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+constexpr size_t kNoRow = static_cast<size_t>(-1);
+
+/**
+ * Open the existing store at path if its rows can be reused for info.
+ *
+ * A store is reusable when it records source file stamps, was built with
+ * the same feature type, bins, regions and decode scale, and records content
+ * hashes exactly when this build deduplicates. Anything else (missing,
+ * unreadable, older format, other settings) means a full rebuild.
+ *
+ * @param path Index path about to be rewritten.
+ * @param info Settings of the new build.
+ * @param deduplicate Whether the new build folds duplicates.
+ * @return Mapped store, or nullptr if nothing can be reused.
+ */
+std::unique_ptr<FeatureStore> openReusableStore(
+    const std::string &path,
+    const FeatureStoreInfo &info,
+    bool deduplicate) {
+    if (!isFeatureStoreFile(path)) {
+        return nullptr;
+    }
+    std::unique_ptr<FeatureStore> store;
+    try {
+        store = std::make_unique<FeatureStore>(path);
+    } catch (const std::runtime_error &) {
+        return nullptr;
+    }
+    const FeatureStoreInfo &stored = store->info();
+    bool sameSettings = stored.featureType == info.featureType &&
+                        stored.binsPerChannel == info.binsPerChannel &&
+                        stored.regionCount == info.regionCount &&
+                        stored.decodeScale == info.decodeScale;
+    if (!sameSettings || !store->hasStamps() || store->hasContentHashes() != deduplicate) {
+        return nullptr;
+    }
+    return store;
+}
+
+/**
+ * Hash a file's bytes: FNV-1a over 8-byte words, then a final avalanche.
+ *
+ * Equal hashes only nominate duplicates; the bytes are compared before rows
+ * are shared.
+ *
+ * @param bytes File contents.
+ * @return 64-bit content hash.
+ */
+uint64_t contentHashOf(const std::vector<uchar> &bytes) {
+    uint64_t hash = 14695981039346656037ull;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= bytes.size(); i += sizeof(uint64_t)) {
+        uint64_t word = 0;
+        std::memcpy(&word, bytes.data() + i, sizeof(word));
+        hash = (hash ^ word) * 1099511628211ull;
+    }
+    for (; i < bytes.size(); ++i) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    hash ^= bytes.size();
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    return hash;
+}
+} // namespace
+
+/**
+ * Build the default index path inside the database directory.
+ *
+ * @param databaseDir Database directory.
+ * @param featureType Classic feature type name.
+ * @return Default features CSV path.
+ */
+std::string defaultIndexPath(const std::string &databaseDir, const std::string &featureType) {
+    return (std::filesystem::path(databaseDir) / (featureType + ".features.bin")).string();
+}
+
+/**
+ * Select the CSV format by file extension.
+ *
+ * @param path Index path.
+ * @return True for ".csv" paths.
+ */
+bool isCsvIndexPath(const std::string &path) {
+    return std::filesystem::path(path).extension() == ".csv";
+}
+
+/**
+ * Extract and persist features for every image in the directory.
+ *
+ * @param databaseDir Database directory.
+ * @param featureType Classic feature type name.
+ * @param outputPath Destination index path (".csv" selects CSV).
+ * @param options Threads, decode scale and incremental mode.
+ * @return Row counts of the written index.
+ * @throws std::runtime_error on unknown feature type, load failure or write failure.
+ */
+IndexBuildStats buildFeatureIndex(
+    const std::string &databaseDir,
+    const std::string &featureType,
+    const std::string &outputPath,
+    const IndexBuildOptions &options) {
+    return buildFeatureIndexes(databaseDir, {featureType}, {outputPath}, options).front();
+}
+
+/**
+ * Decode each image once and persist several feature types from it.
+ *
+ * @param databaseDir Database directory.
+ * @param featureTypes Classic feature type names.
+ * @param outputPaths Destination index path per feature type.
+ * @param options Threads, decode scale and incremental mode.
+ * @return Row counts per index.
+ * @throws std::runtime_error on unknown feature type, load failure or write failure.
+ */
+std::vector<IndexBuildStats> buildFeatureIndexes(
+    const std::string &databaseDir,
+    const std::vector<std::string> &featureTypes,
+    const std::vector<std::string> &outputPaths,
+    const IndexBuildOptions &options) {
+    if (featureTypes.size() != outputPaths.size()) {
+        throw std::runtime_error("Expected one index path per feature type");
+    }
+    for (const auto &featureType : featureTypes) {
+        if (!isClassicFeatureType(featureType)) {
+            throw std::runtime_error("Feature type cannot be indexed: " + featureType);
+        }
+    }
+    if (!isValidDecodeScale(options.decodeScale)) {
+        throw std::runtime_error("Decode scale must be 1, 2, 4 or 8");
+    }
+
+    // Group the types by effective decode scale: one decode per group per image.
+    std::vector<int> scales;
+    std::vector<std::vector<size_t>> groups;
+    for (size_t t = 0; t < featureTypes.size(); ++t) {
+        int scale = decodeScaleFor(featureTypes[t], options.decodeScale);
+        auto it = std::find(scales.begin(), scales.end(), scale);
+        if (it == scales.end()) {
+            scales.push_back(scale);
+            groups.emplace_back();
+            it = scales.end() - 1;
+        }
+        groups[static_cast<size_t>(it - scales.begin())].push_back(t);
+    }
+
+    auto imageFiles = listImageFiles(databaseDir, options.threadCount);
+    std::vector<FileStamp> stamps(imageFiles.size());
+    parallelFor(imageFiles.size(), options.threadCount, [&](size_t i) {
+        stamps[i] = fileStampOf(imageFiles[i]);
+    });
+
+    std::vector<IndexBuildStats> stats(featureTypes.size());
+    std::vector<FeatureStoreInfo> infos;
+    std::vector<std::unique_ptr<FeatureStore>> previous(featureTypes.size());
+    // previousRows[t][i]: row of image i in the previous store for type t, or kNoRow.
+    std::vector<std::vector<size_t>> previousRows(featureTypes.size());
+    // Content hashes; reused rows carry theirs, the rest are hashed below.
+    std::vector<uint64_t> hashes(imageFiles.size(), 0);
+    std::vector<uint8_t> hashKnown(imageFiles.size(), 0);
+    for (size_t t = 0; t < featureTypes.size(); ++t) {
+        FeatureStoreInfo info = featureTypeInfo(featureTypes[t]);
+        info.decodeScale = decodeScaleFor(featureTypes[t], options.decodeScale);
+        infos.push_back(info);
+        previousRows[t].assign(imageFiles.size(), kNoRow);
+        stats[t].images = imageFiles.size();
+        if (options.incremental && !isCsvIndexPath(outputPaths[t])) {
+            previous[t] = openReusableStore(outputPaths[t], info, options.deduplicate);
+        }
+        if (previous[t] == nullptr) {
+            continue;
+        }
+
+        // Duplicates folded into a row reuse it too, under their own stamps.
+        const FeatureStore &store = *previous[t];
+        std::unordered_map<std::string_view, std::pair<size_t, FileStamp>> rowByName;
+        rowByName.reserve(store.rowCount());
+        size_t previousImages = 0;
+        for (size_t row = 0; row < store.rowCount(); ++row) {
+            rowByName.emplace(store.filename(row), std::make_pair(row, store.stamp(row)));
+            auto [first, last] = store.duplicateRange(row);
+            for (size_t d = first; d < last; ++d) {
+                rowByName.emplace(store.duplicateName(d), std::make_pair(row, store.duplicateStamp(d)));
+            }
+            previousImages += 1 + last - first;
+        }
+        size_t stillListed = 0;
+        for (size_t i = 0; i < imageFiles.size(); ++i) {
+            auto it = rowByName.find(imageFiles[i]);
+            if (it == rowByName.end()) {
+                continue;
+            }
+            ++stillListed;
+            if (it->second.second == stamps[i]) {
+                previousRows[t][i] = it->second.first;
+                if (store.hasContentHashes()) {
+                    hashes[i] = store.contentHash(it->second.first);
+                    hashKnown[i] = 1;
+                }
+            }
+        }
+        stats[t].removed = previousImages - stillListed;
+    }
+
+    // copies[c]: byte-identical images, extracted once from the first in listing
+    // order (the representative); copyOf[i] is the entry holding image i.
+    std::vector<size_t> copyOf(imageFiles.size());
+    std::vector<std::vector<size_t>> copies;
+    if (options.deduplicate) {
+        parallelFor(imageFiles.size(), options.threadCount, [&](size_t i) {
+            if (hashKnown[i] == 0) {
+                hashes[i] = contentHashOf(readFileBytes(imageFiles[i]));
+            }
+        });
+        std::unordered_map<uint64_t, size_t> copiesByHash;
+        for (size_t i = 0; i < imageFiles.size(); ++i) {
+            auto [it, added] = copiesByHash.emplace(hashes[i] ^ stamps[i].size, copies.size());
+            if (added || stamps[copies[it->second].front()].size != stamps[i].size) {
+                copyOf[i] = copies.size();
+                copies.push_back({i});
+            } else {
+                copyOf[i] = it->second;
+                copies[it->second].push_back(i);
+            }
+        }
+
+        // A matching hash is only a candidate: confirm the bytes, unless both
+        // files still back the same stored row (confirmed when it was written).
+        std::vector<uint8_t> confirmed(imageFiles.size(), 1);
+        parallelFor(imageFiles.size(), options.threadCount, [&](size_t i) {
+            size_t representative = copies[copyOf[i]].front();
+            if (representative == i) {
+                return;
+            }
+            for (size_t t = 0; t < featureTypes.size(); ++t) {
+                if (previousRows[t][i] != kNoRow && previousRows[t][i] == previousRows[t][representative]) {
+                    return;
+                }
+            }
+            confirmed[i] = readFileBytes(imageFiles[i]) == readFileBytes(imageFiles[representative]) ? 1 : 0;
+        });
+        for (auto &members : copies) {
+            auto split = std::stable_partition(members.begin(), members.end(),
+                                               [&](size_t i) { return confirmed[i] != 0; });
+            for (auto it = split; it != members.end(); ++it) {
+                copyOf[*it] = copies.size();
+                copies.push_back({*it});
+            }
+            members.erase(split, members.end());
+        }
+        // Keep rows in listing order, as without deduplication.
+        std::sort(copies.begin(), copies.end());
+        for (size_t c = 0; c < copies.size(); ++c) {
+            for (size_t i : copies[c]) {
+                copyOf[i] = c;
+            }
+        }
+    } else {
+        copies.resize(imageFiles.size());
+        for (size_t i = 0; i < imageFiles.size(); ++i) {
+            copyOf[i] = i;
+            copies[i] = {i};
+        }
+    }
+
+    // sourceRows[t][c]: previous row reused for entry c, or kNoRow to extract it.
+    std::vector<std::vector<size_t>> sourceRows(featureTypes.size(), std::vector<size_t>(copies.size(), kNoRow));
+    for (size_t t = 0; t < featureTypes.size(); ++t) {
+        for (size_t c = 0; c < copies.size(); ++c) {
+            for (size_t i : copies[c]) {
+                if (previousRows[t][i] != kNoRow) {
+                    sourceRows[t][c] = previousRows[t][i];
+                    break;
+                }
+            }
+            ++(sourceRows[t][c] == kNoRow ? stats[t].extracted : stats[t].reused);
+        }
+        stats[t].duplicates = imageFiles.size() - copies.size();
+    }
+
+    std::vector<std::vector<std::vector<float>>> features(
+        featureTypes.size(), std::vector<std::vector<float>>(copies.size()));
+    parallelFor(copies.size(), options.threadCount, [&](size_t c) {
+        size_t representative = copies[c].front();
+        for (size_t s = 0; s < scales.size(); ++s) {
+            std::vector<size_t> stale;
+            for (size_t t : groups[s]) {
+                if (sourceRows[t][c] == kNoRow) {
+                    stale.push_back(t);
+                } else {
+                    const float *row = previous[t]->row(sourceRows[t][c]);
+                    features[t][c].assign(row, row + previous[t]->dimension());
+                }
+            }
+            if (stale.empty()) {
+                continue;
+            }
+            std::vector<std::string> staleTypes;
+            for (size_t t : stale) {
+                staleTypes.push_back(featureTypes[t]);
+            }
+            cv::Mat image = loadImageOrThrow(imageFiles[representative], scales[s]);
+            auto imageFeatures = computeFeatures(staleTypes, image);
+            for (size_t k = 0; k < stale.size(); ++k) {
+                features[stale[k]][c] = std::move(imageFeatures[k]);
+            }
+        }
+    });
+    previous.clear();
+
+    using FeatureRows = std::vector<std::pair<std::string, std::vector<float>>>;
+    for (size_t t = 0; t < featureTypes.size(); ++t) {
+        const std::string &outputPath = outputPaths[t];
+        if (isCsvIndexPath(outputPath) || !options.deduplicate) {
+            // CSVs cannot record duplicates, so every image gets its own row.
+            FeatureRows rows(imageFiles.size());
+            for (size_t i = 0; i < imageFiles.size(); ++i) {
+                rows[i] = {imageFiles[i], features[t][copyOf[i]]};
+            }
+            features[t].clear();
+            if (isCsvIndexPath(outputPath)) {
+                if (!writeFeaturesCsv(outputPath, rows, options.threadCount)) {
+                    throw std::runtime_error("Failed to write features CSV: " + outputPath);
+                }
+            } else {
+                writeFeatureStore(outputPath, infos[t], rows, stamps, coarseFeatureRows(featureTypes[t], rows));
+            }
+            continue;
+        }
+
+        FeatureRows rows(copies.size());
+        std::vector<FileStamp> rowStamps(copies.size());
+        std::vector<uint64_t> rowHashes(copies.size());
+        std::vector<std::vector<DuplicateFile>> duplicates(copies.size());
+        for (size_t c = 0; c < copies.size(); ++c) {
+            size_t representative = copies[c].front();
+            rows[c] = {imageFiles[representative], std::move(features[t][c])};
+            rowStamps[c] = stamps[representative];
+            rowHashes[c] = hashes[representative];
+            for (size_t k = 1; k < copies[c].size(); ++k) {
+                duplicates[c].push_back({imageFiles[copies[c][k]], stamps[copies[c][k]]});
+            }
+        }
+        writeFeatureStore(outputPath, infos[t], rows, rowStamps, coarseFeatureRows(featureTypes[t], rows),
+                          rowHashes, duplicates);
+    }
+    return stats;
+}
@@ -0,0 +1,530 @@
+/*
+Authors - Joseph Defendre, Sourav Das
+
+Implements the memory-mapped binary feature store.
+Writes a fixed header, an aligned float32 matrix and a name table.
+Maps stores read-only so rows are scanned without parsing or copies.
+Validates header fields and section bounds on open.
+Records per-row source file stamps for incremental index builds.
+Optionally appends a coarse descriptor matrix for cascade pruning.
+Optionally appends content hashes and a duplicate filename table.
+*/
+#include "../include/feature_store.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+constexpr char kStoreMagic[8] = {'C', 'B', 'I', 'R', 'F', 'S', 'T', '1'};
+constexpr uint32_t kStoreVersion = 5;
+constexpr uint64_t kMatrixAlignment = 64;
+
+// On-disk header; all fields are little-endian native values.
+struct StoreHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    char featureType[32];
+    int32_t binsPerChannel;
+    int32_t regionCount;
+    uint64_t dimension;
+    uint64_t rowCount;
+    uint64_t matrixOffset;
+    uint64_t namesOffset;
+    uint64_t fileSize;
+    int32_t decodeScale;
+    int32_t reserved;
+    uint64_t stampsOffset;
+    uint64_t coarseOffset;
+    uint64_t coarseDimension;
+    uint64_t hashesOffset;
+    uint64_t duplicatesOffset;
+    uint64_t duplicateCount;
+};
+static_assert(sizeof(StoreHeader) == 152, "Unexpected feature store header layout.");
+
+// On-disk source file stamp, one per row when stampsOffset is non-zero.
+struct StoredStamp {
+    int64_t modified;
+    uint64_t size;
+};
+static_assert(sizeof(StoredStamp) == 16, "Unexpected feature store stamp layout.");
+
+/**
+ * Header size written by each store version.
+ * Version 1 ends before decodeScale (full resolution); version 2 before stampsOffset;
+ * version 3 before coarseOffset; version 4 before hashesOffset.
+ *
+ * @param version Header version field.
+ * @return Header size in bytes, or 0 for unknown versions.
+ */
+uint32_t headerSizeForVersion(uint32_t version) {
+    switch (version) {
+    case 1:
+        return 96;
+    case 2:
+        return 104;
+    case 3:
+        return 112;
+    case 4:
+        return 128;
+    case kStoreVersion:
+        return sizeof(StoreHeader);
+    default:
+        return 0;
+    }
+}
+
+/**
+ * Round an offset up to the next multiple of alignment.
+ *
+ * @param value Offset in bytes.
+ * @param alignment Power-of-two alignment.
+ * @return Aligned offset.
+ */
+uint64_t alignUp(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+} // namespace
+
+/**
+ * Map the store read-only and resolve the matrix and name table.
+ *
+ * @param path Store file path.
+ * @throws std::runtime_error if mapping fails or the header is invalid.
+ */
+FeatureStore::FeatureStore(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open feature store: " + path);
+    }
+    struct stat fileStat {};
+    if (::fstat(fd, &fileStat) != 0 ||
+        static_cast<size_t>(fileStat.st_size) < sizeof(StoreHeader)) {
+        ::close(fd);
+        throw std::runtime_error("Feature store is truncated: " + path);
+    }
+    mappingSize_ = static_cast<size_t>(fileStat.st_size);
+    mapping_ = ::mmap(nullptr, mappingSize_, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping_ == MAP_FAILED) {
+        mapping_ = nullptr;
+        throw std::runtime_error("Failed to map feature store: " + path);
+    }
+
+    // Older, shorter headers are zero-extended so their missing fields read as unset.
+    StoreHeader header {};
+    std::memcpy(&header, mapping_, offsetof(StoreHeader, featureType));
+    uint32_t headerSize = headerSizeForVersion(header.version);
+    if (headerSize != 0 && header.headerSize == headerSize) {
+        std::memcpy(&header, mapping_, headerSize);
+    }
+    if (header.version < 2) {
+        header.decodeScale = 1;
+    }
+    const char *base = static_cast<const char *>(mapping_);
+    uint64_t matrixBytes = header.rowCount * header.dimension * sizeof(float);
+    uint64_t offsetBytes = (header.rowCount + 1) * sizeof(uint64_t);
+    bool valid = std::memcmp(header.magic, kStoreMagic, sizeof(kStoreMagic)) == 0 &&
+                 headerSize != 0 && header.headerSize == headerSize &&
+                 header.decodeScale >= 1 &&
+                 header.fileSize == mappingSize_ &&
+                 header.matrixOffset % kMatrixAlignment == 0 &&
+                 header.matrixOffset + matrixBytes <= header.namesOffset &&
+                 header.namesOffset % sizeof(uint64_t) == 0 &&
+                 header.namesOffset + offsetBytes <= mappingSize_;
+    if (valid) {
+        nameOffsets_ = reinterpret_cast<const uint64_t *>(base + header.namesOffset);
+        uint64_t nameBytes = nameOffsets_[header.rowCount];
+        uint64_t namesEnd = header.namesOffset + offsetBytes + nameBytes;
+        valid = namesEnd <= mappingSize_ &&
+                (header.stampsOffset == 0 ||
+                 (header.stampsOffset >= namesEnd &&
+                  header.stampsOffset % sizeof(uint64_t) == 0 &&
+                  header.stampsOffset + header.rowCount * sizeof(StoredStamp) <= mappingSize_)) &&
+                (header.coarseOffset == 0 ||
+                 (header.coarseOffset >= namesEnd && header.coarseDimension > 0 &&
+                  header.coarseOffset % kMatrixAlignment == 0 &&
+                  header.coarseOffset + header.rowCount * header.coarseDimension * sizeof(float) <= mappingSize_)) &&
+                (header.hashesOffset == 0 ||
+                 (header.hashesOffset >= namesEnd &&
+                  header.hashesOffset % sizeof(uint64_t) == 0 &&
+                  header.hashesOffset + header.rowCount * sizeof(uint64_t) <= mappingSize_)) &&
+                (header.duplicatesOffset == 0 || header.duplicatesOffset >= namesEnd);
+    }
+    // Duplicates: first duplicate per row (rowCount + 1), stamps, name offsets, name bytes.
+    uint64_t duplicateStampsOffset = header.duplicatesOffset + offsetBytes;
+    uint64_t duplicateNamesOffset = duplicateStampsOffset + header.duplicateCount * sizeof(StoredStamp);
+    uint64_t duplicateOffsetBytes = (header.duplicateCount + 1) * sizeof(uint64_t);
+    if (valid && header.duplicatesOffset != 0) {
+        valid = header.duplicatesOffset % sizeof(uint64_t) == 0 &&
+                duplicateNamesOffset + duplicateOffsetBytes <= mappingSize_;
+        if (valid) {
+            const auto *first = reinterpret_cast<const uint64_t *>(base + header.duplicatesOffset);
+            const auto *offsets = reinterpret_cast<const uint64_t *>(base + duplicateNamesOffset);
+            valid = first[header.rowCount] == header.duplicateCount &&
+                    duplicateNamesOffset + duplicateOffsetBytes + offsets[header.duplicateCount] <= mappingSize_;
+        }
+    }
+    if (!valid) {
+        release();
+        throw std::runtime_error("Invalid feature store: " + path);
+    }
+
+    info_.featureType.assign(header.featureType,
+                             strnlen(header.featureType, sizeof(header.featureType)));
+    info_.binsPerChannel = header.binsPerChannel;
+    info_.regionCount = header.regionCount;
+    info_.decodeScale = header.decodeScale;
+    rowCount_ = static_cast<size_t>(header.rowCount);
+    dimension_ = static_cast<size_t>(header.dimension);
+    matrix_ = reinterpret_cast<const float *>(base + header.matrixOffset);
+    names_ = base + header.namesOffset + offsetBytes;
+    stamps_ = header.stampsOffset == 0 ? nullptr : base + header.stampsOffset;
+    coarse_ = header.coarseOffset == 0 ? nullptr : reinterpret_cast<const float *>(base + header.coarseOffset);
+    coarseDimension_ = coarse_ == nullptr ? 0 : static_cast<size_t>(header.coarseDimension);
+    hashes_ = header.hashesOffset == 0 ? nullptr : base + header.hashesOffset;
+    if (header.duplicatesOffset != 0) {
+        firstDuplicate_ = reinterpret_cast<const uint64_t *>(base + header.duplicatesOffset);
+        duplicateStamps_ = base + duplicateStampsOffset;
+        duplicateNameOffsets_ = reinterpret_cast<const uint64_t *>(base + duplicateNamesOffset);
+        duplicateNames_ = base + duplicateNamesOffset + duplicateOffsetBytes;
+    }
+}
+
+FeatureStore::~FeatureStore() {
+    release();
+}
+
+FeatureStore::FeatureStore(FeatureStore &&other) noexcept {
+    *this = std::move(other);
+}
+
+FeatureStore &FeatureStore::operator=(FeatureStore &&other) noexcept {
+    if (this != &other) {
+        release();
+        mapping_ = other.mapping_;
+        mappingSize_ = other.mappingSize_;
+        info_ = std::move(other.info_);
+        rowCount_ = other.rowCount_;
+        dimension_ = other.dimension_;
+        matrix_ = other.matrix_;
+        nameOffsets_ = other.nameOffsets_;
+        names_ = other.names_;
+        stamps_ = other.stamps_;
+        coarse_ = other.coarse_;
+        coarseDimension_ = other.coarseDimension_;
+        hashes_ = other.hashes_;
+        firstDuplicate_ = other.firstDuplicate_;
+        duplicateStamps_ = other.duplicateStamps_;
+        duplicateNameOffsets_ = other.duplicateNameOffsets_;
+        duplicateNames_ = other.duplicateNames_;
+        other.mapping_ = nullptr;
+        other.mappingSize_ = 0;
+        other.rowCount_ = 0;
+    }
+    return *this;
+}
+
+/**
+ * Return the filename for a row as a view into the mapping.
+ *
+ * @param index Row index.
+ * @return Filename view.
+ */
+std::string_view FeatureStore::filename(size_t index) const {
+    uint64_t begin = nameOffsets_[index];
+    uint64_t end = nameOffsets_[index + 1];
+    return std::string_view(names_ + begin, static_cast<size_t>(end - begin));
+}
+
+/**
+ * Return the source file stamp recorded for a row.
+ *
+ * @param index Row index.
+ * @return Recorded stamp.
+ */
+FileStamp FeatureStore::stamp(size_t index) const {
+    StoredStamp stored {};
+    std::memcpy(&stored, stamps_ + index * sizeof(StoredStamp), sizeof(stored));
+    return FileStamp{stored.modified, stored.size};
+}
+
+/**
+ * Return the content hash recorded for a row.
+ *
+ * @param index Row index.
+ * @return Source file hash.
+ */
+uint64_t FeatureStore::contentHash(size_t index) const {
+    uint64_t hash = 0;
+    std::memcpy(&hash, hashes_ + index * sizeof(uint64_t), sizeof(hash));
+    return hash;
+}
+
+/**
+ * Return the duplicate numbers folded into a row.
+ *
+ * @param index Row index.
+ * @return [first, last) duplicate numbers.
+ */
+std::pair<size_t, size_t> FeatureStore::duplicateRange(size_t index) const {
+    if (firstDuplicate_ == nullptr) {
+        return {0, 0};
+    }
+    return {static_cast<size_t>(firstDuplicate_[index]), static_cast<size_t>(firstDuplicate_[index + 1])};
+}
+
+/**
+ * Return a duplicate's filename as a view into the mapping.
+ *
+ * @param duplicate Duplicate number.
+ * @return Filename view.
+ */
+std::string_view FeatureStore::duplicateName(size_t duplicate) const {
+    uint64_t begin = duplicateNameOffsets_[duplicate];
+    uint64_t end = duplicateNameOffsets_[duplicate + 1];
+    return std::string_view(duplicateNames_ + begin, static_cast<size_t>(end - begin));
+}
+
+/**
+ * Return the stamp recorded for a duplicate.
+ *
+ * @param duplicate Duplicate number.
+ * @return Recorded stamp.
+ */
+FileStamp FeatureStore::duplicateStamp(size_t duplicate) const {
+    StoredStamp stored {};
+    std::memcpy(&stored, duplicateStamps_ + duplicate * sizeof(StoredStamp), sizeof(stored));
+    return FileStamp{stored.modified, stored.size};
+}
+
+/**
+ * Unmap the store if mapped.
+ */
+void FeatureStore::release() {
+    if (mapping_ != nullptr) {
+        ::munmap(mapping_, mappingSize_);
+        mapping_ = nullptr;
+    }
+}
+
+/**
+ * Read the modification stamp of a file or directory.
+ *
+ * @param path File or directory path.
+ * @return Stamp (mtime ticks, and size for regular files).
+ */
+FileStamp fileStampOf(const std::string &path) {
+    std::error_code error;
+    FileStamp stamp;
+    auto modified = std::filesystem::last_write_time(path, error);
+    if (!error) {
+        stamp.modified = static_cast<int64_t>(modified.time_since_epoch().count());
+    }
+    if (std::filesystem::is_regular_file(path, error)) {
+        stamp.size = static_cast<uint64_t>(std::filesystem::file_size(path, error));
+    }
+    return stamp;
+}
+
+/**
+ * Check for the store magic without mapping the whole file.
+ *
+ * @param path File path.
+ * @return True if the magic bytes match.
+ */
+bool isFeatureStoreFile(const std::string &path) {
+    std::ifstream inputFile(path, std::ios::binary);
+    char magic[sizeof(kStoreMagic)] = {};
+    if (!inputFile.read(magic, sizeof(magic))) {
+        return false;
+    }
+    return std::memcmp(magic, kStoreMagic, sizeof(kStoreMagic)) == 0;
+}
+
+/**
+ * Write the header, aligned feature matrix and filename table.
+ *
+ * @param outputPath Destination store path.
+ * @param info Descriptor settings for the header.
+ * @param features Filename/feature pairs of equal dimension.
+ * @param stamps Source file stamp per row (empty = none).
+ * @param coarse Coarse descriptor per row (empty = none).
+ * @param contentHashes Content hash per row (empty = none).
+ * @param duplicates Duplicate files per row (empty = none).
+ * @throws std::runtime_error on inconsistent rows or write failure.
+ */
+void writeFeatureStore(
+    const std::string &outputPath,
+    const FeatureStoreInfo &info,
+    const std::vector<std::pair<std::string, std::vector<float>>> &features,
+    const std::vector<FileStamp> &stamps,
+    const std::vector<std::vector<float>> &coarse,
+    const std::vector<uint64_t> &contentHashes,
+    const std::vector<std::vector<DuplicateFile>> &duplicates) {
+    StoreHeader header {};
+    if (info.featureType.size() >= sizeof(header.featureType)) {
+        throw std::runtime_error("Feature type name too long: " + info.featureType);
+    }
+    uint64_t dimension = features.empty() ? 0 : features.front().second.size();
+    for (const auto &entry : features) {
+        if (entry.second.size() != dimension) {
+            throw std::runtime_error("Feature store rows must share one dimension: " + entry.first);
+        }
+    }
+    if (!stamps.empty() && stamps.size() != features.size()) {
+        throw std::runtime_error("Expected one file stamp per feature store row: " + outputPath);
+    }
+    if (!coarse.empty() && coarse.size() != features.size()) {
+        throw std::runtime_error("Expected one coarse descriptor per feature store row: " + outputPath);
+    }
+    if (!contentHashes.empty() && contentHashes.size() != features.size()) {
+        throw std::runtime_error("Expected one content hash per feature store row: " + outputPath);
+    }
+    if (!duplicates.empty() && duplicates.size() != features.size()) {
+        throw std::runtime_error("Expected one duplicate list per feature store row: " + outputPath);
+    }
+    uint64_t coarseDimension = coarse.empty() ? 0 : coarse.front().size();
+    for (const auto &row : coarse) {
+        if (row.size() != coarseDimension || coarseDimension == 0) {
+            throw std::runtime_error("Coarse descriptors must share one non-zero size: " + outputPath);
+        }
+    }
+
+    // Layout: header | pad | matrix | name offsets | name bytes | pad | stamps | pad | coarse
+    //         | hashes | first duplicate per row | duplicate stamps | duplicate name offsets | bytes.
+    std::vector<uint64_t> nameOffsets;
+    nameOffsets.reserve(features.size() + 1);
+    uint64_t nameBytes = 0;
+    nameOffsets.push_back(0);
+    for (const auto &entry : features) {
+        nameBytes += entry.first.size();
+        nameOffsets.push_back(nameBytes);
+    }
+
+    std::memcpy(header.magic, kStoreMagic, sizeof(kStoreMagic));
+    header.version = kStoreVersion;
+    header.headerSize = sizeof(StoreHeader);
+    std::memcpy(header.featureType, info.featureType.data(), info.featureType.size());
+    header.binsPerChannel = info.binsPerChannel;
+    header.regionCount = info.regionCount;
+    header.decodeScale = info.decodeScale;
+    header.dimension = dimension;
+    header.rowCount = features.size();
+    header.matrixOffset = alignUp(sizeof(StoreHeader), kMatrixAlignment);
+    uint64_t matrixEnd = header.matrixOffset + header.rowCount * dimension * sizeof(float);
+    header.namesOffset = alignUp(matrixEnd, sizeof(uint64_t));
+    uint64_t namesEnd = header.namesOffset + nameOffsets.size() * sizeof(uint64_t) + nameBytes;
+    header.stampsOffset = stamps.empty() ? 0 : alignUp(namesEnd, sizeof(uint64_t));
+    uint64_t stampsEnd = stamps.empty() ? namesEnd : header.stampsOffset + stamps.size() * sizeof(StoredStamp);
+    header.coarseOffset = coarse.empty() ? 0 : alignUp(stampsEnd, kMatrixAlignment);
+    header.coarseDimension = coarseDimension;
+    uint64_t coarseEnd = coarse.empty() ? stampsEnd : header.coarseOffset + coarse.size() * coarseDimension * sizeof(float);
+    header.hashesOffset = contentHashes.empty() ? 0 : alignUp(coarseEnd, sizeof(uint64_t));
+    uint64_t hashesEnd = contentHashes.empty() ? coarseEnd : header.hashesOffset + contentHashes.size() * sizeof(uint64_t);
+
+    std::vector<uint64_t> firstDuplicate;
+    std::vector<uint64_t> duplicateNameOffsets;
+    if (!duplicates.empty()) {
+        firstDuplicate.reserve(duplicates.size() + 1);
+        firstDuplicate.push_back(0);
+        duplicateNameOffsets.push_back(0);
+        for (const auto &rowDuplicates : duplicates) {
+            firstDuplicate.push_back(firstDuplicate.back() + rowDuplicates.size());
+            for (const auto &duplicate : rowDuplicates) {
+                duplicateNameOffsets.push_back(duplicateNameOffsets.back() + duplicate.filename.size());
+            }
+        }
+    }
+    header.duplicateCount = duplicates.empty() ? 0 : firstDuplicate.back();
+    header.duplicatesOffset = duplicates.empty() ? 0 : alignUp(hashesEnd, sizeof(uint64_t));
+    header.fileSize = duplicates.empty()
+                          ? hashesEnd
+                          : header.duplicatesOffset +
+                                (firstDuplicate.size() + duplicateNameOffsets.size()) * sizeof(uint64_t) +
+                                header.duplicateCount * sizeof(StoredStamp) + duplicateNameOffsets.back();
+
+    // Readers may still map the old store; replace it by rename instead of truncating it.
+    std::string temporaryPath = outputPath + ".tmp";
+    std::ofstream outputFile(temporaryPath, std::ios::binary | std::ios::trunc);
+    if (!outputFile.is_open()) {
+        throw std::runtime_error("Failed to open feature store for writing: " + outputPath);
+    }
+    outputFile.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    std::vector<char> padding(header.matrixOffset - sizeof(StoreHeader), 0);
+    outputFile.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+    for (const auto &entry : features) {
+        outputFile.write(reinterpret_cast<const char *>(entry.second.data()),
+                         static_cast<std::streamsize>(dimension * sizeof(float)));
+    }
+    padding.assign(header.namesOffset - matrixEnd, 0);
+    outputFile.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+    outputFile.write(reinterpret_cast<const char *>(nameOffsets.data()),
+                     static_cast<std::streamsize>(nameOffsets.size() * sizeof(uint64_t)));
+    for (const auto &entry : features) {
+        outputFile.write(entry.first.data(), static_cast<std::streamsize>(entry.first.size()));
+    }
+    if (!stamps.empty()) {
+        padding.assign(header.stampsOffset - namesEnd, 0);
+        outputFile.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+        for (const auto &stamp : stamps) {
+            StoredStamp stored {stamp.modified, stamp.size};
+            outputFile.write(reinterpret_cast<const char *>(&stored), sizeof(stored));
+        }
+    }
+    if (!coarse.empty()) {
+        padding.assign(header.coarseOffset - stampsEnd, 0);
+        outputFile.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+        for (const auto &row : coarse) {
+            outputFile.write(reinterpret_cast<const char *>(row.data()),
+                             static_cast<std::streamsize>(coarseDimension * sizeof(float)));
+        }
+    }
+    if (!contentHashes.empty()) {
+        padding.assign(header.hashesOffset - coarseEnd, 0);
+        outputFile.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+        outputFile.write(reinterpret_cast<const char *>(contentHashes.data()),
+                         static_cast<std::streamsize>(contentHashes.size() * sizeof(uint64_t)));
+    }
+    if (!duplicates.empty()) {
+        padding.assign(header.duplicatesOffset - hashesEnd, 0);
+        outputFile.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+        outputFile.write(reinterpret_cast<const char *>(firstDuplicate.data()),
+                         static_cast<std::streamsize>(firstDuplicate.size() * sizeof(uint64_t)));
+        for (const auto &rowDuplicates : duplicates) {
+            for (const auto &duplicate : rowDuplicates) {
+                StoredStamp stored {duplicate.stamp.modified, duplicate.stamp.size};
+                outputFile.write(reinterpret_cast<const char *>(&stored), sizeof(stored));
+            }
+        }
+        outputFile.write(reinterpret_cast<const char *>(duplicateNameOffsets.data()),
+                         static_cast<std::streamsize>(duplicateNameOffsets.size() * sizeof(uint64_t)));
+        for (const auto &rowDuplicates : duplicates) {
+            for (const auto &duplicate : rowDuplicates) {
+                outputFile.write(duplicate.filename.data(), static_cast<std::streamsize>(duplicate.filename.size()));
+            }
+        }
+    }
+    outputFile.close();
+    std::error_code error;
+    if (!outputFile) {
+        std::filesystem::remove(temporaryPath, error);
+        throw std::runtime_error("Failed to write feature store: " + outputPath);
+    }
+    std::filesystem::rename(temporaryPath, outputPath, error);
+    if (error) {
+        std::filesystem::remove(temporaryPath, error);
+        throw std::runtime_error("Failed to replace feature store: " + outputPath);
+    }
+}
@@ -0,0 +1,561 @@
+/*
+Authors - Joseph Defendre, Sourav Das
+
+Implements the feature type registry used by the CLI.
+Dispatches feature type names to extractors and distances.
+Holds the fixed bin/region/weight settings for each type.
+Shared by the live scan and the offline index builder.
+Maps several feature types onto one fused descriptor extraction.
+Pools full histograms into coarse lower-bound descriptors for pruning.
+*/
+#include "../include/feature_types.h"
+
+#include "../include/distance_metrics.h"
+#include "../include/feature_extraction.h"
+#include "../include/profile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+
+namespace {
+constexpr int kHistogramBinsPerChannel = 8;
+constexpr int kChromaticityBinsPerChannel = 16;
+constexpr int kMultiRegionCount = 2;
+constexpr int kSunsetRegionCount = 3;
+constexpr int kSobelMagnitudeBins = 16;
+constexpr size_t kRgbHistogramSize = static_cast<size_t>(
+    kHistogramBinsPerChannel * kHistogramBinsPerChannel * kHistogramBinsPerChannel);
+
+// Uniform region weights for the default multi-histogram.
+const std::vector<float> kMultiRegionWeights(kMultiRegionCount, 1.0f);
+
+// Emphasize the horizon region for sunsets.
+const std::vector<float> kSunsetRegionWeights = {0.2f, 0.3f, 0.5f};
+
+// Coarse descriptors split each channel in two and Sobel magnitudes in four.
+constexpr int kCoarseSplit = 2;
+constexpr size_t kCoarseRgbSize = kCoarseSplit * kCoarseSplit * kCoarseSplit;
+constexpr size_t kCoarseRgSize = kCoarseSplit * kCoarseSplit;
+constexpr size_t kCoarseSobelSize = 4;
+// Default 7x7 BGR center patch.
+constexpr size_t kCenterPatchFeatureSize = 7 * 7 * 3;
+// Baseline patch values summed per coarse entry (one 7-pixel BGR row).
+constexpr size_t kBaselineGroupSize = 21;
+
+/**
+ * Add an 8x8x8 RGB histogram into its 2x2x2 pooled bins.
+ *
+ * @param histogram kRgbHistogramSize bins, index (r * 8 + g) * 8 + b.
+ * @param coarse kCoarseRgbSize bins to add into.
+ */
+void poolRgbHistogram(const float *histogram, float *coarse) {
+    constexpr int step = kHistogramBinsPerChannel / kCoarseSplit;
+    for (int r = 0; r < kHistogramBinsPerChannel; ++r) {
+        for (int g = 0; g < kHistogramBinsPerChannel; ++g) {
+            for (int b = 0; b < kHistogramBinsPerChannel; ++b) {
+                size_t bin = static_cast<size_t>((r * kHistogramBinsPerChannel + g) * kHistogramBinsPerChannel + b);
+                coarse[((r / step) * kCoarseSplit + g / step) * kCoarseSplit + b / step] += histogram[bin];
+            }
+        }
+    }
+}
+
+/**
+ * Intersection distance between pooled histograms (1 - sum of minima).
+ *
+ * @param a First pooled histogram.
+ * @param b Second pooled histogram.
+ * @param size Number of bins.
+ * @return Distance; a lower bound on the distance of the full histograms.
+ */
+float pooledIntersectionDistance(const float *a, const float *b, size_t size) {
+    float similarity = 0.0f;
+    for (size_t i = 0; i < size; ++i) {
+        similarity += std::min(a[i], b[i]);
+    }
+    return 1.0f - similarity;
+}
+
+/**
+ * Weighted pooled distance over per-region coarse histograms.
+ *
+ * @param a First set of pooled region histograms.
+ * @param b Second set of pooled region histograms.
+ * @param weights Per-region weights.
+ * @return Lower bound on histogramIntersectionDistanceMulti.
+ */
+float pooledMultiDistance(FloatView a, FloatView b, const std::vector<float> &weights) {
+    float total = 0.0f;
+    float weightSum = 0.0f;
+    for (size_t region = 0; region < weights.size(); ++region) {
+        size_t offset = region * kCoarseRgbSize;
+        total += pooledIntersectionDistance(a.data + offset, b.data + offset, kCoarseRgbSize) * weights[region];
+        weightSum += weights[region];
+    }
+    return total / weightSum;
+}
+
+/**
+ * Position of a region split in the request, adding it if missing.
+ *
+ * @param request Fused extraction request.
+ * @param regionCount Region split.
+ * @return Index into request.regionCounts (and DescriptorSet::regions).
+ */
+size_t requestRegions(DescriptorRequest &request, int regionCount) {
+    auto it = std::find(request.regionCounts.begin(), request.regionCounts.end(), regionCount);
+    if (it != request.regionCounts.end()) {
+        return static_cast<size_t>(it - request.regionCounts.begin());
+    }
+    request.regionCounts.push_back(regionCount);
+    return request.regionCounts.size() - 1;
+}
+} // namespace
+
+/**
+ * List the pixel-derived feature types.
+ *
+ * @return Classic feature type names.
+ */
+const std::vector<std::string> &classicFeatureTypes() {
+    static const std::vector<std::string> types = {
+        "baseline", "histogram_rg", "histogram_rgb",
+        "multi_histogram", "texture_color", "custom_sunset"};
+    return types;
+}
+
+/**
+ * Check whether the name is one of the pixel-derived feature types.
+ *
+ * @param featureType Feature type name.
+ * @return True if computeFeature supports the type.
+ */
+bool isClassicFeatureType(const std::string &featureType) {
+    const auto &types = classicFeatureTypes();
+    return std::find(types.begin(), types.end(), featureType) != types.end();
+}
+
+/**
+ * Report the bin and region settings used for the feature type.
+ *
+ * @param featureType Classic feature type name or "dnn".
+ * @return Descriptor settings for feature store headers.
+ * @throws std::runtime_error if the feature type is unknown.
+ */
+FeatureStoreInfo featureTypeInfo(const std::string &featureType) {
+    FeatureStoreInfo info;
+    info.featureType = featureType;
+    if (featureType == "histogram_rg") {
+        info.binsPerChannel = kChromaticityBinsPerChannel;
+    } else if (featureType == "histogram_rgb" || featureType == "texture_color") {
+        info.binsPerChannel = kHistogramBinsPerChannel;
+    } else if (featureType == "multi_histogram") {
+        info.binsPerChannel = kHistogramBinsPerChannel;
+        info.regionCount = kMultiRegionCount;
+    } else if (featureType == "custom_sunset") {
+        info.binsPerChannel = kHistogramBinsPerChannel;
+        info.regionCount = kSunsetRegionCount;
+    } else if (featureType != "baseline" && featureType != "dnn") {
+        throw std::runtime_error("Unknown feature type: " + featureType);
+    }
+    return info;
+}
+
+/**
+ * Cap the requested decode scale for types that are not scale-invariant.
+ *
+ * @param featureType Classic feature type name.
+ * @param requested Requested downscale factor.
+ * @return Downscale factor to decode with.
+ */
+int decodeScaleFor(const std::string &featureType, int requested) {
+    return featureType == "baseline" ? 1 : requested;
+}
+
+/**
+ * Run the extractor(s) configured for the feature type.
+ *
+ * @param featureType Classic feature type name.
+ * @param image Input BGR image.
+ * @return Feature vector for the image.
+ * @throws std::runtime_error if the feature type is unknown.
+ */
+std::vector<float> computeFeature(const std::string &featureType, const cv::Mat &image) {
+    return std::move(computeFeatures({featureType}, image).front());
+}
+
+/**
+ * Extract several feature types with one fused pass over the pixels.
+ *
+ * @param featureTypes Classic feature type names.
+ * @param image Input BGR image.
+ * @return One feature vector per requested type, in order.
+ * @throws std::runtime_error if a feature type is unknown.
+ */
+std::vector<std::vector<float>> computeFeatures(
+    const std::vector<std::string> &featureTypes,
+    const cv::Mat &image) {
+    ProfileTimer timer(ProfileStage::Extract);
+    profileCount(ProfileCounter::PixelsProcessed, image.total());
+    // Collect what every type needs so the pixels are walked once.
+    DescriptorRequest request;
+    request.regionBins = kHistogramBinsPerChannel;
+    std::vector<size_t> regionSlot(featureTypes.size(), 0);
+    for (size_t i = 0; i < featureTypes.size(); ++i) {
+        const std::string &featureType = featureTypes[i];
+        if (featureType == "histogram_rg") {
+            request.rgBins = kChromaticityBinsPerChannel;
+        } else if (featureType == "histogram_rgb") {
+            request.rgbBins = kHistogramBinsPerChannel;
+        } else if (featureType == "multi_histogram") {
+            regionSlot[i] = requestRegions(request, kMultiRegionCount);
+        } else if (featureType == "texture_color") {
+            request.rgbBins = kHistogramBinsPerChannel;
+            request.sobelBins = kSobelMagnitudeBins;
+        } else if (featureType == "custom_sunset") {
+            regionSlot[i] = requestRegions(request, kSunsetRegionCount);
+        } else if (featureType != "baseline") {
+            throw std::runtime_error("Unknown feature type: " + featureType);
+        }
+    }
+    DescriptorSet descriptors = extractDescriptors(image, request);
+
+    std::vector<std::vector<float>> features;
+    features.reserve(featureTypes.size());
+    for (size_t i = 0; i < featureTypes.size(); ++i) {
+        const std::string &featureType = featureTypes[i];
+        if (featureType == "baseline") {
+            features.push_back(extractCenterPatchFeature(image));
+        } else if (featureType == "histogram_rg") {
+            features.push_back(descriptors.rgChromaticity);
+        } else if (featureType == "histogram_rgb") {
+            features.push_back(descriptors.rgb);
+        } else if (featureType == "texture_color") {
+            // Concatenate color and texture so one vector describes the image.
+            auto feature = descriptors.rgb;
+            feature.insert(feature.end(), descriptors.sobel.begin(), descriptors.sobel.end());
+            features.push_back(std::move(feature));
+        } else {
+            features.push_back(descriptors.regions[regionSlot[i]]);
+        }
+    }
+    return features;
+}
+
+/**
+ * Apply the distance function configured for the feature type.
+ *
+ * @param featureType Classic feature type name.
+ * @param target Query feature vector.
+ * @param candidate Database feature vector.
+ * @return Distance (smaller is more similar).
+ * @throws std::runtime_error if the feature type is unknown or sizes mismatch.
+ */
+float featureDistance(
+    const std::string &featureType,
+    FloatView target,
+    FloatView candidate) {
+    if (featureType == "baseline") {
+        return ssdDistance(target, candidate);
+    }
+    if (featureType == "histogram_rg" || featureType == "histogram_rgb") {
+        return histogramIntersectionDistance(target, candidate);
+    }
+    if (featureType == "multi_histogram") {
+        return histogramIntersectionDistanceMulti(
+            target, candidate, kRgbHistogramSize, kMultiRegionCount, kMultiRegionWeights);
+    }
+    if (featureType == "texture_color") {
+        if (target.size != candidate.size || target.size < kRgbHistogramSize) {
+            throw std::runtime_error("Texture/color feature size mismatch.");
+        }
+        // View the stored vector as its color and texture parts.
+        size_t textureSize = target.size - kRgbHistogramSize;
+        float colorDistance = histogramIntersectionDistance(
+            target.subview(0, kRgbHistogramSize), candidate.subview(0, kRgbHistogramSize));
+        float textureDistance = histogramIntersectionDistance(
+            target.subview(kRgbHistogramSize, textureSize),
+            candidate.subview(kRgbHistogramSize, textureSize));
+        return (colorDistance + textureDistance) * 0.5f;
+    }
+    if (featureType == "custom_sunset") {
+        return histogramIntersectionDistanceMulti(
+            target, candidate, kRgbHistogramSize, kSunsetRegionCount, kSunsetRegionWeights);
+    }
+    throw std::runtime_error("Unknown feature type: " + featureType);
+}
+
+/**
+ * Sum each histogram part and accept masses of 1 or 0.
+ *
+ * @param featureType Classic histogram feature type name.
+ * @param feature Feature vector.
+ * @return True if every part is normalized or empty.
+ */
+bool hasMetricHistograms(const std::string &featureType, FloatView feature) {
+    // Split points between the type's independently normalized histograms.
+    std::vector<size_t> parts = {0};
+    if (featureType == "texture_color") {
+        parts.push_back(std::min(kRgbHistogramSize, feature.size));
+    } else if (featureType == "multi_histogram" || featureType == "custom_sunset") {
+        for (size_t start = kRgbHistogramSize; start < feature.size; start += kRgbHistogramSize) {
+            parts.push_back(start);
+        }
+    }
+    parts.push_back(feature.size);
+    for (size_t p = 0; p + 1 < parts.size(); ++p) {
+        float mass = 0.0f;
+        for (size_t i = parts[p]; i < parts[p + 1]; ++i) {
+            if (feature.data[i] < 0.0f) {
+                return false;
+            }
+            mass += feature.data[i];
+        }
+        if (mass != 0.0f && std::abs(mass - 1.0f) > 1e-3f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Score a block of stored rows, using the batch kernels where the type allows.
+ *
+ * @param featureType Classic feature type name.
+ * @param target Query feature vector.
+ * @param rows Contiguous row-major matrix.
+ * @param rowCount Number of rows.
+ * @param distances Output distances.
+ * @throws std::runtime_error if the feature type is unknown.
+ */
+void featureDistanceBatch(
+    const std::string &featureType,
+    FloatView target,
+    const float *rows,
+    size_t rowCount,
+    float *distances) {
+    size_t dimension = target.size;
+    if (featureType == "baseline") {
+        ssdDistanceBatch(target.data, rows, rowCount, dimension, distances);
+        return;
+    }
+    if (featureType == "histogram_rg" || featureType == "histogram_rgb") {
+        histogramIntersectionDistanceBatch(target.data, rows, rowCount, dimension, distances);
+        return;
+    }
+    // Composite descriptors score each row through views into the block.
+    for (size_t row = 0; row < rowCount; ++row) {
+        distances[row] = featureDistance(featureType, target, FloatView(rows + row * dimension, dimension));
+    }
+}
+
+/**
+ * Report the pooled descriptor size for the feature type.
+ *
+ * @param featureType Classic feature type name.
+ * @return Coarse descriptor size, or 0 if the type has none.
+ */
+size_t coarseFeatureSize(const std::string &featureType) {
+    if (featureType == "baseline") {
+        return (kCenterPatchFeatureSize + kBaselineGroupSize - 1) / kBaselineGroupSize;
+    }
+    if (featureType == "histogram_rg") {
+        return kCoarseRgSize;
+    }
+    if (featureType == "histogram_rgb") {
+        return kCoarseRgbSize;
+    }
+    if (featureType == "texture_color") {
+        return kCoarseRgbSize + kCoarseSobelSize;
+    }
+    if (featureType == "multi_histogram") {
+        return kCoarseRgbSize * kMultiRegionCount;
+    }
+    if (featureType == "custom_sunset") {
+        return kCoarseRgbSize * kSunsetRegionCount;
+    }
+    return 0;
+}
+
+/**
+ * Pool a full descriptor into wide bins.
+ *
+ * @param featureType Classic feature type name.
+ * @param feature Full feature vector.
+ * @return Coarse descriptor.
+ * @throws std::runtime_error if the type has no coarse descriptor or sizes mismatch.
+ */
+std::vector<float> coarseFeature(const std::string &featureType, FloatView feature) {
+    size_t coarseSize = coarseFeatureSize(featureType);
+    if (coarseSize == 0) {
+        throw std::runtime_error("No coarse descriptor for feature type: " + featureType);
+    }
+    std::vector<float> coarse(coarseSize, 0.0f);
+    auto expectSize = [&](size_t size) {
+        if (feature.size != size) {
+            throw std::runtime_error("Unexpected " + featureType + " feature size for a coarse descriptor.");
+        }
+    };
+
+    if (featureType == "baseline") {
+        expectSize(kCenterPatchFeatureSize);
+        // SSD >= sum over groups of (sum a - sum b)^2 / n (Cauchy-Schwarz), so
+        // scaling each group sum by 1/sqrt(n) makes plain SSD the bound.
+        for (size_t group = 0; group < coarseSize; ++group) {
+            size_t begin = group * kBaselineGroupSize;
+            size_t end = std::min(begin + kBaselineGroupSize, feature.size);
+            float sum = std::accumulate(feature.data + begin, feature.data + end, 0.0f);
+            coarse[group] = sum / std::sqrt(static_cast<float>(end - begin));
+        }
+    } else if (featureType == "histogram_rg") {
+        constexpr int bins = kChromaticityBinsPerChannel;
+        constexpr int step = bins / kCoarseSplit;
+        expectSize(static_cast<size_t>(bins * bins));
+        for (int r = 0; r < bins; ++r) {
+            for (int g = 0; g < bins; ++g) {
+                coarse[(r / step) * kCoarseSplit + g / step] += feature.data[r * bins + g];
+            }
+        }
+    } else if (featureType == "histogram_rgb") {
+        expectSize(kRgbHistogramSize);
+        poolRgbHistogram(feature.data, coarse.data());
+    } else if (featureType == "texture_color") {
+        expectSize(kRgbHistogramSize + kSobelMagnitudeBins);
+        poolRgbHistogram(feature.data, coarse.data());
+        constexpr size_t step = kSobelMagnitudeBins / kCoarseSobelSize;
+        for (size_t bin = 0; bin < kSobelMagnitudeBins; ++bin) {
+            coarse[kCoarseRgbSize + bin / step] += feature.data[kRgbHistogramSize + bin];
+        }
+    } else {
+        size_t regions = coarseSize / kCoarseRgbSize;
+        expectSize(kRgbHistogramSize * regions);
+        for (size_t region = 0; region < regions; ++region) {
+            poolRgbHistogram(feature.data + region * kRgbHistogramSize, coarse.data() + region * kCoarseRgbSize);
+        }
+    }
+    return coarse;
+}
+
+/**
+ * Pool every row of a store about to be written.
+ *
+ * @param featureType Feature type of the rows.
+ * @param features Filename/feature pairs.
+ * @return Coarse descriptors, or empty if the type has none.
+ * @throws std::runtime_error if a row has the wrong size.
+ */
+std::vector<std::vector<float>> coarseFeatureRows(
+    const std::string &featureType,
+    const std::vector<std::pair<std::string, std::vector<float>>> &features) {
+    std::vector<std::vector<float>> coarse;
+    if (coarseFeatureSize(featureType) == 0) {
+        return coarse;
+    }
+    coarse.reserve(features.size());
+    for (const auto &entry : features) {
+        coarse.push_back(coarseFeature(featureType, entry.second));
+    }
+    return coarse;
+}
+
+/**
+ * Lower-bound distance between coarse descriptors.
+ *
+ * @param featureType Classic feature type name.
+ * @param target Query coarse descriptor.
+ * @param candidate Database coarse descriptor.
+ * @return Distance no larger than the full featureDistance.
+ */
+float coarseFeatureDistance(
+    const std::string &featureType,
+    FloatView target,
+    FloatView candidate) {
+    if (featureType == "baseline") {
+        return ssdDistance(target, candidate);
+    }
+    if (featureType == "histogram_rg" || featureType == "histogram_rgb") {
+        return pooledIntersectionDistance(target.data, candidate.data, target.size);
+    }
+    if (featureType == "texture_color") {
+        float colorDistance = pooledIntersectionDistance(target.data, candidate.data, kCoarseRgbSize);
+        float textureDistance = pooledIntersectionDistance(
+            target.data + kCoarseRgbSize, candidate.data + kCoarseRgbSize, kCoarseSobelSize);
+        return (colorDistance + textureDistance) * 0.5f;
+    }
+    if (featureType == "multi_histogram") {
+        return pooledMultiDistance(target, candidate, kMultiRegionWeights);
+    }
+    if (featureType == "custom_sunset") {
+        return pooledMultiDistance(target, candidate, kSunsetRegionWeights);
+    }
+    throw std::runtime_error("No coarse descriptor for feature type: " + featureType);
+}
+
+/**
+ * Precompute the query's histogram tail mass where a bounded metric needs it.
+ *
+ * @param featureType Classic feature type name.
+ * @param target Query feature vector.
+ * @return Bounded query state.
+ */
+BoundedTarget boundedTarget(const std::string &featureType, FloatView target) {
+    BoundedTarget bounded;
+    bounded.feature = target;
+    if (featureType == "histogram_rg" || featureType == "histogram_rgb") {
+        bounded.tailMass = histogramTailMass(target);
+    } else if (featureType == "texture_color" && target.size >= kRgbHistogramSize) {
+        bounded.tailMass = histogramTailMass(target.subview(0, kRgbHistogramSize));
+    }
+    return bounded;
+}
+
+/**
+ * Apply the feature type's distance with early abandoning.
+ *
+ * @param featureType Classic feature type name.
+ * @param target Query prepared by boundedTarget.
+ * @param candidate Database feature vector.
+ * @param bound Distance the candidate must not exceed to be useful.
+ * @return Exact distance, or a value greater than bound.
+ * @throws std::runtime_error if the feature type is unknown or sizes mismatch.
+ */
+float featureDistanceBounded(
+    const std::string &featureType,
+    const BoundedTarget &target,
+    FloatView candidate,
+    float bound) {
+    FloatView query = target.feature;
+    if (featureType == "baseline") {
+        return ssdDistanceBounded(query, candidate, bound);
+    }
+    if (featureType == "histogram_rg" || featureType == "histogram_rgb") {
+        return histogramIntersectionDistanceBounded(query, candidate, target.tailMass, bound);
+    }
+    if (featureType == "multi_histogram") {
+        return histogramIntersectionDistanceMultiBounded(
+            query, candidate, kRgbHistogramSize, kMultiRegionCount, kMultiRegionWeights, bound);
+    }
+    if (featureType == "custom_sunset") {
+        return histogramIntersectionDistanceMultiBounded(
+            query, candidate, kRgbHistogramSize, kSunsetRegionCount, kSunsetRegionWeights, bound);
+    }
+    if (featureType == "texture_color") {
+        if (query.size != candidate.size || query.size < kRgbHistogramSize) {
+            throw std::runtime_error("Texture/color feature size mismatch.");
+        }
+        // The result averages two non-negative parts, so colour alone must stay within 2 * bound.
+        size_t textureSize = query.size - kRgbHistogramSize;
+        float colorDistance = histogramIntersectionDistanceBounded(
+            query.subview(0, kRgbHistogramSize), candidate.subview(0, kRgbHistogramSize), target.tailMass,
+            bound * 2.0f);
+        if (colorDistance > abandonThreshold(bound * 2.0f)) {
+            return colorDistance * 0.5f;
+        }
+        float textureDistance = histogramIntersectionDistance(
+            query.subview(kRgbHistogramSize, textureSize), candidate.subview(kRgbHistogramSize, textureSize));
+        return (colorDistance + textureDistance) * 0.5f;
+    }
+    throw std::runtime_error("Unknown feature type: " + featureType);
+}
@@ -0,0 +1,347 @@
+/*
+Authors - Joseph Defendre, Sourav Das
+
+Implements the recursive image file walker.
+Worker threads pop directories from a shared stack and push subdirectories back.
+Uses dirent types to skip a stat() per entry on filesystems that report them.
+Feeds a background walk into a growing path list for streaming scans.
+*/
+#include "../include/file_walker.h"
+
+#include "../include/profile.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+namespace {
+/**
+ * Directories waiting to be read and the walkers reading them.
+ */
+struct WalkState {
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<std::string> pending;
+    // Walkers currently reading a directory (and so maybe adding to pending).
+    size_t active = 0;
+    bool stopped = false;
+    std::exception_ptr error;
+    // Serializes the caller's callbacks.
+    std::mutex callbackMutex;
+};
+
+/**
+ * Lowercase an ASCII letter.
+ *
+ * @param c Character.
+ * @return Lowercase character.
+ */
+char asciiLower(char c) {
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+/**
+ * Read one directory's entries.
+ *
+ * @param directory Directory path.
+ * @param subdirectories Receives subdirectory paths.
+ * @param images Receives image file paths.
+ */
+void readDirectory(
+    const std::string &directory,
+    std::vector<std::string> &subdirectories,
+    std::vector<std::string> &images) {
+    ProfileTimer timer(ProfileStage::List);
+    DIR *handle = ::opendir(directory.c_str());
+    if (handle == nullptr) {
+        return;
+    }
+    std::string prefix = directory.back() == '/' ? directory : directory + '/';
+    while (const dirent *entry = ::readdir(handle)) {
+        std::string_view name(entry->d_name);
+        if (name == "." || name == "..") {
+            continue;
+        }
+        bool image = hasImageExtension(name);
+        unsigned char type = entry->d_type;
+        if (type == DT_DIR) {
+            subdirectories.push_back(prefix + entry->d_name);
+        } else if (type == DT_REG) {
+            if (image) {
+                images.push_back(prefix + entry->d_name);
+            }
+        } else if (type == DT_UNKNOWN || (type == DT_LNK && image)) {
+            // Links and filesystems without d_type need a stat().
+            std::string path = prefix + entry->d_name;
+            struct stat info {};
+            if (image && ::stat(path.c_str(), &info) == 0 && S_ISREG(info.st_mode)) {
+                images.push_back(std::move(path));
+            } else if (type == DT_UNKNOWN && ::lstat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode)) {
+                subdirectories.push_back(std::move(path));
+            }
+        }
+    }
+    ::closedir(handle);
+}
+
+/**
+ * Read directories until none are pending and no walker can add more.
+ *
+ * @param state Shared walk state.
+ * @param onImage Image callback.
+ * @param onDirectory Directory callback (may be empty).
+ */
+void walkDirectories(
+    WalkState &state,
+    const std::function<bool(std::string &&)> &onImage,
+    const std::function<void(const std::string &)> &onDirectory) {
+    std::vector<std::string> subdirectories;
+    std::vector<std::string> images;
+    while (true) {
+        std::string directory;
+        {
+            std::unique_lock<std::mutex> lock(state.mutex);
+            state.changed.wait(lock, [&]() { return state.stopped || !state.pending.empty() || state.active == 0; });
+            if (state.stopped || state.pending.empty()) {
+                return;
+            }
+            // Depth first keeps the pending stack small on wide trees.
+            directory = std::move(state.pending.back());
+            state.pending.pop_back();
+            ++state.active;
+        }
+
+        subdirectories.clear();
+        images.clear();
+        bool keepGoing = true;
+        try {
+            readDirectory(directory, subdirectories, images);
+            std::lock_guard<std::mutex> lock(state.callbackMutex);
+            if (onDirectory) {
+                onDirectory(directory);
+            }
+            for (auto &image : images) {
+                if (!onImage(std::move(image))) {
+                    keepGoing = false;
+                    break;
+                }
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            if (!state.error) {
+                state.error = std::current_exception();
+            }
+            keepGoing = false;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            state.stopped = state.stopped || !keepGoing;
+            for (auto &subdirectory : subdirectories) {
+                state.pending.push_back(std::move(subdirectory));
+            }
+            --state.active;
+        }
+        state.changed.notify_all();
+    }
+}
+} // namespace
+
+/**
+ * Compare the extension after the last dot against the supported types.
+ *
+ * @param filename Filename or path.
+ * @return True for a supported image extension.
+ */
+bool hasImageExtension(std::string_view filename) {
+    static constexpr std::string_view kExtensions[] = {".jpg", ".jpeg", ".png", ".bmp"};
+    size_t dot = filename.find_last_of('.');
+    if (dot == std::string_view::npos) {
+        return false;
+    }
+    std::string_view extension = filename.substr(dot);
+    for (std::string_view candidate : kExtensions) {
+        if (extension.size() == candidate.size() &&
+            std::equal(extension.begin(), extension.end(), candidate.begin(),
+                       [](char a, char b) { return asciiLower(a) == b; })) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Walk a directory tree on a pool of threads.
+ *
+ * @param root Directory to walk.
+ * @param threadCount Reader threads.
+ * @param onImage Image callback; false stops the walk.
+ * @param onDirectory Directory callback (may be empty).
+ */
+void walkImageFiles(
+    const std::string &root,
+    int threadCount,
+    const std::function<bool(std::string &&)> &onImage,
+    const std::function<void(const std::string &)> &onDirectory) {
+    DIR *handle = root.empty() ? nullptr : ::opendir(root.c_str());
+    if (handle == nullptr) {
+        throw std::runtime_error("Cannot open directory: " + root);
+    }
+    ::closedir(handle);
+
+    WalkState state;
+    state.pending.push_back(root);
+    std::vector<std::thread> threads;
+    for (int t = 1; t < threadCount; ++t) {
+        threads.emplace_back([&]() { walkDirectories(state, onImage, onDirectory); });
+    }
+    walkDirectories(state, onImage, onDirectory);
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    if (state.error) {
+        std::rethrow_exception(state.error);
+    }
+}
+
+/**
+ * Walk a directory tree and sort what was found.
+ *
+ * @param root Directory to walk.
+ * @param threadCount Reader threads.
+ * @return Sorted listing.
+ */
+ImageListing listImageTree(const std::string &root, int threadCount) {
+    ImageListing listing;
+    walkImageFiles(
+        root, threadCount,
+        [&](std::string &&path) {
+            listing.files.push_back(std::move(path));
+            return true;
+        },
+        [&](const std::string &directory) { listing.directories.push_back(directory); });
+    ProfileTimer timer(ProfileStage::List);
+    std::sort(listing.files.begin(), listing.files.end());
+    return listing;
+}
+
+/**
+ * Hash the current stamps of the listed directories.
+ *
+ * @param directories Directory paths.
+ * @return Combined stamp.
+ */
+FileStamp directoryTreeStamp(const std::vector<std::string> &directories) {
+    // FNV-1a over each directory's mtime and size.
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&](uint64_t value) {
+        hash ^= value;
+        hash *= 1099511628211ull;
+    };
+    for (const auto &directory : directories) {
+        FileStamp stamp = fileStampOf(directory);
+        mix(static_cast<uint64_t>(stamp.modified));
+        mix(stamp.size);
+    }
+    return {static_cast<int64_t>(hash), directories.size()};
+}
+
+/**
+ * Start the background walk.
+ *
+ * @param root Directory to walk.
+ * @param threadCount Reader threads.
+ */
+ImagePathStream::ImagePathStream(const std::string &root, int threadCount) {
+    walker_ = std::thread([this, root, threadCount]() {
+        std::exception_ptr error;
+        try {
+            walkImageFiles(root, threadCount, [this](std::string &&path) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (cancelled_) {
+                    return false;
+                }
+                paths_.push_back(std::move(path));
+                available_.notify_one();
+                return true;
+            });
+        } catch (...) {
+            error = std::current_exception();
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        error_ = error;
+        done_ = true;
+        available_.notify_all();
+    });
+}
+
+/**
+ * Stop the walk and wait for its threads.
+ */
+ImagePathStream::~ImagePathStream() {
+    cancel();
+    if (walker_.joinable()) {
+        walker_.join();
+    }
+}
+
+/**
+ * Hand out the next found path.
+ *
+ * @param index Path number.
+ * @param path Path.
+ * @return False when no more paths will come.
+ */
+bool ImagePathStream::next(size_t &index, std::string &path) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    available_.wait(lock, [this]() { return cancelled_ || done_ || handedOut_ < paths_.size(); });
+    if (cancelled_ || handedOut_ >= paths_.size()) {
+        return false;
+    }
+    index = handedOut_++;
+    path = paths_[index];
+    return true;
+}
+
+/**
+ * @param index Path number.
+ * @return Path.
+ */
+std::string ImagePathStream::path(size_t index) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return paths_[index];
+}
+
+/**
+ * @return Paths found so far.
+ */
+size_t ImagePathStream::found() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return paths_.size();
+}
+
+/**
+ * Stop the walk early.
+ */
+void ImagePathStream::cancel() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cancelled_ = true;
+    available_.notify_all();
+}
+
+/**
+ * Join the walk and surface its error.
+ */
+void ImagePathStream::finish() {
+    if (walker_.joinable()) {
+        walker_.join();
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (error_) {
+        std::rethrow_exception(error_);
+    }
+}
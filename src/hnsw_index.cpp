@@ -0,0 +1,630 @@
+/*
+Authors - Joseph Defendre, Sourav Das
+
+Implements the HNSW approximate nearest-neighbour index.
+Inserts nodes concurrently with per-node locks and the neighbour heuristic.
+Searches greedily through the upper layers, then with an ef-sized beam on layer 0.
+Reads and writes a self-contained binary file with vectors and filenames.
+*/
+#include "../include/hnsw_index.h"
+
+#include "../include/parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <queue>
+#include <random>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+namespace {
+constexpr char kHnswMagic[8] = {'C', 'B', 'I', 'R', 'H', 'N', 'S', 'W'};
+constexpr uint32_t kHnswVersion = 1;
+// Layer assignment is capped so a corrupt or unlucky draw cannot explode memory.
+constexpr int32_t kMaxLevel = 16;
+
+// On-disk header; all fields are little-endian native values.
+struct HnswHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t cosine;
+    uint64_t rowCount;
+    uint64_t dimension;
+    uint64_t m;
+    uint64_t efConstruction;
+    uint32_t entryPoint;
+    int32_t maxLevel;
+};
+static_assert(sizeof(HnswHeader) == 56, "Unexpected HNSW header layout.");
+
+/**
+ * Epoch-stamped visited marks reused across searches on one thread.
+ */
+struct VisitedSet {
+    std::vector<uint32_t> marks;
+    uint32_t epoch = 0;
+
+    /**
+     * Start a new search over nodeCount nodes.
+     *
+     * @param nodeCount Number of graph nodes.
+     */
+    void reset(size_t nodeCount) {
+        if (marks.size() < nodeCount) {
+            marks.assign(nodeCount, 0);
+            epoch = 0;
+        }
+        if (++epoch == 0) {
+            std::fill(marks.begin(), marks.end(), 0);
+            epoch = 1;
+        }
+    }
+
+    /**
+     * Mark a node as visited.
+     *
+     * @param node Node id.
+     * @return True if the node was already visited in this search.
+     */
+    bool visit(uint32_t node) {
+        if (marks[node] == epoch) {
+            return true;
+        }
+        marks[node] = epoch;
+        return false;
+    }
+};
+
+/**
+ * Visited set for the calling thread.
+ *
+ * @return Thread-local visited set.
+ */
+VisitedSet &threadVisitedSet() {
+    thread_local VisitedSet visited;
+    return visited;
+}
+
+/**
+ * Order candidates nearest first, breaking ties by lower index.
+ */
+bool nearerCandidate(const ScoredCandidate &a, const ScoredCandidate &b) {
+    return a.distance < b.distance || (a.distance == b.distance && a.index < b.index);
+}
+
+/**
+ * Write a trivially copyable array to a stream.
+ *
+ * @param output Output stream.
+ * @param values Array to write.
+ */
+template <typename T>
+void writeArray(std::ofstream &output, const std::vector<T> &values) {
+    output.write(reinterpret_cast<const char *>(values.data()),
+                 static_cast<std::streamsize>(values.size() * sizeof(T)));
+}
+
+/**
+ * Read a trivially copyable array of known length from a stream.
+ *
+ * @param input Input stream.
+ * @param values Array to fill (already sized).
+ * @return True if every element was read.
+ */
+template <typename T>
+bool readArray(std::ifstream &input, std::vector<T> &values) {
+    return static_cast<bool>(input.read(reinterpret_cast<char *>(values.data()),
+                                        static_cast<std::streamsize>(values.size() * sizeof(T))));
+}
+} // namespace
+
+/**
+ * Load the graph, vectors and filenames from disk and validate every link.
+ *
+ * @param path Index file path.
+ * @throws std::runtime_error if the file is unreadable or malformed.
+ */
+HnswIndex::HnswIndex(const std::string &path) {
+    std::ifstream input(path, std::ios::binary);
+    if (!input.is_open()) {
+        throw std::runtime_error("Failed to open HNSW index: " + path);
+    }
+    HnswHeader header {};
+    bool valid = static_cast<bool>(input.read(reinterpret_cast<char *>(&header), sizeof(header))) &&
+                 std::memcmp(header.magic, kHnswMagic, sizeof(kHnswMagic)) == 0 &&
+                 header.version == kHnswVersion && header.cosine <= 1 && header.m >= 2 &&
+                 header.m <= 1024 && header.rowCount < UINT32_MAX && header.dimension > 0 &&
+                 header.maxLevel < kMaxLevel &&
+                 (header.rowCount == 0 ? header.maxLevel == -1
+                                       : header.entryPoint < header.rowCount && header.maxLevel >= 0);
+    if (!valid) {
+        throw std::runtime_error("Invalid HNSW index: " + path);
+    }
+
+    cosine_ = header.cosine == 1;
+    metric_ = cosine_ ? "cosine" : "ssd";
+    params_.m = static_cast<size_t>(header.m);
+    params_.efConstruction = static_cast<size_t>(header.efConstruction);
+    dimension_ = static_cast<size_t>(header.dimension);
+    kernels_ = &activeDistanceKernels();
+    entryPoint_ = header.entryPoint;
+    maxLevel_ = header.maxLevel;
+    size_t rowCount = static_cast<size_t>(header.rowCount);
+
+    data_.resize(rowCount * dimension_);
+    levels_.resize(rowCount);
+    layer0_.resize(rowCount * (linkCapacity(0) + 1));
+    valid = readArray(input, data_) && readArray(input, levels_) && readArray(input, layer0_);
+    upperLayers_.resize(rowCount);
+    for (size_t node = 0; valid && node < rowCount; ++node) {
+        valid = levels_[node] >= 0 && levels_[node] <= maxLevel_;
+        if (valid && levels_[node] > 0) {
+            upperLayers_[node].resize(static_cast<size_t>(levels_[node]) * (linkCapacity(1) + 1));
+            valid = readArray(input, upperLayers_[node]);
+        }
+    }
+    for (size_t node = 0; valid && node < rowCount; ++node) {
+        for (int32_t level = 0; valid && level <= levels_[node]; ++level) {
+            const uint32_t *list = links(static_cast<uint32_t>(node), level);
+            valid = list[0] <= linkCapacity(level);
+            for (uint32_t i = 1; valid && i <= list[0]; ++i) {
+                valid = list[i] < rowCount && levels_[list[i]] >= level;
+            }
+        }
+    }
+
+    std::vector<uint64_t> nameOffsets(rowCount + 1);
+    valid = valid && readArray(input, nameOffsets) && nameOffsets[0] == 0 &&
+            std::is_sorted(nameOffsets.begin(), nameOffsets.end());
+    std::string names;
+    if (valid) {
+        names.resize(static_cast<size_t>(nameOffsets[rowCount]));
+        valid = static_cast<bool>(input.read(names.data(), static_cast<std::streamsize>(names.size())));
+    }
+    if (!valid) {
+        throw std::runtime_error("Invalid HNSW index: " + path);
+    }
+    filenames_.reserve(rowCount);
+    for (size_t row = 0; row < rowCount; ++row) {
+        filenames_.emplace_back(names, nameOffsets[row], nameOffsets[row + 1] - nameOffsets[row]);
+    }
+    indexFilenames();
+}
+
+/**
+ * Copy (and for cosine normalize) the vectors, then insert every node.
+ *
+ * @param metric "cosine" or "ssd".
+ * @param rows Row-major vectors.
+ * @param rowCount Number of vectors.
+ * @param dimension Floats per vector.
+ * @param filenames Filename per vector.
+ * @param params Construction settings.
+ * @param threadCount Worker threads.
+ * @return Built index.
+ * @throws std::runtime_error on invalid inputs.
+ */
+HnswIndex HnswIndex::build(
+    const std::string &metric,
+    const float *rows,
+    size_t rowCount,
+    size_t dimension,
+    std::vector<std::string> filenames,
+    const HnswParams &params,
+    int threadCount) {
+    if (metric != "cosine" && metric != "ssd") {
+        throw std::runtime_error("HNSW index supports cosine or ssd, not " + metric);
+    }
+    if (params.m < 2 || params.m > 1024 || params.efConstruction == 0) {
+        throw std::runtime_error("HNSW needs 2 <= M <= 1024 and efConstruction > 0");
+    }
+    if (filenames.size() != rowCount || rowCount >= UINT32_MAX || dimension == 0) {
+        throw std::runtime_error("HNSW index needs one filename per non-empty vector");
+    }
+
+    HnswIndex index;
+    index.metric_ = metric;
+    index.cosine_ = metric == "cosine";
+    index.params_ = params;
+    index.dimension_ = dimension;
+    index.kernels_ = &activeDistanceKernels();
+    index.data_.assign(rows, rows + rowCount * dimension);
+    index.filenames_ = std::move(filenames);
+    if (index.cosine_) {
+        for (size_t row = 0; row < rowCount; ++row) {
+            float *values = index.data_.data() + row * dimension;
+            float norm = std::sqrt(index.kernels_->dot(values, values, dimension));
+            if (norm > 0.0f) {
+                std::transform(values, values + dimension, values, [norm](float v) { return v / norm; });
+            }
+        }
+    }
+
+    // Draw every node's top layer up front so the layer assignment depends only on the seed.
+    // Concurrent inserts still race for neighbours; only a one-thread build gives the same links every time.
+    std::mt19937 rng(params.seed);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    double levelScale = 1.0 / std::log(static_cast<double>(params.m));
+    index.levels_.resize(rowCount);
+    index.upperLayers_.resize(rowCount);
+    for (size_t node = 0; node < rowCount; ++node) {
+        double draw = -std::log(std::max(uniform(rng), 1e-12)) * levelScale;
+        index.levels_[node] = std::min(static_cast<int32_t>(draw), kMaxLevel - 1);
+        index.upperLayers_[node].assign(
+            static_cast<size_t>(index.levels_[node]) * (index.linkCapacity(1) + 1), 0);
+    }
+    index.layer0_.assign(rowCount * (index.linkCapacity(0) + 1), 0);
+
+    if (rowCount > 0) {
+        index.nodeLocks_ = std::make_unique<std::mutex[]>(rowCount);
+        index.entryLock_ = std::make_unique<std::mutex>();
+        index.entryPoint_ = 0;
+        index.maxLevel_ = index.levels_[0];
+        parallelFor(rowCount - 1, threadCount, [&index](size_t i) {
+            index.insert(static_cast<uint32_t>(i + 1));
+        });
+        index.nodeLocks_.reset();
+        index.entryLock_.reset();
+    }
+    index.indexFilenames();
+    return index;
+}
+
+/**
+ * Write header, vectors, levels, links and the filename table.
+ *
+ * @param path Destination path.
+ * @throws std::runtime_error on write failure.
+ */
+void HnswIndex::save(const std::string &path) const {
+    HnswHeader header {};
+    std::memcpy(header.magic, kHnswMagic, sizeof(kHnswMagic));
+    header.version = kHnswVersion;
+    header.cosine = cosine_ ? 1 : 0;
+    header.rowCount = size();
+    header.dimension = dimension_;
+    header.m = params_.m;
+    header.efConstruction = params_.efConstruction;
+    header.entryPoint = entryPoint_;
+    header.maxLevel = maxLevel_;
+
+    std::vector<uint64_t> nameOffsets;
+    nameOffsets.reserve(size() + 1);
+    nameOffsets.push_back(0);
+    for (const auto &name : filenames_) {
+        nameOffsets.push_back(nameOffsets.back() + name.size());
+    }
+
+    // Replace by rename so a serving process never reads a half-written file.
+    std::string temporaryPath = path + ".tmp";
+    std::ofstream output(temporaryPath, std::ios::binary | std::ios::trunc);
+    if (!output.is_open()) {
+        throw std::runtime_error("Failed to open HNSW index for writing: " + path);
+    }
+    output.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    writeArray(output, data_);
+    writeArray(output, levels_);
+    writeArray(output, layer0_);
+    for (const auto &upper : upperLayers_) {
+        writeArray(output, upper);
+    }
+    writeArray(output, nameOffsets);
+    for (const auto &name : filenames_) {
+        output.write(name.data(), static_cast<std::streamsize>(name.size()));
+    }
+    output.close();
+    std::error_code error;
+    if (!output) {
+        std::filesystem::remove(temporaryPath, error);
+        throw std::runtime_error("Failed to write HNSW index: " + path);
+    }
+    std::filesystem::rename(temporaryPath, path, error);
+    if (error) {
+        std::filesystem::remove(temporaryPath, error);
+        throw std::runtime_error("Failed to replace HNSW index: " + path);
+    }
+}
+
+/**
+ * Greedy descent through the upper layers, then a beam search on layer 0.
+ *
+ * @param query Query vector.
+ * @param k Number of results.
+ * @param ef Beam width.
+ * @return Nearest candidates first.
+ * @throws std::runtime_error on a dimension mismatch.
+ */
+std::vector<ScoredCandidate> HnswIndex::search(FloatView query, size_t k, size_t ef) const {
+    if (query.size != dimension_) {
+        throw std::runtime_error("HNSW query size does not match the index dimension");
+    }
+    if (size() == 0 || k == 0) {
+        return {};
+    }
+    std::vector<float> normalized;
+    const float *values = query.data;
+    if (cosine_) {
+        float norm = std::sqrt(kernels_->dot(query.data, query.data, dimension_));
+        normalized.assign(query.data, query.data + dimension_);
+        if (norm > 0.0f) {
+            for (float &value : normalized) {
+                value /= norm;
+            }
+        }
+        values = normalized.data();
+    }
+
+    uint32_t entry = greedyClosest(values, entryPoint_, maxLevel_, 1, false);
+    auto results = searchLayer(values, entry, std::max(ef, k), 0, false);
+    if (results.size() > k) {
+        results.resize(k);
+    }
+    return results;
+}
+
+/**
+ * Look up the row for a filename.
+ *
+ * @param name Filename.
+ * @return Row or npos.
+ */
+size_t HnswIndex::findRow(const std::string &name) const {
+    auto it = rowByName_.find(name);
+    return it == rowByName_.end() ? npos : it->second;
+}
+
+/**
+ * Distance between two stored-format vectors (1 - dot for cosine, SSD otherwise).
+ */
+float HnswIndex::distance(const float *a, const float *b) const {
+    return cosine_ ? 1.0f - kernels_->dot(a, b, dimension_) : kernels_->ssd(a, b, dimension_);
+}
+
+/**
+ * Link list of a node on a level: [count, ids...].
+ */
+const uint32_t *HnswIndex::links(uint32_t node, int level) const {
+    if (level == 0) {
+        return layer0_.data() + static_cast<size_t>(node) * (linkCapacity(0) + 1);
+    }
+    return upperLayers_[node].data() + static_cast<size_t>(level - 1) * (linkCapacity(1) + 1);
+}
+
+uint32_t *HnswIndex::links(uint32_t node, int level) {
+    return const_cast<uint32_t *>(static_cast<const HnswIndex *>(this)->links(node, level));
+}
+
+/**
+ * Walk greedily towards the query on each level from fromLevel down to toLevel.
+ *
+ * @param query Stored-format query vector.
+ * @param entry Starting node.
+ * @param fromLevel Highest level to search.
+ * @param toLevel Lowest level to search.
+ * @param locked Copy link lists under their node lock (during build).
+ * @return Closest node found on toLevel.
+ */
+uint32_t HnswIndex::greedyClosest(
+    const float *query,
+    uint32_t entry,
+    int fromLevel,
+    int toLevel,
+    bool locked) const {
+    uint32_t current = entry;
+    float currentDistance = distance(query, data_.data() + static_cast<size_t>(current) * dimension_);
+    std::vector<uint32_t> neighbours;
+    for (int level = fromLevel; level >= toLevel; --level) {
+        bool moved = true;
+        while (moved) {
+            moved = false;
+            {
+                std::unique_lock<std::mutex> lock;
+                if (locked) {
+                    lock = std::unique_lock<std::mutex>(nodeLocks_[current]);
+                }
+                const uint32_t *list = links(current, level);
+                neighbours.assign(list + 1, list + 1 + list[0]);
+            }
+            for (uint32_t neighbour : neighbours) {
+                float d = distance(query, data_.data() + static_cast<size_t>(neighbour) * dimension_);
+                if (d < currentDistance) {
+                    currentDistance = d;
+                    current = neighbour;
+                    moved = true;
+                }
+            }
+        }
+    }
+    return current;
+}
+
+/**
+ * Beam search on one level.
+ *
+ * @param query Stored-format query vector.
+ * @param entry Starting node.
+ * @param ef Beam width (number of results kept).
+ * @param level Graph level.
+ * @param locked Copy link lists under their node lock (during build).
+ * @return Up to ef candidates, nearest first.
+ */
+std::vector<ScoredCandidate> HnswIndex::searchLayer(
+    const float *query,
+    uint32_t entry,
+    size_t ef,
+    int level,
+    bool locked) const {
+    using Entry = std::pair<float, uint32_t>;
+    VisitedSet &visited = threadVisitedSet();
+    visited.reset(size());
+
+    // Frontier is a min-heap; results a max-heap holding the best ef so far.
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> frontier;
+    std::priority_queue<Entry> results;
+    float entryDistance = distance(query, data_.data() + static_cast<size_t>(entry) * dimension_);
+    frontier.emplace(entryDistance, entry);
+    results.emplace(entryDistance, entry);
+    visited.visit(entry);
+
+    std::vector<uint32_t> neighbours;
+    while (!frontier.empty()) {
+        Entry nearest = frontier.top();
+        if (nearest.first > results.top().first && results.size() >= ef) {
+            break;
+        }
+        frontier.pop();
+        {
+            std::unique_lock<std::mutex> lock;
+            if (locked) {
+                lock = std::unique_lock<std::mutex>(nodeLocks_[nearest.second]);
+            }
+            const uint32_t *list = links(nearest.second, level);
+            neighbours.assign(list + 1, list + 1 + list[0]);
+        }
+        for (uint32_t neighbour : neighbours) {
+            if (visited.visit(neighbour)) {
+                continue;
+            }
+            float d = distance(query, data_.data() + static_cast<size_t>(neighbour) * dimension_);
+            if (results.size() < ef || d < results.top().first) {
+                frontier.emplace(d, neighbour);
+                results.emplace(d, neighbour);
+                if (results.size() > ef) {
+                    results.pop();
+                }
+            }
+        }
+    }
+
+    std::vector<ScoredCandidate> ordered;
+    ordered.reserve(results.size());
+    while (!results.empty()) {
+        ordered.push_back({results.top().first, results.top().second});
+        results.pop();
+    }
+    std::sort(ordered.begin(), ordered.end(), nearerCandidate);
+    return ordered;
+}
+
+/**
+ * Neighbour selection heuristic: keep a candidate only if it is closer to the
+ * base node than to every neighbour already kept, which spreads links across
+ * clusters instead of spending them all inside the nearest one.
+ *
+ * @param candidates Candidates with their distance to the base node.
+ * @param limit Maximum number of neighbours.
+ * @return Selected node ids.
+ */
+std::vector<uint32_t> HnswIndex::selectNeighbours(std::vector<ScoredCandidate> candidates, size_t limit) const {
+    std::sort(candidates.begin(), candidates.end(), nearerCandidate);
+    std::vector<uint32_t> selected;
+    for (const auto &candidate : candidates) {
+        if (selected.size() >= limit) {
+            break;
+        }
+        const float *values = data_.data() + candidate.index * dimension_;
+        bool diverse = std::none_of(selected.begin(), selected.end(), [&](uint32_t kept) {
+            return distance(values, data_.data() + static_cast<size_t>(kept) * dimension_) <
+                   candidate.distance;
+        });
+        if (diverse) {
+            selected.push_back(static_cast<uint32_t>(candidate.index));
+        }
+    }
+    return selected;
+}
+
+/**
+ * Insert one node: descend to its top layer, then link it on every layer below.
+ *
+ * @param node Node id (its vector and level are already set).
+ */
+void HnswIndex::insert(uint32_t node) {
+    const float *values = data_.data() + static_cast<size_t>(node) * dimension_;
+    int32_t level = levels_[node];
+
+    // A node that becomes the new top holds the entry lock for its whole insert.
+    std::unique_lock<std::mutex> entryLock(*entryLock_);
+    uint32_t entry = entryPoint_;
+    int32_t topLevel = maxLevel_;
+    if (level <= topLevel) {
+        entryLock.unlock();
+    }
+
+    uint32_t current = entry;
+    if (level < topLevel) {
+        current = greedyClosest(values, current, topLevel, level + 1, true);
+    }
+    for (int32_t l = std::min(level, topLevel); l >= 0; --l) {
+        auto candidates = searchLayer(values, current, params_.efConstruction, l, true);
+        current = static_cast<uint32_t>(candidates.front().index);
+        std::vector<uint32_t> selected = selectNeighbours(candidates, params_.m);
+        {
+            std::lock_guard<std::mutex> lock(nodeLocks_[node]);
+            uint32_t *list = links(node, l);
+            list[0] = static_cast<uint32_t>(selected.size());
+            std::copy(selected.begin(), selected.end(), list + 1);
+        }
+
+        // Add the reverse links, re-running the heuristic when a list is full.
+        size_t capacity = linkCapacity(l);
+        for (uint32_t neighbour : selected) {
+            std::lock_guard<std::mutex> lock(nodeLocks_[neighbour]);
+            uint32_t *list = links(neighbour, l);
+            if (std::find(list + 1, list + 1 + list[0], node) != list + 1 + list[0]) {
+                // A concurrent insert of the neighbour already linked back to this node.
+                continue;
+            }
+            if (list[0] < capacity) {
+                list[1 + list[0]] = node;
+                ++list[0];
+                continue;
+            }
+            const float *base = data_.data() + static_cast<size_t>(neighbour) * dimension_;
+            std::vector<ScoredCandidate> pool;
+            pool.push_back({distance(base, values), node});
+            for (uint32_t i = 1; i <= list[0]; ++i) {
+                pool.push_back({distance(base, data_.data() + static_cast<size_t>(list[i]) * dimension_), list[i]});
+            }
+            std::vector<uint32_t> kept = selectNeighbours(std::move(pool), capacity);
+            list[0] = static_cast<uint32_t>(kept.size());
+            std::copy(kept.begin(), kept.end(), list + 1);
+        }
+    }
+
+    if (level > topLevel) {
+        entryPoint_ = node;
+        maxLevel_ = level;
+    }
+}
+
+/**
+ * Build the filename lookup table.
+ */
+void HnswIndex::indexFilenames() {
+    rowByName_.clear();
+    rowByName_.reserve(filenames_.size());
+    for (size_t row = 0; row < filenames_.size(); ++row) {
+        rowByName_.emplace(filenames_[row], row);
+    }
+}
+
+/**
+ * Check for the HNSW magic without reading the whole file.
+ *
+ * @param path File path.
+ * @return True if the magic bytes match.
+ */
+bool isHnswIndexFile(const std::string &path) {
+    std::ifstream input(path, std::ios::binary);
+    char magic[sizeof(kHnswMagic)] = {};
+    if (!input.read(magic, sizeof(magic))) {
+        return false;
+    }
+    return std::memcmp(magic, kHnswMagic, sizeof(kHnswMagic)) == 0;
+}
@@ -2,90 +2,283 @@
 Authors - Joseph Defendre, Sourav Das
 
 Implements image and CSV I/O helpers.
-Finds image files by extension and loads with OpenCV.
-Reads/writes feature CSVs and embedding CSVs.
-Provides parsing utilities with basic validation.
+Lists image files through the recursive walker and loads them with OpenCV.
+Reads feature/embedding CSVs from a memory map in parallel line-aligned chunks.
+Writes feature CSVs with std::to_chars.
+Splits file reads from decoding for the staged scan pipeline.
+Maps decode scales onto OpenCV's reduced-resolution read modes.
 */
 #include "../include/image_io.h"
 
+#include "../include/distance_kernels.h"
+#include "../include/file_walker.h"
+#include "../include/parallel.h"
+#include "../include/profile.h"
+
 #include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
-#include <sstream>
 #include <stdexcept>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 namespace {
+// Lines per parse chunk are found by splitting the file into this many pieces per thread.
+constexpr size_t kChunksPerThread = 4;
+// Rows formatted per writer chunk.
+constexpr size_t kWriteChunkRows = 1024;
+
+/**
+ * Read-only mapping of a whole file (empty files map to nothing).
+ */
+class MappedFile {
+public:
+    explicit MappedFile(const std::string &path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Failed to open features CSV: " + path);
+        }
+        struct stat fileStat {};
+        if (::fstat(fd, &fileStat) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Failed to read features CSV: " + path);
+        }
+        size_ = static_cast<size_t>(fileStat.st_size);
+        if (size_ > 0) {
+            void *mapping = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error("Failed to map features CSV: " + path);
+            }
+            ::madvise(mapping, size_, MADV_SEQUENTIAL);
+            data_ = static_cast<const char *>(mapping);
+        }
+        ::close(fd);
+    }
+    ~MappedFile() {
+        if (data_ != nullptr) {
+            ::munmap(const_cast<char *>(data_), size_);
+        }
+    }
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const char *data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const char *data_ = nullptr;
+    size_t size_ = 0;
+};
+
+/**
+ * One CSV line with its line ending removed.
+ */
+struct CsvLine {
+    const char *begin;
+    const char *end;
+};
+
 /**
- * Check common image extensions (case-insensitive).
+ * Visit the non-empty lines of a chunk.
  *
- * @param filename Filename or path.
- * @return True if the extension is a supported image type.
+ * @param begin First byte of the chunk (a line start).
+ * @param end One past the last byte (a line start or end of file).
+ * @param visit Called with each line, without its "\n" or "\r\n".
  */
-bool hasImageExtension(const std::string &filename) {
-    auto lower = filename;
-    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
-    auto dot = lower.find_last_of('.');
-    if (dot == std::string::npos) {
-        return false;
+template <typename Visit>
+void forEachLine(const char *begin, const char *end, Visit visit) {
+    while (begin < end) {
+        const char *newline = static_cast<const char *>(std::memchr(begin, '\n', static_cast<size_t>(end - begin)));
+        const char *lineEnd = newline != nullptr ? newline : end;
+        const char *next = newline != nullptr ? newline + 1 : end;
+        if (lineEnd > begin && lineEnd[-1] == '\r') {
+            --lineEnd;
+        }
+        if (lineEnd > begin) {
+            visit(CsvLine {begin, lineEnd});
+        }
+        begin = next;
+    }
+}
+
+/**
+ * Number of values after the filename (a trailing empty cell is not counted).
+ *
+ * @param line CSV line.
+ * @return Value count.
+ */
+size_t csvValueCount(const CsvLine &line) {
+    size_t commas = static_cast<size_t>(std::count(line.begin, line.end, ','));
+    return commas > 0 && line.end[-1] == ',' ? commas - 1 : commas;
+}
+
+/**
+ * Parse one numeric cell; blank cells are 0 and surrounding spaces are ignored.
+ *
+ * @param begin First byte of the cell.
+ * @param end One past the last byte.
+ * @param value Output value.
+ * @return False if the cell is not a number.
+ */
+bool parseCsvNumber(const char *begin, const char *end, float &value) {
+    while (begin < end && (*begin == ' ' || *begin == '\t')) {
+        ++begin;
+    }
+    while (end > begin && (end[-1] == ' ' || end[-1] == '\t')) {
+        --end;
+    }
+    if (begin == end) {
+        value = 0.0f;
+        return true;
     }
-    auto ext = lower.substr(dot);
-    return ext == ".jpg" || ext == ".jpeg" || ext == ".png" || ext == ".bmp";
+    if (*begin == '+') {
+        ++begin;
+    }
+    auto result = std::from_chars(begin, end, value);
+    return result.ec == std::errc() && result.ptr == end;
 }
 
 /**
- * Parse a comma-separated list of floats, treating empty cells as zero.
+ * Split a buffer into line-aligned chunks of roughly equal size.
  *
- * @param line CSV line containing numeric values.
- * @return Vector of parsed float values.
+ * @param data Buffer start.
+ * @param size Buffer size.
+ * @param pieces Requested number of chunks.
+ * @return Chunk boundaries (chunk i is [bounds[i], bounds[i + 1])).
  */
-std::vector<float> parseCsvNumbers(const std::string &line) {
-    std::vector<float> values;
-    std::stringstream lineStream(line);
-    std::string cell;
-    while (std::getline(lineStream, cell, ',')) {
-        if (cell.empty()) {
-            values.push_back(0.0f);
-            continue;
+std::vector<const char *> lineAlignedChunks(const char *data, size_t size, size_t pieces) {
+    std::vector<const char *> bounds {data};
+    const char *end = data + size;
+    for (size_t i = 1; i < pieces; ++i) {
+        const char *cut = std::max(data + size * i / pieces, bounds.back());
+        const char *newline = static_cast<const char *>(std::memchr(cut, '\n', static_cast<size_t>(end - cut)));
+        if (newline == nullptr) {
+            break;
+        }
+        if (newline + 1 > bounds.back()) {
+            bounds.push_back(newline + 1);
         }
-        values.push_back(std::stof(cell));
     }
-    return values;
+    bounds.push_back(end);
+    return bounds;
+}
+/**
+ * Translate a decode scale into imread/imdecode flags.
+ *
+ * @param decodeScale Downscale factor (1, 2, 4 or 8).
+ * @return OpenCV read flags.
+ * @throws std::runtime_error if the scale is not supported.
+ */
+int readFlagsForScale(int decodeScale) {
+    switch (decodeScale) {
+    case 1:
+        return cv::IMREAD_COLOR;
+    case 2:
+        return cv::IMREAD_REDUCED_COLOR_2;
+    case 4:
+        return cv::IMREAD_REDUCED_COLOR_4;
+    case 8:
+        return cv::IMREAD_REDUCED_COLOR_8;
+    default:
+        throw std::runtime_error("Decode scale must be 1, 2, 4 or 8: " + std::to_string(decodeScale));
+    }
 }
 } // namespace
 
 /**
- * Enumerate and sort image files from a directory.
+ * Enumerate and sort image files below a directory.
  *
  * @param directoryPath Directory to scan.
+ * @param threadCount Directory reader threads.
  * @return Sorted list of image file paths.
  */
-std::vector<std::string> listImageFiles(const std::string &directoryPath) {
-    std::vector<std::string> files;
-    for (const auto &entry : std::filesystem::directory_iterator(directoryPath)) {
-        if (!entry.is_regular_file()) {
-            continue;
-        }
-        const auto path = entry.path();
-        if (hasImageExtension(path.filename().string())) {
-            files.push_back(path.string());
-        }
-    }
-    std::sort(files.begin(), files.end());
-    return files;
+std::vector<std::string> listImageFiles(const std::string &directoryPath, int threadCount) {
+    return listImageTree(directoryPath, threadCount).files;
+}
+
+/**
+ * Check whether a decode scale maps to an OpenCV read mode.
+ *
+ * @param decodeScale Downscale factor.
+ * @return True for 1, 2, 4 and 8.
+ */
+bool isValidDecodeScale(int decodeScale) {
+    return decodeScale == 1 || decodeScale == 2 || decodeScale == 4 || decodeScale == 8;
 }
 
 /**
  * Load an image and throw if OpenCV fails to decode it.
  *
  * @param imagePath Path to the image file.
+ * @param decodeScale Downscale factor.
  * @return Loaded BGR image.
  * @throws std::runtime_error if loading fails.
  */
-cv::Mat loadImageOrThrow(const std::string &imagePath) {
-    cv::Mat image = cv::imread(imagePath, cv::IMREAD_COLOR);
+cv::Mat loadImageOrThrow(const std::string &imagePath, int decodeScale) {
+    ProfileTimer timer(ProfileStage::Decode);
+    cv::Mat image = cv::imread(imagePath, readFlagsForScale(decodeScale));
+    if (image.empty()) {
+        throw std::runtime_error("Failed to load image: " + imagePath);
+    }
+    if (profilingEnabled()) {
+        // imread reads the file itself, so its size is the bytes read.
+        std::error_code error;
+        auto size = std::filesystem::file_size(imagePath, error);
+        profileCount(ProfileCounter::BytesRead, error ? 0 : static_cast<uint64_t>(size));
+        profileCount(ProfileCounter::ImagesDecoded, 1);
+    }
+    return image;
+}
+
+/**
+ * Read an entire file into a byte buffer.
+ *
+ * @param path File path.
+ * @return File contents.
+ * @throws std::runtime_error if the file cannot be read.
+ */
+std::vector<uchar> readFileBytes(const std::string &path) {
+    ProfileTimer timer(ProfileStage::Read);
+    std::ifstream inputFile(path, std::ios::binary | std::ios::ate);
+    if (!inputFile.is_open()) {
+        throw std::runtime_error("Failed to open file: " + path);
+    }
+    std::streamsize size = inputFile.tellg();
+    inputFile.seekg(0, std::ios::beg);
+    std::vector<uchar> bytes(static_cast<size_t>(std::max<std::streamsize>(size, 0)));
+    if (!inputFile.read(reinterpret_cast<char *>(bytes.data()), size)) {
+        throw std::runtime_error("Failed to read file: " + path);
+    }
+    profileCount(ProfileCounter::BytesRead, bytes.size());
+    return bytes;
+}
+
+/**
+ * Decode an in-memory image and throw if OpenCV fails to decode it.
+ *
+ * @param bytes Encoded image data.
+ * @param imagePath Source path for error messages.
+ * @param decodeScale Downscale factor.
+ * @return Decoded BGR image.
+ * @throws std::runtime_error if decoding fails.
+ */
+cv::Mat decodeImageOrThrow(
+    const std::vector<uchar> &bytes,
+    const std::string &imagePath,
+    int decodeScale) {
+    ProfileTimer timer(ProfileStage::Decode);
+    cv::Mat image = cv::imdecode(bytes, readFlagsForScale(decodeScale));
     if (image.empty()) {
         throw std::runtime_error("Failed to load image: " + imagePath);
     }
+    profileCount(ProfileCounter::ImagesDecoded, 1);
     return image;
 }
 
@@ -94,87 +287,161 @@ cv::Mat loadImageOrThrow(const std::string &imagePath) {
  *
  * @param outputPath Destination CSV path.
  * @param features Vector of filename/feature pairs.
- * @return True on success, false if the file cannot be opened.
+ * @param threadCount Worker threads used for formatting.
+ * @return True on success, false if the file cannot be opened or written.
  */
 bool writeFeaturesCsv(
     const std::string &outputPath,
-    const std::vector<std::pair<std::string, std::vector<float>>> &features) {
-    std::ofstream outputFile(outputPath);
+    const std::vector<std::pair<std::string, std::vector<float>>> &features,
+    int threadCount) {
+    std::ofstream outputFile(outputPath, std::ios::binary);
     if (!outputFile.is_open()) {
         return false;
     }
 
-    for (const auto &entry : features) {
-        outputFile << entry.first;
-        for (float value : entry.second) {
-            outputFile << "," << value;
+    // Shortest round-trip text, so stored features rank like live ones.
+    // Chunks are formatted a wave at a time to bound the buffered text.
+    size_t chunkCount = (features.size() + kWriteChunkRows - 1) / kWriteChunkRows;
+    size_t wave = static_cast<size_t>(std::max(threadCount, 1)) * kChunksPerThread;
+    std::vector<std::string> texts(std::min(wave, chunkCount));
+    for (size_t first = 0; first < chunkCount; first += wave) {
+        size_t count = std::min(wave, chunkCount - first);
+        parallelFor(count, threadCount, [&](size_t k) {
+            std::string &text = texts[k];
+            text.clear();
+            size_t begin = (first + k) * kWriteChunkRows;
+            size_t end = std::min(begin + kWriteChunkRows, features.size());
+            char number[32];
+            for (size_t row = begin; row < end; ++row) {
+                text += features[row].first;
+                for (float value : features[row].second) {
+                    auto result = std::to_chars(number, number + sizeof(number), value);
+                    text += ',';
+                    text.append(number, result.ptr);
+                }
+                text += '\n';
+            }
+        });
+        for (size_t k = 0; k < count; ++k) {
+            outputFile.write(texts[k].data(), static_cast<std::streamsize>(texts[k].size()));
         }
-        outputFile << "\n";
     }
 
-    return true;
+    outputFile.close();
+    return static_cast<bool>(outputFile);
 }
 
 /**
- * Read a CSV of filename followed by feature values.
+ * Parse a features/embeddings CSV into a contiguous matrix.
+ *
+ * Pass 1 counts rows per chunk and checks that every row has the same number
+ * of values; pass 2 parses each chunk into its precomputed row range.
  *
  * @param inputPath Source CSV path.
- * @return Vector of filename/feature pairs.
- * @throws std::runtime_error if the file cannot be opened.
+ * @param threadCount Worker threads used for parsing.
+ * @return Parsed matrix with row norms.
+ * @throws std::runtime_error on unreadable files, bad numbers or ragged rows.
  */
-std::vector<std::pair<std::string, std::vector<float>>> readFeaturesCsv(
-    const std::string &inputPath) {
-    std::ifstream inputFile(inputPath);
-    if (!inputFile.is_open()) {
-        throw std::runtime_error("Failed to open features CSV: " + inputPath);
+FeatureMatrix readFeatureMatrixCsv(const std::string &inputPath, int threadCount) {
+    MappedFile file(inputPath);
+    profileCount(ProfileCounter::BytesRead, file.size());
+    FeatureMatrix matrix;
+    if (file.size() == 0) {
+        return matrix;
     }
+    auto bounds = lineAlignedChunks(file.data(), file.size(),
+                                    static_cast<size_t>(std::max(threadCount, 1)) * kChunksPerThread);
+    size_t chunkCount = bounds.size() - 1;
 
-    std::vector<std::pair<std::string, std::vector<float>>> features;
-    std::string line;
-    while (std::getline(inputFile, line)) {
-        if (line.empty()) {
-            continue;
+    // Sentinel for "no rows yet" in a chunk's dimension.
+    constexpr size_t kUnknown = static_cast<size_t>(-1);
+    std::vector<size_t> chunkRows(chunkCount, 0);
+    std::vector<size_t> chunkDimensions(chunkCount, kUnknown);
+    std::vector<uint8_t> chunkRagged(chunkCount, 0);
+    parallelFor(chunkCount, threadCount, [&](size_t chunk) {
+        forEachLine(bounds[chunk], bounds[chunk + 1], [&](const CsvLine &line) {
+            size_t values = csvValueCount(line);
+            if (chunkDimensions[chunk] == kUnknown) {
+                chunkDimensions[chunk] = values;
+            } else if (values != chunkDimensions[chunk]) {
+                chunkRagged[chunk] = 1;
+            }
+            ++chunkRows[chunk];
+        });
+    });
+
+    std::vector<size_t> firstRow(chunkCount + 1, 0);
+    size_t dimension = kUnknown;
+    for (size_t chunk = 0; chunk < chunkCount; ++chunk) {
+        if (chunkDimensions[chunk] != kUnknown) {
+            if (dimension == kUnknown) {
+                dimension = chunkDimensions[chunk];
+            }
+            if (chunkRagged[chunk] != 0 || chunkDimensions[chunk] != dimension) {
+                throw std::runtime_error("CSV rows must all have the same number of values: " + inputPath);
+            }
         }
-        std::stringstream lineStream(line);
-        std::string filename;
-        std::getline(lineStream, filename, ',');
-        std::string rest;
-        std::getline(lineStream, rest);
-        auto values = parseCsvNumbers(rest);
-        features.emplace_back(filename, std::move(values));
+        firstRow[chunk + 1] = firstRow[chunk] + chunkRows[chunk];
+    }
+    size_t rowCount = firstRow[chunkCount];
+    if (rowCount == 0) {
+        return matrix;
     }
 
-    return features;
+    matrix.dimension = dimension;
+    matrix.filenames.resize(rowCount);
+    matrix.rows.resize(rowCount * dimension);
+    matrix.norms.resize(rowCount);
+    auto dot = activeDistanceKernels().dot;
+    std::vector<std::string> errors(chunkCount);
+    parallelFor(chunkCount, threadCount, [&](size_t chunk) {
+        size_t row = firstRow[chunk];
+        forEachLine(bounds[chunk], bounds[chunk + 1], [&](const CsvLine &line) {
+            if (!errors[chunk].empty()) {
+                return;
+            }
+            const char *comma = std::find(line.begin, line.end, ',');
+            matrix.filenames[row].assign(line.begin, comma);
+            float *values = matrix.rows.data() + row * dimension;
+            const char *cell = comma;
+            for (size_t i = 0; i < dimension; ++i) {
+                const char *cellBegin = cell + 1;
+                cell = std::find(cellBegin, line.end, ',');
+                if (!parseCsvNumber(cellBegin, cell, values[i])) {
+                    errors[chunk] = "Invalid number in CSV " + inputPath + " for " + matrix.filenames[row] + ": " +
+                                    std::string(cellBegin, cell);
+                    return;
+                }
+            }
+            matrix.norms[row] = std::sqrt(dot(values, values, dimension));
+            ++row;
+        });
+    });
+    for (const auto &error : errors) {
+        if (!error.empty()) {
+            throw std::runtime_error(error);
+        }
+    }
+    return matrix;
 }
 
 /**
- * Read embeddings into a filename -> vector map.
+ * Read a CSV of filename followed by feature values.
  *
  * @param inputPath Source CSV path.
- * @return Map from filename to embedding vector.
- * @throws std::runtime_error if the file cannot be opened.
+ * @param threadCount Worker threads used for parsing.
+ * @return Vector of filename/feature pairs.
  */
-std::unordered_map<std::string, std::vector<float>> readEmbeddingsCsv(
-    const std::string &inputPath) {
-    std::ifstream inputFile(inputPath);
-    if (!inputFile.is_open()) {
-        throw std::runtime_error("Failed to open embeddings CSV: " + inputPath);
-    }
-
-    std::unordered_map<std::string, std::vector<float>> embeddings;
-    std::string line;
-    while (std::getline(inputFile, line)) {
-        if (line.empty()) {
-            continue;
-        }
-        std::stringstream lineStream(line);
-        std::string filename;
-        std::getline(lineStream, filename, ',');
-        std::string rest;
-        std::getline(lineStream, rest);
-        auto values = parseCsvNumbers(rest);
-        embeddings.emplace(filename, std::move(values));
+std::vector<std::pair<std::string, std::vector<float>>> readFeaturesCsv(
+    const std::string &inputPath,
+    int threadCount) {
+    FeatureMatrix matrix = readFeatureMatrixCsv(inputPath, threadCount);
+    std::vector<std::pair<std::string, std::vector<float>>> features;
+    features.reserve(matrix.filenames.size());
+    for (size_t row = 0; row < matrix.filenames.size(); ++row) {
+        const float *values = matrix.rows.data() + row * matrix.dimension;
+        features.emplace_back(std::move(matrix.filenames[row]),
+                              std::vector<float>(values, values + matrix.dimension));
     }
-
-    return embeddings;
+    return features;
 }
@@ -5,42 +5,73 @@ CLI entry point for the CBIR system.
 Parses arguments and dispatches feature extraction.
 Computes distances and ranks matches.
 Supports embeddings-based DNN mode and least-similar output.
+Builds offline feature indexes and queries them without decoding.
+Packs CSV features/embeddings into memory-mapped binary stores.
+Serves repeated queries from one resident process.
+Reports ranking drift of reduced-resolution decoding.
+Builds HNSW graphs for approximate DNN embedding queries.
+Builds VP-trees for exact pruned queries over classic feature stores.
+Splits stores into shards for scatter-gather serving.
+Lists database images recursively, sorted or as they are found.
+Prints byte-identical duplicates beside their match with --collapse-duplicates.
+Profiles query stages to stderr on request.
 */
-#include "../include/distance_metrics.h"
-#include "../include/feature_extraction.h"
+#include "../include/decode_drift.h"
+#include "../include/feature_index.h"
+#include "../include/feature_store.h"
+#include "../include/feature_types.h"
+#include "../include/file_walker.h"
+#include "../include/hnsw_index.h"
 #include "../include/image_io.h"
+#include "../include/parallel.h"
+#include "../include/pq_index.h"
+#include "../include/profile.h"
+#include "../include/query.h"
+#include "../include/server.h"
+#include "../include/shard.h"
+#include "../include/top_k.h"
+#include "../include/vp_tree.h"
 
 #include <algorithm>
+#include <chrono>
+#include <cstdio>
 #include <exception>
+#include <fstream>
+#include <stdexcept>
 #include <iostream>
-#include <filesystem>
+#include <sstream>
 #include <string>
-
-/**
- * Extract filename from a full path (used for embedding CSV keys).
- *
- * @param path Full file path.
- * @return Basename component of the path.
- */
-std::string basenameFromPath(const std::string &path) {
-    return std::filesystem::path(path).filename().string();
-}
 #include <vector>
 
 namespace {
-// Simple result record for ranking.
-struct Match {
-    std::string filename;
-    float distance;
-};
-
 /**
  * Print CLI usage and options to stdout.
  */
 void printUsage() {
     std::cout
         << "Usage:\n"
-        << "  ./cbir <target_image> <database_dir> <feature_type> <distance_metric> <N> [embeddings_csv] [--least]\n\n"
+        << "  ./cbir <target_image> <database_dir> <feature_type> <distance_metric> <N> [embeddings_csv] [--least]\n"
+        << "         [--index <index_path>] [--threads <T>]\n"
+        << "         [--pipeline <R,D,E>] [--queue-depth <Q>] [--pipeline-stats] [--decode-scale <S>]\n"
+        << "         [--profile | --profile-json] [--progress-ms <P>] [--time-budget-ms <B>] [--exhaustive]\n"
+        << "         [--unordered] [--collapse-duplicates]\n"
+        << "  ./cbir batch <targets_file> <database_dir> <feature_type> <distance_metric> <N> [embeddings_csv]\n"
+        << "         [--least] [--index <index_path>] [--threads <T>] [--decode-scale <S>] [--profile | --profile-json]\n"
+        << "         [--collapse-duplicates]\n"
+        << "  ./cbir index <database_dir> <feature_type> [index_path] [--threads <T>] [--decode-scale <S>] [--rebuild]\n"
+        << "         [--no-dedup]\n"
+        << "  ./cbir index <database_dir> all [index_dir] [--threads <T>] [--decode-scale <S>] [--rebuild] [--no-dedup]\n"
+        << "  ./cbir pack <features_csv> <store_path> [feature_type] [--threads <T>]\n"
+        << "  ./cbir hnsw <embeddings_csv|store> <index_path> [--metric <cosine|ssd>] [--m <M>]\n"
+        << "         [--ef-construction <E>] [--threads <T>]\n"
+        << "  ./cbir pq <embeddings_csv|store> <pq_path> [--metric <cosine|ssd>] [--subspaces <M>] [--codes-only]\n"
+        << "         [--threads <T>]\n"
+        << "  ./cbir vptree <feature_store> <tree_path> [--leaf-size <L>] [--threads <T>] [--verify <Q>]\n"
+        << "  ./cbir shard <feature_store> <N> <output_prefix>\n"
+        << "  ./cbir list <database_dir> [--threads <T>] [--unordered]\n"
+        << "  ./cbir serve [--socket <path> | --tcp <host:port>] [--shard <store>]\n"
+        << "  ./cbir serve [--socket <path> | --tcp <host:port>] --shards <endpoint,...> [--shard-timeout-ms <T>]\n"
+        << "  ./cbir drift <database_dir> <feature_type> <N> [--scales <2,4,8>] [--samples <S>] [--threads <T>]\n\n"
         << "Feature types:\n"
         << "  baseline\n"
         << "  histogram_rg\n"
@@ -52,186 +83,756 @@ void printUsage() {
         << "Distance metrics:\n"
         << "  ssd\n"
         << "  histogram_intersection\n"
-        << "  cosine\n";
+        << "  cosine\n\n"
+        << "Options:\n"
+        << "  --threads <T>         Worker threads for the scan (0 = all cores, default 1)\n"
+        << "  --pipeline <R,D,E>    Staged scan with R reader, D decoder and E extractor threads\n"
+        << "  --queue-depth <Q>     Capacity of each queue between pipeline stages (default 16)\n"
+        << "  --pipeline-stats      Print per-stage utilization and queue occupancy to stderr\n"
+        << "  --decode-scale <S>    Decode images at 1/S resolution (1, 2, 4 or 8; baseline stays at 1)\n"
+        << "  --profile             Print per-stage times and counters to stderr\n"
+        << "  --profile-json        Same as --profile, as one JSON line\n"
+        << "  --progress-ms <P>     Print the best-N so far every P ms while scanning\n"
+        << "  --time-budget-ms <B>  Stop scanning after B ms and print the partial best-N\n"
+        << "  --exhaustive          Score every index/embedding row in full (no coarse prefilter or early abandon)\n"
+        << "  --unordered           Score (or list) images as the directory walk finds them, without sorting;\n"
+        << "                        ties between equal distances may then rank in any order\n"
+        << "  --collapse-duplicates With an index: list byte-identical copies of a match on its line,\n"
+        << "                        tab-separated, instead of as matches of their own\n"
+        << "  --rebuild             index: re-extract every image instead of reusing unchanged rows\n"
+        << "  --no-dedup            index: extract and store byte-identical images separately\n"
+        << "  --ef <E>              dnn with an HNSW index: search beam width (default 64)\n"
+        << "  --m <M>               hnsw: links per node (default 16; layer 0 keeps 2M)\n"
+        << "  --ef-construction <E> hnsw: beam width while inserting (default 200)\n"
+        << "  --rerank <R>          dnn with a PQ index: candidates re-scored exactly (default 64, 0 = codes only)\n"
+        << "  --subspaces <M>       pq: code bytes per embedding (default dimension / 4)\n"
+        << "  --codes-only          pq: drop the full vectors (smallest file, no re-ranking)\n"
+        << "  --leaf-size <L>       vptree: rows per leaf bucket (default 16)\n"
+        << "  --verify <Q>          vptree: check Q stored rows as queries against a linear scan\n"
+        << "  --socket <path>       serve: listen on a Unix socket instead of stdin/stdout\n"
+        << "  --tcp <host:port>     serve: listen on TCP instead of stdin/stdout\n"
+        << "  --shard <store>       serve: worker answering every query from this shard store\n"
+        << "  --shards <E,...>      serve: coordinator scattering queries to these workers (socket paths or host:port)\n"
+        << "  --shard-timeout-ms <T> serve: drop shards that have not answered after T ms (default 10000, 0 = wait)\n";
 }
 
 /**
- * Return the top-N matches sorted by distance (ascending or descending).
+ * Print the profile recorded since profiling was enabled to stderr.
  *
- * @param matches Unsorted match list.
- * @param topN Number of results to keep.
- * @param descending If true, return largest distances (least similar).
- * @return Sorted and truncated match list.
+ * @param options Query options (profileJson picks the format).
+ * @param start When the profiled work started.
  */
-std::vector<Match> topMatches(std::vector<Match> matches, int topN, bool descending) {
-    std::sort(matches.begin(), matches.end(),
-              [descending](const Match &a, const Match &b) {
-                  return descending ? a.distance > b.distance : a.distance < b.distance;
-              });
-    if (topN < static_cast<int>(matches.size())) {
-        matches.resize(topN);
+void printQueryProfile(const QueryOptions &options, std::chrono::steady_clock::time_point start) {
+    ProfileReport report = collectProfile();
+    report.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (options.profileJson) {
+        printProfileJson(report, std::cerr);
+    } else {
+        printProfile(report, std::cerr);
     }
-    return matches;
 }
-} // namespace
 
 /**
- * CLI entry point: parse arguments, compute features/distances, and rank matches.
+ * Print one match line; duplicates folded into the match follow, tab-separated.
+ *
+ * @param prefix Text before the filename (e.g. the batch target and a space).
+ * @param match Match to print.
+ */
+void printMatch(const std::string &prefix, const Match &match) {
+    std::cout << prefix << match.filename << " " << match.distance;
+    for (const auto &duplicate : match.duplicates) {
+        std::cout << "\t" << duplicate;
+    }
+    std::cout << "\n";
+}
+
+/**
+ * Print a block of matches under a `#` header line, then flush.
+ *
+ * @param header Header text after "# ".
+ * @param matches Matches to print.
+ */
+void printMatchBlock(const std::string &header, const std::vector<Match> &matches) {
+    std::cout << "# " << header << "\n";
+    for (const auto &match : matches) {
+        printMatch("", match);
+    }
+    std::cout.flush();
+}
+
+/**
+ * Run the `batch` subcommand: answer every target listed in a file with one database scan.
  *
  * @param argc Argument count.
- * @param argv Argument vector.
+ * @param argv Argument vector (argv[1] is "batch").
  * @return Exit code (0 on success).
  */
-int main(int argc, char **argv) {
-    if (argc < 6) {
+int runBatchCommand(int argc, char **argv) {
+    if (argc < 7) {
         printUsage();
         return 1;
     }
 
+    QueryOptions options;
+    std::vector<std::string> targets;
     try {
-        // Parse required arguments and optional embeddings/flags.
-        std::string targetImagePath = argv[1];
-        std::string databaseDir = argv[2];
-        std::string featureType = argv[3];
-        std::string distanceMetric = argv[4];
-        int topN = std::stoi(argv[5]);
-        bool showLeast = false;
-        std::string embeddingsPath;
+        // The targets file takes the place of the target image.
+        options = parseQueryArguments(std::vector<std::string>(argv + 2, argv + argc));
+        std::ifstream targetsFile(options.targetImagePath);
+        if (!targetsFile) {
+            throw std::runtime_error("Failed to open targets file: " + options.targetImagePath);
+        }
+        std::string line;
+        while (std::getline(targetsFile, line)) {
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if (!line.empty()) {
+                targets.push_back(line);
+            }
+        }
+    } catch (const std::logic_error &ex) {
+        std::cerr << ex.what() << "\n";
+        printUsage();
+        return 1;
+    } catch (const std::exception &ex) {
+        std::cerr << "Error: " << ex.what() << "\n";
+        return 1;
+    }
 
-        for (int i = 6; i < argc; ++i) {
-            std::string arg = argv[i];
-            if (arg == "--least") {
-                showLeast = true;
-            } else if (embeddingsPath.empty()) {
-                embeddingsPath = arg;
+    try {
+        if (options.threadCount > 1) {
+            cv::setNumThreads(1);
+        }
+        setProfilingEnabled(options.profile);
+        auto start = std::chrono::steady_clock::now();
+        auto results = runBatchQuery(options, targets);
+        if (options.profile) {
+            printQueryProfile(options, start);
+        }
+        for (size_t i = 0; i < targets.size(); ++i) {
+            for (const auto &match : results[i]) {
+                printMatch(targets[i] + " ", match);
             }
         }
+    } catch (const std::exception &ex) {
+        std::cerr << "Error: " << ex.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Run the `pack` subcommand: convert a features/embeddings CSV to a binary store.
+ *
+ * @param argc Argument count.
+ * @param argv Argument vector (argv[1] is "pack").
+ * @return Exit code (0 on success).
+ */
+int runPackCommand(int argc, char **argv) {
+    if (argc < 4) {
+        printUsage();
+        return 1;
+    }
 
-        auto imageFiles = listImageFiles(databaseDir);
-        if (imageFiles.empty()) {
-            std::cerr << "No images found in directory: " << databaseDir << "\n";
+    try {
+        std::string inputPath = argv[2];
+        std::string outputPath = argv[3];
+        std::string featureType;
+        int threadCount = 1;
+        for (int i = 4; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--threads" && i + 1 < argc) {
+                threadCount = resolveThreadCount(std::stoi(argv[++i]));
+            } else if (arg.rfind("--", 0) != 0 && featureType.empty()) {
+                featureType = arg;
+            } else {
+                // Unknown flags and extra positionals would otherwise pack under a bogus type.
+                printUsage();
+                return 1;
+            }
+        }
+        if (featureType.empty()) {
+            featureType = "dnn";
+        } else if (featureType != "dnn" && !isClassicFeatureType(featureType)) {
+            std::cerr << "Unknown feature type: " << featureType << "\n";
+            printUsage();
             return 1;
         }
+        auto rows = readFeaturesCsv(inputPath, threadCount);
+        writeFeatureStore(outputPath, featureTypeInfo(featureType), rows, {}, coarseFeatureRows(featureType, rows));
+        std::cout << "Packed " << rows.size() << " rows to " << outputPath << "\n";
+    } catch (const std::exception &ex) {
+        std::cerr << "Error: " << ex.what() << "\n";
+        return 1;
+    }
 
-        std::vector<Match> matches;
-        matches.reserve(imageFiles.size());
+    return 0;
+}
+
+/**
+ * Load embeddings from a CSV or packed store as one row-major matrix.
+ *
+ * @param inputPath Embeddings CSV or store path.
+ * @param rows Output: rowCount * dimension floats.
+ * @param filenames Output: filename per row.
+ * @param threadCount Worker threads used to parse a CSV.
+ * @return Floats per embedding (0 when there are none).
+ * @throws std::runtime_error on unreadable input or mixed dimensions.
+ */
+size_t loadEmbeddingMatrix(
+    const std::string &inputPath,
+    std::vector<float> &rows,
+    std::vector<std::string> &filenames,
+    int threadCount) {
+    // Packed stores are copied out of the mapping; CSVs parse straight into one matrix.
+    if (isFeatureStoreFile(inputPath)) {
+        FeatureStore store(inputPath);
+        size_t dimension = store.dimension();
+        rows.assign(store.data(), store.data() + store.rowCount() * dimension);
+        for (size_t row = 0; row < store.rowCount(); ++row) {
+            filenames.emplace_back(store.filename(row));
+        }
+        return dimension;
+    }
+    FeatureMatrix matrix = readFeatureMatrixCsv(inputPath, threadCount);
+    rows = std::move(matrix.rows);
+    filenames = std::move(matrix.filenames);
+    return matrix.dimension;
+}
+
+/**
+ * Run the `hnsw` subcommand: build an approximate nearest-neighbour graph over embeddings.
+ *
+ * @param argc Argument count.
+ * @param argv Argument vector (argv[1] is "hnsw").
+ * @return Exit code (0 on success).
+ */
+int runHnswCommand(int argc, char **argv) {
+    if (argc < 4) {
+        printUsage();
+        return 1;
+    }
 
-        // DNN embeddings are matched via filename lookup in the CSV.
-        if (featureType == "dnn") {
-            if (embeddingsPath.empty()) {
-                std::cerr << "Missing embeddings CSV path for DNN features.\n";
+    try {
+        std::string inputPath = argv[2];
+        std::string outputPath = argv[3];
+        std::string metric = "cosine";
+        HnswParams params;
+        int threadCount = 1;
+        for (int i = 4; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--metric" && i + 1 < argc) {
+                metric = argv[++i];
+            } else if (arg == "--m" && i + 1 < argc) {
+                params.m = static_cast<size_t>(std::stoul(argv[++i]));
+            } else if (arg == "--ef-construction" && i + 1 < argc) {
+                params.efConstruction = static_cast<size_t>(std::stoul(argv[++i]));
+            } else if (arg == "--threads" && i + 1 < argc) {
+                threadCount = resolveThreadCount(std::stoi(argv[++i]));
+            } else {
+                printUsage();
                 return 1;
             }
-            auto embeddings = readEmbeddingsCsv(embeddingsPath);
-            std::string targetKey = basenameFromPath(targetImagePath);
-            auto targetIt = embeddings.find(targetKey);
-            if (targetIt == embeddings.end()) {
-                std::cerr << "Target embedding not found in CSV.\n";
+        }
+
+        std::vector<float> rows;
+        std::vector<std::string> filenames;
+        size_t dimension = loadEmbeddingMatrix(inputPath, rows, filenames, threadCount);
+        size_t rowCount = filenames.size();
+        HnswIndex index =
+            HnswIndex::build(metric, rows.data(), rowCount, dimension, std::move(filenames), params, threadCount);
+        index.save(outputPath);
+        std::cout << "Indexed " << rowCount << " embeddings to " << outputPath << "\n";
+    } catch (const std::exception &ex) {
+        std::cerr << "Error: " << ex.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Run the `pq` subcommand: train a product quantizer and write compressed embeddings.
+ *
+ * @param argc Argument count.
+ * @param argv Argument vector (argv[1] is "pq").
+ * @return Exit code (0 on success).
+ */
+int runPqCommand(int argc, char **argv) {
+    if (argc < 4) {
+        printUsage();
+        return 1;
+    }
+
+    try {
+        std::string inputPath = argv[2];
+        std::string outputPath = argv[3];
+        std::string metric = "cosine";
+        PqParams params;
+        int threadCount = 1;
+        for (int i = 4; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--metric" && i + 1 < argc) {
+                metric = argv[++i];
+            } else if (arg == "--subspaces" && i + 1 < argc) {
+                params.subspaces = static_cast<size_t>(std::stoul(argv[++i]));
+            } else if (arg == "--codes-only") {
+                params.keepVectors = false;
+            } else if (arg == "--threads" && i + 1 < argc) {
+                threadCount = resolveThreadCount(std::stoi(argv[++i]));
+            } else {
+                printUsage();
                 return 1;
             }
-            const auto &targetEmbedding = targetIt->second;
-            for (const auto &file : imageFiles) {
-                std::string key = basenameFromPath(file);
-                auto embedIt = embeddings.find(key);
-                if (embedIt == embeddings.end()) {
-                    // Skip files that don't have embeddings.
-                    continue;
-                }
-                const auto &embedding = embedIt->second;
-                float distance = 0.0f;
-                if (distanceMetric == "cosine") {
-                    distance = cosineDistance(targetEmbedding, embedding);
-                } else {
-                    distance = ssdDistance(targetEmbedding, embedding);
-                }
-                matches.push_back({file, distance});
+        }
+
+        std::vector<float> rows;
+        std::vector<std::string> filenames;
+        size_t dimension = loadEmbeddingMatrix(inputPath, rows, filenames, threadCount);
+        writePqIndex(outputPath, metric, rows.data(), filenames.size(), dimension, filenames, params, threadCount);
+        PqIndex index(outputPath);
+        std::cout << "Encoded " << index.rowCount() << " embeddings to " << outputPath << " ("
+                  << index.subspaces() << " code bytes per row, "
+                  << index.dimension() * sizeof(float) / index.subspaces() << "x smaller than float32)\n";
+    } catch (const std::exception &ex) {
+        std::cerr << "Error: " << ex.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Run the `vptree` subcommand: build an exact metric index over a classic feature store.
+ *
+ * With --verify, evenly spaced stored rows are queried against both the tree
+ * and a linear scan; any difference in the top 10 is reported and fails the run.
+ *
+ * @param argc Argument count.
+ * @param argv Argument vector (argv[1] is "vptree").
+ * @return Exit code (0 on success, 1 on error or verification mismatch).
+ */
+int runVpTreeCommand(int argc, char **argv) {
+    if (argc < 4) {
+        printUsage();
+        return 1;
+    }
+
+    try {
+        std::string inputPath = argv[2];
+        std::string outputPath = argv[3];
+        size_t leafSize = 16;
+        int threadCount = 1;
+        size_t verifyCount = 0;
+        for (int i = 4; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--leaf-size" && i + 1 < argc) {
+                leafSize = static_cast<size_t>(std::stoul(argv[++i]));
+            } else if (arg == "--threads" && i + 1 < argc) {
+                threadCount = resolveThreadCount(std::stoi(argv[++i]));
+            } else if (arg == "--verify" && i + 1 < argc) {
+                verifyCount = static_cast<size_t>(std::stoul(argv[++i]));
+            } else {
+                printUsage();
+                return 1;
             }
-        } else {
+        }
 
-            // Feature extraction on raw pixels for classic descriptors.
-            cv::Mat targetImage = loadImageOrThrow(targetImagePath);
+        FeatureStore store(inputPath);
+        VpTree tree = VpTree::build(store, leafSize, threadCount);
+        tree.save(outputPath);
+        std::cout << "Indexed " << tree.size() << " rows to " << outputPath << " (" << tree.nodeCount()
+                  << " nodes)\n";
 
-            if (featureType == "baseline") {
-                auto targetFeature = extractCenterPatchFeature(targetImage);
-                for (const auto &file : imageFiles) {
-                    cv::Mat image = loadImageOrThrow(file);
-                    auto feature = extractCenterPatchFeature(image);
-                    float distance = ssdDistance(targetFeature, feature);
-                    matches.push_back({file, distance});
+        if (verifyCount > 0 && tree.size() > 0) {
+            const size_t k = 10;
+            const std::string &featureType = store.info().featureType;
+            verifyCount = std::min(verifyCount, tree.size());
+            size_t mismatches = 0;
+            double nodesVisited = 0.0;
+            double distancesComputed = 0.0;
+            for (size_t q = 0; q < verifyCount; ++q) {
+                size_t queryRow = q * tree.size() / verifyCount;
+                FloatView query(store.row(queryRow), store.dimension());
+                TopKCollector linear(k, false);
+                for (size_t row = 0; row < store.rowCount(); ++row) {
+                    linear.offer(featureDistance(featureType, query, FloatView(store.row(row), store.dimension())), row);
                 }
-            } else if (featureType == "histogram_rg") {
-                auto targetFeature = extractRgChromaticityHistogram(targetImage);
-                for (const auto &file : imageFiles) {
-                    cv::Mat image = loadImageOrThrow(file);
-                    auto feature = extractRgChromaticityHistogram(image);
-                    float distance = histogramIntersectionDistance(targetFeature, feature);
-                    matches.push_back({file, distance});
+                std::vector<ScoredCandidate> expected = linear.sorted();
+                VpSearchStats stats;
+                std::vector<ScoredCandidate> actual = tree.search(query, k, &stats);
+                bool same = expected.size() == actual.size();
+                for (size_t i = 0; same && i < expected.size(); ++i) {
+                    same = expected[i].index == actual[i].index && expected[i].distance == actual[i].distance;
                 }
-            } else if (featureType == "histogram_rgb") {
-                auto targetFeature = extractRgbHistogram(targetImage);
-                for (const auto &file : imageFiles) {
-                    cv::Mat image = loadImageOrThrow(file);
-                    auto feature = extractRgbHistogram(image);
-                    float distance = histogramIntersectionDistance(targetFeature, feature);
-                    matches.push_back({file, distance});
+                if (!same) {
+                    ++mismatches;
+                    std::cerr << "Mismatch for row " << queryRow << " (" << store.filename(queryRow) << ")\n";
                 }
-            } else if (featureType == "multi_histogram") {
-                int binsPerChannel = 8;
-                int regionCount = 2;
-                auto targetFeature =
-                    extractMultiRegionRgbHistogram(targetImage, binsPerChannel, regionCount);
-                size_t binsPerHistogram = static_cast<size_t>(binsPerChannel * binsPerChannel * binsPerChannel);
-
-                // Uniform region weights for the default multi-histogram.
-                std::vector<float> weights(regionCount, 1.0f);
-                for (const auto &file : imageFiles) {
-                    cv::Mat image = loadImageOrThrow(file);
-                    auto feature =
-                        extractMultiRegionRgbHistogram(image, binsPerChannel, regionCount);
-                    float distance = histogramIntersectionDistanceMulti(
-                        targetFeature, feature, binsPerHistogram, regionCount, weights);
-                    matches.push_back({file, distance});
-                }
-            } else if (featureType == "texture_color") {
-                auto targetColor = extractRgbHistogram(targetImage);
-                auto targetTexture = extractSobelMagnitudeHistogram(targetImage);
-                for (const auto &file : imageFiles) {
-                    cv::Mat image = loadImageOrThrow(file);
-                    auto color = extractRgbHistogram(image);
-                    auto texture = extractSobelMagnitudeHistogram(image);
-                    float colorDistance = histogramIntersectionDistance(targetColor, color);
-                    float textureDistance = histogramIntersectionDistance(targetTexture, texture);
-                    float distance = (colorDistance + textureDistance) * 0.5f;
-                    matches.push_back({file, distance});
+                nodesVisited += static_cast<double>(stats.nodesVisited);
+                distancesComputed += static_cast<double>(stats.distancesComputed);
+            }
+            double queries = static_cast<double>(verifyCount);
+            std::cout << "Verified " << verifyCount << " queries: " << mismatches << " mismatches, "
+                      << 100.0 * nodesVisited / queries / static_cast<double>(tree.nodeCount()) << "% nodes visited, "
+                      << 100.0 * distancesComputed / queries / static_cast<double>(tree.size())
+                      << "% distances computed\n";
+            if (mismatches > 0) {
+                return 1;
+            }
+        }
+    } catch (const std::exception &ex) {
+        std::cerr << "Error: " << ex.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Run the `shard` subcommand: split a feature store into contiguous row ranges.
+ *
+ * @param argc Argument count.
+ * @param argv Argument vector (argv[1] is "shard").
+ * @return Exit code (0 on success).
+ */
+int runShardCommand(int argc, char **argv) {
+    if (argc != 5) {
+        printUsage();
+        return 1;
+    }
+
+    try {
+        size_t shardCount = static_cast<size_t>(std::stoul(argv[3]));
+        for (const auto &path : splitFeatureStore(argv[2], shardCount, argv[4])) {
+            std::cout << "Wrote " << path << " (" << FeatureStore(path).rowCount() << " rows)\n";
+        }
+    } catch (const std::exception &ex) {
+        std::cerr << "Error: " << ex.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Run the `list` subcommand: print the image paths a query would scan.
+ *
+ * @param argc Argument count.
+ * @param argv Argument vector (argv[1] is "list").
+ * @return Exit code (0 on success).
+ */
+int runListCommand(int argc, char **argv) {
+    if (argc < 3) {
+        printUsage();
+        return 1;
+    }
+
+    try {
+        std::string databaseDir = argv[2];
+        int threadCount = 1;
+        bool unordered = false;
+        for (int i = 3; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--threads" && i + 1 < argc) {
+                threadCount = resolveThreadCount(std::stoi(argv[++i]));
+            } else if (arg == "--unordered") {
+                unordered = true;
+            } else {
+                printUsage();
+                return 1;
+            }
+        }
+
+        if (unordered) {
+            walkImageFiles(databaseDir, threadCount, [](std::string &&path) {
+                std::cout << path << "\n";
+                return true;
+            });
+        } else {
+            for (const auto &path : listImageFiles(databaseDir, threadCount)) {
+                std::cout << path << "\n";
+            }
+        }
+    } catch (const std::exception &ex) {
+        std::cerr << "Error: " << ex.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Run the `index` subcommand: extract features once and persist them.
+ *
+ * @param argc Argument count.
+ * @param argv Argument vector (argv[1] is "index").
+ * @return Exit code (0 on success).
+ */
+int runIndexCommand(int argc, char **argv) {
+    if (argc < 4) {
+        printUsage();
+        return 1;
+    }
+
+    try {
+        std::string databaseDir = argv[2];
+        std::string featureType = argv[3];
+        std::string outputPath;
+        IndexBuildOptions buildOptions;
+        for (int i = 4; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--threads" && i + 1 < argc) {
+                buildOptions.threadCount = resolveThreadCount(std::stoi(argv[++i]));
+            } else if (arg == "--rebuild") {
+                buildOptions.incremental = false;
+            } else if (arg == "--no-dedup") {
+                buildOptions.deduplicate = false;
+            } else if (arg == "--decode-scale" && i + 1 < argc) {
+                buildOptions.decodeScale = std::stoi(argv[++i]);
+                if (!isValidDecodeScale(buildOptions.decodeScale)) {
+                    std::cerr << "Decode scale must be 1, 2, 4 or 8\n";
+                    printUsage();
+                    return 1;
                 }
-            } else if (featureType == "custom_sunset") {
-                int binsPerChannel = 8;
-                int regionCount = 3;
-                auto targetFeature =
-                    extractCustomSunsetHistogram(targetImage, binsPerChannel, regionCount);
-                size_t binsPerHistogram = static_cast<size_t>(binsPerChannel * binsPerChannel * binsPerChannel);
-                
-                // Emphasize the horizon region for sunsets.
-                std::vector<float> weights = {0.2f, 0.3f, 0.5f};
-                for (const auto &file : imageFiles) {
-                    cv::Mat image = loadImageOrThrow(file);
-                    auto feature =
-                        extractCustomSunsetHistogram(image, binsPerChannel, regionCount);
-                    float distance = histogramIntersectionDistanceMulti(
-                        targetFeature, feature, binsPerHistogram, regionCount, weights);
-                    matches.push_back({file, distance});
+            } else if (arg.rfind("--", 0) != 0 && outputPath.empty()) {
+                outputPath = arg;
+            } else {
+                // Unknown flags, flags missing their value and extra positionals.
+                printUsage();
+                return 1;
+            }
+        }
+        if (featureType != "all" && !isClassicFeatureType(featureType)) {
+            std::cerr << "Feature type cannot be indexed: " << featureType << "\n";
+            printUsage();
+            return 1;
+        }
+
+        // "all" writes every classic type from one decode per image.
+        std::vector<std::string> featureTypes = {featureType};
+        std::vector<std::string> outputPaths = {outputPath};
+        if (featureType == "all") {
+            std::string outputDir = outputPath.empty() ? databaseDir : outputPath;
+            featureTypes = classicFeatureTypes();
+            outputPaths.clear();
+            for (const auto &type : featureTypes) {
+                outputPaths.push_back(defaultIndexPath(outputDir, type));
+            }
+        } else if (outputPath.empty()) {
+            outputPaths[0] = defaultIndexPath(databaseDir, featureType);
+        }
+        if (buildOptions.threadCount > 1) {
+            cv::setNumThreads(1);
+        }
+
+        auto stats = buildFeatureIndexes(databaseDir, featureTypes, outputPaths, buildOptions);
+        for (size_t t = 0; t < outputPaths.size(); ++t) {
+            std::cout << "Indexed " << stats[t].images << " images to " << outputPaths[t]
+                      << " (" << stats[t].extracted << " extracted, " << stats[t].reused
+                      << " reused, " << stats[t].duplicates << " duplicates, " << stats[t].removed
+                      << " removed)\n";
+        }
+    } catch (const std::exception &ex) {
+        std::cerr << "Error: " << ex.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Run the `drift` subcommand: compare reduced-resolution rankings with full resolution.
+ *
+ * @param argc Argument count.
+ * @param argv Argument vector (argv[1] is "drift").
+ * @return Exit code (0 on success).
+ */
+int runDriftCommand(int argc, char **argv) {
+    if (argc < 5) {
+        printUsage();
+        return 1;
+    }
+
+    try {
+        DriftOptions options;
+        options.databaseDir = argv[2];
+        options.featureType = argv[3];
+        options.topN = static_cast<size_t>(std::stoul(argv[4]));
+        for (int i = 5; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--scales" && i + 1 < argc) {
+                options.scales.clear();
+                std::stringstream list(argv[++i]);
+                std::string item;
+                while (std::getline(list, item, ',')) {
+                    options.scales.push_back(std::stoi(item));
                 }
+            } else if (arg == "--samples" && i + 1 < argc) {
+                options.samples = static_cast<size_t>(std::stoul(argv[++i]));
+            } else if (arg == "--threads" && i + 1 < argc) {
+                options.threadCount = resolveThreadCount(std::stoi(argv[++i]));
             } else {
-                std::cerr << "Unknown feature type: " << featureType << "\n";
                 printUsage();
                 return 1;
             }
         }
+        if (options.threadCount > 1) {
+            cv::setNumThreads(1);
+        }
+
+        auto report = measureDecodeDrift(options);
+        std::printf("%-6s %10s %14s %12s\n", "scale", "overlap@N", "rank_shift", "ms/image");
+        for (const auto &row : report) {
+            std::printf("%-6d %10.3f %14.3f %12.3f\n", row.scale, row.overlap,
+                        row.rankDisplacement, row.millisecondsPerImage);
+        }
+    } catch (const std::exception &ex) {
+        std::cerr << "Error: " << ex.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Run the `serve` subcommand: answer query lines from one resident process.
+ *
+ * @param argc Argument count.
+ * @param argv Argument vector (argv[1] is "serve").
+ * @return Exit code (0 on success).
+ */
+int runServeCommand(int argc, char **argv) {
+    ServerOptions options;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--socket" && i + 1 < argc) {
+            options.socketPath = argv[++i];
+        } else if (arg == "--tcp" && i + 1 < argc) {
+            options.tcpAddress = argv[++i];
+        } else if (arg == "--shard" && i + 1 < argc) {
+            options.shardPath = argv[++i];
+        } else if (arg == "--shards" && i + 1 < argc) {
+            std::stringstream endpoints(argv[++i]);
+            std::string endpoint;
+            while (std::getline(endpoints, endpoint, ',')) {
+                if (!endpoint.empty()) {
+                    options.shardEndpoints.push_back(endpoint);
+                }
+            }
+        } else if (arg == "--shard-timeout-ms" && i + 1 < argc) {
+            options.shardTimeoutMs = std::max(std::stoi(argv[++i]), 0);
+        } else {
+            printUsage();
+            return 1;
+        }
+    }
+
+    try {
+        runServer(options);
+    } catch (const std::exception &ex) {
+        std::cerr << "Error: " << ex.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
+} // namespace
 
-        auto top = topMatches(matches, topN, showLeast);
-        for (const auto &match : top) {
-            std::cout << match.filename << " " << match.distance << "\n";
+/**
+ * CLI entry point: parse arguments, compute features/distances, and rank matches.
+ *
+ * @param argc Argument count.
+ * @param argv Argument vector.
+ * @return Exit code (0 on success).
+ */
+int main(int argc, char **argv) {
+    if (argc >= 2 && std::string(argv[1]) == "index") {
+        return runIndexCommand(argc, argv);
+    }
+    if (argc >= 2 && std::string(argv[1]) == "batch") {
+        return runBatchCommand(argc, argv);
+    }
+    if (argc >= 2 && std::string(argv[1]) == "pack") {
+        return runPackCommand(argc, argv);
+    }
+    if (argc >= 2 && std::string(argv[1]) == "hnsw") {
+        return runHnswCommand(argc, argv);
+    }
+    if (argc >= 2 && std::string(argv[1]) == "pq") {
+        return runPqCommand(argc, argv);
+    }
+    if (argc >= 2 && std::string(argv[1]) == "vptree") {
+        return runVpTreeCommand(argc, argv);
+    }
+    if (argc >= 2 && std::string(argv[1]) == "list") {
+        return runListCommand(argc, argv);
+    }
+    if (argc >= 2 && std::string(argv[1]) == "shard") {
+        return runShardCommand(argc, argv);
+    }
+    if (argc >= 2 && std::string(argv[1]) == "serve") {
+        return runServeCommand(argc, argv);
+    }
+    if (argc >= 2 && std::string(argv[1]) == "drift") {
+        return runDriftCommand(argc, argv);
+    }
+    if (argc < 6) {
+        printUsage();
+        return 1;
+    }
+
+    QueryOptions options;
+    try {
+        options = parseQueryArguments(std::vector<std::string>(argv + 1, argv + argc));
+    } catch (const std::logic_error &ex) {
+        // invalid_argument/out_of_range: bad usage rather than a failed query.
+        std::cerr << ex.what() << "\n";
+        printUsage();
+        return 1;
+    } catch (const std::exception &ex) {
+        std::cerr << "Error: " << ex.what() << "\n";
+        return 1;
+    }
+
+    try {
+        if (options.threadCount > 1 || options.usePipeline) {
+            // Workers already cover the cores; keep OpenCV from oversubscribing them.
+            cv::setNumThreads(1);
+        }
+
+        setProfilingEnabled(options.profile);
+        auto start = std::chrono::steady_clock::now();
+        if (options.progressIntervalMs == 0 && options.timeBudgetMs == 0) {
+            auto top = runQuery(options);
+            if (options.profile) {
+                printQueryProfile(options, start);
+            }
+            for (const auto &match : top) {
+                printMatch("", match);
+            }
+            return 0;
+        }
+
+        // Streaming output: snapshot blocks, then a final block marked complete or partial.
+        QueryResult result = runQueryWithProgress(options, [](const QueryProgress &progress) {
+            std::ostringstream header;
+            header << "progress " << progress.scanned << "/" << progress.total << " "
+                   << static_cast<long long>(progress.elapsedMs) << " ms";
+            printMatchBlock(header.str(), progress.matches);
+        });
+        if (options.profile) {
+            printQueryProfile(options, start);
+        }
+        if (!result.complete) {
+            std::cerr << "Time budget reached: results cover " << result.scanned << " of " << result.total
+                      << " images\n";
         }
+        printMatchBlock("final " + std::to_string(result.scanned) + "/" + std::to_string(result.total) +
+                            (result.complete ? " complete" : " partial"),
+                        result.matches);
     } catch (const std::exception &ex) {
         std::cerr << "Error: " << ex.what() << "\n";
         return 1;
@@ -0,0 +1,120 @@
+/*
+Authors - Joseph Defendre, Sourav Das
+
+Implements the CLI worker pool helper.
+Spawns std::thread workers that pull chunks from an atomic counter.
+Stops early and rethrows when any worker fails.
+Falls back to a plain loop for a single thread.
+*/
+#include "../include/parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+// Upper bound on iterations claimed per counter increment.
+constexpr size_t kMaxChunkSize = 16;
+// Target number of chunks per worker so uneven images still balance.
+constexpr size_t kChunksPerWorker = 8;
+} // namespace
+
+/**
+ * Map non-positive requests to the hardware thread count.
+ *
+ * @param requested Requested thread count.
+ * @return Thread count >= 1.
+ */
+int resolveThreadCount(int requested) {
+    if (requested > 0) {
+        return requested;
+    }
+    unsigned int hardware = std::thread::hardware_concurrency();
+    return hardware > 0 ? static_cast<int>(hardware) : 1;
+}
+
+/**
+ * Clamp the requested thread count to the loop size.
+ *
+ * @param count Number of iterations.
+ * @param threadCount Requested worker threads.
+ * @return Worker count >= 1.
+ */
+size_t parallelWorkerCount(size_t count, int threadCount) {
+    return std::max<size_t>(std::min(static_cast<size_t>(std::max(threadCount, 1)), count), 1);
+}
+
+/**
+ * Run the loop body over [0, count) on a pool of worker threads.
+ *
+ * @param count Number of iterations.
+ * @param threadCount Number of worker threads.
+ * @param body Loop body called once per index.
+ */
+void parallelFor(size_t count, int threadCount, const std::function<void(size_t)> &body) {
+    parallelForWorkers(count, threadCount, [&body](size_t i, size_t) { body(i); });
+}
+
+/**
+ * Run the loop body over [0, count), tagging each call with its worker slot.
+ *
+ * @param count Number of iterations.
+ * @param threadCount Number of worker threads.
+ * @param body Loop body called once per index with the worker slot.
+ */
+void parallelForWorkers(
+    size_t count,
+    int threadCount,
+    const std::function<void(size_t, size_t)> &body) {
+    size_t workers = parallelWorkerCount(count, threadCount);
+    if (workers <= 1) {
+        for (size_t i = 0; i < count; ++i) {
+            body(i, 0);
+        }
+        return;
+    }
+
+    size_t chunkSize = std::clamp<size_t>(count / (workers * kChunksPerWorker), 1, kMaxChunkSize);
+    std::atomic<size_t> next{0};
+    std::atomic<bool> failed{false};
+    std::exception_ptr firstError;
+    std::mutex errorMutex;
+
+    auto worker = [&](size_t slot) {
+        while (!failed.load(std::memory_order_relaxed)) {
+            size_t begin = next.fetch_add(chunkSize, std::memory_order_relaxed);
+            if (begin >= count) {
+                break;
+            }
+            size_t end = std::min(begin + chunkSize, count);
+            try {
+                for (size_t i = begin; i < end; ++i) {
+                    body(i, slot);
+                }
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!firstError) {
+                    firstError = std::current_exception();
+                }
+                failed.store(true, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(workers - 1);
+    for (size_t t = 1; t < workers; ++t) {
+        threads.emplace_back(worker, t);
+    }
+    // The calling thread takes part in the loop as worker slot 0.
+    worker(0);
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    if (firstError) {
+        std::rethrow_exception(firstError);
+    }
+}
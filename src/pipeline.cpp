@@ -0,0 +1,463 @@
+/*
+Authors - Joseph Defendre, Sourav Das
+
+Implements the staged image scan pipeline.
+Reader, decoder and extractor pools hand work through bounded queues.
+The calling thread acts as the single scorer stage.
+Tracks busy/wait time per stage and depth statistics per queue.
+*/
+#include "../include/pipeline.h"
+
+#include "../include/image_io.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+/**
+ * Seconds elapsed between two time points.
+ *
+ * @param start Start time.
+ * @param end End time.
+ * @return Elapsed seconds.
+ */
+double secondsBetween(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double>(end - start).count();
+}
+
+/**
+ * Blocking FIFO with a fixed capacity.
+ *
+ * push() blocks while the queue is full (backpressure) and pop() blocks while
+ * it is empty. close() marks the end of input; abort() wakes every waiter so
+ * a failing stage can shut the pipeline down.
+ */
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : capacity_(std::max<size_t>(capacity, 1)) {}
+
+    bool push(T item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (items_.size() >= capacity_ && !aborted_) {
+            ++fullWaits_;
+        }
+        notFull_.wait(lock, [this] { return items_.size() < capacity_ || aborted_; });
+        if (aborted_) {
+            return false;
+        }
+        items_.push_back(std::move(item));
+        recordDepth();
+        notEmpty_.notify_one();
+        return true;
+    }
+
+    bool pop(T &item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (items_.empty() && !closed_ && !aborted_) {
+            ++emptyWaits_;
+        }
+        notEmpty_.wait(lock, [this] { return !items_.empty() || closed_ || aborted_; });
+        if (aborted_ || items_.empty()) {
+            return false;
+        }
+        item = std::move(items_.front());
+        items_.pop_front();
+        notFull_.notify_one();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        notEmpty_.notify_all();
+    }
+
+    void abort() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        aborted_ = true;
+        notEmpty_.notify_all();
+        notFull_.notify_all();
+    }
+
+    PipelineQueueStats stats(const std::string &name) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        PipelineQueueStats result;
+        result.name = name;
+        result.capacity = capacity_;
+        result.maxDepth = maxDepth_;
+        result.meanDepth = depthSamples_ > 0 ? depthSum_ / static_cast<double>(depthSamples_) : 0.0;
+        result.fullWaits = fullWaits_;
+        result.emptyWaits = emptyWaits_;
+        return result;
+    }
+
+private:
+    // Sample the depth after every push; cheap and good enough for tuning.
+    void recordDepth() {
+        ++depthSamples_;
+        depthSum_ += static_cast<double>(items_.size());
+        maxDepth_ = std::max(maxDepth_, items_.size());
+    }
+
+    size_t capacity_;
+    std::deque<T> items_;
+    mutable std::mutex mutex_;
+    std::condition_variable notFull_;
+    std::condition_variable notEmpty_;
+    bool closed_ = false;
+    bool aborted_ = false;
+    size_t fullWaits_ = 0;
+    size_t emptyWaits_ = 0;
+    size_t depthSamples_ = 0;
+    double depthSum_ = 0.0;
+    size_t maxDepth_ = 0;
+};
+
+struct RawItem {
+    size_t index;
+    std::string path;
+    std::vector<uchar> bytes;
+};
+
+struct DecodedItem {
+    size_t index;
+    cv::Mat image;
+};
+
+struct FeatureItem {
+    size_t index;
+    std::vector<float> feature;
+};
+
+/**
+ * Per-stage counters merged from each worker thread when it exits.
+ */
+class StageCounter {
+public:
+    StageCounter(std::string name, int threads) {
+        stats_.name = std::move(name);
+        stats_.threads = threads;
+    }
+
+    void add(size_t items, double busySeconds, double waitSeconds) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.items += items;
+        stats_.busySeconds += busySeconds;
+        stats_.waitSeconds += waitSeconds;
+    }
+
+    PipelineStageStats stats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+private:
+    mutable std::mutex mutex_;
+    PipelineStageStats stats_;
+};
+
+/**
+ * Shared failure state: keeps the first exception and aborts all queues.
+ */
+class PipelineFailure {
+public:
+    template <typename... Queues>
+    void fail(std::exception_ptr error, Queues &...queues) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!error_) {
+                error_ = error;
+            }
+        }
+        (queues.abort(), ...);
+    }
+
+    void rethrowIfFailed() {
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    std::exception_ptr error_;
+};
+} // namespace
+
+/**
+ * Parse "readers,decoders,extractors" into the stage thread counts.
+ *
+ * @param spec Stage specification.
+ * @param options Options to update.
+ * @throws std::runtime_error if malformed.
+ */
+void parsePipelineSpec(const std::string &spec, PipelineOptions &options) {
+    std::stringstream specStream(spec);
+    std::string cell;
+    std::vector<int> counts;
+    while (std::getline(specStream, cell, ',')) {
+        counts.push_back(std::stoi(cell));
+    }
+    if (counts.size() != 3 || *std::min_element(counts.begin(), counts.end()) < 1) {
+        throw std::runtime_error("Pipeline spec must be readers,decoders,extractors (each >= 1): " + spec);
+    }
+    options.readerThreads = counts[0];
+    options.decoderThreads = counts[1];
+    options.extractorThreads = counts[2];
+}
+
+/**
+ * Run the pipeline over a fixed list, handing files out in list order.
+ *
+ * @param files Image paths.
+ * @param options Stage thread counts and queue capacity.
+ * @param extract Feature extractor.
+ * @param consume Scorer callback (false stops the scan early).
+ * @return Collected stage and queue statistics.
+ */
+PipelineStats runImagePipeline(
+    const std::vector<std::string> &files,
+    const PipelineOptions &options,
+    const std::function<std::vector<float>(const cv::Mat &)> &extract,
+    const std::function<bool(size_t, const std::vector<float> &)> &consume) {
+    std::atomic<size_t> nextFile{0};
+    auto source = [&](size_t &index, std::string &path) {
+        index = nextFile.fetch_add(1, std::memory_order_relaxed);
+        if (index >= files.size()) {
+            return false;
+        }
+        path = files[index];
+        return true;
+    };
+    return runImagePipeline(source, options, extract, consume);
+}
+
+/**
+ * Run reader, decoder and extractor pools and score on the calling thread.
+ *
+ * @param nextFile File source shared by the reader threads.
+ * @param options Stage thread counts and queue capacity.
+ * @param extract Feature extractor.
+ * @param consume Scorer callback (false stops the scan early).
+ * @return Collected stage and queue statistics.
+ * @throws The first exception raised by any stage.
+ */
+PipelineStats runImagePipeline(
+    const std::function<bool(size_t &, std::string &)> &nextFile,
+    const PipelineOptions &options,
+    const std::function<std::vector<float>(const cv::Mat &)> &extract,
+    const std::function<bool(size_t, const std::vector<float> &)> &consume) {
+    BoundedQueue<RawItem> rawQueue(options.queueCapacity);
+    BoundedQueue<DecodedItem> decodedQueue(options.queueCapacity);
+    BoundedQueue<FeatureItem> featureQueue(options.queueCapacity);
+    PipelineFailure failure;
+
+    int readerThreads = std::max(options.readerThreads, 1);
+    int decoderThreads = std::max(options.decoderThreads, 1);
+    int extractorThreads = std::max(options.extractorThreads, 1);
+    StageCounter readCounter("read", readerThreads);
+    StageCounter decodeCounter("decode", decoderThreads);
+    StageCounter extractCounter("extract", extractorThreads);
+    StageCounter scoreCounter("score", 1);
+
+    std::atomic<int> readersLeft{readerThreads};
+    std::atomic<int> decodersLeft{decoderThreads};
+    std::atomic<int> extractorsLeft{extractorThreads};
+    auto abortAll = [&](std::exception_ptr error) {
+        failure.fail(error, rawQueue, decodedQueue, featureQueue);
+    };
+
+    auto reader = [&]() {
+        size_t items = 0;
+        double busy = 0.0;
+        double wait = 0.0;
+        try {
+            size_t index;
+            std::string path;
+            while (nextFile(index, path)) {
+                auto start = Clock::now();
+                std::vector<uchar> bytes = readFileBytes(path);
+                RawItem item{index, std::move(path), std::move(bytes)};
+                auto read = Clock::now();
+                bool pushed = rawQueue.push(std::move(item));
+                busy += secondsBetween(start, read);
+                wait += secondsBetween(read, Clock::now());
+                if (!pushed) {
+                    break;
+                }
+                ++items;
+            }
+        } catch (...) {
+            abortAll(std::current_exception());
+        }
+        readCounter.add(items, busy, wait);
+        if (--readersLeft == 0) {
+            rawQueue.close();
+        }
+    };
+
+    auto decoder = [&]() {
+        size_t items = 0;
+        double busy = 0.0;
+        double wait = 0.0;
+        try {
+            RawItem raw;
+            while (true) {
+                auto start = Clock::now();
+                if (!rawQueue.pop(raw)) {
+                    break;
+                }
+                auto popped = Clock::now();
+                DecodedItem item{raw.index,
+                                 decodeImageOrThrow(raw.bytes, raw.path, options.decodeScale)};
+                raw.bytes = std::vector<uchar>();
+                auto decoded = Clock::now();
+                bool pushed = decodedQueue.push(std::move(item));
+                wait += secondsBetween(start, popped) + secondsBetween(decoded, Clock::now());
+                busy += secondsBetween(popped, decoded);
+                if (!pushed) {
+                    break;
+                }
+                ++items;
+            }
+        } catch (...) {
+            abortAll(std::current_exception());
+        }
+        decodeCounter.add(items, busy, wait);
+        if (--decodersLeft == 0) {
+            decodedQueue.close();
+        }
+    };
+
+    auto extractor = [&]() {
+        size_t items = 0;
+        double busy = 0.0;
+        double wait = 0.0;
+        try {
+            DecodedItem decoded;
+            while (true) {
+                auto start = Clock::now();
+                if (!decodedQueue.pop(decoded)) {
+                    break;
+                }
+                auto popped = Clock::now();
+                FeatureItem item{decoded.index, extract(decoded.image)};
+                decoded.image = cv::Mat();
+                auto extracted = Clock::now();
+                bool pushed = featureQueue.push(std::move(item));
+                wait += secondsBetween(start, popped) + secondsBetween(extracted, Clock::now());
+                busy += secondsBetween(popped, extracted);
+                if (!pushed) {
+                    break;
+                }
+                ++items;
+            }
+        } catch (...) {
+            abortAll(std::current_exception());
+        }
+        extractCounter.add(items, busy, wait);
+        if (--extractorsLeft == 0) {
+            featureQueue.close();
+        }
+    };
+
+    auto wallStart = Clock::now();
+    std::vector<std::thread> threads;
+    threads.reserve(static_cast<size_t>(readerThreads + decoderThreads + extractorThreads));
+    for (int i = 0; i < readerThreads; ++i) {
+        threads.emplace_back(reader);
+    }
+    for (int i = 0; i < decoderThreads; ++i) {
+        threads.emplace_back(decoder);
+    }
+    for (int i = 0; i < extractorThreads; ++i) {
+        threads.emplace_back(extractor);
+    }
+
+    // Scorer stage runs here so consume() never needs to be thread-safe.
+    size_t scored = 0;
+    double scoreBusy = 0.0;
+    double scoreWait = 0.0;
+    try {
+        FeatureItem item;
+        while (true) {
+            auto start = Clock::now();
+            if (!featureQueue.pop(item)) {
+                break;
+            }
+            auto popped = Clock::now();
+            bool keepGoing = consume(item.index, item.feature);
+            scoreWait += secondsBetween(start, popped);
+            scoreBusy += secondsBetween(popped, Clock::now());
+            ++scored;
+            if (!keepGoing) {
+                // Not a failure: unblock the other stages and let them exit.
+                rawQueue.abort();
+                decodedQueue.abort();
+                featureQueue.abort();
+                break;
+            }
+        }
+    } catch (...) {
+        abortAll(std::current_exception());
+    }
+    scoreCounter.add(scored, scoreBusy, scoreWait);
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    failure.rethrowIfFailed();
+
+    PipelineStats stats;
+    stats.wallSeconds = secondsBetween(wallStart, Clock::now());
+    stats.stages = {readCounter.stats(), decodeCounter.stats(), extractCounter.stats(),
+                    scoreCounter.stats()};
+    stats.queues = {rawQueue.stats("read->decode"), decodedQueue.stats("decode->extract"),
+                    featureQueue.stats("extract->score")};
+    return stats;
+}
+
+/**
+ * Print stage utilization and queue occupancy as aligned tables.
+ *
+ * @param stats Collected pipeline stats.
+ * @param out Destination stream.
+ */
+void printPipelineStats(const PipelineStats &stats, std::ostream &out) {
+    out << std::fixed << std::setprecision(3);
+    out << "pipeline wall " << stats.wallSeconds << " s\n";
+    out << std::left << std::setw(10) << "stage" << std::right << std::setw(8) << "threads"
+        << std::setw(10) << "items" << std::setw(12) << "busy_s" << std::setw(12) << "wait_s"
+        << std::setw(8) << "util" << "\n";
+    for (const auto &stage : stats.stages) {
+        // Utilization: share of the stage's thread-time spent doing work.
+        double capacity = stats.wallSeconds * stage.threads;
+        double utilization = capacity > 0.0 ? stage.busySeconds / capacity : 0.0;
+        out << std::left << std::setw(10) << stage.name << std::right << std::setw(8)
+            << stage.threads << std::setw(10) << stage.items << std::setw(12) << stage.busySeconds
+            << std::setw(12) << stage.waitSeconds << std::setw(8) << utilization << "\n";
+    }
+    out << std::left << std::setw(18) << "queue" << std::right << std::setw(6) << "cap"
+        << std::setw(8) << "max" << std::setw(8) << "mean" << std::setw(8) << "full"
+        << std::setw(8) << "empty" << "\n";
+    for (const auto &queue : stats.queues) {
+        out << std::left << std::setw(18) << queue.name << std::right << std::setw(6)
+            << queue.capacity << std::setw(8) << queue.maxDepth << std::setw(8) << queue.meanDepth
+            << std::setw(8) << queue.fullWaits << std::setw(8) << queue.emptyWaits << "\n";
+    }
+    out.unsetf(std::ios::floatfield);
+    out << std::setprecision(6);
+}
@@ -0,0 +1,568 @@
+/*
+Authors - Joseph Defendre, Sourav Das
+
+Implements the product-quantized embedding index.
+Trains 256-centroid k-means codebooks per subspace on a sample of the rows.
+Writes codes, codebooks, optional full vectors and filenames to one file.
+Maps the file read-only and scans codes with per-query lookup tables.
+*/
+#include "../include/pq_index.h"
+
+#include "../include/distance_kernels.h"
+#include "../include/parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+constexpr char kPqMagic[8] = {'C', 'B', 'I', 'R', 'P', 'Q', 'I', '1'};
+constexpr uint32_t kPqVersion = 1;
+constexpr size_t kCentroids = 256;
+constexpr uint64_t kSectionAlignment = 64;
+// Rows scored per worker task during the code scan.
+constexpr size_t kScanBlockRows = 4096;
+
+// On-disk header; all fields are little-endian native values.
+struct PqHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t cosine;
+    uint64_t rowCount;
+    uint64_t dimension;
+    uint64_t subspaces;
+    uint64_t centroidsOffset;
+    uint64_t codesOffset;
+    uint64_t vectorsOffset;
+    uint64_t namesOffset;
+    uint64_t fileSize;
+};
+static_assert(sizeof(PqHeader) == 80, "Unexpected PQ index header layout.");
+
+/**
+ * Round an offset up to the next multiple of alignment.
+ *
+ * @param value Offset in bytes.
+ * @param alignment Power-of-two alignment.
+ * @return Aligned offset.
+ */
+uint64_t alignUp(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+/**
+ * Scale a vector to unit length in place (zero vectors are left as they are).
+ *
+ * @param values Vector data.
+ * @param dimension Number of floats.
+ */
+void normalize(float *values, size_t dimension) {
+    float norm = std::sqrt(activeDistanceKernels().dot(values, values, dimension));
+    if (norm > 0.0f) {
+        for (size_t d = 0; d < dimension; ++d) {
+            values[d] /= norm;
+        }
+    }
+}
+
+/**
+ * Nearest of 256 centroids for one vector slice (ties go to the lower code).
+ *
+ * @param slice Vector slice.
+ * @param centroids 256 centroids of width floats each.
+ * @param width Slice width.
+ * @return Code of the nearest centroid.
+ */
+uint8_t nearestCentroid(const float *slice, const float *centroids, size_t width) {
+    size_t best = 0;
+    float bestDistance = INFINITY;
+    for (size_t j = 0; j < kCentroids; ++j) {
+        const float *centroid = centroids + j * width;
+        float sum = 0.0f;
+        for (size_t d = 0; d < width; ++d) {
+            float diff = slice[d] - centroid[d];
+            sum += diff * diff;
+        }
+        if (sum < bestDistance) {
+            bestDistance = sum;
+            best = j;
+        }
+    }
+    return static_cast<uint8_t>(best);
+}
+
+/**
+ * Lloyd's k-means on one subspace slice of the training sample.
+ *
+ * Starts from distinct sample points, reseeds empty clusters from the sample,
+ * and pads with copies of centroid 0 when there are fewer than 256 samples.
+ *
+ * @param rows Row-major vectors.
+ * @param dimension Floats per vector.
+ * @param sample Training row indices.
+ * @param begin First dimension of the slice.
+ * @param width Slice width.
+ * @param iterations Lloyd iterations.
+ * @param seed Random seed for initialization and reseeding.
+ * @param centroids Output: 256 centroids of width floats.
+ */
+void trainSubspace(
+    const float *rows,
+    size_t dimension,
+    const std::vector<size_t> &sample,
+    size_t begin,
+    size_t width,
+    size_t iterations,
+    uint32_t seed,
+    float *centroids) {
+    std::mt19937 rng(seed);
+    size_t k = std::min(kCentroids, sample.size());
+    std::vector<size_t> order(sample.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), rng);
+    auto slice = [&](size_t i) { return rows + sample[i] * dimension + begin; };
+    for (size_t j = 0; j < k; ++j) {
+        std::copy(slice(order[j]), slice(order[j]) + width, centroids + j * width);
+    }
+    for (size_t j = k; j < kCentroids; ++j) {
+        std::copy(centroids, centroids + width, centroids + j * width);
+    }
+
+    std::uniform_int_distribution<size_t> pick(0, sample.size() - 1);
+    std::vector<double> sums(kCentroids * width);
+    std::vector<size_t> counts(kCentroids);
+    for (size_t iteration = 0; iteration < iterations; ++iteration) {
+        std::fill(sums.begin(), sums.end(), 0.0);
+        std::fill(counts.begin(), counts.end(), 0);
+        for (size_t i = 0; i < sample.size(); ++i) {
+            const float *values = slice(i);
+            size_t code = nearestCentroid(values, centroids, width);
+            ++counts[code];
+            for (size_t d = 0; d < width; ++d) {
+                sums[code * width + d] += values[d];
+            }
+        }
+        for (size_t j = 0; j < k; ++j) {
+            float *centroid = centroids + j * width;
+            if (counts[j] == 0) {
+                const float *values = slice(pick(rng));
+                std::copy(values, values + width, centroid);
+                continue;
+            }
+            for (size_t d = 0; d < width; ++d) {
+                centroid[d] = static_cast<float>(sums[j * width + d] / counts[j]);
+            }
+        }
+    }
+}
+} // namespace
+
+/**
+ * Map the index read-only and resolve its sections.
+ *
+ * @param path Index file path.
+ * @throws std::runtime_error if mapping fails or the header is invalid.
+ */
+PqIndex::PqIndex(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open PQ index: " + path);
+    }
+    struct stat fileStat {};
+    if (::fstat(fd, &fileStat) != 0 || static_cast<size_t>(fileStat.st_size) < sizeof(PqHeader)) {
+        ::close(fd);
+        throw std::runtime_error("PQ index is truncated: " + path);
+    }
+    mappingSize_ = static_cast<size_t>(fileStat.st_size);
+    mapping_ = ::mmap(nullptr, mappingSize_, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping_ == MAP_FAILED) {
+        mapping_ = nullptr;
+        throw std::runtime_error("Failed to map PQ index: " + path);
+    }
+
+    PqHeader header {};
+    std::memcpy(&header, mapping_, sizeof(header));
+    const char *base = static_cast<const char *>(mapping_);
+    uint64_t centroidBytes = kCentroids * header.dimension * sizeof(float);
+    uint64_t codeBytes = header.rowCount * header.subspaces;
+    uint64_t vectorBytes = header.rowCount * header.dimension * sizeof(float);
+    uint64_t offsetBytes = (header.rowCount + 1) * sizeof(uint64_t);
+    bool valid = std::memcmp(header.magic, kPqMagic, sizeof(kPqMagic)) == 0 &&
+                 header.version == kPqVersion && header.cosine <= 1 &&
+                 header.dimension > 0 && header.subspaces > 0 && header.subspaces <= header.dimension &&
+                 header.fileSize == mappingSize_ &&
+                 header.centroidsOffset % kSectionAlignment == 0 &&
+                 header.centroidsOffset + centroidBytes <= header.codesOffset &&
+                 header.codesOffset + codeBytes <= header.namesOffset &&
+                 (header.vectorsOffset == 0 ||
+                  (header.vectorsOffset % kSectionAlignment == 0 &&
+                   header.vectorsOffset >= header.codesOffset + codeBytes &&
+                   header.vectorsOffset + vectorBytes <= header.namesOffset)) &&
+                 header.namesOffset % sizeof(uint64_t) == 0 &&
+                 header.namesOffset + offsetBytes <= mappingSize_;
+    if (valid) {
+        nameOffsets_ = reinterpret_cast<const uint64_t *>(base + header.namesOffset);
+        valid = header.namesOffset + offsetBytes + nameOffsets_[header.rowCount] <= mappingSize_;
+    }
+    if (!valid) {
+        release();
+        throw std::runtime_error("Invalid PQ index: " + path);
+    }
+
+    cosine_ = header.cosine == 1;
+    metric_ = cosine_ ? "cosine" : "ssd";
+    rowCount_ = static_cast<size_t>(header.rowCount);
+    dimension_ = static_cast<size_t>(header.dimension);
+    subspaces_ = static_cast<size_t>(header.subspaces);
+    centroids_ = reinterpret_cast<const float *>(base + header.centroidsOffset);
+    codes_ = reinterpret_cast<const uint8_t *>(base + header.codesOffset);
+    vectors_ = header.vectorsOffset == 0 ? nullptr
+                                         : reinterpret_cast<const float *>(base + header.vectorsOffset);
+    names_ = base + header.namesOffset + offsetBytes;
+}
+
+PqIndex::~PqIndex() {
+    release();
+}
+
+PqIndex::PqIndex(PqIndex &&other) noexcept {
+    *this = std::move(other);
+}
+
+PqIndex &PqIndex::operator=(PqIndex &&other) noexcept {
+    if (this != &other) {
+        release();
+        mapping_ = other.mapping_;
+        mappingSize_ = other.mappingSize_;
+        metric_ = std::move(other.metric_);
+        cosine_ = other.cosine_;
+        rowCount_ = other.rowCount_;
+        dimension_ = other.dimension_;
+        subspaces_ = other.subspaces_;
+        centroids_ = other.centroids_;
+        codes_ = other.codes_;
+        vectors_ = other.vectors_;
+        nameOffsets_ = other.nameOffsets_;
+        names_ = other.names_;
+        other.mapping_ = nullptr;
+        other.mappingSize_ = 0;
+        other.rowCount_ = 0;
+    }
+    return *this;
+}
+
+/**
+ * Return the filename for a row as a view into the mapping.
+ *
+ * @param index Row index.
+ * @return Filename view.
+ */
+std::string_view PqIndex::filename(size_t index) const {
+    uint64_t begin = nameOffsets_[index];
+    uint64_t end = nameOffsets_[index + 1];
+    return std::string_view(names_ + begin, static_cast<size_t>(end - begin));
+}
+
+/**
+ * Linear filename lookup (one per query, so no hash table is kept).
+ *
+ * @param name Filename.
+ * @return Row index or npos.
+ */
+size_t PqIndex::findRow(std::string_view name) const {
+    for (size_t row = 0; row < rowCount_; ++row) {
+        if (filename(row) == name) {
+            return row;
+        }
+    }
+    return npos;
+}
+
+/**
+ * Copy a stored vector, or rebuild it from its centroids.
+ *
+ * @param index Row index.
+ * @return Vector of dimension() floats.
+ */
+std::vector<float> PqIndex::rowVector(size_t index) const {
+    if (vectors_ != nullptr) {
+        const float *row = vectors_ + index * dimension_;
+        return std::vector<float>(row, row + dimension_);
+    }
+    std::vector<float> values(dimension_);
+    const uint8_t *code = codes_ + index * subspaces_;
+    for (size_t s = 0; s < subspaces_; ++s) {
+        size_t begin = subspaceBegin(s);
+        size_t width = subspaceBegin(s + 1) - begin;
+        const float *centroid = centroids_ + kCentroids * begin + code[s] * width;
+        std::copy(centroid, centroid + width, values.begin() + static_cast<std::ptrdiff_t>(begin));
+    }
+    return values;
+}
+
+/**
+ * Scan every code with per-subspace lookup tables, then re-rank exactly.
+ *
+ * @param query Query vector.
+ * @param k Number of results.
+ * @param rerank Candidates re-scored on full vectors.
+ * @param allowed Optional eligibility mask.
+ * @param threadCount Worker threads.
+ * @return Nearest candidates first.
+ * @throws std::runtime_error on a dimension mismatch.
+ */
+std::vector<ScoredCandidate> PqIndex::search(
+    FloatView query,
+    size_t k,
+    size_t rerank,
+    const std::vector<uint8_t> *allowed,
+    int threadCount) const {
+    if (query.size != dimension_) {
+        throw std::runtime_error("PQ query size does not match the index dimension");
+    }
+    if (allowed != nullptr && allowed->size() != rowCount_) {
+        throw std::runtime_error("PQ row mask size does not match the index");
+    }
+    std::vector<float> prepared = prepareQuery(query);
+
+    // table[s * 256 + c]: distance contribution of centroid c in subspace s.
+    // Cosine stores -dot so the row score is 1 + sum.
+    std::vector<float> table(subspaces_ * kCentroids);
+    const DistanceKernels &kernels = activeDistanceKernels();
+    for (size_t s = 0; s < subspaces_; ++s) {
+        size_t begin = subspaceBegin(s);
+        size_t width = subspaceBegin(s + 1) - begin;
+        for (size_t c = 0; c < kCentroids; ++c) {
+            const float *centroid = centroids_ + kCentroids * begin + c * width;
+            table[s * kCentroids + c] = cosine_ ? -kernels.dot(prepared.data() + begin, centroid, width)
+                                                : kernels.ssd(prepared.data() + begin, centroid, width);
+        }
+    }
+    float bias = cosine_ ? 1.0f : 0.0f;
+
+    bool exact = vectors_ != nullptr && rerank > 0;
+    size_t keep = exact ? std::max(rerank, k) : k;
+    size_t blockCount = (rowCount_ + kScanBlockRows - 1) / kScanBlockRows;
+    std::vector<TopKCollector> collectors(parallelWorkerCount(blockCount, threadCount),
+                                          TopKCollector(keep, false));
+    parallelForWorkers(blockCount, threadCount, [&](size_t block, size_t worker) {
+        size_t end = std::min(rowCount_, (block + 1) * kScanBlockRows);
+        for (size_t row = block * kScanBlockRows; row < end; ++row) {
+            if (allowed != nullptr && (*allowed)[row] == 0) {
+                continue;
+            }
+            const uint8_t *code = codes_ + row * subspaces_;
+            const float *lookup = table.data();
+            // Four independent sums keep the adds from serializing on one register.
+            float sums[4] = {bias, 0.0f, 0.0f, 0.0f};
+            size_t s = 0;
+            for (; s + 4 <= subspaces_; s += 4, lookup += 4 * kCentroids) {
+                sums[0] += lookup[code[s]];
+                sums[1] += lookup[kCentroids + code[s + 1]];
+                sums[2] += lookup[2 * kCentroids + code[s + 2]];
+                sums[3] += lookup[3 * kCentroids + code[s + 3]];
+            }
+            for (; s < subspaces_; ++s, lookup += kCentroids) {
+                sums[0] += lookup[code[s]];
+            }
+            collectors[worker].offer((sums[0] + sums[1]) + (sums[2] + sums[3]), row);
+        }
+    });
+    auto candidates = mergeTopK(collectors).sorted();
+    if (!exact) {
+        return candidates;
+    }
+
+    for (auto &candidate : candidates) {
+        const float *row = vectors_ + candidate.index * dimension_;
+        candidate.distance = cosine_ ? 1.0f - kernels.dot(prepared.data(), row, dimension_)
+                                     : kernels.ssd(prepared.data(), row, dimension_);
+    }
+    TopKCollector best(k, false);
+    for (const auto &candidate : candidates) {
+        best.offer(candidate.distance, candidate.index);
+    }
+    return best.sorted();
+}
+
+/**
+ * Copy the query, normalizing it for cosine indexes.
+ *
+ * @param query Query vector.
+ * @return Query in the stored vector space.
+ */
+std::vector<float> PqIndex::prepareQuery(FloatView query) const {
+    std::vector<float> prepared(query.data, query.data + query.size);
+    if (cosine_) {
+        normalize(prepared.data(), prepared.size());
+    }
+    return prepared;
+}
+
+/**
+ * Unmap the index if mapped.
+ */
+void PqIndex::release() {
+    if (mapping_ != nullptr) {
+        ::munmap(mapping_, mappingSize_);
+        mapping_ = nullptr;
+    }
+}
+
+/**
+ * Check for the PQ magic without mapping the whole file.
+ *
+ * @param path File path.
+ * @return True if the magic bytes match.
+ */
+bool isPqIndexFile(const std::string &path) {
+    std::ifstream inputFile(path, std::ios::binary);
+    char magic[sizeof(kPqMagic)] = {};
+    if (!inputFile.read(magic, sizeof(magic))) {
+        return false;
+    }
+    return std::memcmp(magic, kPqMagic, sizeof(kPqMagic)) == 0;
+}
+
+/**
+ * Train codebooks, encode the rows and write the index file.
+ *
+ * @param outputPath Destination path.
+ * @param metric "cosine" or "ssd".
+ * @param rows Row-major vectors.
+ * @param rowCount Number of vectors.
+ * @param dimension Floats per vector.
+ * @param filenames Filename per vector.
+ * @param params Training settings.
+ * @param threadCount Worker threads.
+ * @throws std::runtime_error on invalid inputs or write failure.
+ */
+void writePqIndex(
+    const std::string &outputPath,
+    const std::string &metric,
+    const float *rows,
+    size_t rowCount,
+    size_t dimension,
+    const std::vector<std::string> &filenames,
+    const PqParams &params,
+    int threadCount) {
+    if (metric != "cosine" && metric != "ssd") {
+        throw std::runtime_error("PQ index supports cosine or ssd, not " + metric);
+    }
+    if (rowCount == 0 || dimension == 0 || filenames.size() != rowCount) {
+        throw std::runtime_error("PQ index needs at least one vector and one filename per vector");
+    }
+    size_t subspaces = params.subspaces != 0 ? params.subspaces : std::max<size_t>(dimension / 4, 1);
+    if (subspaces > dimension || params.trainingSamples == 0) {
+        throw std::runtime_error("PQ needs 1 <= subspaces <= dimension and a training sample");
+    }
+    bool cosine = metric == "cosine";
+
+    // Cosine indexes quantize unit vectors; SSD indexes quantize the rows as given.
+    std::vector<float> normalized;
+    if (cosine) {
+        normalized.assign(rows, rows + rowCount * dimension);
+        parallelFor(rowCount, threadCount, [&](size_t row) {
+            normalize(normalized.data() + row * dimension, dimension);
+        });
+        rows = normalized.data();
+    }
+
+    std::mt19937 rng(params.seed);
+    std::vector<size_t> sample(rowCount);
+    std::iota(sample.begin(), sample.end(), 0);
+    if (rowCount > params.trainingSamples) {
+        std::shuffle(sample.begin(), sample.end(), rng);
+        sample.resize(params.trainingSamples);
+        std::sort(sample.begin(), sample.end());
+    }
+
+    auto subspaceBegin = [&](size_t s) { return s * dimension / subspaces; };
+    std::vector<float> centroids(kCentroids * dimension);
+    parallelFor(subspaces, threadCount, [&](size_t s) {
+        size_t begin = subspaceBegin(s);
+        trainSubspace(rows, dimension, sample, begin, subspaceBegin(s + 1) - begin, params.iterations,
+                      params.seed + static_cast<uint32_t>(s), centroids.data() + kCentroids * begin);
+    });
+    std::vector<uint8_t> codes(rowCount * subspaces);
+    parallelFor(rowCount, threadCount, [&](size_t row) {
+        for (size_t s = 0; s < subspaces; ++s) {
+            size_t begin = subspaceBegin(s);
+            codes[row * subspaces + s] = nearestCentroid(rows + row * dimension + begin,
+                                                         centroids.data() + kCentroids * begin,
+                                                         subspaceBegin(s + 1) - begin);
+        }
+    });
+
+    // Layout: header | pad | centroids | codes | pad | vectors | pad | name offsets | name bytes.
+    std::vector<uint64_t> nameOffsets;
+    nameOffsets.reserve(rowCount + 1);
+    nameOffsets.push_back(0);
+    for (const auto &name : filenames) {
+        nameOffsets.push_back(nameOffsets.back() + name.size());
+    }
+    PqHeader header {};
+    std::memcpy(header.magic, kPqMagic, sizeof(kPqMagic));
+    header.version = kPqVersion;
+    header.cosine = cosine ? 1 : 0;
+    header.rowCount = rowCount;
+    header.dimension = dimension;
+    header.subspaces = subspaces;
+    header.centroidsOffset = alignUp(sizeof(PqHeader), kSectionAlignment);
+    header.codesOffset = header.centroidsOffset + centroids.size() * sizeof(float);
+    uint64_t codesEnd = header.codesOffset + codes.size();
+    header.vectorsOffset = params.keepVectors ? alignUp(codesEnd, kSectionAlignment) : 0;
+    uint64_t dataEnd = params.keepVectors ? header.vectorsOffset + rowCount * dimension * sizeof(float) : codesEnd;
+    header.namesOffset = alignUp(dataEnd, sizeof(uint64_t));
+    header.fileSize = header.namesOffset + nameOffsets.size() * sizeof(uint64_t) + nameOffsets.back();
+
+    // Replace by rename so a serving process never maps a half-written file.
+    std::string temporaryPath = outputPath + ".tmp";
+    std::ofstream outputFile(temporaryPath, std::ios::binary | std::ios::trunc);
+    if (!outputFile.is_open()) {
+        throw std::runtime_error("Failed to open PQ index for writing: " + outputPath);
+    }
+    auto pad = [&](uint64_t from, uint64_t to) {
+        std::vector<char> padding(to - from, 0);
+        outputFile.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+    };
+    outputFile.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    pad(sizeof(PqHeader), header.centroidsOffset);
+    outputFile.write(reinterpret_cast<const char *>(centroids.data()),
+                     static_cast<std::streamsize>(centroids.size() * sizeof(float)));
+    outputFile.write(reinterpret_cast<const char *>(codes.data()), static_cast<std::streamsize>(codes.size()));
+    if (params.keepVectors) {
+        pad(codesEnd, header.vectorsOffset);
+        outputFile.write(reinterpret_cast<const char *>(rows),
+                         static_cast<std::streamsize>(rowCount * dimension * sizeof(float)));
+    }
+    pad(dataEnd, header.namesOffset);
+    outputFile.write(reinterpret_cast<const char *>(nameOffsets.data()),
+                     static_cast<std::streamsize>(nameOffsets.size() * sizeof(uint64_t)));
+    for (const auto &name : filenames) {
+        outputFile.write(name.data(), static_cast<std::streamsize>(name.size()));
+    }
+    outputFile.close();
+    std::error_code error;
+    if (!outputFile) {
+        std::filesystem::remove(temporaryPath, error);
+        throw std::runtime_error("Failed to write PQ index: " + outputPath);
+    }
+    std::filesystem::rename(temporaryPath, outputPath, error);
+    if (error) {
+        std::filesystem::remove(temporaryPath, error);
+        throw std::runtime_error("Failed to replace PQ index: " + outputPath);
+    }
+}
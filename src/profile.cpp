@@ -0,0 +1,276 @@
+/*
+Authors - Joseph Defendre, Sourav Das
+
+Implements the per-stage query profiler.
+Gives each thread a cache-line-aligned slot on first use.
+Folds a slot into retired totals when its thread exits and reuses it,
+so pool workers are still summed after joining without slots piling up.
+Prints totals as a table or a single JSON line.
+*/
+#include "../include/profile.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace profile_detail {
+std::atomic<bool> enabled{false};
+} // namespace profile_detail
+
+namespace {
+/**
+ * Totals recorded by one thread. Only the owning thread writes; readers run
+ * after the workers join, so relaxed atomics are enough.
+ */
+struct alignas(64) ThreadSlot {
+    std::array<std::atomic<uint64_t>, kProfileStageCount> nanoseconds {};
+    std::array<std::atomic<uint64_t>, kProfileStageCount> calls {};
+    std::array<std::atomic<uint64_t>, kProfileCounterCount> counters {};
+};
+
+std::mutex gSlotsMutex;
+std::vector<std::unique_ptr<ThreadSlot>> gSlots;
+// Slots whose threads have exited, zeroed and ready for the next thread.
+std::vector<ThreadSlot *> gFreeSlots;
+// Totals of exited threads, each still counted as its own thread.
+ProfileReport gRetired;
+
+/**
+ * Add one thread's totals to a report.
+ *
+ * @param slot Thread slot.
+ * @param report Report to add into.
+ */
+void foldSlot(const ThreadSlot &slot, ProfileReport &report) {
+    bool active = false;
+    for (size_t s = 0; s < kProfileStageCount; ++s) {
+        uint64_t calls = slot.calls[s].load(std::memory_order_relaxed);
+        if (calls == 0) {
+            continue;
+        }
+        double seconds = static_cast<double>(slot.nanoseconds[s].load(std::memory_order_relaxed)) * 1e-9;
+        ProfileStageReport &stage = report.stages[s];
+        stage.seconds += seconds;
+        stage.maxThreadSeconds = std::max(stage.maxThreadSeconds, seconds);
+        stage.calls += calls;
+        ++stage.threads;
+        active = true;
+    }
+    for (size_t c = 0; c < kProfileCounterCount; ++c) {
+        uint64_t value = slot.counters[c].load(std::memory_order_relaxed);
+        report.counters[c] += value;
+        active = active || value != 0;
+    }
+    report.threads += active ? 1 : 0;
+}
+
+/**
+ * Zero a slot's totals.
+ *
+ * @param slot Thread slot.
+ */
+void clearSlot(ThreadSlot &slot) {
+    for (auto &value : slot.nanoseconds) {
+        value.store(0, std::memory_order_relaxed);
+    }
+    for (auto &value : slot.calls) {
+        value.store(0, std::memory_order_relaxed);
+    }
+    for (auto &value : slot.counters) {
+        value.store(0, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * A thread's hold on its slot; returns the slot when the thread exits.
+ *
+ * Thread-local destructors run before join() returns, so a pool's totals
+ * are in gRetired by the time the caller collects them.
+ */
+struct SlotLease {
+    ThreadSlot *slot = nullptr;
+
+    ~SlotLease() {
+        if (slot == nullptr) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(gSlotsMutex);
+        foldSlot(*slot, gRetired);
+        clearSlot(*slot);
+        gFreeSlots.push_back(slot);
+    }
+};
+
+/**
+ * @return The calling thread's slot, taking a free one or registering a new one on first use.
+ */
+ThreadSlot &threadSlot() {
+    thread_local SlotLease lease;
+    if (lease.slot == nullptr) {
+        std::lock_guard<std::mutex> lock(gSlotsMutex);
+        if (gFreeSlots.empty()) {
+            gSlots.push_back(std::make_unique<ThreadSlot>());
+            lease.slot = gSlots.back().get();
+        } else {
+            lease.slot = gFreeSlots.back();
+            gFreeSlots.pop_back();
+        }
+    }
+    return *lease.slot;
+}
+
+/**
+ * Single-writer add (no read-modify-write needed).
+ */
+void bump(std::atomic<uint64_t> &value, uint64_t amount) {
+    value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+const char *const kStageNames[kProfileStageCount] = {"list", "load", "read", "decode", "extract", "score", "rank"};
+const char *const kCounterNames[kProfileCounterCount] = {"images_decoded",    "bytes_read",
+                                                         "pixels_processed",  "candidates_scored",
+                                                         "candidates_pruned", "distances_abandoned",
+                                                         "index_nodes_visited"};
+} // namespace
+
+namespace profile_detail {
+/**
+ * Charge elapsed time to a stage on the calling thread.
+ *
+ * @param stage Stage.
+ * @param nanoseconds Elapsed time.
+ */
+void record(ProfileStage stage, uint64_t nanoseconds) {
+    ThreadSlot &slot = threadSlot();
+    size_t i = static_cast<size_t>(stage);
+    bump(slot.nanoseconds[i], nanoseconds);
+    bump(slot.calls[i], 1);
+}
+
+/**
+ * Add to a counter on the calling thread.
+ *
+ * @param counter Counter.
+ * @param amount Amount to add.
+ */
+void add(ProfileCounter counter, uint64_t amount) {
+    bump(threadSlot().counters[static_cast<size_t>(counter)], amount);
+}
+} // namespace profile_detail
+
+/**
+ * Enable or disable profiling, clearing totals when enabling.
+ *
+ * @param enabled New state.
+ */
+void setProfilingEnabled(bool enabled) {
+    if (enabled) {
+        std::lock_guard<std::mutex> lock(gSlotsMutex);
+        for (auto &slot : gSlots) {
+            clearSlot(*slot);
+        }
+        gRetired = ProfileReport();
+    }
+    profile_detail::enabled.store(enabled, std::memory_order_relaxed);
+}
+
+/**
+ * Sum the retired totals and the live thread slots.
+ *
+ * @return Aggregated report (wallSeconds left at 0 for the caller to fill).
+ */
+ProfileReport collectProfile() {
+    std::lock_guard<std::mutex> lock(gSlotsMutex);
+    ProfileReport report = gRetired;
+    for (const auto &slot : gSlots) {
+        // Free slots are zeroed and add nothing.
+        foldSlot(*slot, report);
+    }
+    return report;
+}
+
+/**
+ * @param stage Stage.
+ * @return Report name of the stage.
+ */
+const char *profileStageName(ProfileStage stage) {
+    return kStageNames[static_cast<size_t>(stage)];
+}
+
+/**
+ * @param counter Counter.
+ * @return Report name of the counter.
+ */
+const char *profileCounterName(ProfileCounter counter) {
+    return kCounterNames[static_cast<size_t>(counter)];
+}
+
+/**
+ * Print the stage table and counters.
+ *
+ * @param report Collected profile.
+ * @param out Destination stream.
+ */
+void printProfile(const ProfileReport &report, std::ostream &out) {
+    out << std::fixed << std::setprecision(3);
+    out << "profile wall " << report.wallSeconds * 1e3 << " ms, " << report.threads << " threads\n";
+    out << std::left << std::setw(10) << "stage" << std::right << std::setw(8) << "threads" << std::setw(12)
+        << "calls" << std::setw(12) << "total_ms" << std::setw(14) << "max_thread_ms" << std::setw(8) << "wall%"
+        << "\n";
+    for (size_t s = 0; s < kProfileStageCount; ++s) {
+        const ProfileStageReport &stage = report.stages[s];
+        if (stage.calls == 0) {
+            continue;
+        }
+        // The busiest thread bounds the stage's share of the wall time.
+        double share = report.wallSeconds > 0.0 ? 100.0 * stage.maxThreadSeconds / report.wallSeconds : 0.0;
+        out << std::left << std::setw(10) << kStageNames[s] << std::right << std::setw(8) << stage.threads
+            << std::setw(12) << stage.calls << std::setw(12) << stage.seconds * 1e3 << std::setw(14)
+            << stage.maxThreadSeconds * 1e3 << std::setw(8) << std::setprecision(1) << share << "\n"
+            << std::setprecision(3);
+    }
+    for (size_t c = 0; c < kProfileCounterCount; ++c) {
+        out << std::left << std::setw(20) << kCounterNames[c] << std::right << report.counters[c] << "\n";
+    }
+    uint64_t scored = report.counters[static_cast<size_t>(ProfileCounter::CandidatesScored)];
+    uint64_t pruned = report.counters[static_cast<size_t>(ProfileCounter::CandidatesPruned)];
+    uint64_t abandoned = report.counters[static_cast<size_t>(ProfileCounter::DistancesAbandoned)];
+    if (scored > 0 && pruned + abandoned > 0) {
+        out << std::setprecision(1) << "cascade pruned " << 100.0 * static_cast<double>(pruned) / scored
+            << "% coarse, " << 100.0 * static_cast<double>(abandoned) / scored << "% abandoned, "
+            << 100.0 * static_cast<double>(scored - pruned - abandoned) / scored << "% scored in full\n";
+    }
+    out.unsetf(std::ios::floatfield);
+    out << std::setprecision(6);
+}
+
+/**
+ * Print the profile as a single-line JSON object.
+ *
+ * @param report Collected profile.
+ * @param out Destination stream.
+ */
+void printProfileJson(const ProfileReport &report, std::ostream &out) {
+    out << std::fixed << std::setprecision(6);
+    out << "{\"wall_s\":" << report.wallSeconds << ",\"threads\":" << report.threads << ",\"stages\":{";
+    bool first = true;
+    for (size_t s = 0; s < kProfileStageCount; ++s) {
+        const ProfileStageReport &stage = report.stages[s];
+        if (stage.calls == 0) {
+            continue;
+        }
+        out << (first ? "" : ",") << "\"" << kStageNames[s] << "\":{\"total_s\":" << stage.seconds
+            << ",\"max_thread_s\":" << stage.maxThreadSeconds << ",\"calls\":" << stage.calls
+            << ",\"threads\":" << stage.threads << "}";
+        first = false;
+    }
+    out << "},\"counters\":{";
+    for (size_t c = 0; c < kProfileCounterCount; ++c) {
+        out << (c == 0 ? "" : ",") << "\"" << kCounterNames[c] << "\":" << report.counters[c];
+    }
+    out << "}}\n";
+    out.unsetf(std::ios::floatfield);
+    out << std::setprecision(6);
+}
@@ -0,0 +1,1507 @@
+/*
+Authors - Joseph Defendre, Sourav Das
+
+Implements CBIR query execution.
+Parses query arguments and dispatches to live image, stored index and embedding scans.
+Scores candidates on a worker pool or staged pipeline.
+Answers dnn queries approximately from an HNSW graph when one is given.
+Answers classic queries exactly from a VP-tree when one is given as --index.
+Streams scores into per-worker bounded top-K heaps and merges them.
+Batch queries score many targets per pass over cache-sized database tiles.
+Exhaustive scans honour a time budget and report periodic best-N snapshots.
+Stored-feature scans prune with coarse descriptors and early-abandoned distances.
+Live scans can score images while the directory walk is still finding them.
+Expands or collapses byte-identical duplicates recorded by deduplicated indexes.
+Resolves filenames only for the final ranking.
+*/
+#include "../include/query.h"
+
+#include "../include/distance_kernels.h"
+#include "../include/distance_metrics.h"
+#include "../include/feature_store.h"
+#include "../include/feature_types.h"
+#include "../include/file_walker.h"
+#include "../include/hnsw_index.h"
+#include "../include/pq_index.h"
+#include "../include/image_io.h"
+#include "../include/parallel.h"
+#include "../include/profile.h"
+#include "../include/query_cache.h"
+#include "../include/top_k.h"
+#include "../include/vp_tree.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+// Marks a store row that was not found (e.g. a missing target embedding).
+constexpr size_t kNoRow = static_cast<size_t>(-1);
+// Rows scored per batch-kernel call when scanning a feature store.
+constexpr size_t kStoreBlockRows = 256;
+// Database bytes per batch-query tile; a tile stays in L2 while queries pass over it.
+constexpr size_t kBatchTileBytes = size_t(128) << 10;
+// Queries per batch work item (tiles are split further when there are many).
+constexpr size_t kBatchQueryGroup = 64;
+// Queries sharing each row load in the cosine dot kernel.
+constexpr size_t kBatchQueryBlock = 4;
+
+/**
+ * Extract filename from a full path (used for embedding CSV keys).
+ *
+ * @param path Full file path.
+ * @return Basename component of the path.
+ */
+std::string basenameFromPath(const std::string &path) {
+    return std::filesystem::path(path).filename().string();
+}
+
+// Finds the first embedding row stored under a name (kNoRow if none).
+using EmbeddingRowLookup = std::function<size_t(const std::string &)>;
+
+/**
+ * Index the first row of each name, for lookups that do not allocate per row.
+ *
+ * @param rowCount Number of rows.
+ * @param nameOf Row name accessor (must outlive the map).
+ * @return Name -> first row.
+ */
+template <typename NameOf>
+std::unordered_map<std::string_view, size_t> firstRowByName(size_t rowCount, NameOf nameOf) {
+    std::unordered_map<std::string_view, size_t> rows;
+    rows.reserve(rowCount);
+    for (size_t row = 0; row < rowCount; ++row) {
+        rows.emplace(nameOf(row), row);
+    }
+    return rows;
+}
+
+/**
+ * Wrap a name -> first row map as a lookup.
+ *
+ * @param rows Map from firstRowByName or an EmbeddingTable (must outlive the lookup).
+ * @return Lookup returning kNoRow for unknown names.
+ */
+template <typename RowMap>
+EmbeddingRowLookup lookupIn(const RowMap &rows) {
+    return [&rows](const std::string &name) {
+        auto it = rows.find(name);
+        return it == rows.end() ? kNoRow : it->second;
+    };
+}
+
+/**
+ * Find the embedding row of an image.
+ *
+ * An image below a subdirectory of the database is looked up by its path
+ * relative to the database directory ("sub/pic.jpg") first, so embeddings
+ * keyed that way tell same-named files apart; otherwise by its basename.
+ *
+ * @param path Image path.
+ * @param databaseDir Database directory.
+ * @param findRow Embedding row lookup.
+ * @return Row, or kNoRow if the image has no embedding.
+ */
+size_t embeddingRowOf(const std::string &path, const std::string &databaseDir, const EmbeddingRowLookup &findRow) {
+    std::string prefix = databaseDir.empty() || databaseDir.back() == '/' ? databaseDir : databaseDir + '/';
+    if (path.size() > prefix.size() && path.compare(0, prefix.size(), prefix) == 0 &&
+        path.find('/', prefix.size()) != std::string::npos) {
+        size_t row = findRow(path.substr(prefix.size()));
+        if (row != kNoRow) {
+            return row;
+        }
+    }
+    return findRow(basenameFromPath(path));
+}
+
+/**
+ * Database files paired one-to-one with embedding rows.
+ */
+struct EmbeddingFiles {
+    // Embedding row of each database file (kNoRow if none).
+    std::vector<size_t> rowOfFile;
+    // Database file of each embedding row (kNoRow if none).
+    std::vector<size_t> fileOfRow;
+};
+
+/**
+ * Pair database files with their embedding rows.
+ *
+ * Files from different subdirectories can share a basename. When two files
+ * resolve to the same row, the first in listing order keeps it, the other is
+ * skipped, and a warning is printed, so no embedding is ranked twice and
+ * every embedding path (CSV, store, HNSW, PQ, batch) picks the same file.
+ *
+ * @param imageFiles Database image paths.
+ * @param databaseDir Database directory.
+ * @param rowCount Number of embedding rows.
+ * @param findRow Embedding row lookup.
+ * @return Pairing in both directions.
+ */
+EmbeddingFiles pairEmbeddingFiles(
+    const std::vector<std::string> &imageFiles,
+    const std::string &databaseDir,
+    size_t rowCount,
+    const EmbeddingRowLookup &findRow) {
+    EmbeddingFiles pairs;
+    pairs.rowOfFile.assign(imageFiles.size(), kNoRow);
+    pairs.fileOfRow.assign(rowCount, kNoRow);
+    size_t collisions = 0;
+    size_t firstCollision = kNoRow;
+    for (size_t i = 0; i < imageFiles.size(); ++i) {
+        size_t row = embeddingRowOf(imageFiles[i], databaseDir, findRow);
+        if (row == kNoRow) {
+            continue;
+        }
+        if (pairs.fileOfRow[row] != kNoRow) {
+            firstCollision = collisions++ == 0 ? i : firstCollision;
+            continue;
+        }
+        pairs.fileOfRow[row] = i;
+        pairs.rowOfFile[i] = row;
+    }
+    if (collisions > 0) {
+        size_t kept = pairs.fileOfRow[embeddingRowOf(imageFiles[firstCollision], databaseDir, findRow)];
+        std::cerr << "Warning: " << collisions << " database image(s) share an embedding name with an earlier one"
+                  << " and were skipped (e.g. " << imageFiles[firstCollision] << " and " << imageFiles[kept]
+                  << "); key embeddings by path relative to the database directory to tell them apart\n";
+    }
+    return pairs;
+}
+
+/**
+ * Create one empty top-N collector per scan worker.
+ *
+ * @param options Query options (topN and showLeast).
+ * @param workers Number of worker slots.
+ * @return Collectors indexed by worker slot.
+ */
+std::vector<TopKCollector> makeCollectors(const QueryOptions &options, size_t workers) {
+    size_t capacity = static_cast<size_t>(std::max(options.topN, 0));
+    return std::vector<TopKCollector>(workers, TopKCollector(capacity, options.showLeast));
+}
+
+/**
+ * Check whether a scan may drop candidates that cannot reach the top N.
+ *
+ * Pruning needs a k-th best to compare against, which --least reverses.
+ *
+ * @param options Query options.
+ * @return True unless --exhaustive, --least or N = 0.
+ */
+bool cascadeEnabled(const QueryOptions &options) {
+    return !options.exhaustive && !options.showLeast && options.topN > 0;
+}
+
+/**
+ * Distance a candidate has to beat to enter a nearest-first collector.
+ *
+ * @param collector Worker collector.
+ * @return The current k-th best, or infinity while the collector is filling.
+ */
+float pruneBound(const TopKCollector &collector) {
+    return collector.full() ? collector.worstDistance() : std::numeric_limits<float>::infinity();
+}
+
+/**
+ * Maps a row to the byte-identical images folded into it (empty = none recorded).
+ */
+using DuplicatesOf = std::function<std::vector<std::string>(size_t)>;
+
+/**
+ * Merge per-worker collectors and materialize the winning matches.
+ *
+ * @param collectors Per-worker collectors.
+ * @param nameOf Maps a candidate index to its filename.
+ * @param duplicatesOf Maps a candidate index to its duplicates (may be empty).
+ * @return Ranked matches.
+ */
+template <typename NameOf>
+std::vector<Match> rankedMatches(
+    const std::vector<TopKCollector> &collectors,
+    NameOf nameOf,
+    const DuplicatesOf &duplicatesOf = {}) {
+    ProfileTimer timer(ProfileStage::Rank);
+    std::vector<Match> matches;
+    for (const auto &candidate : mergeTopK(collectors).sorted()) {
+        matches.push_back({std::string(nameOf(candidate.index)), candidate.distance});
+        if (duplicatesOf) {
+            matches.back().duplicates = duplicatesOf(candidate.index);
+        }
+    }
+    return matches;
+}
+
+/**
+ * Duplicate lookup for a feature store's rows.
+ *
+ * @param store Mapped feature store.
+ * @return Lookup, or empty if the store records no duplicates.
+ */
+DuplicatesOf storeDuplicates(const FeatureStore &store) {
+    if (!store.hasDuplicates()) {
+        return {};
+    }
+    return [&store](size_t row) {
+        std::vector<std::string> names;
+        auto [first, last] = store.duplicateRange(row);
+        for (size_t d = first; d < last; ++d) {
+            names.emplace_back(store.duplicateName(d));
+        }
+        return names;
+    };
+}
+
+/**
+ * Present the duplicates attached to ranked matches as the options ask.
+ *
+ * Collapsed, each match keeps its duplicate list. Expanded (the default), each
+ * duplicate becomes a match with the same distance and the list is re-ranked
+ * by distance, then filename, and cut to N: the ranking an index with a row
+ * per image gives, since its rows are in filename order too.
+ *
+ * @param options Query options (collapseDuplicates, topN, showLeast).
+ * @param matches Ranked matches, one per stored row.
+ * @return Matches to report.
+ */
+std::vector<Match> reportDuplicates(const QueryOptions &options, std::vector<Match> matches) {
+    bool any = std::any_of(matches.begin(), matches.end(),
+                           [](const Match &match) { return !match.duplicates.empty(); });
+    if (options.collapseDuplicates || !any) {
+        return matches;
+    }
+    std::vector<Match> expanded;
+    for (auto &match : matches) {
+        for (auto &duplicate : match.duplicates) {
+            expanded.push_back({std::move(duplicate), match.distance});
+        }
+        match.duplicates.clear();
+        expanded.push_back(std::move(match));
+    }
+    std::sort(expanded.begin(), expanded.end(), [&](const Match &a, const Match &b) {
+        if (a.distance != b.distance) {
+            return options.showLeast ? a.distance > b.distance : a.distance < b.distance;
+        }
+        return a.filename < b.filename;
+    });
+    expanded.resize(std::min(expanded.size(), static_cast<size_t>(std::max(options.topN, 0))));
+    return expanded;
+}
+
+/**
+ * Time budget and progress snapshots for one query's scan.
+ *
+ * A scan registers its per-worker collectors with begin(), skips its
+ * remaining candidates once expired() is true, offers through withCollector()
+ * and reports finished candidates with advance(). Collectors are only locked
+ * while snapshots are enabled, so that a snapshot can merge them mid-scan.
+ */
+class ScanMonitor {
+public:
+    ScanMonitor(const QueryOptions &options, const QueryProgressCallback &onProgress)
+        : start_(Clock::now()),
+          deadline_(start_ + std::chrono::milliseconds(options.timeBudgetMs)),
+          hasBudget_(options.timeBudgetMs > 0),
+          interval_(std::chrono::milliseconds(options.progressIntervalMs)),
+          reporting_(options.progressIntervalMs > 0 && static_cast<bool>(onProgress)),
+          onProgress_(onProgress) {}
+
+    /**
+     * Start monitoring a scan.
+     *
+     * @param collectors Per-worker collectors (must outlive the scan).
+     * @param total Candidates in the scan.
+     * @param nameOf Maps a candidate index to its filename.
+     */
+    void begin(std::vector<TopKCollector> &collectors, size_t total, std::function<std::string(size_t)> nameOf) {
+        collectors_ = &collectors;
+        total_.store(total, std::memory_order_relaxed);
+        nameOf_ = std::move(nameOf);
+        if (reporting_) {
+            locks_ = std::make_unique<std::mutex[]>(collectors.size());
+            nextReport_.store((Clock::now() - start_ + interval_).count(), std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Update the candidate count of a scan whose inputs are still being found.
+     *
+     * @param total Candidates known so far.
+     */
+    void setTotal(size_t total) { total_.store(total, std::memory_order_relaxed); }
+
+    /** @return True once the time budget is spent (and from then on). */
+    bool expired() {
+        if (stopped_.load(std::memory_order_relaxed)) {
+            return true;
+        }
+        if (hasBudget_ && Clock::now() >= deadline_) {
+            stopped_.store(true, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * Run offer(collector) on a worker's collector.
+     *
+     * @param worker Worker slot.
+     * @param offer Callback receiving the worker's TopKCollector.
+     */
+    template <typename Offer>
+    void withCollector(size_t worker, Offer offer) {
+        if (!reporting_) {
+            offer((*collectors_)[worker]);
+            return;
+        }
+        std::lock_guard<std::mutex> lock(locks_[worker]);
+        offer((*collectors_)[worker]);
+    }
+
+    /**
+     * Count scored candidates and emit a snapshot when one is due.
+     *
+     * @param count Candidates finished by the caller.
+     */
+    void advance(size_t count) {
+        scanned_.fetch_add(count, std::memory_order_relaxed);
+        if (reporting_) {
+            reportIfDue();
+        }
+    }
+
+    /**
+     * Package the final ranking with the scan coverage.
+     *
+     * @param matches Final matches.
+     * @return Query result.
+     */
+    QueryResult result(std::vector<Match> matches) const {
+        QueryResult result;
+        result.matches = std::move(matches);
+        result.complete = !stopped_.load(std::memory_order_relaxed);
+        result.scanned = scanned_.load(std::memory_order_relaxed);
+        result.total = total_.load(std::memory_order_relaxed);
+        return result;
+    }
+
+private:
+    /**
+     * Merge the collectors and hand a snapshot to the callback.
+     * One worker claims each interval; the others carry on scanning.
+     */
+    void reportIfDue() {
+        Clock::rep now = (Clock::now() - start_).count();
+        Clock::rep due = nextReport_.load(std::memory_order_relaxed);
+        if (now < due ||
+            !nextReport_.compare_exchange_strong(due, now + Clock::duration(interval_).count(),
+                                                 std::memory_order_relaxed)) {
+            return;
+        }
+        std::vector<TopKCollector> &collectors = *collectors_;
+        TopKCollector merged = [&]() {
+            std::lock_guard<std::mutex> lock(locks_[0]);
+            return collectors[0];
+        }();
+        for (size_t worker = 1; worker < collectors.size(); ++worker) {
+            std::lock_guard<std::mutex> lock(locks_[worker]);
+            merged.merge(collectors[worker]);
+        }
+
+        QueryProgress progress;
+        for (const auto &candidate : merged.sorted()) {
+            progress.matches.push_back({nameOf_(candidate.index), candidate.distance});
+        }
+        progress.scanned = scanned_.load(std::memory_order_relaxed);
+        progress.total = total_.load(std::memory_order_relaxed);
+        progress.elapsedMs = std::chrono::duration<double, std::milli>(Clock::now() - start_).count();
+        std::lock_guard<std::mutex> lock(reportMutex_);
+        onProgress_(progress);
+    }
+
+    Clock::time_point start_;
+    Clock::time_point deadline_;
+    bool hasBudget_;
+    std::chrono::milliseconds interval_;
+    bool reporting_;
+    const QueryProgressCallback &onProgress_;
+
+    std::vector<TopKCollector> *collectors_ = nullptr;
+    std::atomic<size_t> total_{0};
+    std::function<std::string(size_t)> nameOf_;
+    std::unique_ptr<std::mutex[]> locks_;
+    std::atomic<Clock::rep> nextReport_{0};
+    std::atomic<size_t> scanned_{0};
+    std::atomic<bool> stopped_{false};
+    std::mutex reportMutex_;
+};
+
+/**
+ * Check that stored descriptor settings match the requested feature type.
+ *
+ * @param actual Settings recorded in a store or index.
+ * @param featureType Feature type requested on the command line.
+ * @param path Store path (for error messages).
+ * @throws std::runtime_error if the type or bin/region settings differ.
+ */
+void validateStoreInfo(
+    const FeatureStoreInfo &actual,
+    const std::string &featureType,
+    const std::string &path) {
+    FeatureStoreInfo expected = featureTypeInfo(featureType);
+    if (actual.featureType != expected.featureType ||
+        actual.binsPerChannel != expected.binsPerChannel ||
+        actual.regionCount != expected.regionCount) {
+        throw std::runtime_error(
+            "Feature store " + path + " holds " + actual.featureType +
+            " features, not " + featureType);
+    }
+}
+
+/**
+ * Check that a feature store was built for the requested feature type.
+ *
+ * @param store Mapped feature store.
+ * @param featureType Feature type requested on the command line.
+ * @param path Store path (for error messages).
+ * @throws std::runtime_error if the type or bin/region settings differ.
+ */
+void validateStoreInfo(
+    const FeatureStore &store,
+    const std::string &featureType,
+    const std::string &path) {
+    validateStoreInfo(store.info(), featureType, path);
+}
+
+/**
+ * List database images, failing if the directory has none.
+ *
+ * @param databaseDir Database directory.
+ * @return Sorted image paths.
+ * @throws std::runtime_error if no images are found.
+ */
+std::vector<std::string> listImageFilesOrThrow(const std::string &databaseDir) {
+    auto imageFiles = listImageFiles(databaseDir);
+    if (imageFiles.empty()) {
+        throw std::runtime_error("No images found in directory: " + databaseDir);
+    }
+    return imageFiles;
+}
+
+/**
+ * Score a classic feature query against a row-major feature matrix.
+ *
+ * @param options Query options.
+ * @param targetFeature Query feature vector.
+ * @param rows First row of the matrix.
+ * @param rowCount Number of rows.
+ * @param nameOf Maps a row index to its filename.
+ * @param monitor Time budget and progress for the scan.
+ * @param coarseRows Coarse descriptor matrix for the rows, or nullptr.
+ * @param duplicatesOf Maps a row index to its duplicates (may be empty).
+ * @return Top-N matches over the rows.
+ */
+template <typename NameOf>
+std::vector<Match> scanFeatureRows(
+    const QueryOptions &options,
+    const std::vector<float> &targetFeature,
+    const float *rows,
+    size_t rowCount,
+    NameOf nameOf,
+    ScanMonitor &monitor,
+    const float *coarseRows = nullptr,
+    const DuplicatesOf &duplicatesOf = {}) {
+    size_t dimension = targetFeature.size();
+    size_t blockCount = (rowCount + kStoreBlockRows - 1) / kStoreBlockRows;
+    auto collectors = makeCollectors(options, parallelWorkerCount(blockCount, options.threadCount));
+    monitor.begin(collectors, rowCount, [&](size_t row) { return std::string(nameOf(row)); });
+
+    bool cascade = cascadeEnabled(options);
+    BoundedTarget bounded = boundedTarget(options.featureType, targetFeature);
+    std::vector<float> targetCoarse;
+    if (cascade && coarseRows != nullptr) {
+        targetCoarse = coarseFeature(options.featureType, targetFeature);
+    }
+    size_t coarseDimension = targetCoarse.size();
+
+    parallelForWorkers(blockCount, options.threadCount, [&](size_t block, size_t worker) {
+        if (monitor.expired()) {
+            return;
+        }
+        ProfileTimer timer(ProfileStage::Score);
+        size_t begin = block * kStoreBlockRows;
+        size_t count = std::min(kStoreBlockRows, rowCount - begin);
+        profileCount(ProfileCounter::CandidatesScored, count);
+        if (cascade) {
+            // Coarse filter, then a full distance that stops once it loses to the k-th best.
+            size_t pruned = 0;
+            monitor.withCollector(worker, [&](TopKCollector &collector) {
+                for (size_t row = begin; row < begin + count; ++row) {
+                    float bound = pruneBound(collector);
+                    if (coarseDimension != 0 && bound < std::numeric_limits<float>::infinity() &&
+                        coarseFeatureDistance(options.featureType, targetCoarse,
+                                              FloatView(coarseRows + row * coarseDimension, coarseDimension)) >
+                            abandonThreshold(bound)) {
+                        ++pruned;
+                        continue;
+                    }
+                    collector.offer(featureDistanceBounded(options.featureType, bounded,
+                                                           FloatView(rows + row * dimension, dimension), bound),
+                                    row);
+                }
+            });
+            profileCount(ProfileCounter::CandidatesPruned, pruned);
+            monitor.advance(count);
+            return;
+        }
+        std::array<float, kStoreBlockRows> distances;
+        featureDistanceBatch(options.featureType, targetFeature, rows + begin * dimension, count,
+                             distances.data());
+        monitor.withCollector(worker, [&](TopKCollector &collector) {
+            for (size_t i = 0; i < count; ++i) {
+                collector.offer(distances[i], begin + i);
+            }
+        });
+        monitor.advance(count);
+    });
+
+    return rankedMatches(collectors, nameOf, duplicatesOf);
+}
+
+/**
+ * Score a classic feature query against a mapped feature store.
+ *
+ * @param options Query options (indexPath names a binary store).
+ * @param targetFeature Query feature vector.
+ * @param store Mapped feature store.
+ * @param monitor Time budget and progress for the scan.
+ * @return Top-N matches over the stored rows, duplicates reported as the options ask.
+ */
+std::vector<Match> scanFeatureStore(
+    const QueryOptions &options,
+    const std::vector<float> &targetFeature,
+    const FeatureStore &store,
+    ScanMonitor &monitor) {
+    validateStoreInfo(store, options.featureType, options.indexPath);
+    if (store.rowCount() == 0) {
+        throw std::runtime_error("No features found in index: " + options.indexPath);
+    }
+    if (store.dimension() != targetFeature.size()) {
+        throw std::runtime_error(
+            "Index feature size does not match " + options.featureType + ": " + options.indexPath);
+    }
+
+    // Stores written before coarse descriptors existed still get early abandoning.
+    const float *coarseRows =
+        store.hasCoarse() && store.coarseDimension() == coarseFeatureSize(options.featureType)
+            ? store.coarseData()
+            : nullptr;
+    return reportDuplicates(
+        options, scanFeatureRows(options, targetFeature, store.data(), store.rowCount(),
+                                 [&](size_t row) { return store.filename(row); }, monitor, coarseRows,
+                                 storeDuplicates(store)));
+}
+
+/**
+ * Score a classic feature query against a features CSV index.
+ *
+ * @param options Query options (indexPath names a CSV).
+ * @param targetFeature Query feature vector.
+ * @param indexed Parsed CSV rows.
+ * @param monitor Time budget and progress for the scan.
+ * @return Top-N matches over the CSV rows.
+ */
+std::vector<Match> scanFeaturesCsv(
+    const QueryOptions &options,
+    const std::vector<float> &targetFeature,
+    const FeatureMatrix &indexed,
+    ScanMonitor &monitor) {
+    if (indexed.filenames.empty()) {
+        throw std::runtime_error("No features found in index: " + options.indexPath);
+    }
+    if (indexed.dimension != targetFeature.size()) {
+        throw std::runtime_error(
+            "Index feature size does not match " + options.featureType + ": " + options.indexPath);
+    }
+
+    // Parsed CSVs are contiguous, so they take the same blocked path as stores.
+    return scanFeatureRows(options, targetFeature, indexed.rows.data(), indexed.filenames.size(),
+                           [&](size_t row) { return indexed.filenames[row]; }, monitor);
+}
+
+/**
+ * Decode every database image, extract its feature and score it.
+ *
+ * @param options Query options.
+ * @param targetFeature Query feature vector.
+ * @param monitor Time budget and progress for the scan.
+ * @return Top-N matches over the database images.
+ */
+std::vector<Match> scanImages(
+    const QueryOptions &options,
+    const std::vector<float> &targetFeature,
+    ScanMonitor &monitor) {
+    auto imageFiles = listImageFilesOrThrow(options.databaseDir);
+    int decodeScale = decodeScaleFor(options.featureType, options.decodeScale);
+
+    std::vector<TopKCollector> collectors;
+    if (options.usePipeline) {
+        // The scorer stage runs on this thread, so one collector suffices.
+        collectors = makeCollectors(options, 1);
+        monitor.begin(collectors, imageFiles.size(), [&](size_t i) { return imageFiles[i]; });
+        PipelineOptions pipeline = options.pipeline;
+        pipeline.decodeScale = decodeScale;
+        auto stats = runImagePipeline(
+            imageFiles, pipeline,
+            [&](const cv::Mat &image) { return computeFeature(options.featureType, image); },
+            [&](size_t i, const std::vector<float> &feature) {
+                {
+                    ProfileTimer timer(ProfileStage::Score);
+                    profileCount(ProfileCounter::CandidatesScored, 1);
+                    float distance = featureDistance(options.featureType, targetFeature, feature);
+                    monitor.withCollector(0, [&](TopKCollector &collector) { collector.offer(distance, i); });
+                }
+                monitor.advance(1);
+                return !monitor.expired();
+            });
+        if (options.pipelineStats) {
+            printPipelineStats(stats, std::cerr);
+        }
+    } else {
+        collectors = makeCollectors(options, parallelWorkerCount(imageFiles.size(), options.threadCount));
+        monitor.begin(collectors, imageFiles.size(), [&](size_t i) { return imageFiles[i]; });
+        parallelForWorkers(imageFiles.size(), options.threadCount, [&](size_t i, size_t worker) {
+            if (monitor.expired()) {
+                return;
+            }
+            cv::Mat image = loadImageOrThrow(imageFiles[i], decodeScale);
+            auto feature = computeFeature(options.featureType, image);
+            {
+                ProfileTimer timer(ProfileStage::Score);
+                profileCount(ProfileCounter::CandidatesScored, 1);
+                float distance = featureDistance(options.featureType, targetFeature, feature);
+                monitor.withCollector(worker, [&](TopKCollector &collector) { collector.offer(distance, i); });
+            }
+            monitor.advance(1);
+        });
+    }
+
+    return rankedMatches(collectors, [&](size_t i) { return imageFiles[i]; });
+}
+
+/**
+ * Score database images as the directory walk finds them (--unordered).
+ *
+ * Nothing waits for a complete, sorted listing, so scoring starts with the
+ * first directory read. Candidates are numbered in discovery order, which
+ * only matters for ties between equal distances.
+ *
+ * @param options Query options.
+ * @param targetFeature Query feature vector.
+ * @param monitor Time budget and progress for the scan.
+ * @return Top-N matches over the database images.
+ * @throws std::runtime_error if the directory cannot be read or has no images.
+ */
+std::vector<Match> streamImages(
+    const QueryOptions &options,
+    const std::vector<float> &targetFeature,
+    ScanMonitor &monitor) {
+    ImagePathStream paths(options.databaseDir, options.threadCount);
+    int decodeScale = decodeScaleFor(options.featureType, options.decodeScale);
+    auto nextPath = [&](size_t &index, std::string &path) {
+        if (monitor.expired()) {
+            // Out of budget: stop the walk too, not just the scoring.
+            paths.cancel();
+            return false;
+        }
+        if (!paths.next(index, path)) {
+            return false;
+        }
+        monitor.setTotal(paths.found());
+        return true;
+    };
+    auto score = [&](size_t i, size_t worker, const std::vector<float> &feature) {
+        ProfileTimer timer(ProfileStage::Score);
+        profileCount(ProfileCounter::CandidatesScored, 1);
+        float distance = featureDistance(options.featureType, targetFeature, feature);
+        monitor.withCollector(worker, [&](TopKCollector &collector) { collector.offer(distance, i); });
+    };
+
+    std::vector<TopKCollector> collectors;
+    try {
+        if (options.usePipeline) {
+            collectors = makeCollectors(options, 1);
+            monitor.begin(collectors, 0, [&](size_t i) { return paths.path(i); });
+            PipelineOptions pipeline = options.pipeline;
+            pipeline.decodeScale = decodeScale;
+            auto stats = runImagePipeline(
+                nextPath, pipeline,
+                [&](const cv::Mat &image) { return computeFeature(options.featureType, image); },
+                [&](size_t i, const std::vector<float> &feature) {
+                    score(i, 0, feature);
+                    monitor.advance(1);
+                    return !monitor.expired();
+                });
+            if (options.pipelineStats) {
+                printPipelineStats(stats, std::cerr);
+            }
+        } else {
+            // One long-lived loop per worker slot, each pulling paths until the walk is done.
+            size_t workers = parallelWorkerCount(static_cast<size_t>(options.threadCount), options.threadCount);
+            collectors = makeCollectors(options, workers);
+            monitor.begin(collectors, 0, [&](size_t i) { return paths.path(i); });
+            parallelForWorkers(workers, options.threadCount, [&](size_t, size_t worker) {
+                size_t i;
+                std::string path;
+                try {
+                    while (nextPath(i, path)) {
+                        auto feature = computeFeature(options.featureType, loadImageOrThrow(path, decodeScale));
+                        score(i, worker, feature);
+                        monitor.advance(1);
+                    }
+                } catch (...) {
+                    // Stop the walk now so the other workers' next() returns
+                    // false instead of draining the rest of the tree.
+                    paths.cancel();
+                    throw;
+                }
+            });
+        }
+    } catch (...) {
+        paths.cancel();
+        throw;
+    }
+    paths.finish();
+    if (paths.found() == 0) {
+        throw std::runtime_error("No images found in directory: " + options.databaseDir);
+    }
+    monitor.setTotal(paths.found());
+    return rankedMatches(collectors, [&](size_t i) { return paths.path(i); });
+}
+
+/**
+ * Score DNN embeddings from a packed store for images in the database directory.
+ *
+ * @param options Query options (embeddingsPath names a binary store).
+ * @param imageFiles Database image paths.
+ * @param store Mapped embedding store.
+ * @param monitor Time budget and progress for the scan.
+ * @return Top-N matches among images that have embeddings.
+ */
+std::vector<Match> scanEmbeddingStore(
+    const QueryOptions &options,
+    const std::vector<std::string> &imageFiles,
+    const FeatureStore &store,
+    ScanMonitor &monitor) {
+    validateStoreInfo(store, options.featureType, options.embeddingsPath);
+
+    // Match rows to database files as every embedding path does.
+    auto rowByName = firstRowByName(store.rowCount(), [&](size_t row) { return store.filename(row); });
+    EmbeddingRowLookup findRow = lookupIn(rowByName);
+    EmbeddingFiles pairs = pairEmbeddingFiles(imageFiles, options.databaseDir, store.rowCount(), findRow);
+    size_t targetRow = embeddingRowOf(options.targetImagePath, options.databaseDir, findRow);
+    if (targetRow == kNoRow) {
+        throw std::runtime_error("Target embedding not found in CSV.");
+    }
+    const float *targetEmbedding = store.row(targetRow);
+
+    size_t blockCount = (store.rowCount() + kStoreBlockRows - 1) / kStoreBlockRows;
+    auto collectors = makeCollectors(options, parallelWorkerCount(blockCount, options.threadCount));
+    auto nameOf = [&](size_t row) { return imageFiles[pairs.fileOfRow[row]]; };
+    monitor.begin(collectors, store.rowCount(), nameOf);
+    parallelForWorkers(blockCount, options.threadCount, [&](size_t block, size_t worker) {
+        if (monitor.expired()) {
+            return;
+        }
+        ProfileTimer timer(ProfileStage::Score);
+        size_t begin = block * kStoreBlockRows;
+        size_t end = std::min(begin + kStoreBlockRows, store.rowCount());
+        profileCount(ProfileCounter::CandidatesScored, end - begin);
+        // Score the whole block; rows without a database file are skipped below.
+        std::array<float, kStoreBlockRows> distances;
+        if (options.distanceMetric != "cosine" && cascadeEnabled(options)) {
+            // SSD only grows, so each row stops once it passes the worker's k-th best.
+            monitor.withCollector(worker, [&](TopKCollector &collector) {
+                for (size_t i = begin; i < end; ++i) {
+                    if (pairs.fileOfRow[i] != kNoRow) {
+                        FloatView row(store.row(i), store.dimension());
+                        collector.offer(ssdDistanceBounded(FloatView(targetEmbedding, store.dimension()), row,
+                                                           pruneBound(collector)),
+                                        i);
+                    }
+                }
+            });
+            monitor.advance(end - begin);
+            return;
+        }
+        if (options.distanceMetric == "cosine") {
+            cosineDistanceBatch(targetEmbedding, store.row(begin), end - begin,
+                                store.dimension(), distances.data());
+        } else {
+            ssdDistanceBatch(targetEmbedding, store.row(begin), end - begin,
+                             store.dimension(), distances.data());
+        }
+        monitor.withCollector(worker, [&](TopKCollector &collector) {
+            for (size_t i = begin; i < end; ++i) {
+                if (pairs.fileOfRow[i] != kNoRow) {
+                    collector.offer(distances[i - begin], i);
+                }
+            }
+        });
+        monitor.advance(end - begin);
+    });
+
+    return rankedMatches(collectors, nameOf);
+}
+
+/**
+ * Answer a classic query exactly from a VP-tree.
+ *
+ * @param options Query options (indexPath names a VP-tree).
+ * @param targetFeature Query feature vector.
+ * @param tree Loaded tree.
+ * @return Top-N matches, identical to a linear scan of the source store.
+ * @throws std::runtime_error on a feature type or size mismatch, or --least.
+ */
+std::vector<Match> searchVpTree(
+    const QueryOptions &options,
+    const std::vector<float> &targetFeature,
+    const VpTree &tree) {
+    validateStoreInfo(tree.info(), options.featureType, options.indexPath);
+    if (options.showLeast) {
+        throw std::runtime_error("--least needs an exhaustive scan; pass the feature store");
+    }
+    if (tree.dimension() != targetFeature.size()) {
+        throw std::runtime_error(
+            "Index feature size does not match " + options.featureType + ": " + options.indexPath);
+    }
+    VpSearchStats stats;
+    std::vector<ScoredCandidate> candidates;
+    {
+        ProfileTimer timer(ProfileStage::Score);
+        candidates = tree.search(targetFeature, static_cast<size_t>(std::max(options.topN, 0)), &stats);
+        profileCount(ProfileCounter::CandidatesScored, stats.distancesComputed);
+        profileCount(ProfileCounter::IndexNodesVisited, stats.nodesVisited);
+    }
+    ProfileTimer timer(ProfileStage::Rank);
+    std::vector<Match> matches;
+    for (const auto &candidate : candidates) {
+        matches.push_back({tree.filename(candidate.index), candidate.distance, tree.duplicates(candidate.index)});
+    }
+    return reportDuplicates(options, std::move(matches));
+}
+
+/**
+ * Answer a DNN query from an HNSW graph, keeping images in the database directory.
+ *
+ * Graph rows whose file is not in the directory are skipped; the search is
+ * widened until topN rows remain or the whole graph has been returned.
+ *
+ * @param options Query options (embeddingsPath names an HNSW index).
+ * @param imageFiles Database image paths.
+ * @param index Loaded graph.
+ * @return Approximate top-N matches.
+ * @throws std::runtime_error on a metric mismatch, --least or a missing target.
+ */
+std::vector<Match> searchHnswIndex(
+    const QueryOptions &options,
+    const std::vector<std::string> &imageFiles,
+    const HnswIndex &index) {
+    if (options.distanceMetric != index.metric()) {
+        throw std::runtime_error("HNSW index " + options.embeddingsPath + " was built for " +
+                                 index.metric() + ", not " + options.distanceMetric);
+    }
+    if (options.showLeast) {
+        throw std::runtime_error("--least needs an exhaustive scan; pass the embeddings CSV or store");
+    }
+    EmbeddingRowLookup findRow = [&index](const std::string &name) {
+        size_t row = index.findRow(name);
+        return row == HnswIndex::npos ? kNoRow : row;
+    };
+    size_t targetRow = embeddingRowOf(options.targetImagePath, options.databaseDir, findRow);
+    if (targetRow == kNoRow) {
+        throw std::runtime_error("Target embedding not found in CSV.");
+    }
+
+    EmbeddingFiles pairs = pairEmbeddingFiles(imageFiles, options.databaseDir, index.size(), findRow);
+    size_t wanted = static_cast<size_t>(std::max(options.topN, 0));
+    size_t k = wanted;
+    size_t ef = std::max(options.hnswEf, wanted);
+    std::vector<Match> matches;
+    ProfileTimer timer(ProfileStage::Score);
+    while (true) {
+        matches.clear();
+        auto candidates = index.search(index.row(targetRow), k, ef);
+        profileCount(ProfileCounter::CandidatesScored, candidates.size());
+        for (const auto &candidate : candidates) {
+            size_t file = pairs.fileOfRow[candidate.index];
+            if (file != kNoRow && matches.size() < wanted) {
+                matches.push_back({imageFiles[file], candidate.distance});
+            }
+        }
+        if (matches.size() >= wanted || candidates.size() < k || k >= index.size()) {
+            return matches;
+        }
+        k = std::min(k * 2, index.size());
+        ef = std::max(ef, k);
+    }
+}
+
+/**
+ * Answer a DNN query from a product-quantized index, keeping images in the database directory.
+ *
+ * @param options Query options (embeddingsPath names a PQ index).
+ * @param imageFiles Database image paths.
+ * @param index Mapped index.
+ * @return Top-N matches by code distance, re-ranked exactly when vectors are stored.
+ * @throws std::runtime_error on a metric mismatch, --least or a missing target.
+ */
+std::vector<Match> searchPqIndex(
+    const QueryOptions &options,
+    const std::vector<std::string> &imageFiles,
+    const PqIndex &index) {
+    if (options.distanceMetric != index.metric()) {
+        throw std::runtime_error("PQ index " + options.embeddingsPath + " was built for " +
+                                 index.metric() + ", not " + options.distanceMetric);
+    }
+    if (options.showLeast) {
+        throw std::runtime_error("--least needs an exhaustive scan; pass the embeddings CSV or store");
+    }
+    auto rowByName = firstRowByName(index.rowCount(), [&](size_t row) { return index.filename(row); });
+    EmbeddingRowLookup findRow = lookupIn(rowByName);
+    size_t targetRow = embeddingRowOf(options.targetImagePath, options.databaseDir, findRow);
+    if (targetRow == kNoRow) {
+        throw std::runtime_error("Target embedding not found in CSV.");
+    }
+
+    // Only rows paired with a file in the database directory are scored.
+    EmbeddingFiles pairs = pairEmbeddingFiles(imageFiles, options.databaseDir, index.rowCount(), findRow);
+    std::vector<uint8_t> allowed(index.rowCount(), 0);
+    for (size_t row = 0; row < index.rowCount(); ++row) {
+        allowed[row] = pairs.fileOfRow[row] != kNoRow ? 1 : 0;
+    }
+
+    std::vector<float> target = index.rowVector(targetRow);
+    size_t wanted = static_cast<size_t>(std::max(options.topN, 0));
+    ProfileTimer timer(ProfileStage::Score);
+    // Every allowed row's code is scored.
+    profileCount(ProfileCounter::CandidatesScored,
+                 static_cast<uint64_t>(std::count(allowed.begin(), allowed.end(), uint8_t(1))));
+    auto candidates = index.search(FloatView(target.data(), target.size()), wanted, options.pqRerank, &allowed,
+                                   options.threadCount);
+    std::vector<Match> matches;
+    for (const auto &candidate : candidates) {
+        matches.push_back({imageFiles[pairs.fileOfRow[candidate.index]], candidate.distance});
+    }
+    return matches;
+}
+
+/**
+ * Score DNN embeddings from a CSV for images in the database directory.
+ *
+ * @param options Query options (embeddingsPath names a CSV).
+ * @param imageFiles Database image paths.
+ * @param embeddings Embeddings keyed by filename.
+ * @param monitor Time budget and progress for the scan.
+ * @return Top-N matches among images that have embeddings.
+ */
+std::vector<Match> scanEmbeddingsCsv(
+    const QueryOptions &options,
+    const std::vector<std::string> &imageFiles,
+    const EmbeddingTable &embeddings,
+    ScanMonitor &monitor) {
+    EmbeddingRowLookup findRow = lookupIn(embeddings.rowByName);
+    size_t targetRow = embeddingRowOf(options.targetImagePath, options.databaseDir, findRow);
+    if (targetRow == kNoRow) {
+        throw std::runtime_error("Target embedding not found in CSV.");
+    }
+    const FeatureMatrix &matrix = embeddings.matrix;
+    EmbeddingFiles pairs = pairEmbeddingFiles(imageFiles, options.databaseDir, matrix.filenames.size(), findRow);
+    size_t dimension = matrix.dimension;
+    const float *targetEmbedding = matrix.rows.data() + targetRow * dimension;
+    float targetNorm = matrix.norms[targetRow];
+    bool cosine = options.distanceMetric == "cosine";
+    bool bounded = !cosine && cascadeEnabled(options);
+    auto dot = activeDistanceKernels().dot;
+
+    auto collectors = makeCollectors(options, parallelWorkerCount(imageFiles.size(), options.threadCount));
+    monitor.begin(collectors, imageFiles.size(), [&](size_t i) { return imageFiles[i]; });
+    parallelForWorkers(imageFiles.size(), options.threadCount, [&](size_t i, size_t worker) {
+        if (monitor.expired()) {
+            return;
+        }
+        ProfileTimer timer(ProfileStage::Score);
+        size_t embedRow = pairs.rowOfFile[i];
+        if (embedRow != kNoRow) {
+            profileCount(ProfileCounter::CandidatesScored, 1);
+            const float *row = matrix.rows.data() + embedRow * dimension;
+            float distance = 1.0f;
+            if (bounded) {
+                monitor.withCollector(worker, [&](TopKCollector &collector) {
+                    collector.offer(ssdDistanceBounded(FloatView(targetEmbedding, dimension), FloatView(row, dimension),
+                                                       pruneBound(collector)),
+                                    i);
+                });
+                monitor.advance(1);
+                return;
+            }
+            if (!cosine) {
+                distance = ssdDistance(FloatView(targetEmbedding, dimension), FloatView(row, dimension));
+            } else if (targetNorm > 0.0f && matrix.norms[embedRow] > 0.0f) {
+                // Cosine reuses the norms computed while parsing.
+                distance = 1.0f - dot(targetEmbedding, row, dimension) / (targetNorm * matrix.norms[embedRow]);
+            }
+            monitor.withCollector(worker, [&](TopKCollector &collector) { collector.offer(distance, i); });
+        }
+        // Files without embeddings are skipped but still count as scanned.
+        monitor.advance(1);
+    });
+
+    return rankedMatches(collectors, [&](size_t i) { return imageFiles[i]; });
+}
+
+/**
+ * Database side of a batch query: a row-major matrix and the name of each row.
+ */
+struct BatchDatabase {
+    // Rows used in place (mapped store, cached features or parsed CSV).
+    const float *rows = nullptr;
+    size_t rowCount = 0;
+    size_t dimension = 0;
+    // Per-row eligibility (empty = every row is a candidate).
+    std::vector<uint8_t> eligible;
+    std::function<std::string(size_t)> nameOf;
+    DuplicatesOf duplicatesOf;
+};
+
+/**
+ * Score every query against every eligible database row in cache-sized tiles.
+ *
+ * Work items are (row tile, query group) pairs, so the database is streamed
+ * from memory once per query group instead of once per query. Cosine scores
+ * unit queries against precomputed row norms with the four-query dot kernel;
+ * other metrics run the single-query batch kernels over the resident tile.
+ *
+ * @param options Query options (metric, feature type, topN, showLeast, threads).
+ * @param database Database rows.
+ * @param queries queryCount * dimension floats (normalized in place for cosine).
+ * @param queryCount Number of queries.
+ * @return Ranked matches per query.
+ */
+std::vector<std::vector<Match>> scanBatch(
+    const QueryOptions &options,
+    const BatchDatabase &database,
+    std::vector<float> &queries,
+    size_t queryCount) {
+    size_t dimension = database.dimension;
+    const float *rows = database.rows;
+    bool cosine = options.featureType == "dnn" && options.distanceMetric == "cosine";
+    const DistanceKernels &kernels = activeDistanceKernels();
+
+    // 1 / |row| per row (0 for zero rows, which score 1.0 like cosineDistance).
+    std::vector<float> rowScale;
+    if (cosine) {
+        rowScale.resize(database.rowCount);
+        parallelFor(database.rowCount, options.threadCount, [&](size_t row) {
+            float norm = kernels.dot(rows + row * dimension, rows + row * dimension, dimension);
+            rowScale[row] = norm > 0.0f ? 1.0f / std::sqrt(norm) : 0.0f;
+        });
+        for (size_t q = 0; q < queryCount; ++q) {
+            float *query = queries.data() + q * dimension;
+            float norm = kernels.dot(query, query, dimension);
+            float scale = norm > 0.0f ? 1.0f / std::sqrt(norm) : 0.0f;
+            for (size_t d = 0; d < dimension; ++d) {
+                query[d] *= scale;
+            }
+        }
+    }
+
+    size_t tileRows = std::clamp<size_t>(kBatchTileBytes / (dimension * sizeof(float)), 1, kStoreBlockRows);
+    size_t tileCount = (database.rowCount + tileRows - 1) / tileRows;
+    size_t groupCount = (queryCount + kBatchQueryGroup - 1) / kBatchQueryGroup;
+    size_t itemCount = tileCount * groupCount;
+    size_t workers = parallelWorkerCount(itemCount, options.threadCount);
+    size_t capacity = static_cast<size_t>(std::max(options.topN, 0));
+    // collectors[q][worker], so each query merges like a single-query scan.
+    std::vector<std::vector<TopKCollector>> collectors(
+        queryCount, std::vector<TopKCollector>(workers, TopKCollector(capacity, options.showLeast)));
+
+    parallelForWorkers(itemCount, options.threadCount, [&](size_t item, size_t worker) {
+        ProfileTimer timer(ProfileStage::Score);
+        // Consecutive items share a tile, so concurrent workers hit the same rows in cache.
+        size_t begin = (item / groupCount) * tileRows;
+        size_t count = std::min(tileRows, database.rowCount - begin);
+        size_t firstQuery = (item % groupCount) * kBatchQueryGroup;
+        size_t lastQuery = std::min(firstQuery + kBatchQueryGroup, queryCount);
+        // One candidate per (query, row) pair.
+        profileCount(ProfileCounter::CandidatesScored, count * (lastQuery - firstQuery));
+        const float *tile = rows + begin * dimension;
+        std::array<float, kBatchQueryBlock * kStoreBlockRows> distances;
+
+        for (size_t first = firstQuery; first < lastQuery; first += kBatchQueryBlock) {
+            size_t block = std::min(kBatchQueryBlock, lastQuery - first);
+            if (cosine) {
+                // Short blocks repeat their last query; the extra outputs are ignored.
+                const float *blockQueries[kBatchQueryBlock];
+                for (size_t q = 0; q < kBatchQueryBlock; ++q) {
+                    blockQueries[q] = queries.data() + (first + std::min(q, block - 1)) * dimension;
+                }
+                for (size_t row = 0; row < count; ++row) {
+                    float dots[kBatchQueryBlock];
+                    kernels.dot4(blockQueries, tile + row * dimension, dimension, dots);
+                    // Zero queries and rows have a zero dot or scale, so they score 1.0.
+                    for (size_t q = 0; q < block; ++q) {
+                        distances[q * kStoreBlockRows + row] = 1.0f - dots[q] * rowScale[begin + row];
+                    }
+                }
+            } else {
+                for (size_t q = 0; q < block; ++q) {
+                    const float *query = queries.data() + (first + q) * dimension;
+                    float *out = distances.data() + q * kStoreBlockRows;
+                    if (options.featureType == "dnn") {
+                        ssdDistanceBatch(query, tile, count, dimension, out);
+                    } else {
+                        featureDistanceBatch(options.featureType, FloatView(query, dimension), tile, count, out);
+                    }
+                }
+            }
+            for (size_t q = 0; q < block; ++q) {
+                TopKCollector &collector = collectors[first + q][worker];
+                for (size_t row = 0; row < count; ++row) {
+                    if (database.eligible.empty() || database.eligible[begin + row] != 0) {
+                        collector.offer(distances[q * kStoreBlockRows + row], begin + row);
+                    }
+                }
+            }
+        }
+    });
+
+    std::vector<std::vector<Match>> results;
+    results.reserve(queryCount);
+    for (const auto &queryCollectors : collectors) {
+        results.push_back(reportDuplicates(options, rankedMatches(queryCollectors, database.nameOf,
+                                                                  database.duplicatesOf)));
+    }
+    return results;
+}
+} // namespace
+
+/**
+ * Parse CLI-style query arguments into options.
+ *
+ * @param args Arguments after the program name.
+ * @return Parsed options.
+ * @throws std::invalid_argument on missing arguments or an unknown feature type.
+ */
+QueryOptions parseQueryArguments(const std::vector<std::string> &args) {
+    if (args.size() < 5) {
+        throw std::invalid_argument("Expected <target_image> <database_dir> <feature_type> <distance_metric> <N>");
+    }
+
+    // Parse required arguments and optional embeddings/flags.
+    QueryOptions options;
+    options.targetImagePath = args[0];
+    options.databaseDir = args[1];
+    options.featureType = args[2];
+    options.distanceMetric = args[3];
+    options.topN = std::stoi(args[4]);
+
+    for (size_t i = 5; i < args.size(); ++i) {
+        const std::string &arg = args[i];
+        if (arg == "--least") {
+            options.showLeast = true;
+        } else if (arg == "--index" && i + 1 < args.size()) {
+            options.indexPath = args[++i];
+        } else if (arg == "--threads" && i + 1 < args.size()) {
+            options.threadCount = resolveThreadCount(std::stoi(args[++i]));
+        } else if (arg == "--pipeline" && i + 1 < args.size()) {
+            options.usePipeline = true;
+            parsePipelineSpec(args[++i], options.pipeline);
+        } else if (arg == "--queue-depth" && i + 1 < args.size()) {
+            options.pipeline.queueCapacity = static_cast<size_t>(std::stoul(args[++i]));
+        } else if (arg == "--pipeline-stats") {
+            options.pipelineStats = true;
+        } else if (arg == "--profile") {
+            options.profile = true;
+        } else if (arg == "--profile-json") {
+            options.profile = true;
+            options.profileJson = true;
+        } else if (arg == "--ef" && i + 1 < args.size()) {
+            options.hnswEf = static_cast<size_t>(std::stoul(args[++i]));
+        } else if (arg == "--rerank" && i + 1 < args.size()) {
+            options.pqRerank = static_cast<size_t>(std::stoul(args[++i]));
+        } else if (arg == "--exhaustive") {
+            options.exhaustive = true;
+        } else if (arg == "--unordered") {
+            options.unordered = true;
+        } else if (arg == "--collapse-duplicates") {
+            options.collapseDuplicates = true;
+        } else if (arg == "--progress-ms" && i + 1 < args.size()) {
+            options.progressIntervalMs = std::max(std::stoi(args[++i]), 0);
+        } else if (arg == "--time-budget-ms" && i + 1 < args.size()) {
+            options.timeBudgetMs = std::max(std::stoi(args[++i]), 0);
+        } else if (arg == "--decode-scale" && i + 1 < args.size()) {
+            options.decodeScale = std::stoi(args[++i]);
+            if (!isValidDecodeScale(options.decodeScale)) {
+                throw std::invalid_argument("Decode scale must be 1, 2, 4 or 8");
+            }
+        } else if (options.embeddingsPath.empty()) {
+            options.embeddingsPath = arg;
+        }
+    }
+
+    if (options.featureType != "dnn" && !isClassicFeatureType(options.featureType)) {
+        throw std::invalid_argument("Unknown feature type: " + options.featureType);
+    }
+    return options;
+}
+
+/**
+ * Run a query against the configured source and rank the results.
+ *
+ * @param options Query options.
+ * @param cache Resident inputs to reuse, or nullptr to load everything fresh.
+ * @return Top-N matches.
+ * @throws std::runtime_error on missing inputs or unreadable files.
+ */
+std::vector<Match> runQuery(const QueryOptions &options, QueryCache *cache) {
+    return runQueryWithProgress(options, QueryProgressCallback(), cache).matches;
+}
+
+/**
+ * Run a query, stopping at the time budget and reporting snapshots.
+ *
+ * @param options Query options.
+ * @param onProgress Snapshot receiver (may be empty).
+ * @param cache Resident inputs to reuse, or nullptr to load everything fresh.
+ * @return Matches and scan coverage.
+ * @throws std::runtime_error on missing inputs or unreadable files.
+ */
+QueryResult runQueryWithProgress(
+    const QueryOptions &options,
+    const QueryProgressCallback &onProgress,
+    QueryCache *cache) {
+    // The budget counts from here, so loading and the target decode use it up too.
+    ScanMonitor monitor(options, onProgress);
+    // One-shot queries load into a throwaway cache so both paths share the scans.
+    QueryCache oneShot;
+    QueryCache &sources = cache != nullptr ? *cache : oneShot;
+
+    if (options.featureType == "dnn") {
+        // DNN embeddings are matched via filename lookup in the CSV.
+        const auto &imageFiles = sources.imageFiles(options.databaseDir, options.threadCount);
+        if (imageFiles.empty()) {
+            throw std::runtime_error("No images found in directory: " + options.databaseDir);
+        }
+        if (options.embeddingsPath.empty()) {
+            throw std::runtime_error("Missing embeddings CSV path for DNN features.");
+        }
+        if (isHnswIndexFile(options.embeddingsPath)) {
+            return monitor.result(searchHnswIndex(options, imageFiles, sources.hnswIndex(options.embeddingsPath)));
+        }
+        if (isPqIndexFile(options.embeddingsPath)) {
+            return monitor.result(searchPqIndex(options, imageFiles, sources.pqIndex(options.embeddingsPath)));
+        }
+        return monitor.result(
+            isFeatureStoreFile(options.embeddingsPath)
+                ? scanEmbeddingStore(options, imageFiles, sources.featureStore(options.embeddingsPath), monitor)
+                : scanEmbeddingsCsv(options, imageFiles,
+                                    sources.embeddingsCsv(options.embeddingsPath, options.threadCount), monitor));
+    }
+
+    // Only the target image is decoded when stored or cached features are available.
+    int decodeScale = decodeScaleFor(options.featureType, options.decodeScale);
+    if (!options.indexPath.empty() && isVpTreeFile(options.indexPath)) {
+        const VpTree &tree = sources.vpTree(options.indexPath);
+        cv::Mat targetImage = loadImageOrThrow(options.targetImagePath, tree.info().decodeScale);
+        return monitor.result(searchVpTree(options, computeFeature(options.featureType, targetImage), tree));
+    }
+    if (!options.indexPath.empty() && isFeatureStoreFile(options.indexPath)) {
+        // Decode the target at the scale the stored features were built with.
+        const FeatureStore &store = sources.featureStore(options.indexPath);
+        cv::Mat targetImage = loadImageOrThrow(options.targetImagePath, store.info().decodeScale);
+        return monitor.result(scanFeatureStore(options, computeFeature(options.featureType, targetImage), store, monitor));
+    }
+    cv::Mat targetImage = loadImageOrThrow(options.targetImagePath, decodeScale);
+    auto targetFeature = computeFeature(options.featureType, targetImage);
+    if (!options.indexPath.empty()) {
+        return monitor.result(scanFeaturesCsv(options, targetFeature,
+                                              sources.featuresCsv(options.indexPath, options.threadCount), monitor));
+    }
+    if (cache == nullptr) {
+        // Stream the one-shot scan rather than holding every database feature.
+        return monitor.result(options.unordered ? streamImages(options, targetFeature, monitor)
+                                                : scanImages(options, targetFeature, monitor));
+    }
+
+    const FeatureMatrix &features =
+        cache->imageFeatures(options.databaseDir, options.featureType, options.threadCount, decodeScale);
+    if (features.filenames.empty()) {
+        throw std::runtime_error("No images found in directory: " + options.databaseDir);
+    }
+    if (features.dimension != targetFeature.size()) {
+        throw std::runtime_error("Feature size mismatch for " + options.featureType);
+    }
+    return monitor.result(scanFeatureRows(options, targetFeature, features.rows.data(), features.filenames.size(),
+                                          [&](size_t i) { return features.filenames[i]; }, monitor));
+}
+
+/**
+ * Run many targets against one database, sharing the database scan.
+ *
+ * @param options Query options shared by every target.
+ * @param targets Target image paths (or embedding keys for dnn).
+ * @param cache Resident inputs to reuse, or nullptr to load everything fresh.
+ * @return Matches per target, in target order.
+ * @throws std::runtime_error on missing inputs, unreadable files or size mismatches.
+ */
+std::vector<std::vector<Match>> runBatchQuery(
+    const QueryOptions &options,
+    const std::vector<std::string> &targets,
+    QueryCache *cache) {
+    QueryCache oneShot;
+    QueryCache &sources = cache != nullptr ? *cache : oneShot;
+    if (targets.empty()) {
+        return {};
+    }
+
+    bool dnn = options.featureType == "dnn";
+    if ((dnn && !options.embeddingsPath.empty() &&
+         (isHnswIndexFile(options.embeddingsPath) || isPqIndexFile(options.embeddingsPath))) ||
+        (!dnn && !options.indexPath.empty() && isVpTreeFile(options.indexPath))) {
+        // Indexes do not scan the database; answer from the shared index.
+        std::vector<std::vector<Match>> results;
+        for (const auto &target : targets) {
+            QueryOptions single = options;
+            single.targetImagePath = target;
+            results.push_back(runQuery(single, &sources));
+        }
+        return results;
+    }
+
+    BatchDatabase database;
+    std::vector<float> queries;
+    if (dnn) {
+        const auto &imageFiles = sources.imageFiles(options.databaseDir, options.threadCount);
+        if (imageFiles.empty()) {
+            throw std::runtime_error("No images found in directory: " + options.databaseDir);
+        }
+        if (options.embeddingsPath.empty()) {
+            throw std::runtime_error("Missing embeddings CSV path for DNN features.");
+        }
+        if (isFeatureStoreFile(options.embeddingsPath)) {
+            // Store rows are scored in place; rows without a database file are masked out.
+            const FeatureStore &store = sources.featureStore(options.embeddingsPath);
+            validateStoreInfo(store, options.featureType, options.embeddingsPath);
+            database.rows = store.data();
+            database.rowCount = store.rowCount();
+            database.dimension = store.dimension();
+            auto rowByName = firstRowByName(store.rowCount(), [&](size_t row) { return store.filename(row); });
+            EmbeddingRowLookup findRow = lookupIn(rowByName);
+            auto fileOfRow = std::make_shared<std::vector<size_t>>(
+                pairEmbeddingFiles(imageFiles, options.databaseDir, store.rowCount(), findRow).fileOfRow);
+            database.eligible.assign(store.rowCount(), 0);
+            for (size_t row = 0; row < store.rowCount(); ++row) {
+                database.eligible[row] = (*fileOfRow)[row] != kNoRow ? 1 : 0;
+            }
+            database.nameOf = [&imageFiles, fileOfRow](size_t row) { return imageFiles[(*fileOfRow)[row]]; };
+            for (const auto &target : targets) {
+                size_t row = embeddingRowOf(target, options.databaseDir, findRow);
+                if (row == kNoRow) {
+                    throw std::runtime_error("Target embedding not found in CSV: " + target);
+                }
+                queries.insert(queries.end(), store.row(row), store.row(row) + store.dimension());
+            }
+        } else {
+            // Parsed CSVs are contiguous too; rows of files outside the directory are masked out,
+            // as are repeated filenames (the first row wins, as in single queries).
+            const EmbeddingTable &embeddings = sources.embeddingsCsv(options.embeddingsPath, options.threadCount);
+            const FeatureMatrix &matrix = embeddings.matrix;
+            database.rows = matrix.rows.data();
+            database.rowCount = matrix.filenames.size();
+            database.dimension = matrix.dimension;
+            EmbeddingRowLookup findRow = lookupIn(embeddings.rowByName);
+            auto fileOfRow = std::make_shared<std::vector<size_t>>(
+                pairEmbeddingFiles(imageFiles, options.databaseDir, database.rowCount, findRow).fileOfRow);
+            database.eligible.assign(database.rowCount, 0);
+            for (size_t row = 0; row < database.rowCount; ++row) {
+                database.eligible[row] = (*fileOfRow)[row] != kNoRow ? 1 : 0;
+            }
+            database.nameOf = [&imageFiles, fileOfRow](size_t row) { return imageFiles[(*fileOfRow)[row]]; };
+            for (const auto &target : targets) {
+                size_t targetRow = embeddingRowOf(target, options.databaseDir, findRow);
+                if (targetRow == kNoRow) {
+                    throw std::runtime_error("Target embedding not found in CSV: " + target);
+                }
+                const float *row = matrix.rows.data() + targetRow * matrix.dimension;
+                queries.insert(queries.end(), row, row + matrix.dimension);
+            }
+        }
+    } else {
+        int decodeScale = decodeScaleFor(options.featureType, options.decodeScale);
+        if (!options.indexPath.empty() && isFeatureStoreFile(options.indexPath)) {
+            const FeatureStore &store = sources.featureStore(options.indexPath);
+            validateStoreInfo(store, options.featureType, options.indexPath);
+            if (store.rowCount() == 0) {
+                throw std::runtime_error("No features found in index: " + options.indexPath);
+            }
+            decodeScale = store.info().decodeScale;
+            database.rows = store.data();
+            database.rowCount = store.rowCount();
+            database.dimension = store.dimension();
+            database.nameOf = [&store](size_t row) { return std::string(store.filename(row)); };
+            database.duplicatesOf = storeDuplicates(store);
+        } else if (!options.indexPath.empty()) {
+            const FeatureMatrix &indexed = sources.featuresCsv(options.indexPath, options.threadCount);
+            if (indexed.filenames.empty()) {
+                throw std::runtime_error("No features found in index: " + options.indexPath);
+            }
+            database.rows = indexed.rows.data();
+            database.rowCount = indexed.filenames.size();
+            database.dimension = indexed.dimension;
+            database.nameOf = [&indexed](size_t row) { return indexed.filenames[row]; };
+        } else {
+            const FeatureMatrix &features =
+                sources.imageFeatures(options.databaseDir, options.featureType, options.threadCount, decodeScale);
+            if (features.filenames.empty()) {
+                throw std::runtime_error("No images found in directory: " + options.databaseDir);
+            }
+            database.rows = features.rows.data();
+            database.rowCount = features.filenames.size();
+            database.dimension = features.dimension;
+            database.nameOf = [&features](size_t row) { return features.filenames[row]; };
+        }
+
+        // Targets are decoded once each, in parallel, at the database's scale.
+        std::vector<std::vector<float>> targetFeatures(targets.size());
+        parallelFor(targets.size(), options.threadCount, [&](size_t i) {
+            targetFeatures[i] =
+                computeFeature(options.featureType, loadImageOrThrow(targets[i], decodeScale));
+        });
+        for (const auto &feature : targetFeatures) {
+            if (feature.size() != database.dimension) {
+                throw std::runtime_error("Feature size mismatch for " + options.featureType);
+            }
+            queries.insert(queries.end(), feature.begin(), feature.end());
+        }
+    }
+
+    if (database.rowCount == 0 || database.dimension == 0) {
+        // Nothing to rank (e.g. no database file has an embedding).
+        return std::vector<std::vector<Match>>(targets.size());
+    }
+    return scanBatch(options, database, queries, targets.size());
+}
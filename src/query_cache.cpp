@@ -0,0 +1,216 @@
+/*
+Authors - Joseph Defendre, Sourav Das
+
+Implements the resident query data cache.
+Stamps each entry with the path's mtime and size.
+Loads listings, stores and CSVs through the existing readers.
+Extracts live image features on the worker pool into a flat matrix.
+Stamps each live image so only changed files are extracted again.
+*/
+#include "../include/query_cache.h"
+
+#include "../include/feature_types.h"
+#include "../include/image_io.h"
+#include "../include/parallel.h"
+#include "../include/profile.h"
+
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+
+namespace {
+
+/**
+ * Return the cached value for key, reloading it when the stamp changed.
+ *
+ * @param entries Cache map.
+ * @param key Cache key.
+ * @param stamp Current stamp of the underlying input.
+ * @param load Loader returning a fresh value (may throw; nothing is cached then).
+ * @return Reference to the cached value.
+ */
+template <typename Map, typename Load>
+auto &cachedValue(Map &entries, const std::string &key, const FileStamp &stamp, Load load) {
+    auto it = entries.find(key);
+    if (it != entries.end() && it->second.stamp == stamp) {
+        return it->second.value;
+    }
+    if (it != entries.end()) {
+        // Drop the stale value first so its memory is not held twice.
+        entries.erase(it);
+    }
+    typename Map::mapped_type entry{stamp, load()};
+    return entries.emplace(key, std::move(entry)).first->second.value;
+}
+} // namespace
+
+/**
+ * List (or reuse the listing of) a database directory tree.
+ *
+ * @param databaseDir Database directory.
+ * @param threadCount Directory reader threads.
+ * @return Sorted image paths.
+ */
+const std::vector<std::string> &QueryCache::imageFiles(const std::string &databaseDir, int threadCount) {
+    // Re-stat the directories seen last time; a new subdirectory changes its parent.
+    auto it = listings_.find(databaseDir);
+    if (it != listings_.end() && it->second.stamp == directoryTreeStamp(it->second.value.directories)) {
+        return it->second.value.files;
+    }
+    if (it != listings_.end()) {
+        listings_.erase(it);
+    }
+    ImageListing listing = listImageTree(databaseDir, threadCount);
+    FileStamp stamp = directoryTreeStamp(listing.directories);
+    Entry<ImageListing> entry{stamp, std::move(listing)};
+    return listings_.emplace(databaseDir, std::move(entry)).first->second.value.files;
+}
+
+/**
+ * Map (or reuse the mapping of) a binary feature store.
+ *
+ * @param path Store path.
+ * @return Mapped store.
+ */
+const FeatureStore &QueryCache::featureStore(const std::string &path) {
+    return cachedValue(stores_, path, fileStampOf(path), [&]() {
+        ProfileTimer timer(ProfileStage::Load);
+        return FeatureStore(path);
+    });
+}
+
+/**
+ * Load (or reuse) an HNSW graph.
+ *
+ * @param path Index path.
+ * @return Loaded graph.
+ */
+const HnswIndex &QueryCache::hnswIndex(const std::string &path) {
+    return cachedValue(hnswIndexes_, path, fileStampOf(path), [&]() {
+        ProfileTimer timer(ProfileStage::Load);
+        return HnswIndex(path);
+    });
+}
+
+/**
+ * Map (or reuse) a product-quantized index.
+ *
+ * @param path Index path.
+ * @return Mapped index.
+ */
+const PqIndex &QueryCache::pqIndex(const std::string &path) {
+    return cachedValue(pqIndexes_, path, fileStampOf(path), [&]() {
+        ProfileTimer timer(ProfileStage::Load);
+        return PqIndex(path);
+    });
+}
+
+/**
+ * Load (or reuse) a VP-tree.
+ *
+ * @param path Tree path.
+ * @return Loaded tree.
+ */
+const VpTree &QueryCache::vpTree(const std::string &path) {
+    return cachedValue(vpTrees_, path, fileStampOf(path), [&]() {
+        ProfileTimer timer(ProfileStage::Load);
+        return VpTree(path);
+    });
+}
+
+/**
+ * Parse (or reuse) a features CSV.
+ *
+ * @param path CSV path.
+ * @param threadCount Worker threads used for parsing.
+ * @return Parsed rows.
+ */
+const FeatureMatrix &QueryCache::featuresCsv(const std::string &path, int threadCount) {
+    return cachedValue(featureCsvs_, path, fileStampOf(path), [&]() {
+        ProfileTimer timer(ProfileStage::Load);
+        return readFeatureMatrixCsv(path, threadCount);
+    });
+}
+
+/**
+ * Parse (or reuse) an embeddings CSV and index it by filename.
+ *
+ * @param path CSV path.
+ * @param threadCount Worker threads used for parsing.
+ * @return Parsed embeddings.
+ */
+const EmbeddingTable &QueryCache::embeddingsCsv(const std::string &path, int threadCount) {
+    return cachedValue(embeddingCsvs_, path, fileStampOf(path), [&]() {
+        ProfileTimer timer(ProfileStage::Load);
+        EmbeddingTable table;
+        table.matrix = readFeatureMatrixCsv(path, threadCount);
+        table.rowByName.reserve(table.matrix.filenames.size());
+        for (size_t row = 0; row < table.matrix.filenames.size(); ++row) {
+            table.rowByName.emplace(table.matrix.filenames[row], row);
+        }
+        return table;
+    });
+}
+
+/**
+ * Extract (or reuse) the features of every image in a directory.
+ *
+ * @param databaseDir Database directory.
+ * @param featureType Classic feature type.
+ * @param threadCount Worker threads used for extraction.
+ * @param decodeScale Downscale factor used when decoding the images.
+ * @return Feature matrix in listing order.
+ */
+const FeatureMatrix &QueryCache::imageFeatures(
+    const std::string &databaseDir,
+    const std::string &featureType,
+    int threadCount,
+    int decodeScale) {
+    const auto &files = imageFiles(databaseDir, threadCount);
+    std::string key = databaseDir + '\n' + featureType + '\n' + std::to_string(decodeScale);
+    // Directory stamps miss images rewritten in place, so stamp every file.
+    std::vector<FileStamp> stamps(files.size());
+    parallelFor(files.size(), threadCount, [&](size_t i) { stamps[i] = fileStampOf(files[i]); });
+
+    auto it = imageFeatures_.find(key);
+    if (it != imageFeatures_.end() && it->second.stamps == stamps && it->second.matrix.filenames == files) {
+        return it->second.matrix;
+    }
+
+    // Rows of unchanged files carry over; everything else is extracted.
+    const ImageFeatures *previous = it != imageFeatures_.end() ? &it->second : nullptr;
+    std::unordered_map<std::string_view, size_t> previousRow;
+    if (previous != nullptr) {
+        previousRow.reserve(previous->matrix.filenames.size());
+        for (size_t row = 0; row < previous->matrix.filenames.size(); ++row) {
+            previousRow.emplace(previous->matrix.filenames[row], row);
+        }
+    }
+    std::vector<std::vector<float>> features(files.size());
+    parallelFor(files.size(), threadCount, [&](size_t i) {
+        auto found = previousRow.find(files[i]);
+        if (found != previousRow.end() && previous->stamps[found->second] == stamps[i]) {
+            const float *row = previous->matrix.rows.data() + found->second * previous->matrix.dimension;
+            features[i].assign(row, row + previous->matrix.dimension);
+            return;
+        }
+        features[i] = computeFeature(featureType, loadImageOrThrow(files[i], decodeScale));
+    });
+
+    ImageFeatures entry;
+    entry.stamps = std::move(stamps);
+    FeatureMatrix &matrix = entry.matrix;
+    matrix.filenames = files;
+    matrix.dimension = features.empty() ? 0 : features.front().size();
+    matrix.rows.reserve(files.size() * matrix.dimension);
+    for (size_t i = 0; i < features.size(); ++i) {
+        if (features[i].size() != matrix.dimension) {
+            throw std::runtime_error("Inconsistent feature size for image: " + files[i]);
+        }
+        matrix.rows.insert(matrix.rows.end(), features[i].begin(), features[i].end());
+    }
+    if (it != imageFeatures_.end()) {
+        imageFeatures_.erase(it);
+    }
+    return imageFeatures_.emplace(key, std::move(entry)).first->second.matrix;
+}
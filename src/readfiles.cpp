@@ -1,75 +0,0 @@
-/*
-  Bruce A. Maxwell
-  S21
-  
-  Sample code to identify image fils in a directory
-
-  Standalone utility to scan directories for image files.
-  Prints matching filenames and full paths to stdout.
-  Uses POSIX dirent to iterate directory contents.
-  Serves as a sample helper for file listing.
-
-*/
-#include <cstdio>
-#include <cstring>
-#include <cstdlib>
-#include <dirent.h>
-
-/**
- * Scan a directory for image files and print their filenames and full paths.
- *
- * @param argc Argument count (expects a directory path).
- * @param argv Argument vector.
- * @return 0 on success, non-zero on error.
- */
-int main(int argc, char *argv[]) {
-  char dirname[256];
-  char buffer[256];
-  FILE *fp;
-  DIR *dirp;
-  struct dirent *dp;
-  int i;
-
-  // check for sufficient arguments
-  if( argc < 2) {
-    printf("usage: %s <directory path>\n", argv[0]);
-    exit(-1);
-  }
-
-  // get the directory path
-  strcpy(dirname, argv[1]);
-  printf("Processing directory %s\n", dirname );
-
-  // open the directory
-  dirp = opendir( dirname );
-  if( dirp == NULL) {
-    printf("Cannot open directory %s\n", dirname);
-    exit(-1);
-  }
-
-  // loop over all the files in the image file listing
-  while( (dp = readdir(dirp)) != NULL ) {
-
-    // check if the file is an image
-    if( strstr(dp->d_name, ".jpg") ||
-	strstr(dp->d_name, ".png") ||
-	strstr(dp->d_name, ".ppm") ||
-	strstr(dp->d_name, ".tif") ) {
-
-      // echo the filename and its full path for downstream tools
-      printf("processing image file: %s\n", dp->d_name);
-
-      // build the overall filename
-      strcpy(buffer, dirname);
-      strcat(buffer, "/");
-      strcat(buffer, dp->d_name);
-
-      printf("full path name: %s\n", buffer);
-
-    }
-  }
-  
-  printf("Terminating\n");
-
-  return(0);
-}
@@ -0,0 +1,406 @@
+/*
+Authors - Joseph Defendre, Sourav Das
+
+Implements the persistent query server.
+Tokenizes request lines and runs them through runQuery with a shared cache.
+Frames each response with an OK/ERROR header line.
+Listens on a Unix domain socket or TCP, or reads stdin line by line.
+Forwards requests to shard workers when running as a coordinator.
+*/
+#include "../include/server.h"
+
+#include "../include/profile.h"
+#include "../include/query.h"
+#include "../include/query_cache.h"
+#include "../include/shard.h"
+
+#include <opencv2/opencv.hpp>
+
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+// Pending connections queued by listen().
+constexpr int kListenBacklog = 8;
+// Bytes read from a client socket per recv() call.
+constexpr size_t kReadChunkSize = 4096;
+
+/**
+ * Build a runtime_error carrying the current errno text.
+ *
+ * @param what Failed operation.
+ * @return Exception to throw.
+ */
+std::runtime_error socketError(const std::string &what) {
+    return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+/**
+ * Write the whole buffer to a socket.
+ *
+ * @param fd Connected socket.
+ * @param text Bytes to send.
+ * @return False if the client went away.
+ */
+bool sendAll(int fd, const std::string &text) {
+    size_t sent = 0;
+    while (sent < text.size()) {
+        ssize_t written = ::send(fd, text.data() + sent, text.size() - sent, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        sent += static_cast<size_t>(written);
+    }
+    return true;
+}
+
+using RequestHandler = std::function<std::string(const std::string &)>;
+
+/**
+ * Frame matches as an OK response.
+ *
+ * Distances use std::to_chars so a coordinator merging shard answers sees the
+ * exact floats the shards ranked by.
+ *
+ * @param matches Ranked matches.
+ * @param complete False to mark the response partial.
+ * @return Response text.
+ */
+std::string formatMatches(const std::vector<Match> &matches, bool complete) {
+    std::string response = "OK " + std::to_string(matches.size()) + (complete ? "" : " partial") + "\n";
+    char number[32];
+    for (const auto &match : matches) {
+        auto result = std::to_chars(number, number + sizeof(number), match.distance);
+        response += match.filename;
+        response += ' ';
+        response.append(number, result.ptr);
+        for (const auto &duplicate : match.duplicates) {
+            response += '\t';
+            response += duplicate;
+        }
+        response += '\n';
+    }
+    return response;
+}
+
+/**
+ * Frame an error as a single ERROR line.
+ *
+ * @param message Error text (newlines are flattened).
+ * @return Response text.
+ */
+std::string formatError(std::string message) {
+    for (char &c : message) {
+        if (c == '\n') {
+            c = ' ';
+        }
+    }
+    return "ERROR " + message + "\n";
+}
+
+/**
+ * Answer request lines from one client until it disconnects.
+ *
+ * @param fd Connected socket.
+ * @param handler Produces the response to each line.
+ */
+void serveConnection(int fd, const RequestHandler &handler) {
+    std::string pending;
+    char buffer[kReadChunkSize];
+    while (true) {
+        ssize_t received = ::recv(fd, buffer, sizeof(buffer), 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return;
+        }
+        pending.append(buffer, static_cast<size_t>(received));
+
+        size_t lineEnd;
+        while ((lineEnd = pending.find('\n')) != std::string::npos) {
+            std::string line = pending.substr(0, lineEnd);
+            pending.erase(0, lineEnd + 1);
+            if (!sendAll(fd, handler(line))) {
+                return;
+            }
+        }
+    }
+}
+
+/**
+ * Accept clients on a listening socket forever, one at a time.
+ *
+ * @param listener Listening socket.
+ * @param handler Produces the response to each line.
+ */
+void acceptLoop(int listener, const RequestHandler &handler) {
+    while (true) {
+        int client = ::accept(listener, nullptr, nullptr);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            auto failure = socketError("Failed to accept connection");
+            ::close(listener);
+            throw failure;
+        }
+        serveConnection(client, handler);
+        ::close(client);
+    }
+}
+
+/**
+ * Accept clients on a TCP address forever.
+ *
+ * @param address host:port to bind (e.g. 127.0.0.1:7000).
+ * @param handler Produces the response to each line.
+ */
+void serveTcp(const std::string &address, const RequestHandler &handler) {
+    std::string host;
+    std::string port;
+    if (!splitTcpEndpoint(address, host, port)) {
+        throw std::runtime_error("Expected host:port for --tcp: " + address);
+    }
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    addrinfo *addresses = nullptr;
+    int error = ::getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses);
+    if (error != 0) {
+        throw std::runtime_error("Failed to resolve " + address + ": " + ::gai_strerror(error));
+    }
+    int listener = ::socket(addresses->ai_family, addresses->ai_socktype, addresses->ai_protocol);
+    if (listener < 0) {
+        ::freeaddrinfo(addresses);
+        throw socketError("Failed to create socket");
+    }
+    // Restarted workers can rebind while old connections sit in TIME_WAIT.
+    int reuse = 1;
+    ::setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    bool bound = ::bind(listener, addresses->ai_addr, addresses->ai_addrlen) == 0 &&
+                 ::listen(listener, kListenBacklog) == 0;
+    ::freeaddrinfo(addresses);
+    if (!bound) {
+        auto failure = socketError("Failed to listen on " + address);
+        ::close(listener);
+        throw failure;
+    }
+    std::cerr << "Listening on " << address << "\n";
+    acceptLoop(listener, handler);
+}
+
+/**
+ * Accept clients on a Unix domain socket forever.
+ *
+ * @param socketPath Socket path (a stale socket file is replaced).
+ * @param handler Produces the response to each line.
+ */
+void serveSocket(const std::string &socketPath, const RequestHandler &handler) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Socket path too long: " + socketPath);
+    }
+    std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+    std::error_code error;
+    if (std::filesystem::is_socket(socketPath, error)) {
+        // Left behind by a previous server that was killed.
+        std::filesystem::remove(socketPath, error);
+    }
+
+    int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        throw socketError("Failed to create socket");
+    }
+    if (::bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+        ::listen(listener, kListenBacklog) != 0) {
+        auto failure = socketError("Failed to listen on " + socketPath);
+        ::close(listener);
+        throw failure;
+    }
+    std::cerr << "Listening on " << socketPath << "\n";
+    acceptLoop(listener, handler);
+}
+} // namespace
+
+/**
+ * Split a request line into arguments with shell-style quoting.
+ *
+ * @param line Request line.
+ * @return Arguments.
+ */
+std::vector<std::string> splitRequestLine(const std::string &line) {
+    std::vector<std::string> args;
+    std::string current;
+    bool inArgument = false;
+    char quote = '\0';
+
+    for (size_t i = 0; i < line.size(); ++i) {
+        char c = line[i];
+        if (quote == '\'') {
+            if (c == '\'') {
+                quote = '\0';
+            } else {
+                current += c;
+            }
+        } else if (quote == '"') {
+            if (c == '"') {
+                quote = '\0';
+            } else if (c == '\\' && i + 1 < line.size() &&
+                       (line[i + 1] == '"' || line[i + 1] == '\\')) {
+                current += line[++i];
+            } else {
+                current += c;
+            }
+        } else if (c == '\'' || c == '"') {
+            quote = c;
+            inArgument = true;
+        } else if (c == '\\' && i + 1 < line.size()) {
+            current += line[++i];
+            inArgument = true;
+        } else if (c == ' ' || c == '\t' || c == '\r') {
+            if (inArgument) {
+                args.push_back(std::move(current));
+                current.clear();
+                inArgument = false;
+            }
+        } else {
+            current += c;
+            inArgument = true;
+        }
+    }
+    if (quote != '\0') {
+        throw std::invalid_argument("Unterminated quote in request");
+    }
+    if (inArgument) {
+        args.push_back(std::move(current));
+    }
+    return args;
+}
+
+/**
+ * Parse, run and format one request.
+ *
+ * @param line Request line.
+ * @param cache Resident query cache.
+ * @param shardPath Store replacing the request's source, or empty.
+ * @return Framed response text.
+ */
+std::string handleRequestLine(const std::string &line, QueryCache &cache, const std::string &shardPath) {
+    try {
+        auto args = splitRequestLine(line);
+        if (args.empty()) {
+            return "";
+        }
+        QueryOptions options = parseQueryArguments(args);
+        if (!shardPath.empty()) {
+            // A worker owns one slice of the rows, whatever index the client named.
+            if (options.featureType == "dnn") {
+                throw std::runtime_error("Shard workers serve classic feature types only");
+            }
+            options.indexPath = shardPath;
+        }
+        // Same policy as the one-shot CLI, reset per request since it is process-wide.
+        cv::setNumThreads(options.threadCount > 1 || options.usePipeline ? 1 : -1);
+
+        // Requests run one at a time, so the process-wide profiler sees only this query.
+        setProfilingEnabled(options.profile);
+        auto start = std::chrono::steady_clock::now();
+        // Snapshots have no place in the framed protocol; a budget still applies.
+        QueryResult result = runQueryWithProgress(options, QueryProgressCallback(), &cache);
+        if (options.profile) {
+            ProfileReport report = collectProfile();
+            report.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (options.profileJson) {
+                printProfileJson(report, std::cerr);
+            } else {
+                printProfile(report, std::cerr);
+            }
+        }
+        return formatMatches(result.matches, result.complete);
+    } catch (const std::exception &ex) {
+        return formatError(ex.what());
+    }
+}
+
+/**
+ * Scatter one request to the shard workers and frame the merged answer.
+ *
+ * @param line Request line.
+ * @param options Coordinator settings.
+ * @return Framed response text.
+ */
+std::string handleCoordinatorLine(const std::string &line, const ServerOptions &options) {
+    try {
+        auto args = splitRequestLine(line);
+        if (args.empty()) {
+            return "";
+        }
+        // Parsed here only to reject bad requests early and to learn N and the ranking order.
+        QueryOptions query = parseQueryArguments(args);
+        ScatterResult result =
+            scatterQuery(options.shardEndpoints, line, query.topN, query.showLeast, options.shardTimeoutMs);
+        size_t answered = 0;
+        for (const auto &shard : result.shards) {
+            if (shard.status == ShardStatus::Rejected) {
+                return formatError("shard " + shard.endpoint + ": " + shard.message);
+            }
+            if (shard.status == ShardStatus::Failed) {
+                std::cerr << "Shard " << shard.endpoint << " failed: " << shard.message << "\n";
+            } else {
+                ++answered;
+            }
+        }
+        if (answered == 0) {
+            return formatError("No shard answered");
+        }
+        return formatMatches(result.matches, result.complete);
+    } catch (const std::exception &ex) {
+        return formatError(ex.what());
+    }
+}
+
+/**
+ * Run the server loop on stdio or a Unix domain socket.
+ *
+ * @param options Server options.
+ */
+void runServer(const ServerOptions &options) {
+    QueryCache cache;
+    RequestHandler handler;
+    if (!options.shardEndpoints.empty()) {
+        handler = [&](const std::string &line) { return handleCoordinatorLine(line, options); };
+    } else {
+        handler = [&](const std::string &line) { return handleRequestLine(line, cache, options.shardPath); };
+    }
+    if (!options.tcpAddress.empty()) {
+        serveTcp(options.tcpAddress, handler);
+        return;
+    }
+    if (!options.socketPath.empty()) {
+        serveSocket(options.socketPath, handler);
+        return;
+    }
+
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        std::cout << handler(line) << std::flush;
+    }
+}
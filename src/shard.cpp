@@ -0,0 +1,420 @@
+/*
+Authors - Joseph Defendre, Sourav Das
+
+Implements sharded scatter-gather search.
+Writes contiguous row ranges of a feature store as separate shard stores.
+Queries every shard worker concurrently with non-blocking sockets and poll().
+Drops shards that miss their deadline and merges the rest with a top-K heap.
+Carries content hashes and duplicate lists into the shard stores.
+*/
+#include "../include/shard.h"
+
+#include "../include/feature_store.h"
+#include "../include/feature_types.h"
+#include "../include/top_k.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+// Bytes read from a shard socket per recv() call.
+constexpr size_t kReadChunkSize = 4096;
+
+/**
+ * One in-flight request to a shard worker.
+ */
+struct ShardCall {
+    enum class Stage { Connecting, Sending, Receiving, Done };
+
+    int fd = -1;
+    Stage stage = Stage::Done;
+    size_t sent = 0;
+    std::string received;
+    ShardOutcome outcome;
+    std::vector<Match> matches;
+};
+
+/**
+ * Stop a call with an error.
+ *
+ * @param call Shard call.
+ * @param message Failure description.
+ */
+void failCall(ShardCall &call, const std::string &message) {
+    call.outcome.status = ShardStatus::Failed;
+    call.outcome.message = message;
+    call.stage = ShardCall::Stage::Done;
+}
+
+/**
+ * Start a non-blocking connection to a shard endpoint.
+ *
+ * @param call Shard call; fd and stage are set, or the call fails.
+ */
+void startConnect(ShardCall &call) {
+    const std::string &endpoint = call.outcome.endpoint;
+    std::string host;
+    std::string port;
+    int result = -1;
+    if (splitTcpEndpoint(endpoint, host, port)) {
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo *addresses = nullptr;
+        int error = ::getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses);
+        if (error != 0) {
+            failCall(call, std::string("cannot resolve host: ") + ::gai_strerror(error));
+            return;
+        }
+        call.fd = ::socket(addresses->ai_family, addresses->ai_socktype | SOCK_NONBLOCK, addresses->ai_protocol);
+        if (call.fd >= 0) {
+            result = ::connect(call.fd, addresses->ai_addr, addresses->ai_addrlen);
+        }
+        ::freeaddrinfo(addresses);
+    } else {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (endpoint.size() >= sizeof(address.sun_path)) {
+            failCall(call, "socket path too long");
+            return;
+        }
+        std::memcpy(address.sun_path, endpoint.c_str(), endpoint.size() + 1);
+        call.fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (call.fd >= 0) {
+            result = ::connect(call.fd, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+        }
+    }
+    if (call.fd < 0) {
+        failCall(call, std::string("cannot create socket: ") + std::strerror(errno));
+    } else if (result == 0) {
+        call.stage = ShardCall::Stage::Sending;
+    } else if (errno == EINPROGRESS) {
+        call.stage = ShardCall::Stage::Connecting;
+    } else {
+        failCall(call, std::string("cannot connect: ") + std::strerror(errno));
+    }
+}
+
+/**
+ * Parse a complete framed response if one has arrived.
+ *
+ * @param call Shard call; on completion its outcome and matches are filled.
+ * @return True once the response is complete (or found malformed).
+ */
+bool parseResponse(ShardCall &call) {
+    const std::string &text = call.received;
+    size_t headerEnd = text.find('\n');
+    if (headerEnd == std::string::npos) {
+        return false;
+    }
+    std::string header = text.substr(0, headerEnd);
+    if (header.rfind("ERROR ", 0) == 0) {
+        call.outcome.status = ShardStatus::Rejected;
+        call.outcome.message = header.substr(6);
+        return true;
+    }
+    bool partial = header.size() > 8 && header.compare(header.size() - 8, 8, " partial") == 0;
+    char *end = nullptr;
+    unsigned long count = header.rfind("OK ", 0) == 0 ? std::strtoul(header.c_str() + 3, &end, 10) : 0;
+    if (end == nullptr || end == header.c_str() + 3 || (*end != '\0' && *end != ' ')) {
+        failCall(call, "malformed response: " + header);
+        return true;
+    }
+
+    std::vector<Match> matches;
+    size_t lineStart = headerEnd + 1;
+    while (matches.size() < count) {
+        size_t lineEnd = text.find('\n', lineStart);
+        if (lineEnd == std::string::npos) {
+            return false;
+        }
+        // Filenames may hold spaces; the distance follows the last one, and
+        // collapsed duplicates follow the distance, tab-separated.
+        std::string line = text.substr(lineStart, lineEnd - lineStart);
+        std::vector<std::string> duplicates;
+        size_t tab = line.find('\t');
+        for (size_t next = tab; next != std::string::npos;) {
+            size_t after = line.find('\t', next + 1);
+            duplicates.push_back(line.substr(next + 1, after == std::string::npos ? std::string::npos : after - next - 1));
+            next = after;
+        }
+        if (tab != std::string::npos) {
+            line.resize(tab);
+        }
+        size_t split = line.rfind(' ');
+        char *distanceEnd = nullptr;
+        float distance = split == std::string::npos ? 0.0f : std::strtof(line.c_str() + split + 1, &distanceEnd);
+        if (distanceEnd == nullptr || *distanceEnd != '\0') {
+            failCall(call, "malformed match line: " + line);
+            return true;
+        }
+        matches.push_back({line.substr(0, split), distance, std::move(duplicates)});
+        lineStart = lineEnd + 1;
+    }
+    call.outcome.status = partial ? ShardStatus::Partial : ShardStatus::Answered;
+    call.outcome.matchCount = matches.size();
+    call.matches = std::move(matches);
+    return true;
+}
+
+/**
+ * Advance a call after poll() reported its socket ready.
+ *
+ * @param call Shard call.
+ * @param request Request bytes (line plus newline).
+ */
+void advanceCall(ShardCall &call, const std::string &request) {
+    if (call.stage == ShardCall::Stage::Connecting) {
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (::getsockopt(call.fd, SOL_SOCKET, SO_ERROR, &error, &length) != 0 || error != 0) {
+            failCall(call, std::string("cannot connect: ") + std::strerror(error != 0 ? error : errno));
+            return;
+        }
+        call.stage = ShardCall::Stage::Sending;
+    }
+    if (call.stage == ShardCall::Stage::Sending) {
+        while (call.sent < request.size()) {
+            ssize_t written = ::send(call.fd, request.data() + call.sent, request.size() - call.sent, MSG_NOSIGNAL);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return;
+            }
+            if (written <= 0) {
+                failCall(call, std::string("send failed: ") + std::strerror(errno));
+                return;
+            }
+            call.sent += static_cast<size_t>(written);
+        }
+        // One request per connection; the worker sees EOF after answering.
+        ::shutdown(call.fd, SHUT_WR);
+        call.stage = ShardCall::Stage::Receiving;
+        return;
+    }
+
+    char buffer[kReadChunkSize];
+    while (true) {
+        ssize_t received = ::recv(call.fd, buffer, sizeof(buffer), 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        }
+        if (received <= 0) {
+            if (!parseResponse(call)) {
+                failCall(call, received == 0 ? "connection closed mid-response"
+                                             : std::string("receive failed: ") + std::strerror(errno));
+            }
+            call.stage = ShardCall::Stage::Done;
+            return;
+        }
+        call.received.append(buffer, static_cast<size_t>(received));
+        if (parseResponse(call)) {
+            call.stage = ShardCall::Stage::Done;
+            return;
+        }
+    }
+}
+} // namespace
+
+/**
+ * @param storePrefix Output prefix.
+ * @param shard Shard number.
+ * @return Shard store path.
+ */
+std::string shardStorePath(const std::string &storePrefix, size_t shard) {
+    return storePrefix + "." + std::to_string(shard) + ".bin";
+}
+
+/**
+ * Write each contiguous row range of a store as its own store.
+ *
+ * @param storePath Source store.
+ * @param shardCount Number of shards.
+ * @param outputPrefix Shard path prefix.
+ * @return Shard store paths.
+ */
+std::vector<std::string> splitFeatureStore(
+    const std::string &storePath,
+    size_t shardCount,
+    const std::string &outputPrefix) {
+    FeatureStore store(storePath);
+    if (!isClassicFeatureType(store.info().featureType)) {
+        // Embedding queries look up the target's row, which only one shard would hold.
+        throw std::runtime_error("Only classic feature stores can be sharded: " + storePath);
+    }
+    if (shardCount == 0 || shardCount > store.rowCount()) {
+        throw std::runtime_error("Shard count must be between 1 and the row count (" +
+                                 std::to_string(store.rowCount()) + ")");
+    }
+
+    std::vector<std::string> paths;
+    size_t dimension = store.dimension();
+    size_t coarseDimension = store.coarseDimension();
+    for (size_t shard = 0; shard < shardCount; ++shard) {
+        size_t begin = shard * store.rowCount() / shardCount;
+        size_t end = (shard + 1) * store.rowCount() / shardCount;
+        std::vector<std::pair<std::string, std::vector<float>>> rows;
+        std::vector<FileStamp> stamps;
+        std::vector<std::vector<float>> coarse;
+        std::vector<uint64_t> hashes;
+        std::vector<std::vector<DuplicateFile>> duplicates;
+        bool hasDuplicates = false;
+        rows.reserve(end - begin);
+        for (size_t row = begin; row < end; ++row) {
+            rows.emplace_back(std::string(store.filename(row)),
+                              std::vector<float>(store.row(row), store.row(row) + dimension));
+            if (store.hasStamps()) {
+                stamps.push_back(store.stamp(row));
+            }
+            if (store.hasCoarse()) {
+                const float *values = store.coarseData() + row * coarseDimension;
+                coarse.emplace_back(values, values + coarseDimension);
+            }
+            if (store.hasContentHashes()) {
+                hashes.push_back(store.contentHash(row));
+            }
+            auto [first, last] = store.duplicateRange(row);
+            duplicates.emplace_back();
+            for (size_t d = first; d < last; ++d) {
+                duplicates.back().push_back({std::string(store.duplicateName(d)), store.duplicateStamp(d)});
+            }
+            hasDuplicates = hasDuplicates || first != last;
+        }
+        if (!hasDuplicates) {
+            duplicates.clear();
+        }
+        paths.push_back(shardStorePath(outputPrefix, shard));
+        writeFeatureStore(paths.back(), store.info(), rows, stamps, coarse, hashes, duplicates);
+    }
+    return paths;
+}
+
+/**
+ * Split a TCP endpoint into host and port.
+ *
+ * @param endpoint Endpoint text.
+ * @param host Host part.
+ * @param port Port part.
+ * @return True for host:port.
+ */
+bool splitTcpEndpoint(const std::string &endpoint, std::string &host, std::string &port) {
+    size_t colon = endpoint.rfind(':');
+    if (colon == std::string::npos || colon == 0 || colon + 1 == endpoint.size() ||
+        endpoint.find('/') != std::string::npos) {
+        return false;
+    }
+    std::string digits = endpoint.substr(colon + 1);
+    if (!std::all_of(digits.begin(), digits.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+        return false;
+    }
+    host = endpoint.substr(0, colon);
+    port = digits;
+    return true;
+}
+
+/**
+ * Query all shards concurrently and merge their answers.
+ *
+ * @param endpoints Shard endpoints in shard order.
+ * @param requestLine Query line.
+ * @param topN Merged result count.
+ * @param keepLargest Rank largest distances first.
+ * @param timeoutMs Per-shard deadline (0 = none).
+ * @return Merged result.
+ */
+ScatterResult scatterQuery(
+    const std::vector<std::string> &endpoints,
+    const std::string &requestLine,
+    int topN,
+    bool keepLargest,
+    int timeoutMs) {
+    using Clock = std::chrono::steady_clock;
+    auto deadline = Clock::now() + std::chrono::milliseconds(timeoutMs);
+    std::string request = requestLine + "\n";
+
+    std::vector<ShardCall> calls(endpoints.size());
+    for (size_t shard = 0; shard < endpoints.size(); ++shard) {
+        calls[shard].outcome.endpoint = endpoints[shard];
+        startConnect(calls[shard]);
+        if (calls[shard].stage == ShardCall::Stage::Sending) {
+            advanceCall(calls[shard], request);
+        }
+    }
+
+    std::vector<pollfd> waiting;
+    std::vector<size_t> waitingShards;
+    while (true) {
+        waiting.clear();
+        waitingShards.clear();
+        for (size_t shard = 0; shard < calls.size(); ++shard) {
+            const ShardCall &call = calls[shard];
+            if (call.stage != ShardCall::Stage::Done) {
+                short events = call.stage == ShardCall::Stage::Receiving ? POLLIN : POLLOUT;
+                waiting.push_back({call.fd, events, 0});
+                waitingShards.push_back(shard);
+            }
+        }
+        if (waiting.empty()) {
+            break;
+        }
+        int waitMs = -1;
+        if (timeoutMs > 0) {
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+            waitMs = static_cast<int>(std::max<long long>(remaining, 0));
+        }
+        int ready = waitMs == 0 ? 0 : ::poll(waiting.data(), waiting.size(), waitMs);
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ready <= 0) {
+            std::string message = ready == 0 ? "timed out after " + std::to_string(timeoutMs) + " ms"
+                                             : std::string("poll failed: ") + std::strerror(errno);
+            for (size_t shard : waitingShards) {
+                failCall(calls[shard], message);
+            }
+            break;
+        }
+        for (size_t i = 0; i < waiting.size(); ++i) {
+            if (waiting[i].revents != 0) {
+                advanceCall(calls[waitingShards[i]], request);
+            }
+        }
+    }
+
+    // Global order: distance, then shard, then the shard's own rank.
+    ScatterResult result;
+    result.complete = true;
+    TopKCollector collector(static_cast<size_t>(std::max(topN, 0)), keepLargest);
+    std::vector<const Match *> byIndex;
+    for (auto &call : calls) {
+        if (call.fd >= 0) {
+            ::close(call.fd);
+        }
+        for (const auto &match : call.matches) {
+            collector.offer(match.distance, byIndex.size());
+            byIndex.push_back(&match);
+        }
+        result.complete = result.complete && call.outcome.status == ShardStatus::Answered;
+        result.shards.push_back(call.outcome);
+    }
+    for (const auto &candidate : collector.sorted()) {
+        result.matches.push_back(*byIndex[candidate.index]);
+    }
+    return result;
+}
@@ -0,0 +1,99 @@
+/*
+Authors - Joseph Defendre, Sourav Das
+
+Implements the streaming top-K collector.
+Uses a std heap whose front is the worst retained candidate.
+Breaks distance ties by candidate index for deterministic output.
+Merges partial collectors built by parallel scan workers.
+*/
+#include "../include/top_k.h"
+
+#include <algorithm>
+
+/**
+ * Create an empty collector.
+ *
+ * @param capacity Number of results to keep.
+ * @param keepLargest Keep largest distances instead of smallest.
+ */
+TopKCollector::TopKCollector(size_t capacity, bool keepLargest)
+    : capacity_(capacity), keepLargest_(keepLargest) {
+    heap_.reserve(capacity);
+}
+
+/**
+ * Strict ordering: true if a ranks ahead of b.
+ *
+ * @param a First candidate.
+ * @param b Second candidate.
+ * @return True if a is the better result.
+ */
+bool TopKCollector::better(const ScoredCandidate &a, const ScoredCandidate &b) const {
+    if (a.distance != b.distance) {
+        return keepLargest_ ? a.distance > b.distance : a.distance < b.distance;
+    }
+    return a.index < b.index;
+}
+
+/**
+ * Insert the candidate if it beats the worst retained one.
+ *
+ * @param distance Candidate distance.
+ * @param index Candidate index.
+ */
+void TopKCollector::offer(float distance, size_t index) {
+    if (capacity_ == 0) {
+        return;
+    }
+    auto heapOrder = [this](const ScoredCandidate &a, const ScoredCandidate &b) {
+        return better(a, b);
+    };
+    ScoredCandidate candidate{distance, index};
+    if (heap_.size() < capacity_) {
+        heap_.push_back(candidate);
+        std::push_heap(heap_.begin(), heap_.end(), heapOrder);
+        return;
+    }
+    if (better(candidate, heap_.front())) {
+        std::pop_heap(heap_.begin(), heap_.end(), heapOrder);
+        heap_.back() = candidate;
+        std::push_heap(heap_.begin(), heap_.end(), heapOrder);
+    }
+}
+
+/**
+ * Offer every candidate held by another collector.
+ *
+ * @param other Partial collector.
+ */
+void TopKCollector::merge(const TopKCollector &other) {
+    for (const auto &candidate : other.heap_) {
+        offer(candidate.distance, candidate.index);
+    }
+}
+
+/**
+ * Copy the retained candidates in rank order.
+ *
+ * @return Best-first candidates.
+ */
+std::vector<ScoredCandidate> TopKCollector::sorted() const {
+    std::vector<ScoredCandidate> result = heap_;
+    std::sort(result.begin(), result.end(),
+              [this](const ScoredCandidate &a, const ScoredCandidate &b) { return better(a, b); });
+    return result;
+}
+
+/**
+ * Merge per-worker collectors into the first one's configuration.
+ *
+ * @param collectors Partial collectors.
+ * @return Combined collector.
+ */
+TopKCollector mergeTopK(const std::vector<TopKCollector> &collectors) {
+    TopKCollector merged = collectors.front();
+    for (size_t i = 1; i < collectors.size(); ++i) {
+        merged.merge(collectors[i]);
+    }
+    return merged;
+}
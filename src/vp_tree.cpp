@@ -0,0 +1,504 @@
+/*
+Authors - Joseph Defendre, Sourav Das
+
+Implements the vantage-point tree over stored classic features.
+Splits rows at the median distance from a spread-maximizing vantage row.
+Searches nearer sides first and skips sides the triangle inequality rules out.
+Reads and writes a self-contained binary file with rows and filenames.
+Keeps the duplicate filenames of deduplicated stores with their rows.
+*/
+#include "../include/vp_tree.h"
+
+#include "../include/feature_types.h"
+#include "../include/parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+namespace {
+constexpr char kVpTreeMagic[8] = {'C', 'B', 'I', 'R', 'V', 'P', 'T', '1'};
+// Version 2 appends the duplicate filename table.
+constexpr uint32_t kVpTreeVersion = 2;
+constexpr uint32_t kNoNode = std::numeric_limits<uint32_t>::max();
+// Vantage candidates tried per split, and rows each is measured against.
+constexpr size_t kVantageCandidates = 4;
+constexpr size_t kVantageSample = 16;
+// Splits smaller than this compute their distances on one thread.
+constexpr size_t kParallelSplitRows = 4096;
+// Intersection on histograms that sum to 1 only up to rounding is a metric up
+// to about this much, so pruning leaves a little room for it.
+constexpr float kPruneSlack = 1e-4f;
+
+// On-disk header; all fields are little-endian native values.
+struct VpTreeHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t leafSize;
+    char featureType[32];
+    int32_t binsPerChannel;
+    int32_t regionCount;
+    int32_t decodeScale;
+    uint32_t root;
+    uint64_t rowCount;
+    uint64_t dimension;
+    uint64_t nodeCount;
+};
+static_assert(sizeof(VpTreeHeader) == 88, "Unexpected VP-tree header layout.");
+
+/**
+ * Step a xorshift generator (deterministic vantage choice, so builds repeat).
+ *
+ * @param state Generator state (non-zero).
+ * @return Next value.
+ */
+uint32_t nextRandom(uint32_t &state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+/**
+ * Write a trivially copyable array to a stream.
+ *
+ * @param output Output stream.
+ * @param values Array to write.
+ */
+template <typename T>
+void writeArray(std::ofstream &output, const std::vector<T> &values) {
+    output.write(reinterpret_cast<const char *>(values.data()),
+                 static_cast<std::streamsize>(values.size() * sizeof(T)));
+}
+
+/**
+ * Read a trivially copyable array of known length from a stream.
+ *
+ * @param input Input stream.
+ * @param values Array to fill (already sized).
+ * @return True if every element was read.
+ */
+template <typename T>
+bool readArray(std::ifstream &input, std::vector<T> &values) {
+    return static_cast<bool>(input.read(reinterpret_cast<char *>(values.data()),
+                                        static_cast<std::streamsize>(values.size() * sizeof(T))));
+}
+} // namespace
+
+/**
+ * Load the header, rows, nodes and filenames and validate every node.
+ *
+ * @param path Tree file path.
+ * @throws std::runtime_error if the file is unreadable or malformed.
+ */
+VpTree::VpTree(const std::string &path) {
+    std::ifstream input(path, std::ios::binary);
+    if (!input.is_open()) {
+        throw std::runtime_error("Failed to open VP-tree: " + path);
+    }
+    VpTreeHeader header {};
+    bool valid = static_cast<bool>(input.read(reinterpret_cast<char *>(&header), sizeof(header))) &&
+                 std::memcmp(header.magic, kVpTreeMagic, sizeof(kVpTreeMagic)) == 0 &&
+                 (header.version == 1 || header.version == kVpTreeVersion) && header.leafSize >= 1 && header.decodeScale >= 1 &&
+                 header.rowCount < kNoNode && header.nodeCount < kNoNode && header.dimension > 0 &&
+                 (header.rowCount == 0 ? header.nodeCount == 0 : header.root < header.nodeCount);
+    if (!valid) {
+        throw std::runtime_error("Invalid VP-tree: " + path);
+    }
+
+    info_.featureType.assign(header.featureType, strnlen(header.featureType, sizeof(header.featureType)));
+    info_.binsPerChannel = header.binsPerChannel;
+    info_.regionCount = header.regionCount;
+    info_.decodeScale = header.decodeScale;
+    squared_ = info_.featureType == "baseline";
+    leafSize_ = header.leafSize;
+    dimension_ = static_cast<size_t>(header.dimension);
+    root_ = header.root;
+    size_t rowCount = static_cast<size_t>(header.rowCount);
+
+    data_.resize(rowCount * dimension_);
+    nodes_.resize(static_cast<size_t>(header.nodeCount));
+    valid = readArray(input, data_) && readArray(input, nodes_);
+    // Vantage rows live in internal nodes; the rest fill the leaf buckets.
+    size_t vantageCount = 0;
+    // buildNode numbers children after their parent and always builds an
+    // inside child, so anything else is a corrupt (or cyclic) file.
+    for (size_t node = 0; valid && node < nodes_.size(); ++node) {
+        const Node &entry = nodes_[node];
+        valid = entry.count > 0 ? entry.begin <= rowCount && entry.count <= rowCount - entry.begin
+                                : entry.vantage < rowCount && entry.radius >= 0.0f &&
+                                      entry.inside > node && entry.inside < nodes_.size() &&
+                                      (entry.outside == kNoNode ||
+                                       (entry.outside > node && entry.outside < nodes_.size()));
+        vantageCount += entry.count > 0 ? 0 : 1;
+    }
+    valid = valid && vantageCount <= rowCount;
+    if (valid) {
+        order_.resize(rowCount - vantageCount);
+        valid = readArray(input, order_);
+    }
+    for (size_t node = 0; valid && node < nodes_.size(); ++node) {
+        const Node &entry = nodes_[node];
+        valid = entry.count == 0 || entry.begin + entry.count <= order_.size();
+    }
+    for (size_t i = 0; valid && i < order_.size(); ++i) {
+        valid = order_[i] < rowCount;
+    }
+
+    std::vector<uint64_t> nameOffsets(rowCount + 1);
+    valid = valid && readArray(input, nameOffsets) && nameOffsets[0] == 0 &&
+            std::is_sorted(nameOffsets.begin(), nameOffsets.end());
+    std::string names;
+    if (valid) {
+        names.resize(static_cast<size_t>(nameOffsets[rowCount]));
+        valid = static_cast<bool>(input.read(names.data(), static_cast<std::streamsize>(names.size())));
+    }
+    std::vector<uint64_t> firstDuplicate;
+    std::vector<uint64_t> duplicateOffsets;
+    std::string duplicateNames;
+    if (valid && header.version >= 2) {
+        firstDuplicate.resize(rowCount + 1);
+        valid = readArray(input, firstDuplicate) && firstDuplicate[0] == 0 &&
+                std::is_sorted(firstDuplicate.begin(), firstDuplicate.end()) &&
+                firstDuplicate[rowCount] < kNoNode;
+        if (valid) {
+            duplicateOffsets.resize(static_cast<size_t>(firstDuplicate[rowCount]) + 1);
+            valid = readArray(input, duplicateOffsets) && duplicateOffsets[0] == 0 &&
+                    std::is_sorted(duplicateOffsets.begin(), duplicateOffsets.end());
+        }
+        if (valid) {
+            duplicateNames.resize(static_cast<size_t>(duplicateOffsets.back()));
+            valid = static_cast<bool>(
+                input.read(duplicateNames.data(), static_cast<std::streamsize>(duplicateNames.size())));
+        }
+    }
+    if (!valid) {
+        throw std::runtime_error("Invalid VP-tree: " + path);
+    }
+    filenames_.reserve(rowCount);
+    for (size_t row = 0; row < rowCount; ++row) {
+        filenames_.emplace_back(names, nameOffsets[row], nameOffsets[row + 1] - nameOffsets[row]);
+    }
+    if (!firstDuplicate.empty() && firstDuplicate[rowCount] > 0) {
+        firstDuplicate_.assign(firstDuplicate.begin(), firstDuplicate.end());
+        for (size_t d = 0; d + 1 < duplicateOffsets.size(); ++d) {
+            duplicateNames_.emplace_back(duplicateNames, duplicateOffsets[d], duplicateOffsets[d + 1] - duplicateOffsets[d]);
+        }
+    }
+}
+
+/**
+ * Copy the store's rows and split them recursively around vantage rows.
+ *
+ * @param store Classic feature store.
+ * @param leafSize Rows per leaf bucket.
+ * @param threadCount Worker threads.
+ * @return Built tree.
+ * @throws std::runtime_error on invalid inputs.
+ */
+VpTree VpTree::build(const FeatureStore &store, size_t leafSize, int threadCount) {
+    if (!isClassicFeatureType(store.info().featureType)) {
+        throw std::runtime_error("VP-trees index classic feature stores, not " + store.info().featureType);
+    }
+    if (leafSize == 0 || leafSize >= kNoNode) {
+        throw std::runtime_error("VP-tree leaf size must be at least 1");
+    }
+    if (store.rowCount() >= kNoNode) {
+        throw std::runtime_error("Too many rows for a VP-tree");
+    }
+
+    VpTree tree;
+    tree.info_ = store.info();
+    tree.squared_ = tree.info_.featureType == "baseline";
+    tree.leafSize_ = leafSize;
+    tree.dimension_ = store.dimension();
+    tree.data_.assign(store.data(), store.data() + store.rowCount() * store.dimension());
+    tree.filenames_.reserve(store.rowCount());
+    if (store.hasDuplicates()) {
+        tree.firstDuplicate_.push_back(0);
+    }
+    for (size_t row = 0; row < store.rowCount(); ++row) {
+        tree.filenames_.emplace_back(store.filename(row));
+        if (store.hasDuplicates()) {
+            auto [first, last] = store.duplicateRange(row);
+            for (size_t d = first; d < last; ++d) {
+                tree.duplicateNames_.emplace_back(store.duplicateName(d));
+            }
+            tree.firstDuplicate_.push_back(static_cast<uint32_t>(tree.duplicateNames_.size()));
+        }
+        // Intersection obeys the triangle inequality on normalized or empty
+        // histograms (flat images have an all-zero Sobel part).
+        if (!tree.squared_ && !hasMetricHistograms(tree.info_.featureType, tree.row(row))) {
+            throw std::runtime_error("VP-tree needs normalized histograms; row is not: " + tree.filenames_.back());
+        }
+    }
+
+    std::vector<uint32_t> rows(store.rowCount());
+    for (size_t row = 0; row < rows.size(); ++row) {
+        rows[row] = static_cast<uint32_t>(row);
+    }
+    tree.order_.reserve(rows.size());
+    uint32_t seed = 0x9E3779B9u;
+    if (!rows.empty()) {
+        tree.root_ = tree.buildNode(rows, 0, rows.size(), threadCount, seed);
+    }
+    return tree;
+}
+
+/**
+ * Build the subtree over rows[begin, end), reordering that range.
+ *
+ * @param rows Row ids being partitioned.
+ * @param begin First row of the range.
+ * @param end One past the last row.
+ * @param threadCount Worker threads for large splits.
+ * @param seed Vantage choice generator state.
+ * @return Index of the subtree's root node.
+ */
+uint32_t VpTree::buildNode(std::vector<uint32_t> &rows, size_t begin, size_t end, int threadCount, uint32_t &seed) {
+    uint32_t nodeIndex = static_cast<uint32_t>(nodes_.size());
+    size_t count = end - begin;
+    if (count <= leafSize_) {
+        nodes_.push_back({kNoNode, kNoNode, kNoNode, static_cast<uint32_t>(order_.size()),
+                          static_cast<uint32_t>(count), 0.0f});
+        order_.insert(order_.end(), rows.begin() + begin, rows.begin() + end);
+        return nodeIndex;
+    }
+
+    // A vantage row whose distances spread widely makes the median split useful.
+    const std::string &featureType = info_.featureType;
+    size_t bestCandidate = begin;
+    float bestSpread = -1.0f;
+    for (size_t c = 0; c < kVantageCandidates; ++c) {
+        size_t candidate = begin + nextRandom(seed) % count;
+        float sum = 0.0f;
+        float sumSquares = 0.0f;
+        for (size_t s = 0; s < kVantageSample; ++s) {
+            size_t other = begin + nextRandom(seed) % count;
+            float distance = metricDistance(featureDistance(featureType, row(rows[candidate]), row(rows[other])));
+            sum += distance;
+            sumSquares += distance * distance;
+        }
+        float spread = sumSquares - sum * sum / static_cast<float>(kVantageSample);
+        if (spread > bestSpread) {
+            bestSpread = spread;
+            bestCandidate = candidate;
+        }
+    }
+    std::swap(rows[begin], rows[bestCandidate]);
+    uint32_t vantage = rows[begin];
+
+    std::vector<std::pair<float, uint32_t>> byDistance(count - 1);
+    parallelFor(count - 1, count >= kParallelSplitRows ? threadCount : 1, [&](size_t i) {
+        uint32_t other = rows[begin + 1 + i];
+        byDistance[i] = {metricDistance(featureDistance(featureType, row(vantage), row(other))), other};
+    });
+    size_t half = byDistance.size() / 2;
+    std::nth_element(byDistance.begin(), byDistance.begin() + half, byDistance.end());
+    float radius = byDistance[half].first;
+    for (size_t i = 0; i < byDistance.size(); ++i) {
+        rows[begin + 1 + i] = byDistance[i].second;
+    }
+
+    nodes_.push_back({vantage, kNoNode, kNoNode, 0, 0, radius});
+    // Inside: rows [begin + 1, begin + 2 + half) have distance <= radius; the rest >= radius.
+    size_t split = begin + 2 + half;
+    uint32_t inside = buildNode(rows, begin + 1, split, threadCount, seed);
+    uint32_t outside = split < end ? buildNode(rows, split, end, threadCount, seed) : kNoNode;
+    nodes_[nodeIndex].inside = inside;
+    nodes_[nodeIndex].outside = outside;
+    return nodeIndex;
+}
+
+/**
+ * Write header, rows, nodes, leaf order and the filename table.
+ *
+ * @param path Destination path.
+ * @throws std::runtime_error on write failure.
+ */
+void VpTree::save(const std::string &path) const {
+    VpTreeHeader header {};
+    if (info_.featureType.size() >= sizeof(header.featureType)) {
+        throw std::runtime_error("Feature type name too long: " + info_.featureType);
+    }
+    std::memcpy(header.magic, kVpTreeMagic, sizeof(kVpTreeMagic));
+    header.version = kVpTreeVersion;
+    header.leafSize = static_cast<uint32_t>(leafSize_);
+    std::memcpy(header.featureType, info_.featureType.data(), info_.featureType.size());
+    header.binsPerChannel = info_.binsPerChannel;
+    header.regionCount = info_.regionCount;
+    header.decodeScale = info_.decodeScale;
+    header.root = root_;
+    header.rowCount = size();
+    header.dimension = dimension_;
+    header.nodeCount = nodes_.size();
+
+    std::vector<uint64_t> nameOffsets;
+    nameOffsets.reserve(size() + 1);
+    nameOffsets.push_back(0);
+    for (const auto &name : filenames_) {
+        nameOffsets.push_back(nameOffsets.back() + name.size());
+    }
+    // Trees without duplicates still write an all-zero table.
+    std::vector<uint64_t> firstDuplicate(size() + 1, 0);
+    for (size_t row = 0; row < size() && !firstDuplicate_.empty(); ++row) {
+        firstDuplicate[row + 1] = firstDuplicate_[row + 1];
+    }
+    std::vector<uint64_t> duplicateOffsets = {0};
+    for (const auto &name : duplicateNames_) {
+        duplicateOffsets.push_back(duplicateOffsets.back() + name.size());
+    }
+
+    // Replace by rename so a serving process never reads a half-written file.
+    std::string temporaryPath = path + ".tmp";
+    std::ofstream output(temporaryPath, std::ios::binary | std::ios::trunc);
+    if (!output.is_open()) {
+        throw std::runtime_error("Failed to open VP-tree for writing: " + path);
+    }
+    output.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    writeArray(output, data_);
+    writeArray(output, nodes_);
+    writeArray(output, order_);
+    writeArray(output, nameOffsets);
+    for (const auto &name : filenames_) {
+        output.write(name.data(), static_cast<std::streamsize>(name.size()));
+    }
+    writeArray(output, firstDuplicate);
+    writeArray(output, duplicateOffsets);
+    for (const auto &name : duplicateNames_) {
+        output.write(name.data(), static_cast<std::streamsize>(name.size()));
+    }
+    output.close();
+    std::error_code error;
+    if (!output) {
+        std::filesystem::remove(temporaryPath, error);
+        throw std::runtime_error("Failed to write VP-tree: " + path);
+    }
+    std::filesystem::rename(temporaryPath, path, error);
+    if (error) {
+        std::filesystem::remove(temporaryPath, error);
+        throw std::runtime_error("Failed to replace VP-tree: " + path);
+    }
+}
+
+/**
+ * List the duplicates recorded for a row.
+ *
+ * @param index Row index.
+ * @return Duplicate filenames (empty for most rows).
+ */
+std::vector<std::string> VpTree::duplicates(size_t index) const {
+    if (firstDuplicate_.empty()) {
+        return {};
+    }
+    return std::vector<std::string>(duplicateNames_.begin() + firstDuplicate_[index],
+                                    duplicateNames_.begin() + firstDuplicate_[index + 1]);
+}
+
+/**
+ * Depth-first search, nearer side first, pruning by the triangle inequality.
+ *
+ * @param query Query feature vector.
+ * @param k Number of results.
+ * @param stats Optional search counters.
+ * @return Nearest candidates first.
+ * @throws std::runtime_error on a dimension mismatch.
+ */
+std::vector<ScoredCandidate> VpTree::search(FloatView query, size_t k, VpSearchStats *stats) const {
+    if (query.size != dimension_) {
+        throw std::runtime_error("VP-tree query size does not match the index dimension");
+    }
+    VpSearchStats counts;
+    TopKCollector collector(k, false);
+    if (k == 0 || nodes_.empty()) {
+        return {};
+    }
+    const std::string &featureType = info_.featureType;
+    BoundedTarget bounded = boundedTarget(featureType, query);
+    auto bound = [&]() {
+        return collector.full() ? collector.worstDistance() : std::numeric_limits<float>::infinity();
+    };
+
+    // Pending subtrees with the lower bound on any metric distance inside them.
+    std::vector<std::pair<uint32_t, float>> pending = {{root_, 0.0f}};
+    while (!pending.empty()) {
+        auto [nodeIndex, lowerBound] = pending.back();
+        pending.pop_back();
+        float limit = metricDistance(bound());
+        if (lowerBound > abandonThreshold(limit) + kPruneSlack) {
+            continue;
+        }
+        ++counts.nodesVisited;
+        const Node &node = nodes_[nodeIndex];
+        if (node.count > 0) {
+            for (uint32_t i = node.begin; i < node.begin + node.count; ++i) {
+                uint32_t rowIndex = order_[i];
+                collector.offer(featureDistanceBounded(featureType, bounded, row(rowIndex), bound()), rowIndex);
+            }
+            counts.distancesComputed += node.count;
+            continue;
+        }
+
+        float distance = featureDistance(featureType, query, row(node.vantage));
+        collector.offer(distance, node.vantage);
+        ++counts.distancesComputed;
+        // |d(q, v) - d(v, x)| <= d(q, x): inside rows are at least d(q, v) - radius
+        // away, outside rows at least radius - d(q, v).
+        float toVantage = metricDistance(distance);
+        // Subtrees are nested, so the parent's bound still holds below.
+        float insideBound = std::max(toVantage - node.radius, lowerBound);
+        float outsideBound = std::max(node.radius - toVantage, lowerBound);
+        bool insideFirst = toVantage <= node.radius;
+        // Pushed last = searched first.
+        if (insideFirst) {
+            if (node.outside != kNoNode) {
+                pending.push_back({node.outside, outsideBound});
+            }
+            if (node.inside != kNoNode) {
+                pending.push_back({node.inside, insideBound});
+            }
+        } else {
+            if (node.inside != kNoNode) {
+                pending.push_back({node.inside, insideBound});
+            }
+            if (node.outside != kNoNode) {
+                pending.push_back({node.outside, outsideBound});
+            }
+        }
+    }
+    if (stats != nullptr) {
+        *stats = counts;
+    }
+    return collector.sorted();
+}
+
+/**
+ * Map a feature distance onto the metric the tree is built on.
+ *
+ * @param featureDistance Distance from featureDistance.
+ * @return sqrt(SSD) for baseline, the intersection distance otherwise.
+ */
+float VpTree::metricDistance(float featureDistance) const {
+    return squared_ ? std::sqrt(std::max(featureDistance, 0.0f)) : featureDistance;
+}
+
+/**
+ * Check for the tree magic without reading the whole file.
+ *
+ * @param path File path.
+ * @return True if the magic bytes match.
+ */
+bool isVpTreeFile(const std::string &path) {
+    std::ifstream inputFile(path, std::ios::binary);
+    char magic[sizeof(kVpTreeMagic)] = {};
+    if (!inputFile.read(magic, sizeof(magic))) {
+        return false;
+    }
+    return std::memcmp(magic, kVpTreeMagic, sizeof(kVpTreeMagic)) == 0;
+}